@@ -77,7 +77,7 @@ bool enable_model3d_custom_mipmaps(1), flatten_tt_mesh_under_models(0), show_map
 bool enable_dpart_shadows(0), enable_tt_model_reflect(1), enable_tt_model_indir(0), auto_calc_tt_model_zvals(0), use_model_lod_blocks(0), enable_translocator(0), enable_grass_fire(0);
 bool disable_model_textures(0), start_in_inf_terrain(0), allow_shader_invariants(1), config_unlimited_weapons(0), disable_tt_water_reflect(0), allow_model3d_quads(1);
 bool enable_timing_profiler(0), fast_transparent_spheres(0), force_ref_cmap_update(0), use_instanced_pine_trees(0), enable_postproc_recolor(0), draw_building_interiors(0);
-bool toggle_room_light(0);
+bool toggle_room_light(0), sharded_lighting_accum(1);
 int xoff(0), yoff(0), xoff2(0), yoff2(0), rand_gen_index(0), mesh_rgen_index(0), camera_change(1), camera_in_air(0), auto_time_adv(0);
 int animate(1), animate2(1), draw_model(0), init_x(STARTING_INIT_X), fire_key(0), do_run(0), init_num_balls(-1), change_wmode_frame(0);
 int game_mode(0), map_mode(0), load_hmv(0), load_coll_objs(1), read_landscape(0), screen_reset(0), mesh_seed(0), rgen_seed(1);
@@ -95,7 +95,7 @@ int enable_fsource(0), run_forward(0), advanced(0), dynamic_mesh_scroll(0);
 int read_snow_file(0), write_snow_file(0), mesh_detail_tex(NOISE_TEX);
 int read_light_files[NUM_LIGHTING_TYPES] = {0}, write_light_files[NUM_LIGHTING_TYPES] = {0};
 unsigned num_snowflakes(0), create_voxel_landscape(0), hmap_filter_width(0), num_dynam_parts(100), snow_coverage_resolution(2), num_birds_per_tile(2), num_fish_per_tile(15);
-unsigned erosion_iters(0), erosion_iters_tt(0), video_framerate(60), num_video_threads(0), skybox_tid(0);
+unsigned erosion_iters(0), erosion_iters_tt(0), video_framerate(60), num_video_threads(0), skybox_tid(0), num_tile_gen_threads(2);
 float NEAR_CLIP(DEF_NEAR_CLIP), FAR_CLIP(DEF_FAR_CLIP), system_max_orbit(1.0), sky_occlude_scale(0.0), tree_slope_thresh(5.0), mouse_sensitivity(1.0), tt_grass_scale_factor(1.0);
 float water_plane_z(0.0), base_gravity(1.0), crater_depth(1.0), crater_radius(1.0), disabled_mesh_z(FAR_CLIP), vegetation(1.0), atmosphere(1.0), biome_x_offset(0.0);
 float mesh_file_scale(1.0), mesh_file_tz(0.0), speed_mult(1.0), mesh_z_cutoff(-FAR_CLIP), relh_adj_tex(0.0), dodgeball_metalness(1.0), ray_step_size_mult(1.0);
@@ -109,6 +109,9 @@ float light_int_scale[NUM_LIGHTING_TYPES] = {1.0, 1.0, 1.0, 1.0, 1.0}, first_ray
 double camera_zh(0.0);
 point mesh_origin(all_zeros), camera_pos(all_zeros), cube_map_center(all_zeros);
 string user_text, cobjs_out_fn, sphere_materials_fn, hmap_out_fn, skybox_cube_map_name;
+extern string timing_profiler_trace_fn, tile_cache_dir;
+extern float tt_shadow_update_ms;
+extern bool tt_horizon_shadows;
 colorRGB ambient_lighting_scale(1,1,1), mesh_color_scale(1,1,1);
 colorRGBA bkg_color, flower_color(ALPHA0);
 set<unsigned char> keys, keyset;
@@ -124,7 +127,7 @@ char player_name[MAX_CHARS] = "Player";
 bool vert_opt_flags[3] = {0}; // {enable, full_opt, verbose}
 
 
-extern bool clear_landscape_vbo, use_dense_voxels, tree_4th_branches, model_calc_tan_vect, water_is_lava, use_grass_tess, def_tex_compress, ship_cube_map_reflection;
+extern bool clear_landscape_vbo, use_dense_voxels, tree_4th_branches, model_calc_tan_vect, water_is_lava, use_grass_tess, def_tex_compress, ship_cube_map_reflection, parallel_physics, soa_precipitation, parallel_ship_ai;
 extern int camera_flight, DISABLE_WATER, DISABLE_SCENERY, camera_invincible, onscreen_display, mesh_freq_filter, show_waypoints, last_inventory_frame;
 extern int tree_coll_level, GLACIATE, UNLIMITED_WEAPONS, destroy_thresh, MAX_RUN_DIST, mesh_gen_mode, mesh_gen_shape, map_drag_x, map_drag_y;
 extern unsigned NPTS, NRAYS, LOCAL_RAYS, GLOBAL_RAYS, DYNAMIC_RAYS, NUM_THREADS, MAX_RAY_BOUNCES, grass_density, max_unique_trees, shadow_map_sz;
@@ -173,6 +176,7 @@ void setup_linear_fog(colorRGBA const &color, float fog_end);
 void write_map_mode_heightmap_image();
 
 void apply_grass_scale();
+int run_headless_bench(char const *const scene_config, unsigned num_ticks, char const *const json_fn);
 
 
 // all OpenGL error handling goes through these functions
@@ -1489,7 +1493,7 @@ bool load_config_file(const char *fn) {
 	return 1;
 }
 
-int load_top_level_config(const char *def_file) { // defaults.txt
+int load_top_level_config(const char *def_file, bool is_scene_config) { // defaults.txt, or a single scene config file
 
 #ifndef _WIN32
 	allow_shader_invariants = 0; // Note: I've seen shader invariant errors multiple times on linux but never on Windows, so I guess we disable it by default when not Windows
@@ -1500,7 +1504,7 @@ int load_top_level_config(const char *def_file) { // defaults.txt
 	alloc_if_req(coll_obj_file, dcoll_obj_file);
 	alloc_if_req(ship_def_file, dship_def_file);
 	load_config("config_pre.txt"); // defaults
-	bool const ret(load_config_file(def_file));
+	bool const ret(is_scene_config ? (load_config(def_file) != 0) : load_config_file(def_file));
 	load_config("config_post.txt"); // overrides (load even if main config file failed)
 	apply_grass_scale();
 	return ret;
@@ -1622,6 +1626,7 @@ int load_config(string const &config_file) {
 	kwmb.add("use_dense_voxels", use_dense_voxels);
 	kwmb.add("use_voxel_cobjs", use_voxel_cobjs);
 	kwmb.add("mt_cobj_tree_build", mt_cobj_tree_build);
+	kwmb.add("sharded_lighting_accum", sharded_lighting_accum);
 	kwmb.add("global_lighting_update", global_lighting_update);
 	kwmb.add("lighting_update_offline", lighting_update_offline);
 	kwmb.add("two_sided_lighting", two_sided_lighting);
@@ -1651,6 +1656,7 @@ int load_config(string const &config_file) {
 	kwmb.add("enable_mouse_look", enable_mouse_look);
 	kwmb.add("enable_init_shields", enable_init_shields);
 	kwmb.add("tt_triplanar_tex", tt_triplanar_tex);
+	kwmb.add("tt_horizon_shadows", tt_horizon_shadows);
 	kwmb.add("enable_model3d_bump_maps", enable_model3d_bump_maps);
 	kwmb.add("use_obj_file_bump_grayscale", use_obj_file_bump_grayscale);
 	kwmb.add("invert_bump_maps", invert_bump_maps);
@@ -1684,6 +1690,9 @@ int load_config(string const &config_file) {
 	kwmb.add("keep_keycards_on_death", keep_keycards_on_death);
 	kwmb.add("enable_timing_profiler", enable_timing_profiler);
 	kwmb.add("fast_transparent_spheres", fast_transparent_spheres);
+	kwmb.add("parallel_physics", parallel_physics);
+	kwmb.add("soa_precipitation", soa_precipitation);
+	kwmb.add("parallel_ship_ai", parallel_ship_ai);
 
 	kw_to_val_map_t<int> kwmi(error);
 	kwmi.add("verbose", verbose_mode);
@@ -1728,6 +1737,7 @@ int load_config(string const &config_file) {
 	kwmu.add("hmap_filter_width", hmap_filter_width);
 	kwmu.add("erosion_iters", erosion_iters);
 	kwmu.add("erosion_iters_tt", erosion_iters_tt);
+	kwmu.add("num_tile_gen_threads", num_tile_gen_threads);
 	kwmu.add("num_dynam_parts", num_dynam_parts);
 	kwmu.add("num_birds_per_tile", num_birds_per_tile);
 	kwmu.add("num_fish_per_tile", num_fish_per_tile);
@@ -1811,6 +1821,7 @@ int load_config(string const &config_file) {
 	kwmf.add("sky_occlude_scale", sky_occlude_scale);
 	kwmf.add("mouse_sensitivity", mouse_sensitivity);
 	kwmf.add("tt_grass_scale_factor", tt_grass_scale_factor);
+	kwmf.add("tt_shadow_update_ms", tt_shadow_update_ms);
 
 	kwmf.add("hmap_plat_bot",    hmap_params.plat_bot);
 	kwmf.add("hmap_plat_height", hmap_params.plat_h);
@@ -1829,6 +1840,8 @@ int load_config(string const &config_file) {
 
 	kw_to_val_map_t<string> kwms(error);
 	kwms.add("cobjs_out_filename", cobjs_out_fn);
+	kwms.add("timing_profiler_trace_filename", timing_profiler_trace_fn);
+	kwms.add("tile_cache_dir", tile_cache_dir);
 
 	while (read_str(fp, strc)) { // slow but should be OK: these ones require special handling
 		string const str(strc);
@@ -2198,6 +2211,10 @@ void init_debug_callback() {
 int main(int argc, char** argv) {
 
 	cout << "Starting 3DWorld" << endl;
+
+	if (argc >= 3 && strcmp(argv[1], "--headless-bench") == 0) { // no GL context: <scene_config> [<num_ticks>] [<json_out_file>]
+		return run_headless_bench(argv[2], ((argc >= 4) ? max(atoi(argv[3]), 0) : 100), ((argc >= 5) ? argv[4] : nullptr));
+	}
 	if (argc == 2) {read_ueventlist(argv[1]);}
 	int rs(1);
 	if      (srand_param == 1) {rs = GET_TIME_MS();}
@@ -2206,7 +2223,7 @@ int main(int argc, char** argv) {
 	create_sin_table();
 	set_scene_constants();
 	load_texture_names(); // needs to be before config file load
-	load_top_level_config(defaults_file);
+	load_top_level_config(defaults_file, 0);
 	gen_gauss_rand_arr(); // after reading seed from config file
 	cout << "Loading."; cout.flush();
 	
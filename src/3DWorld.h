@@ -1320,6 +1320,9 @@ colorRGBA const BACKGROUND_NIGHT(BLACK);
 
 
 void register_timing_value(const char *str, int delta_time);
+uint64_t timing_profiler_begin_scope();
+void timing_profiler_end_scope(const char *str, uint64_t start_us, int delta_time);
+void timing_profiler_next_frame();
 void toggle_timing_profiler();
 void timing_profiler_stats();
 
@@ -1344,15 +1347,16 @@ void timing_profiler_stats();
 #define PRINT_TIME2(str) {cout << str << " time = " << GET_DELTA_TIME << endl;}
 #endif
 
-class timer_t {
+class timer_t { // scoped timer; nested timers on the same thread are shown as children in the profiler
 	std::string name;
 	int timer1;
+	uint64_t start_us;
 	bool enabled;
 public:
-	timer_t(char const *const name_,  bool enabled_=1) : name(name_), timer1(GET_TIME_MS()), enabled(enabled_) {}
-	timer_t(std::string const &name_, bool enabled_=1) : name(name_), timer1(GET_TIME_MS()), enabled(enabled_) {}
+	timer_t(char const *const name_,  bool enabled_=1) : name(name_), timer1(GET_TIME_MS()), start_us(enabled_ ? timing_profiler_begin_scope() : 0), enabled(enabled_) {}
+	timer_t(std::string const &name_, bool enabled_=1) : name(name_), timer1(GET_TIME_MS()), start_us(enabled_ ? timing_profiler_begin_scope() : 0), enabled(enabled_) {}
 	~timer_t() {end();}
-	void end() {if (enabled && !name.empty()) {register_timing_value(name.c_str(), GET_DELTA_TIME); name.clear();}}
+	void end() {if (enabled && !name.empty()) {timing_profiler_end_scope(name.c_str(), start_us, GET_DELTA_TIME); name.clear();}}
 };
 
 
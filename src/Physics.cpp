@@ -715,8 +715,38 @@ float dwobject::get_true_mass() const {
 }
 
 
+phys_step_t get_global_phys_step() {return phys_step_t(TIMESTEP, tstep);}
+
+thread_local phys_cmd_buffer_t *cur_phys_cmd_buf(nullptr);
+
+void set_thread_phys_cmd_buffer(phys_cmd_buffer_t *buf) {cur_phys_cmd_buf = buf;}
+
+bool defer_phys_side_effect(phys_cmd_buffer_t::cmd_t const &cmd) {
+	if (cur_phys_cmd_buf == nullptr) return 0;
+	cur_phys_cmd_buf->cmds.emplace_back(cur_phys_cmd_buf->cur_obj_ix, cmd);
+	return 1;
+}
+
+int      phys_rand()                                {return (cur_phys_cmd_buf ? cur_phys_cmd_buf->rgen.rand() : rand());}
+float    phys_rand_uniform(float val1, float val2)  {return (cur_phys_cmd_buf ? cur_phys_cmd_buf->rgen.rand_uniform(val1, val2) : rand_uniform(val1, val2));}
+float    phys_signed_rand_float()                   {return (cur_phys_cmd_buf ? cur_phys_cmd_buf->rgen.signed_rand_float() : signed_rand_float());}
+vector3d phys_signed_rand_vector()                  {return (cur_phys_cmd_buf ? cur_phys_cmd_buf->rgen.signed_rand_vector() : signed_rand_vector());}
+
+/*static*/ void phys_cmd_buffer_t::apply_all(vector<phys_cmd_buffer_t> &bufs) {
+	vector<pair<unsigned, cmd_t>> cmds;
+	
+	for (auto &b : bufs) {
+		std::move(b.cmds.begin(), b.cmds.end(), std::back_inserter(cmds));
+		b.cmds.clear();
+	}
+	// each object is advanced by a single thread, so a stable sort by object index restores the serial order
+	std::stable_sort(cmds.begin(), cmds.end(), [](pair<unsigned, cmd_t> const &a, pair<unsigned, cmd_t> const &b) {return (a.first < b.first);});
+	for (auto const &c : cmds) {c.second();}
+}
+
+
 // 0 = out of range/expired, 1 = airborne, 2 = collision, 3 = moving on ground, 4 = motionless
-void dwobject::advance_object(bool disable_motionless_objects, int iter, int obj_index) { // returns collision status
+void dwobject::advance_object(bool disable_motionless_objects, int iter, int obj_index, phys_step_t const &step) { // returns collision status
 
 	assert(!disabled());
 	if (temperature <= ABSOLUTE_ZERO) return;
@@ -740,11 +770,11 @@ void dwobject::advance_object(bool disable_motionless_objects, int iter, int obj
 		status  = 1;
 	}
 	if (disable_motionless_objects && status == 4 && ground_mode) {
-		if ((flags & IS_ON_ICE) || (!(flags & (FLOATING | STATIC_COBJ_COLL)) && object_still_stopped(obj_index))) {
+		if ((flags & IS_ON_ICE) || (!(flags & (FLOATING | STATIC_COBJ_COLL)) && object_still_stopped(obj_index, step))) {
 			point const old_pos(pos);
-			check_vert_collision(obj_index, 1, iter); // needed for gameplay (already tested in object_still_stopped()?)
+			check_vert_collision(obj_index, 1, iter, NULL, all_zeros, 0, 0, -1, 0, &step); // needed for gameplay (already tested in object_still_stopped()?)
 			pos = old_pos;
-			if (disabled() || check_water_collision(velocity.z)) return;
+			if (disabled() || check_water_collision(velocity.z, step)) return;
 			if (pos.z < zmin || !is_over_mesh(pos)) status = 0;
 			flags &= ~Z_STOPPED;
 			return;
@@ -755,7 +785,7 @@ void dwobject::advance_object(bool disable_motionless_objects, int iter, int obj
 
 	if (status == 1 || type == LANDMINE) { // airborne
 		if (type == ROCKET && direction == 1) { // rapid fire rocket
-			rotate_vector3d(signed_rand_vector(), 0.02*fticks*signed_rand_float(), velocity);
+			rotate_vector3d(phys_signed_rand_vector(), 0.02*fticks*phys_signed_rand_float(), velocity);
 		}
 		float air_factor(0.0);
 
@@ -777,7 +807,7 @@ void dwobject::advance_object(bool disable_motionless_objects, int iter, int obj
 			int const xpos(get_xpos(pos.x)), ypos(get_ypos(pos.y));
 
 			if (ground_mode && !point_outside_mesh(xpos, ypos) && (pos.z - radius) > water_matrix[ypos][xpos] &&
-				((friction < 2.0*STICK_THRESHOLD) || (friction < rand_uniform(2.0, 2.5)*STICK_THRESHOLD)))
+				((friction < 2.0*STICK_THRESHOLD) || (friction < phys_rand_uniform(2.0, 2.5)*STICK_THRESHOLD)))
 			{
 				flags &= ~Z_STOPPED;
 			}
@@ -803,7 +833,7 @@ void dwobject::advance_object(bool disable_motionless_objects, int iter, int obj
 				float const grav_well(min(1.0f, 0.1f*v_flow.mag()));
 
 				if (-velocity.z < otype.terminal_vel) {
-					velocity.z -= (1.0 - grav_well)*base_gravity*gscale*GRAVITY*tstep*otype.gravity;
+					velocity.z -= (1.0 - grav_well)*base_gravity*gscale*GRAVITY*step.tstep*otype.gravity;
 					velocity.z  = grav_well*velocity.z - (1.0f - grav_well)*min(-velocity.z, otype.terminal_vel);
 				}
 				if (fabs(air_factor*vtot.z) > fabs(velocity.z) || ((vtot.z < 0.0f) != (velocity.z < 0.0f))) {
@@ -812,7 +842,7 @@ void dwobject::advance_object(bool disable_motionless_objects, int iter, int obj
 			}
 			else {
 				if (-velocity.z < otype.terminal_vel) {
-					velocity.z -= base_gravity*gscale*GRAVITY*tstep*otype.gravity;
+					velocity.z -= base_gravity*gscale*GRAVITY*step.tstep*otype.gravity;
 					velocity.z  = -min(-velocity.z, otype.terminal_vel);
 				}
 				if (fabs(air_factor*local_wind.z) > fabs(velocity.z) || ((local_wind.z < 0) != (velocity.z < 0))) {
@@ -829,12 +859,12 @@ void dwobject::advance_object(bool disable_motionless_objects, int iter, int obj
 					bool const stopped(friction >= 2.0*STICK_THRESHOLD || fabs(velocity[d]) <= friction);
 					velocity[d] = (stopped ? 0.0 : max(0.0f, (velocity[d] + ((velocity[d] > 0.0) ? -friction : friction))));
 				}
-				pos[d] += tstep*velocity[d]; // move object
+				pos[d] += step.tstep*velocity[d]; // move object
 			}
 			if (flags & FLOATING) {float_downstream(pos, radius);}
 		}
-		assert(!is_nan(tstep));
-		pos.z += tstep*velocity.z;
+		assert(!is_nan(step.tstep));
+		pos.z += step.tstep*velocity.z;
 		verify_data();
 
 		// check collisions
@@ -849,11 +879,11 @@ void dwobject::advance_object(bool disable_motionless_objects, int iter, int obj
 			if ((ground_mode && pos.z < zmin) || (flags & Z_STOPPED)) {status = 0;} // out of simulation region and underwater
 			return;
 		}
-		int const wcoll(check_water_collision(vz_old));
+		int const wcoll(check_water_collision(vz_old, step));
 		vector3d cnorm;
 		bool const last_stat_coll((flags & STATIC_COBJ_COLL) != 0);
 		old_pos = pos;
-		int coll(check_vert_collision(obj_index, 1, iter, &cnorm));
+		int coll(check_vert_collision(obj_index, 1, iter, &cnorm, all_zeros, 0, 0, -1, 0, &step));
 		if (disabled()) return;
 
 		if (!ground_mode) { // tiled terrain
@@ -868,12 +898,17 @@ void dwobject::advance_object(bool disable_motionless_objects, int iter, int obj
 			return;
 		}
 		if (val == 2 && !coll) { // collision with mesh surface but not vertical surface
-			if (ground_mode && iter == 0) {surf_collide_obj();} // only supports blood and chunks for now
-			
+			if (ground_mode && iter == 0 && (type == BLOOD || type == CHUNK)) { // only supports blood and chunks for now
+				dwobject const obj(*this);
+				run_or_defer_phys([obj]() {obj.surf_collide_obj();});
+			}
 			if (object_bounce(0, cnorm, 0.0, radius)) {
 				if (radius >= LARGE_OBJ_RAD) {
-					modify_grass_at(pos, 2.0*radius, 1); // crush grass a lot
-					crush_snow_at_pt(pos, 2.0*radius);
+					point const p(pos);
+					run_or_defer_phys([p, radius]() {
+						modify_grass_at(p, 2.0*radius, 1); // crush grass a lot
+						crush_snow_at_pt(p, 2.0*radius);
+					});
 				}
 				status = 1;
 				return; // objects bounce on mesh but not on collision objects
@@ -884,7 +919,11 @@ void dwobject::advance_object(bool disable_motionless_objects, int iter, int obj
 			velocity *= (stopped ? 0.0 : 0.95); // apply some damping
 		}
 		if (coll) { // cobj collision
-			if (type == SAWBLADE) {destroy_coll_objs(pos, 500.0, source, IMPACT);} // shatterable but not destroyable
+			if (type == SAWBLADE) { // shatterable but not destroyable
+				point const p(pos);
+				int const src(source);
+				run_or_defer_phys([p, src]() {destroy_coll_objs(p, 500.0, src, IMPACT);});
+			}
 			bool const stat_coll((flags & STATIC_COBJ_COLL) != 0);
 
 			if (!stat_coll || !last_stat_coll) {
@@ -908,16 +947,20 @@ void dwobject::advance_object(bool disable_motionless_objects, int iter, int obj
 		}
 		if (otype.flags & COLL_DESTROYS) {assert(type != SMILEY); status = 0; return;}
 		if (flags & STATIC_COBJ_COLL) return; // stuck on vertical collision surface
-		if (check_water_collision(velocity.z) && (frozen || get_true_density() < WATER_DENSITY)) return;
+		if (check_water_collision(velocity.z, step) && (frozen || get_true_density() < WATER_DENSITY)) return;
 		if (flags & IS_CUBE_FLAG) return;
 		if (is_flat() || (otype.flags & OBJ_IS_CYLIN)) {set_orient_for_coll(NULL);}
-		int const val(surface_advance()); // move along ground
+		int const val(surface_advance(step)); // move along ground
 
 		if (val == 2) { // moved, recalculate velocity from position change
 			status = 3;
-			if (radius >= LARGE_OBJ_RAD) {check_vert_collision(obj_index, 1, iter);} // adds instability though
-			assert(tstep > 0.0);
-			if (radius >= LARGE_OBJ_RAD && velocity != zero_vector) {modify_grass_at(pos, radius, 1);} // crush grass
+			if (radius >= LARGE_OBJ_RAD) {check_vert_collision(obj_index, 1, iter, NULL, all_zeros, 0, 0, -1, 0, &step);} // adds instability though
+			assert(step.tstep > 0.0);
+			
+			if (radius >= LARGE_OBJ_RAD && velocity != zero_vector) { // crush grass
+				point const p(pos);
+				run_or_defer_phys([p, radius]() {modify_grass_at(p, radius, 1);});
+			}
 		}
 		else if (val == 1) { // stopped
 			if (ground_mode && (otype.flags & IS_PRECIP)) {
@@ -929,7 +972,7 @@ void dwobject::advance_object(bool disable_motionless_objects, int iter, int obj
 				}
 			}
 			if (status != 4) {
-				check_vert_collision(obj_index, 0, iter); // one last time before the object is "stopped"???
+				check_vert_collision(obj_index, 0, iter, NULL, all_zeros, 0, 0, -1, 0, &step); // one last time before the object is "stopped"???
 				velocity = zero_vector;
 				if (!disabled()) {status = 4;}
 			}
@@ -959,7 +1002,7 @@ int get_obj_zval(point &pt, float &dz, float z_offset) { // 0 = out of bounds/er
 }
 
 
-int dwobject::object_still_stopped(int obj_index) {
+int dwobject::object_still_stopped(int obj_index, phys_step_t const &step) {
 
 	float const zval(pos.z - get_true_radius());
 	float const mh(interpolate_mesh_zval(pos.x, pos.y, 0.0, 0, 0));
@@ -971,7 +1014,7 @@ int dwobject::object_still_stopped(int obj_index) {
 	}
 	point const old_pos(pos);
 	pos.z = zval;
-	int const coll(check_vert_collision(obj_index, 0, 0)); // apply coll functions?
+	int const coll(check_vert_collision(obj_index, 0, 0, NULL, all_zeros, 0, 0, -1, 0, &step)); // apply coll functions?
 	pos   = old_pos;
 	if (!disabled() && !coll) status = 1;
 	return coll;
@@ -979,7 +1022,7 @@ int dwobject::object_still_stopped(int obj_index) {
 
 
 // 0 = error (bad position), 1 = stopped, 2 = moved
-int dwobject::surface_advance() {
+int dwobject::surface_advance(phys_step_t const &step) {
 
 	obj_type const &otype(object_types[type]);
 	
@@ -1032,8 +1075,8 @@ int dwobject::surface_advance() {
 	}
 	float const vmult((otype.flags & OBJ_IS_DROP) ? 0.0 : pow(max((1.0f - friction), 0.0f), fticks)); // droplets stick - no momentum
 	velocity = (mesh_vel*(1.0 - vmult) + velocity*vmult);
-	pos.x   += velocity.x*tstep;
-	pos.y   += velocity.y*tstep;
+	pos.x   += velocity.x*step.tstep;
+	pos.y   += velocity.y*step.tstep;
 	pos.z    = mh + radius;
 	return val+1;
 }
@@ -1081,7 +1124,7 @@ void dwobject::set_orient_for_coll(vector3d const *const forced_norm) {
 }
 
 
-int dwobject::check_water_collision(float vz_old) {
+int dwobject::check_water_collision(float vz_old, phys_step_t const &step) {
 
 	if (world_mode != WMODE_GROUND) return 0;
 	obj_type const &otype(object_types[type]);
@@ -1121,7 +1164,7 @@ int dwobject::check_water_collision(float vz_old) {
 
 					if ((zpos - pos.z) > 2.0f*radius) { // under the surface
 						velocity.z  = vz_old;
-						velocity.z -= ((density - WATER_DENSITY)/density)*base_gravity*GRAVITY*tstep;
+						velocity.z -= ((density - WATER_DENSITY)/density)*base_gravity*GRAVITY*step.tstep;
 						flags      |= Z_STOPPED;
 						if ((pos.z - radius) > water_height) splash = 1;
 					}
@@ -1184,15 +1227,22 @@ int dwobject::check_water_collision(float vz_old) {
 			float energy(get_coll_energy(old_v, (exp_on_coll ? zero_vector : velocity), get_true_mass()));
 
 			if (energy > 0.0) {
-				draw_splash(pos.x, pos.y, water_height, SPLASH_BASE_SZ*sqrt(energy));
+				point const p(pos);
+				int const t(type);
+
+				run_or_defer_phys([=]() {
+					draw_splash(p.x, p.y, water_height, SPLASH_BASE_SZ*sqrt(energy));
 				
-				if (type != DROPLET) {
-					if (type == SHRAPNEL) {
-						if (rand()%10 < 6) {energy = 0.0;} else {energy *= 0.2;}
+					if (t != DROPLET) {
+						float splash_energy(energy);
+
+						if (t == SHRAPNEL) {
+							if (rand()%10 < 6) {splash_energy = 0.0;} else {splash_energy *= 0.2;}
+						}
+						//else if (t == FRAGMENT) {splash_energy *= 0.2;} // too many fragments adding energy gives too large of a splash
+						if (splash_energy > 0.0) {add_splash(p, xpos, ypos, splash_energy, radius, (radius >= LARGE_OBJ_RAD));}
 					}
-					//else if (type == FRAGMENT) {energy *= 0.2;} // too many fragments adding energy gives too large of a splash
-					if (energy > 0.0) {add_splash(pos, xpos, ypos, energy, radius, (radius >= LARGE_OBJ_RAD));}
-				}
+				});
 			}
 		}
 	}
@@ -1400,8 +1450,10 @@ int dwobject::object_bounce(int coll_type, vector3d &norm, float elasticity2, fl
 	float const v_tot_sq(velocity.mag_sq());
 
 	if (v_tot_sq >= BOUNCE_CUTOFF || type == DYNAM_PART) {
-		if (type == PLASMA && (coll_type == 0 || coll_type == 3) && v_tot_sq >= 2.25*BOUNCE_CUTOFF && (rand()%10) < 8) {
-			gen_fire(pos, rand_uniform(0.4, 1.2), source);
+		if (type == PLASMA && (coll_type == 0 || coll_type == 3) && v_tot_sq >= 2.25*BOUNCE_CUTOFF && (phys_rand()%10) < 8) {
+			point const p(pos);
+			int const src(source);
+			run_or_defer_phys([p, src]() {gen_fire(p, rand_uniform(0.4, 1.2), src);});
 		}
 		if (object_types[type].flags & OBJ_ROLLS) {flags &= ~WAS_FIRED;} // mark rolling objects as no longer in was-fired state
 		return 1;
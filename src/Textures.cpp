@@ -261,10 +261,8 @@ void set_landscape_texture_from_file() {
 }
 
 
-void load_textures() {
+void load_texture_images() { // CPU side only - no GL calls, so this can be used without a context (headless benchmark)
 
-	timer_t timer("Texture Load");
-	cout << "loading textures"; cout.flush();
 	if (using_custom_landscape_texture()) {set_landscape_texture_from_file();} // must be done first
 	load_texture_names();
 
@@ -276,6 +274,14 @@ void load_textures() {
 	for (int i = 0; i < (int)textures.size(); ++i) {
 		if (!is_tex_disabled(i)) {textures[i].fix_word_alignment();}
 	}
+}
+
+
+void load_textures() {
+
+	timer_t timer("Texture Load");
+	cout << "loading textures"; cout.flush();
+	load_texture_images();
 	cout << " done" << endl;
 	textures[BULLET_D_TEX].merge_in_alpha_channel(textures[BULLET_A_TEX]);
 	gen_smoke_texture();
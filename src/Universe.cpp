@@ -146,12 +146,11 @@ void setup_universe_fog(s_object const &closest) {
 }
 
 
-// Note: not threadsafe
 uobject *line_intersect_universe(point const &start, vector3d const &dir, float length, float line_radius, float &dist) {
 
 	point coll;
 	s_object target;
-	static line_query_state lqs;
+	static thread_local line_query_state lqs; // per-thread for parallel ship AI
 
 	if (universe.get_trajectory_collisions(lqs, target, coll, dir, start, length, line_radius)) { // destroy, query, beams
 		if (target.is_solid()) {
@@ -2784,7 +2783,7 @@ int universe_t::get_closest_object(s_object &result, point pos, int max_level, b
 	pos -= cell.pos;
 	float const planet_thresh(expand*4.0*MAX_PLANET_EXTENT + r_add), moon_thresh(expand*2.0*MAX_PLANET_EXTENT + r_add);
 	float const pt_sq(planet_thresh*planet_thresh), mt_sq(moon_thresh*moon_thresh);
-	static int last_galaxy(-1), last_cluster(-1), last_system(-1);
+	static thread_local int last_galaxy(-1), last_cluster(-1), last_system(-1); // search hints
 	int const first_galaxy_to_try((galaxy_hint >= 0) ? galaxy_hint : last_galaxy);
 	unsigned const ng((unsigned)cell.galaxies->size());
 	unsigned const go((first_galaxy_to_try >= 0 && first_galaxy_to_try < int(ng)) ? last_galaxy : 0);
@@ -28,7 +28,7 @@ unsigned owner_counts[NUM_ALIGNMENT] = {0};
 float resource_counts[NUM_ALIGNMENT] = {0.0};
 
 
-extern bool claim_planet, water_is_lava, no_shift_universe;
+extern bool claim_planet, water_is_lava, no_shift_universe, parallel_ship_ai;
 extern int uxyz[], window_width, window_height, do_run, fire_key, display_mode, DISABLE_WATER, frame_counter;
 extern unsigned NUM_THREADS;
 extern float zmax, zmin, fticks, univ_temp, temperature, atmosphere, vegetation, base_gravity, urm_static;
@@ -63,8 +63,12 @@ void add_player_ship_engine_light();
 
 #ifdef _OPENMP
 int omp_get_thread_num_3dw() {return omp_get_thread_num();} // where does this belong?
+int omp_get_max_threads_3dw() {return omp_get_max_threads();}
+void omp_set_num_threads_3dw(int num) {omp_set_num_threads(num);} // for the calling thread only
 #else
 int omp_get_thread_num_3dw() {return 0;}
+int omp_get_max_threads_3dw() {return 1;}
+void omp_set_num_threads_3dw(int num) {}
 #endif
 
 void init_universe_display() {
@@ -294,7 +298,11 @@ void draw_universe(bool static_only, bool skip_closest, bool no_move, int no_dis
 		// is this legal when a query object that tries to access a planet/moon/star through clobj as the uobject is being deleted?
 		#pragma omp parallel num_threads(2)
 		{
-			if (omp_get_thread_num_3dw() == 1) {process_ships(timer1);}
+			if (omp_get_thread_num_3dw() == 1) {
+				if (parallel_ship_ai) {omp_set_nested(1);} // allow ai_action_parallel() to create a nested team; with libgomp, this only applies to this thread
+				process_ships(timer1);
+				if (parallel_ship_ai) {omp_set_nested(0);}
+			}
 			else {draw_universe_all(static_only, skip_closest, no_move, no_distant, gen_only, no_asteroid_dust);} // *must* be done by master thread
 		}
 	}
@@ -44,7 +44,7 @@ struct binary_file_reader : public binary_file_io {
 	}
 };
 struct binary_file_writer : public binary_file_io {
-	bool open(string const &filename) {return binary_file_io::open(filename, "wb", "writing");}
+	bool open(string const &filename, bool append=0) {return binary_file_io::open(filename, (append ? "ab" : "wb"), "writing");} // appending to a .gz file adds a new gzip member
 
 	bool write(void const *ptr, size_t sz, size_t count) {
 		if      (fp ) {return (fwrite (ptr, sz, count, fp) == count);}
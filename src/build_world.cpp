@@ -14,6 +14,7 @@
 #include "player_state.h"
 #include "file_utils.h"
 #include "openal_wrap.h"
+#include "gameplay.h"
 #include <fstream>
 
 
@@ -26,12 +27,13 @@ unsigned const BLOOD_PER_SMILEY   = 300;
 unsigned const LG_STEPS_PER_FRAME = 10;
 unsigned const SM_STEPS_PER_FRAME = 1;
 unsigned const SHRAP_DLT_IX_MOD   = 8;
+unsigned const PAR_PHYS_MIN_OBJS  = 256; // groups with fewer objects than this are always advanced serially
 float const STAR_INNER_RAD        = 0.4;
 float const ROTATE_RATE           = 25.0;
 
 
 // object variables
-bool printed_ngsp_warning(0), using_model_bcube(0);
+bool printed_ngsp_warning(0), using_model_bcube(0), parallel_physics(0), soa_precipitation(0);
 int num_groups(0), used_objs(0);
 unsigned next_cobj_group_id(0), num_keycards(0);
 float model_czmin(czmin), model_czmax(czmax);
@@ -51,7 +53,7 @@ vector<popup_text_t> popup_text;
 cube_light_src_vect sky_cube_lights, global_cube_lights;
 
 extern bool clear_landscape_vbo, use_voxel_cobjs, tree_4th_branches, lm_alloc, reflect_dodgeballs, begin_motion, disable_fire_delay;
-extern int camera_view, camera_mode, camera_reset, animate2, recreated, temp_change, preproc_cube_cobjs, precip_mode;
+extern int frame_counter, camera_view, camera_mode, camera_reset, animate2, recreated, temp_change, preproc_cube_cobjs, precip_mode;
 extern int is_cloudy, num_smileys, load_coll_objs, world_mode, start_ripple, has_snow_accum, has_accumulation, scrolling, num_items, camera_coll_id;
 extern int num_dodgeballs, display_mode, game_mode, num_trees, tree_mode, has_scenery2, UNLIMITED_WEAPONS, ground_effects_level;
 extern float temperature, zmin, TIMESTEP, base_gravity, orig_timestep, fticks, tstep, sun_rot, czmax, czmin, dodgeball_metalness;
@@ -83,6 +85,7 @@ int read_coll_objects(const char *filename);
 bool write_coll_objects_file(coll_obj_group const &cobjs, string const &fn);
 void gen_star_points();
 int gen_game_obj(int type);
+void update_precip_sim(obj_group &objg);
 point &get_sstate_pos(int id);
 void reset_smoke_tex_data();
 void calc_uw_atten_colors();
@@ -302,6 +305,107 @@ void object_line_coll(dwobject &obj, point const &old_pos, float radius, unsigne
 }
 
 
+// advances one object by one frame, splitting the frame into substeps for fast moving objects
+void advance_obj_substeps(dwobject &obj, unsigned j, int type, unsigned group_flags, unsigned char obj_flags, float radius, bool large_radius, float time, float grav_dz) {
+
+	point const &pos(obj.pos);
+	point const old_pos(pos); // after teleporting
+	unsigned spf(1);
+	int cindex(-1);
+
+	// What about rolling objects (type_flags & OBJ_ROLLS) on the ground (status == 3)?
+	if (obj.status == 1 && is_over_mesh(pos) && !((obj_flags & XY_STOPPED) && (obj_flags & Z_STOPPED))) {
+		if (obj.flags & CAMERA_VIEW) {spf = 4*LG_STEPS_PER_FRAME;} // smaller timesteps if camera view
+		else if (type == PLASMA || type == BALL || type == SAWBLADE) {spf = 3*LG_STEPS_PER_FRAME;}
+		else if (is_rocket_type(type)) {spf = 2*LG_STEPS_PER_FRAME;}
+		else if (large_radius /*|| type == STAR5 || type == SHELLC*/ || type == FRAGMENT) {spf = LG_STEPS_PER_FRAME;}
+		else if (type == SHRAPNEL) {spf = max(1, min(((obj.direction == W_GRENADE) ? 4 : 20), int(0.2*obj.velocity.mag())));}
+		else if (type == PRECIP || (group_flags & PRECIPITATION)) {spf = 1;}
+		else {spf = SM_STEPS_PER_FRAME;}
+
+		if (MORE_COLL_TSTEPS && obj.status == 1 && spf < LG_STEPS_PER_FRAME && pos.z < czmax && pos.z > czmin) {
+			point pos2(pos + obj.velocity*time); // makes precipitation slower, but collision detection is more correct
+			pos2.z -= grav_dz; // maybe want to try with and without this?
+			// Note: we only do the line intersection test if the object moves by more than its radius this frame (static leaves don't)
+			// Note: could also test pos.z > v_collision_matrix[y][x].zmax
+			if (!dist_less_than(pos, pos2, radius)) {check_coll_line(pos, pos2, cindex, -1, 0, 0);} // return value is unused
+		}
+		assert(spf > 0);
+
+		if (spf > 1) {
+			assert(fticks > 0.0);
+			phys_step_t const step(TIMESTEP/spf, TIMESTEP*fticks/spf); // incremental multistep object advance
+			point const obj_pos(obj.pos);
+								
+			for (unsigned k = 0; k < spf; ++k) {
+				obj.advance_object(!recreated, k, j, step);
+				if (obj.status != 1)    break; // no longer airborne
+				if (obj.pos == obj_pos) break; // stopped
+			}
+		}
+	}
+	if (spf == 1) {obj.advance_object(!recreated, 0, j, get_global_phys_step());}
+	obj.verify_data();
+						
+	if (!obj.disabled() && cindex >= 0 && !large_radius && spf < LG_STEPS_PER_FRAME) { // test collision with this cobj
+		object_line_coll(obj, old_pos, radius, j, cindex);
+	}
+}
+
+
+struct par_adv_obj_t { // per-object state captured before the parallel advance, in place of the locals of the serial loop
+	bool advanced;
+	unsigned char obj_flags;
+	int orig_status;
+	par_adv_obj_t() : advanced(0), obj_flags(0), orig_status(0) {}
+};
+
+// objects in these groups only modify themselves when advanced, other than side effects that can be deferred;
+// damaging objects are excluded because their collision callbacks can reject collisions, which must be known immediately
+bool can_advance_group_in_parallel(int type, bool large_radius, collision_func coll_func) {
+
+	if (!parallel_physics || world_mode != WMODE_GROUND) return 0;
+	if (large_radius || coll_func != NULL || type == SMILEY || damage_done_obj[type]) return 0;
+	return !(object_types[type].flags & (EXPL_ON_COLL | OBJ_EXPLODES | COLL_DESTROYS));
+}
+
+// advances the active objects of a group in parallel; new objects and objects that need special handling are left for the serial loop
+void advance_group_parallel(obj_group &objg, int type, size_t iter_count, float radius, float time, float grav_dz, vector<par_adv_obj_t> &state) {
+
+	bool const precip((objg.flags & PRECIPITATION) != 0);
+	static vector<unsigned> to_adv;
+	static vector<phys_cmd_buffer_t> cmd_bufs;
+	to_adv.clear();
+	state.clear();
+	state.resize(iter_count);
+
+	for (unsigned j = 0; j < iter_count; ++j) { // serial setup, matching the per-object code that precedes the advance in process_groups()
+		dwobject &obj(objg.get_obj(j));
+		if (obj.status == 0 || obj.status == OBJ_STAT_RES || obj.health < 0.0 || obj.time < 0 || (obj.flags & CAMERA_VIEW)) continue;
+		if (precip) {obj.update_precip_type();}
+		state[j].obj_flags   = (unsigned char)obj.flags;
+		state[j].orig_status = obj.status;
+		state[j].advanced    = 1;
+		obj.flags &= ~PLATFORM_COLL;
+		if (type == BLOOD || type == CHARRED || type == SHRAPNEL || type == STAR5) {maybe_teleport_object(obj.pos, radius, NO_SOURCE, type, 1);}
+		to_adv.push_back(j);
+	}
+	cmd_bufs.resize(max(1, omp_get_max_threads_3dw()));
+
+#pragma omp parallel for schedule(dynamic,64)
+	for (int i = 0; i < (int)to_adv.size(); ++i) {
+		unsigned const j(to_adv[i]);
+		phys_cmd_buffer_t &cmd_buf(cmd_bufs[omp_get_thread_num_3dw()]);
+		cmd_buf.cur_obj_ix = j;
+		cmd_buf.rgen.set_state(((type << 20) + j + 1), frame_counter); // per object and group type, independent of which thread advances it
+		set_thread_phys_cmd_buffer(&cmd_buf);
+		advance_obj_substeps(objg.get_obj(j), j, type, objg.flags, state[j].obj_flags, radius, 0, time, grav_dz);
+		set_thread_phys_cmd_buffer(nullptr);
+	}
+	phys_cmd_buffer_t::apply_all(cmd_bufs);
+}
+
+
 void set_global_state() {
 
 	camera_view = 0;
@@ -355,6 +459,12 @@ void process_groups() {
 			if (flags & (JUST_INIT | WAS_ADVANCED)) {objg.init_group();}
 			continue;
 		}
+		if (precip && soa_precipitation && world_mode == WMODE_GROUND) { // simulated separately, without per-object physics
+			update_precip_sim(objg);
+			objg.flags |= WAS_ADVANCED;
+			used_objs  += objg.end_id;
+			continue;
+		}
 		float const radius(otype.radius);
 		bool const large_radius(objg.large_radius());
 		collision_func coll_func(NULL);
@@ -390,6 +500,9 @@ void process_groups() {
 		cobj_params cp(otype.elasticity, otype.color, reflective, 1, coll_func, -1, otype.tid, 1.0, 0, 0);
 		if (reflective) {cp.metalness = dodgeball_metalness; cp.tscale = 0.0; cp.color = WHITE; cp.spec_color = WHITE; cp.shine = 100.0;} // reflective metal sphere
 		size_t const iter_count((large_radius || type == MAT_SPHERE || app_rate > 0) ? max_objs : objg.end_id); // optimization to use end_id when valid
+		bool const par_adv(iter_count >= PAR_PHYS_MIN_OBJS && can_advance_group_in_parallel(type, large_radius, coll_func));
+		static vector<par_adv_obj_t> par_state;
+		if (par_adv) {advance_group_parallel(objg, type, iter_count, radius, time, grav_dz, par_state);}
 		bool defer_remove_cobj(0);
 
 		for (size_t jj = 0; jj < iter_count; ++jj) {
@@ -408,8 +521,9 @@ void process_groups() {
 			}
 			if (obj.status == OBJ_STAT_RES) continue; // ignore
 			point &pos(obj.pos);
+			bool const was_advanced(par_adv && par_state[j].advanced); // in the parallel pass above
 
-			if (obj.status == 0) {
+			if (obj.status == 0 && !was_advanced) {
 				if (type == MAT_SPHERE) {remove_mat_sphere(j);}
 				if (gen_count >= app_rate || !(flags & WAS_ADVANCED))      continue;
 				if (type == BALL && (game_mode != 2 || UNLIMITED_WEAPONS)) continue; // not in dodgeball mode
@@ -447,14 +561,15 @@ void process_groups() {
 				}
 				if (type == SNOW) {obj.angle = rand_uniform(0.7, 1.3);} // used as radius
 			} // end obj.status == 0
-			if (precip) {obj.update_precip_type();}
-			unsigned char const obj_flags(obj.flags);
-			int const orig_status(obj.status);
-			obj.flags &= ~PLATFORM_COLL;
+			if (precip && !was_advanced) {obj.update_precip_type();}
+			unsigned char const obj_flags(was_advanced ? par_state[j].obj_flags : obj.flags);
+			int const orig_status(was_advanced ? par_state[j].orig_status : obj.status);
+			if (!was_advanced) {obj.flags &= ~PLATFORM_COLL;}
 			++used_objs;
 			++num_objs;
 
-			if (obj.health < 0.0) {obj.status = 0;} // can get here for smileys?
+			if (was_advanced) {} // nothing else to do
+			else if (obj.health < 0.0) {obj.status = 0;} // can get here for smileys?
 			else if (type == SMILEY) {advance_smiley(obj, j);}
 			else {
 				if (obj.time >= 0) {
@@ -467,51 +582,7 @@ void process_groups() {
 						else if (type == BLOOD || type == CHARRED || type == SHRAPNEL || type == STAR5) {
 							maybe_teleport_object(obj.pos, radius, NO_SOURCE, type, 1);
 						}
-						point const old_pos(pos); // after teleporting
-						unsigned spf(1);
-						int cindex(-1);
-
-						// What about rolling objects (type_flags & OBJ_ROLLS) on the ground (status == 3)?
-						if (obj.status == 1 && is_over_mesh(pos) && !((obj_flags & XY_STOPPED) && (obj_flags & Z_STOPPED))) {
-							if (obj.flags & CAMERA_VIEW) {spf = 4*LG_STEPS_PER_FRAME;} // smaller timesteps if camera view
-							else if (type == PLASMA || type == BALL || type == SAWBLADE) {spf = 3*LG_STEPS_PER_FRAME;}
-							else if (is_rocket_type(type)) {spf = 2*LG_STEPS_PER_FRAME;}
-							else if (large_radius /*|| type == STAR5 || type == SHELLC*/ || type == FRAGMENT) {spf = LG_STEPS_PER_FRAME;}
-							else if (type == SHRAPNEL) {spf = max(1, min(((obj.direction == W_GRENADE) ? 4 : 20), int(0.2*obj.velocity.mag())));}
-							else if (type == PRECIP || (flags & PRECIPITATION)) {spf = 1;}
-							else {spf = SM_STEPS_PER_FRAME;}
-
-							if (MORE_COLL_TSTEPS && obj.status == 1 && spf < LG_STEPS_PER_FRAME && pos.z < czmax && pos.z > czmin) {
-								point pos2(pos + obj.velocity*time); // makes precipitation slower, but collision detection is more correct
-								pos2.z -= grav_dz; // maybe want to try with and without this?
-								// Note: we only do the line intersection test if the object moves by more than its radius this frame (static leaves don't)
-								// Note: could also test pos.z > v_collision_matrix[y][x].zmax
-								if (!dist_less_than(pos, pos2, radius)) {check_coll_line(pos, pos2, cindex, -1, 0, 0);} // return value is unused
-							}
-							assert(spf > 0);
-
-							if (spf > 1) {
-								assert(fticks > 0.0);
-								orig_timestep = TIMESTEP; // incremental multistep object advance
-								TIMESTEP     /= float(spf);
-								tstep         = TIMESTEP*fticks;
-								point const obj_pos(obj.pos);
-								
-								for (unsigned k = 0; k < spf; ++k) {
-									obj.advance_object(!recreated, k, j);
-									if (obj.status != 1)    break; // no longer airborne
-									if (obj.pos == obj_pos) break; // stopped
-								}
-								TIMESTEP = orig_timestep;
-								tstep    = time;
-							}
-						}
-						if (spf == 1) {obj.advance_object(!recreated, 0, j);}
-						obj.verify_data();
-						
-						if (!obj.disabled() && cindex >= 0 && !large_radius && spf < LG_STEPS_PER_FRAME) { // test collision with this cobj
-							object_line_coll(obj, old_pos, radius, j, cindex);
-						}
+						advance_obj_substeps(obj, j, type, flags, obj_flags, radius, large_radius, time, grav_dz);
 					} // not plasma
 				} // obj.time < 0
 				else {obj.time = 0;}
@@ -4,6 +4,8 @@
 #include "3DWorld.h"
 #include "function_registry.h"
 #include "buildings.h"
+#include <algorithm> // for push_heap()/pop_heap()
+#include <cfloat> // for FLT_MAX
 #pragma warning(disable : 26812) // prefer enum class over enum
 
 
@@ -17,12 +19,20 @@ class building_nav_graph_t {
 		pt_with_ix_t(unsigned ix_, point const &pt_) : ix(ix_), pt(pt_) {}
 	};
 	struct node_t { // represents one room or one stairwell
-		bool has_exit, is_hallway, is_stairs;
+		bool has_exit, is_hallway, is_stairs, stairs_dim, stairs_dir;
 		cube_t bcube;
 		vector<pt_with_ix_t> conn_rooms;
-		node_t() : has_exit(0), is_hallway(0), is_stairs(0) {}
+		node_t() : has_exit(0), is_hallway(0), is_stairs(0), stairs_dim(0), stairs_dir(0) {}
 		point get_center() const {return get_cube_center_z1(bcube);}
 
+		point get_stairs_end(bool top_end, float z) const { // center of the bottom (!dir) or top (dir) end of the stairs
+			assert(is_stairs);
+			point pt(get_center());
+			pt[stairs_dim] = bcube.d[stairs_dim][stairs_dir ^ !top_end];
+			pt.z = z;
+			return pt;
+		}
+
 		void add_conn_room(unsigned room, cube_t const &c) {
 			for (auto i = conn_rooms.begin(); i != conn_rooms.end(); ++i) {if (i->ix == room) return;} // ignore duplicates
 			conn_rooms.emplace_back(room, get_cube_center_z1(c));
@@ -33,14 +43,61 @@ class building_nav_graph_t {
 			return all_zeros; // never gets here
 		}
 	};
+	// A* search state, one per thread and reused across searches so that path queries don't allocate once the arrays have grown to the largest graph;
+	// each graph node has two search states, before and after passing through a stairwell, so that paths between floors can be required to use stairs
+	struct a_star_arena_t {
+		struct state_t {
+			float g_score;
+			unsigned came_from, gen; // state is only valid for the current search if gen == cur_gen
+			bool closed;
+			state_t() : g_score(0.0), came_from(0), gen(0), closed(0) {}
+		};
+		typedef pair<float, unsigned> open_entry_t; // {f_score, state}
+		vector<state_t> states;
+		vector<open_entry_t> open; // min heap; entries for states that were later improved are skipped when popped
+		vector<unsigned> node_path; // reversed path of node indices
+		unsigned cur_gen;
+
+		a_star_arena_t() : cur_gen(0) {}
+
+		void start_search(unsigned num_states) {
+			if (states.size() < num_states) {states.resize(num_states);}
+			open.clear();
+			node_path.clear();
+			if (++cur_gen != 0) return;
+			for (state_t &s : states) {s.gen = 0;} // generation counter wrapped, reset all states
+			cur_gen = 1;
+		}
+		state_t &get_state(unsigned s) {
+			state_t &state(states[s]);
+			if (state.gen != cur_gen) {state = state_t(); state.gen = cur_gen; state.g_score = FLT_MAX;}
+			return state;
+		}
+		void push(float f_score, unsigned s) {open.emplace_back(f_score, s); push_heap(open.begin(), open.end(), std::greater<open_entry_t>());}
+		unsigned pop() {pop_heap(open.begin(), open.end(), std::greater<open_entry_t>()); unsigned const s(open.back().second); open.pop_back(); return s;}
+	};
 	unsigned num_rooms, num_stairs;
 	vector<node_t> nodes;
 	node_t       &get_node(unsigned room)       {assert(room < nodes.size()); return nodes[room];}
 	node_t const &get_node(unsigned room) const {assert(room < nodes.size()); return nodes[room];}
 
-	void add_room_to_path(unsigned room1, unsigned room2, vector<point> &path) const {
-		path.push_back(get_node(room1).get_conn_pt(room2)); // door pos
+	static a_star_arena_t &get_arena() {
+		static thread_local a_star_arena_t arena;
+		return arena;
+	}
+
+	void add_room_to_path(unsigned room1, unsigned room2, float z, vector<point> &path) const {
+		node_t const &n1(get_node(room1));
+		// when leaving stairs, walk directly from the end of the stairs rather than back to the entrance, which may be across the stairwell opening
+		if (!n1.is_stairs) {path.push_back(n1.get_conn_pt(room2)); path.back().z = z;} // door pos
 		path.push_back(get_node(room2).get_center()); // next room center
+		path.back().z = z;
+	}
+	void add_stairs_to_path(unsigned stairs, float z1, float z2, vector<point> &path) const {
+		node_t const &node(get_node(stairs));
+		bool const going_up(z2 > z1);
+		path.push_back(node.get_stairs_end(!going_up, z1)); // walk to the bottom of the stairs going up or the top going down
+		path.push_back(node.get_stairs_end( going_up, z2)); // climb or descend to the other end
 	}
 public:
 	building_nav_graph_t() : num_rooms(0), num_stairs(0) {}
@@ -52,7 +109,12 @@ public:
 		for (unsigned n = num_rooms; n < nodes.size(); ++n) {nodes[n].is_stairs = 1;}
 	}
 	void set_room_bcube  (unsigned room,   cube_t const &c) {get_node(room).bcube = c;}
-	void set_stairs_bcube(unsigned stairs, cube_t const &c) {get_node(stairs + num_rooms).bcube = c;}
+	void set_stairs(unsigned stairs, stairwell_t const &s) {
+		node_t &node(get_node(stairs + num_rooms));
+		node.bcube      = s;
+		node.stairs_dim = s.dim;
+		node.stairs_dir = s.dir;
+	}
 	void mark_hallway(unsigned room) {get_node(room).is_hallway = 1;}
 	void mark_exit   (unsigned room) {get_node(room).has_exit   = 1;}
 
@@ -95,18 +157,64 @@ public:
 	}
 	bool is_fully_connected() const {return (count_connected_components() == 1);}
 		
-	bool find_path_points(unsigned room1, unsigned room2, bool use_stairs, vector<point> &path) const {
-		assert(room1 != room2); // or just return an empty path?
+	// A* search over rooms and stairwells; path contains the door/stairs entry point and center of each room after room1;
+	// if use_stairs==1 (room1 and room2 are on different floors or in stacked parts), the path must include exactly one stairwell, otherwise it can't include stairs;
+	// path points are at z1 before the stairs and z2 after; room1 and room2 can be the same room on different floors when use_stairs==1
+	bool find_path_points(unsigned room1, unsigned room2, bool use_stairs, float z1, float z2, vector<point> &path) const {
+		assert(room1 != room2 || use_stairs); // or just return an empty path?
+		assert(room1 < num_rooms && room2 < num_rooms);
 		path.clear();
-		//path.push_back(get_node(room1).get_center()); // center of current room
-		// if use_stairs==1, or room1 and room2 are in different stacks, the path must include stairs
-		unsigned cur(room1);
-		// TODO: run A* algorithm
-		//path[i] = get_node(ix).get_center();
-		return 0;
+		a_star_arena_t &arena(get_arena());
+		arena.start_search(2*nodes.size());
+		unsigned const start_state(2*room1), goal_state(2*room2 + use_stairs);
+		point const goal_center(get_node(room2).get_center());
+		arena.get_state(start_state).g_score = 0.0;
+		arena.push(p2p_dist_xy(get_node(room1).get_center(), goal_center), start_state);
+		bool found(0);
+
+		while (!arena.open.empty()) {
+			unsigned const cur_state(arena.pop());
+			if (cur_state == goal_state) {found = 1; break;}
+			a_star_arena_t::state_t &cur(arena.get_state(cur_state));
+			if (cur.closed) continue; // stale heap entry for a state that was already expanded
+			cur.closed = 1;
+			float const cur_g(cur.g_score);
+			unsigned const cur_node(cur_state >> 1), cur_stairs(cur_state & 1);
+			node_t const &node(get_node(cur_node));
+			point const center(node.get_center());
+
+			for (auto i = node.conn_rooms.begin(); i != node.conn_rooms.end(); ++i) {
+				node_t const &next(get_node(i->ix));
+				if (next.is_stairs && (!use_stairs || cur_stairs)) continue; // stairs not allowed, or already used
+				unsigned const next_state(2*i->ix + (cur_stairs | next.is_stairs));
+				a_star_arena_t::state_t &ns(arena.get_state(next_state));
+				if (ns.closed) continue;
+				point const next_center(next.get_center());
+				float const g(cur_g + p2p_dist_xy(center, i->pt) + p2p_dist_xy(i->pt, next_center)); // center => door => center
+				if (g >= ns.g_score) continue; // not an improvement
+				ns.g_score   = g;
+				ns.came_from = cur_state;
+				arena.push((g + p2p_dist_xy(next_center, goal_center)), next_state); // straight line distance is an admissible heuristic
+			} // for i
+		} // end while()
+		if (!found) return 0;
+
+		for (unsigned s = goal_state; s != start_state; s = arena.get_state(s).came_from) {arena.node_path.push_back(s >> 1);}
+		arena.node_path.push_back(room1);
+		float z(z1);
+
+		for (unsigned i = arena.node_path.size()-1; i > 0; --i) {
+			unsigned const next(arena.node_path[i-1]);
+			if (get_node(next).is_stairs) {add_stairs_to_path(next, z1, z2, path); z = z2;}
+			else {add_room_to_path(arena.node_path[i], next, z, path);}
+		}
+		return 1;
 	}
 };
 
+building_interior_t:: building_interior_t() {} // here because building_nav_graph_t is only defined in this file
+building_interior_t::~building_interior_t() {}
+
 void building_t::build_nav_graph(building_nav_graph_t &ng) const {
 
 	assert(interior); // too strong?
@@ -114,7 +222,7 @@ void building_t::build_nav_graph(building_nav_graph_t &ng) const {
 	float const wall_width(0.5*get_floor_thickness());
 	unsigned const num_rooms(interior->rooms.size()), num_stairs(interior->stairwells.size());
 	ng.set_num_rooms(num_rooms, num_stairs);
-	for (unsigned s = 0; s < num_stairs; ++s) {ng.set_stairs_bcube(s, interior->stairwells[s]);}
+	for (unsigned s = 0; s < num_stairs; ++s) {ng.set_stairs(s, interior->stairwells[s]);}
 
 	for (unsigned r = 0; r < num_rooms; ++r) {
 		room_t const &room(interior->rooms[r]);
@@ -145,6 +253,17 @@ void building_t::build_nav_graph(building_nav_graph_t &ng) const {
 	} // for r
 }
 
+// Note: not thread safe the first time it's called for a building; callers that run in parallel must call this serially first
+building_nav_graph_t const &building_t::get_nav_graph() const {
+	assert(interior);
+	
+	if (!interior->nav_graph) {
+		interior->nav_graph.reset(new building_nav_graph_t);
+		build_nav_graph(*interior->nav_graph);
+	}
+	return *interior->nav_graph;
+}
+
 unsigned building_t::count_connected_room_components() const {
 	if (!interior) return 0;
 	building_nav_graph_t ng;
@@ -163,18 +282,57 @@ bool building_t::find_route_to_point(point const &from, point const &to, vector<
 	assert((unsigned)loc1.room_ix < interior->rooms.size() && (unsigned)loc2.room_ix < interior->rooms.size());
 	if (loc1 == loc2) {path.push_back(to); return 1;} // same part/room/floor, move to <to> and we're done
 	bool use_stairs(0);
-	if (loc1.floor != loc2.floor) {use_stairs = 1;} // different floors
+	if (fabs(from.z - to.z) > 0.5*get_window_vspace()) {use_stairs = 1;} // different floors
 	else if (loc1.part_ix != loc2.part_ix) {
 		if (parts[loc1.part_ix].z1() != parts[loc2.part_ix].z1()) {use_stairs = 1;} // stacked parts
 	}
-	building_nav_graph_t ng; // TODO: cache this in the building (by unique_ptr) or somewhere else?
-	build_nav_graph(ng);
-	if (!ng.find_path_points(loc1.room_ix, loc2.room_ix, use_stairs, path)) return 0; // failed to find a path
+	if (loc1.room_ix == loc2.room_ix && !use_stairs) {path.push_back(to); return 1;} // same room and floor
+	if (!get_nav_graph().find_path_points(loc1.room_ix, loc2.room_ix, use_stairs, from.z, to.z, path)) return 0; // failed to find a path
 	assert(!path.empty());
 	if (path.back() != to) {path.push_back(to);} // add dest pos if not the center of the final room
 	return 1;
 }
 
+// returns 1 if a person can stand at pos in room: inside the room away from the walls, and not blocked by doorways, stairs, elevators, or room objects
+bool building_t::is_valid_person_dest(point const &pos, float radius, room_t const &room) const {
+	cube_t bcube(pos);
+	bcube.expand_by(radius);
+	if (!is_valid_placement_for_room(bcube, room, vect_cube_t(), radius)) return 0;
+	if (!interior->room_geom) return 1;
+	vector<room_object_t> const &objs(interior->room_geom->objs);
+	auto objs_end(objs.begin() + interior->room_geom->stairs_start); // skip stairs
+
+	for (auto i = objs.begin(); i != objs_end; ++i) {
+		if (i->intersects(bcube)) return 0;
+	}
+	return 1;
+}
+
+// chooses a random point in another room, or in the same room on another floor, that's at most one floor above or below pos
+bool building_t::choose_dest_for_person(point const &pos, float radius, rand_gen_t &rgen, point &dest) const {
+	if (!interior || interior->rooms.empty()) return 0;
+	building_loc_t const loc(get_building_loc_for_pt(pos));
+	if (loc.room_ix < 0) return 0; // not in a room
+	float const window_vspacing(get_window_vspace()), floor_thickness(get_floor_thickness());
+
+	for (unsigned n = 0; n < 20; ++n) { // make 20 attempts
+		unsigned const room_ix(rgen.rand() % interior->rooms.size());
+		room_t const &room(interior->rooms[room_ix]);
+		if (min(room.dx(), room.dy()) < 4.0*radius) continue; // room too small
+		unsigned const num_floors(calc_num_floors(room, window_vspacing, floor_thickness));
+		if (num_floors == 0) continue; // shouldn't happen
+		point cand;
+		cand.z = room.z1() + 0.5*floor_thickness + window_vspacing*(rgen.rand() % num_floors); // same as place_person()
+		if (fabs(cand.z - pos.z) > 1.5*window_vspacing) continue; // more than one floor away
+		if ((int)room_ix == loc.room_ix && fabs(cand.z - pos.z) < 0.5*window_vspacing) continue; // pick a different room or floor
+		for (unsigned d = 0; d < 2; ++d) {cand[d] = rgen.rand_uniform(room.d[d][0]+radius, room.d[d][1]-radius);} // random XY point inside this room
+		if (!is_valid_person_dest(cand, radius, room)) continue;
+		dest = cand;
+		return 1;
+	} // for n
+	return 0;
+}
+
 building_loc_t building_t::get_building_loc_for_pt(point const &pt) const {
 	building_loc_t loc;
 
@@ -139,6 +139,7 @@ struct building_params_t {
 };
 
 class building_draw_t;
+class building_nav_graph_t;
 
 struct building_geom_t { // describes the physical shape of a building
 	unsigned num_sides;
@@ -332,9 +333,11 @@ struct building_interior_t {
 	vector<room_t> rooms;
 	vector<elevator_t> elevators;
 	std::unique_ptr<building_room_geom_t> room_geom;
+	std::unique_ptr<building_nav_graph_t> nav_graph;
 	draw_range_t draw_range;
 
-	building_interior_t() {}
+	building_interior_t();
+	~building_interior_t();
 	bool is_cube_close_to_doorway(cube_t const &c, float dmin=0.0f) const;
 	bool is_blocked_by_stairs_or_elevator(cube_t const &c, float dmin=0.0f) const;
 	void finalize();
@@ -357,7 +360,6 @@ struct colored_cube_t;
 typedef vector<colored_cube_t> vect_colored_cube_t;
 class cube_bvh_t;
 class building_indir_light_mgr_t;
-class building_nav_graph_t;
 
 struct building_t : public building_geom_t {
 
@@ -450,8 +452,11 @@ struct building_t : public building_geom_t {
 	void update_grass_exclude_at_pos(point const &pos, vector3d const &xlate) const;
 	void update_stats(building_stats_t &s) const;
 	void build_nav_graph(building_nav_graph_t &ng) const;
+	building_nav_graph_t const &get_nav_graph() const;
 	unsigned count_connected_room_components() const;
 	bool find_route_to_point(point const &from, point const &to, vector<point> &path) const;
+	bool choose_dest_for_person(point const &pos, float radius, rand_gen_t &rgen, point &dest) const;
+	bool is_valid_person_dest(point const &pos, float radius, room_t const &room) const;
 	building_loc_t get_building_loc_for_pt(point const &pt) const;
 private:
 	void get_exclude_cube(point const &pos, cube_t const &skip, cube_t &exclude) const;
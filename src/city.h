@@ -368,7 +368,10 @@ namespace stoplight_ns {
 		void reset_blocked() {UNROLL_4X(blocked[i_] = 0;)}
 		void mark_blocked(bool dim, bool dir) const {blocked[2*dim + dir] = 1;} // Note: not actually const, but blocked is mutable
 		bool is_blocked(bool dim, bool dir) const {return (blocked[2*dim + dir] != 0);}
-		void mark_crosswalk_in_use(bool dim, bool dir) const {cw_in_use |= (1 << (2*dim + dir));}
+		void mark_crosswalk_in_use(bool dim, bool dir) const {
+#pragma omp atomic
+			cw_in_use |= (1 << (2*dim + dir)); // atomic since peds in different plots may be updated in parallel
+		}
 		void init(uint8_t num_conn_, uint8_t conn_);
 		void next_frame();
 		void notify_waiting_car(bool dim, bool dir, unsigned turn) const;
@@ -689,9 +692,10 @@ struct pedestrian_t : public waiting_obj_t {
 	void stop();
 	void go();
 	bool check_for_safe_road_crossing(ped_manager_t const &ped_mgr, cube_t const &plot_bcube, cube_t const &next_plot_bcube, vect_cube_t *dbg_cubes=nullptr) const;
-	bool check_ped_ped_coll_range(vector<pedestrian_t> &peds, unsigned pid, unsigned ped_start, unsigned target_plot, float prox_radius, vector3d &force);
-	bool check_ped_ped_coll(ped_manager_t const &ped_mgr, vector<pedestrian_t> &peds, unsigned pid, float delta_dir);
-	bool check_ped_ped_coll_stopped(vector<pedestrian_t> &peds, unsigned pid);
+	template<typename T> bool check_ped_ped_coll_range(vector<T> const &others, unsigned pid, unsigned ped_start, unsigned ped_end, unsigned target_plot,
+		float prox_radius, vector3d &force, unsigned &coll_ix) const;
+	bool check_ped_ped_coll(ped_manager_t &ped_mgr, vector<pedestrian_t> &peds, unsigned pid, unsigned ped_end, float delta_dir);
+	bool check_ped_ped_coll_stopped(vector<pedestrian_t> &peds, unsigned pid, unsigned ped_end);
 	bool check_inside_plot(ped_manager_t &ped_mgr, point const &prev_pos, cube_t const &plot_bcube, cube_t const &next_plot_bcube);
 	bool check_road_coll(ped_manager_t const &ped_mgr, cube_t const &plot_bcube, cube_t const &next_plot_bcube) const;
 	bool is_valid_pos(vect_cube_t const &colliders, bool &ped_at_dest, ped_manager_t const *const ped_mgr) const;
@@ -699,7 +703,7 @@ struct pedestrian_t : public waiting_obj_t {
 	point get_dest_pos(cube_t const &plot_bcube, cube_t const &next_plot_bcube, ped_manager_t const &ped_mgr) const;
 	bool choose_alt_next_plot(ped_manager_t const &ped_mgr);
 	void get_avoid_cubes(ped_manager_t const &ped_mgr, vect_cube_t const &colliders, point const &dest_pos, vect_cube_t &avoid) const;
-	void next_frame(ped_manager_t &ped_mgr, vector<pedestrian_t> &peds, unsigned pid, rand_gen_t &rgen, float delta_dir);
+	void next_frame(ped_manager_t &ped_mgr, vector<pedestrian_t> &peds, unsigned pid, unsigned ped_end, rand_gen_t &rgen, float delta_dir);
 	void register_at_dest();
 	void destroy() {destroyed = 1;} // that's it, no other effects
 	void debug_draw(ped_manager_t &ped_mgr) const;
@@ -747,10 +751,28 @@ class ped_manager_t { // pedestrians
 		city_ixs_t() : ped_ix(0), plot_ix(0) {}
 		void assign(unsigned ped_ix_, unsigned plot_ix_) {ped_ix = ped_ix_; plot_ix = plot_ix_;}
 	};
+	struct building_ped_path_t { // route for a person inside a building; parallel to peds_b
+		vector<point> path; // reused across routes to avoid reallocation
+		unsigned next_pt;
+		float wait_secs; // time remaining before choosing the next destination
+		building_ped_path_t() : next_pt(0), wait_secs(0.0) {}
+		bool at_dest() const {return (next_pt >= path.size());}
+	};
+	struct ped_snapshot_t { // ped state at the start of the frame, read across plots during the parallel update
+		point pos;
+		vector3d vel;
+		float radius;
+		unsigned plot;
+		ped_snapshot_t(pedestrian_t const &ped) : pos(ped.pos), vel(ped.vel), radius(ped.radius), plot(ped.plot) {}
+	};
 	city_road_gen_t const &road_gen;
 	car_manager_t const &car_manager; // used for ped road crossing safety and dest car selection
 	ped_model_loader_t ped_model_loader;
-	vector<pedestrian_t> peds, peds_b; // dynamic city, static building
+	vector<pedestrian_t> peds, peds_b; // city, building
+	vector<building_ped_path_t> peds_b_paths;
+	vector<ped_snapshot_t> peds_snapshot; // double buffered positions for the parallel update
+	vector<path_finder_t> path_finders; // one per thread
+	vector<vector<pair<unsigned, unsigned>>> deferred_ped_colls; // per thread {ped, colliding ped} for collisions across plots, applied after the parallel update
 	vector<city_ixs_t> by_city; // first ped/plot index for each city
 	vector<unsigned> by_plot;
 	vector<unsigned char> need_to_sort_city;
@@ -759,7 +781,7 @@ class ped_manager_t { // pedestrians
 	ao_draw_state_t dstate;
 	int selected_ped_ssn;
 	unsigned animation_id;
-	bool ped_destroyed, need_to_sort_peds;
+	bool ped_destroyed, need_to_sort_peds, in_parallel_update;
 
 	void assign_ped_model(pedestrian_t &ped);
 	bool gen_ped_pos(pedestrian_t &ped);
@@ -771,9 +793,16 @@ class ped_manager_t { // pedestrians
 	int get_road_ix_for_ped_crossing(pedestrian_t const &ped, bool road_dim) const;
 	bool draw_ped(pedestrian_t const &ped, shader_t &s, pos_dir_up const &pdu, vector3d const &xlate, float def_draw_dist, float draw_dist_sq,
 		bool &in_sphere_draw, bool shadow_only, bool is_dlight_shadows, bool enable_animations);
+	void move_building_ped(pedestrian_t &ped, building_ped_path_t &bpath, rand_gen_t &rgen) const;
+	bool can_update_peds_in_parallel() const;
+	void choose_dests_for_peds_at_dest();
+	void update_peds_parallel(float delta_dir);
 public:
 	// for use in pedestrian_t, mostly for collisions and path finding
-	path_finder_t path_finder;
+	path_finder_t &get_path_finder();
+	bool is_parallel_update() const {return in_parallel_update;}
+	bool check_ped_coll_in_other_plot(pedestrian_t &ped, unsigned pid, unsigned ped_start, unsigned target_plot, float prox_radius, vector3d &force);
+	point const &get_colliding_ped_pos(vector<pedestrian_t> const &peds, unsigned ix) const;
 	vect_cube_t const &get_colliders_for_plot(unsigned city_ix, unsigned plot_ix) const;
 	cube_t const &get_city_plot_bcube_for_peds(unsigned city_ix, unsigned plot_ix) const;
 	cube_t get_expanded_city_bcube_for_peds(unsigned city_ix) const;
@@ -791,11 +820,11 @@ public:
 	bool has_car_at_pt(point const &pos, unsigned city, bool is_parked) const;
 public:
 	ped_manager_t(city_road_gen_t const &road_gen_, car_manager_t const &car_manager_) :
-		road_gen(road_gen_), car_manager(car_manager_), selected_ped_ssn(-1), animation_id(1), ped_destroyed(0), need_to_sort_peds(0) {}
+		road_gen(road_gen_), car_manager(car_manager_), path_finders(1), selected_ped_ssn(-1), animation_id(1), ped_destroyed(0), need_to_sort_peds(0), in_parallel_update(0) {}
 	void next_animation();
 	static float get_ped_radius();
 	bool empty() const {return (peds.empty() && peds_b.empty());}
-	void clear() {peds.clear(); peds_b.clear(); by_city.clear();}
+	void clear() {peds.clear(); peds_b.clear(); peds_b_paths.clear(); by_city.clear();}
 	unsigned get_model_gpu_mem() const {return ped_model_loader.get_gpu_mem();}
 	void init(unsigned num_city, unsigned num_building);
 	bool proc_sphere_coll(point &pos, float radius, vector3d *cnorm) const;
@@ -824,4 +853,6 @@ bool check_line_clip_update_t(point const &p1, point const &p2, float &t, cube_t
 point rand_xy_pt_in_cube(cube_t const &c, float radius, rand_gen_t &rgen);
 bool sphere_in_light_cone_approx(pos_dir_up const &pdu, point const &center, float radius);
 bool place_building_people(vect_building_place_t &locs, float radius, unsigned num); // from gen_buildings.cpp
+bool choose_building_person_dest(unsigned bix, point const &pos, float radius, rand_gen_t &rgen, point &dest); // from gen_buildings.cpp
+bool find_building_person_route(unsigned bix, point const &from, point const &to, vector<point> &path); // from gen_buildings.cpp
 void get_all_garages(vect_cube_t &garages); // from gen_buildings.cpp
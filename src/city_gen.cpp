@@ -10,6 +10,7 @@
 #include "buildings.h"
 #include "tree_3dw.h"
 #include <cfloat> // for FLT_MAX
+#include <queue>
 
 using std::string;
 
@@ -17,6 +18,13 @@ bool const CHECK_HEIGHT_BORDER_ONLY = 1; // choose building site to minimize edg
 float const OUTSIDE_TERRAIN_HEIGHT  = 0.0;
 float const CAR_LANE_OFFSET         = 0.15; // in units of road width
 float const CITY_LIGHT_FALLOFF      = 0.2;
+float const ROUTE_LEFT_TURN_COST    = 4.0; // in units of road width; left turns wait for oncoming traffic
+float const ROUTE_RIGHT_TURN_COST   = 1.0; // in units of road width
+float const ROUTE_STOPLIGHT_COST    = 2.0; // in units of road width; for 3-way and 4-way intersections
+float const ROUTE_CAR_COST          = 3.0; // in units of car length, per car on the road
+float const ROUTE_TRAFFIC_SMOOTH    = 0.05; // exponential smoothing weight for per-frame road car counts
+unsigned const ROUTE_UPDATE_FRAMES  = 120; // all routes are recomputed with the current traffic over this many frames
+unsigned const ROUTE_MAX_ISECS      = 4096; // cities with more intersections use greedy routing; route table size is 4*N^2 bytes
 
 
 city_params_t city_params;
@@ -727,6 +735,154 @@ void plot_xy_t::gen_adj_plots(vector<road_plot_t> const &plots) {
 }
 
 
+// precomputed next turn at each intersection toward every other intersection in a city, so that cars don't need to do a path search;
+// cars can only go straight, left, or right through an intersection, so the graph nodes are {intersection, entry side} pairs;
+// edge costs are the road length plus turn and stoplight costs plus the smoothed car count, and routes are recomputed incrementally as traffic changes
+class car_router_t {
+
+	struct edge_t { // a chain of road segments connecting two intersections
+		unsigned dest_node; // 4*isec + entry side
+		float length, traffic;
+		vector<unsigned> segs;
+		edge_t(unsigned dest_node_, float length_, vector<unsigned> const &segs_) : dest_node(dest_node_), length(length_), traffic(0.0), segs(segs_) {}
+	};
+	struct in_edge_t {
+		unsigned edge_ix, src_isec, exit_orient;
+		in_edge_t(unsigned e, unsigned s, unsigned o) : edge_ix(e), src_isec(s), exit_orient(o) {}
+	};
+	unsigned num_isecs, update_pos;
+	float turn_cost[3], car_cost;
+	vector<edge_t> edges;
+	vector<float> stoplight_cost; // per isec
+	vector<vector<in_edge_t>> in_edges; // per node
+	vector<unsigned char> next_turn; // [dest_isec][node]; TURN_UNSPEC if there's no route
+
+	static unsigned get_entry_side(unsigned exit_orient, unsigned turn_dir) { // inverse of the turn direction logic in update_car()
+		if (turn_dir == TURN_NONE) {return (exit_orient ^ 1);}
+		for (unsigned s = 0; s < 4; ++s) {
+			if (((turn_dir == TURN_LEFT) ? stoplight_ns::conn_left[s] : stoplight_ns::conn_right[s]) == exit_orient) return s;
+		}
+		assert(0);
+		return 0;
+	}
+	float get_edge_cost(edge_t const &e) const {return (e.length + car_cost*e.traffic);}
+
+	void calc_routes_to(unsigned dest) { // reverse Dijkstra from all entry sides of dest
+		typedef pair<float, unsigned> queue_entry_t; // {-cost, node}
+		vector<float> cost(4*num_isecs, FLT_MAX);
+		std::priority_queue<queue_entry_t> queue;
+		unsigned char *const turns(next_turn.data() + 4*size_t(num_isecs)*dest);
+		for (unsigned n = 0; n < 4*num_isecs; ++n) {turns[n] = TURN_UNSPEC;}
+		for (unsigned s = 0; s < 4; ++s) {cost[4*dest + s] = 0.0; queue.push(queue_entry_t(0.0, 4*dest + s));}
+
+		while (!queue.empty()) {
+			float const cur_cost(-queue.top().first);
+			unsigned const node(queue.top().second);
+			queue.pop();
+			if (cur_cost > cost[node]) continue; // stale entry
+
+			for (in_edge_t const &ie : in_edges[node]) {
+				if (ie.src_isec == dest) continue; // already there
+				float const base_cost(cur_cost + get_edge_cost(edges[ie.edge_ix]) + stoplight_cost[ie.src_isec]);
+
+				for (unsigned t = 0; t < 3; ++t) { // {straight, left, right}
+					unsigned const src_node(4*ie.src_isec + get_entry_side(ie.exit_orient, t));
+					float const new_cost(base_cost + turn_cost[t]);
+					if (new_cost >= cost[src_node]) continue;
+					cost [src_node] = new_cost;
+					turns[src_node] = (unsigned char)t;
+					queue.push(queue_entry_t(-new_cost, src_node));
+				}
+			} // for ie
+		} // while
+	}
+	void calc_routes(unsigned start, unsigned num) {
+#pragma omp parallel for schedule(dynamic)
+		for (int i = 0; i < (int)num; ++i) {calc_routes_to((start + i) % num_isecs);}
+	}
+public:
+	car_router_t() : num_isecs(0), update_pos(0), car_cost(0.0) {UNROLL_3X(turn_cost[i_] = 0.0;)}
+	bool enabled() const {return !next_turn.empty();}
+
+	void clear() {
+		num_isecs = update_pos = 0;
+		edges.clear();
+		stoplight_cost.clear();
+		in_edges.clear();
+		next_turn.clear();
+	}
+	// isecs are indexed in the same order as road_network_t::get_isec_by_ix()
+	void build(vector<road_isec_t> const isecs[3], vector<road_seg_t> const &segs) {
+		clear();
+		unsigned isec_offsets[3] = {0};
+		for (unsigned n = 0; n < 3; ++n) {isec_offsets[n] = num_isecs; num_isecs += isecs[n].size();}
+		if (num_isecs < 2 || num_isecs > ROUTE_MAX_ISECS) {num_isecs = 0; return;}
+		float const road_width(city_params.road_width);
+		turn_cost[TURN_NONE ] = 0.0;
+		turn_cost[TURN_LEFT ] = ROUTE_LEFT_TURN_COST *road_width;
+		turn_cost[TURN_RIGHT] = ROUTE_RIGHT_TURN_COST*road_width;
+		car_cost = ROUTE_CAR_COST*city_params.get_nom_car_size().x;
+		stoplight_cost.resize(num_isecs, 0.0);
+		in_edges.resize(4*num_isecs);
+		vector<unsigned> chain;
+
+		for (unsigned n = 0; n < 3; ++n) {
+			for (unsigned i = 0; i < isecs[n].size(); ++i) {
+				road_isec_t const &isec(isecs[n][i]);
+				unsigned const isec_ix(isec_offsets[n] + i);
+				if (n > 0) {stoplight_cost[isec_ix] = ROUTE_STOPLIGHT_COST*road_width;}
+
+				for (unsigned orient = 0; orient < 4; ++orient) { // follow the segments leaving this isec in each direction until we reach another isec
+					if (!(isec.conn & (1<<orient)) || isec.conn_ix[orient] < 0) continue; // no connection, or connector road to another city
+					bool const dir(orient & 1);
+					unsigned seg_ix(isec.conn_ix[orient]);
+					float length(0.0);
+					chain.clear();
+
+					while (1) {
+						assert(seg_ix < segs.size());
+						road_seg_t const &seg(segs[seg_ix]);
+						chain.push_back(seg_ix);
+						length += seg.get_length();
+						if (seg.conn_type[dir] != TYPE_RSEG) break;
+						assert(chain.size() <= segs.size()); // no cycles
+						seg_ix = seg.conn_ix[dir];
+					}
+					road_seg_t const &end_seg(segs[chain.back()]);
+					unsigned const type(end_seg.conn_type[dir]);
+					assert(is_isect(type));
+					unsigned const dest_isec(isec_offsets[type - TYPE_ISEC2] + end_seg.conn_ix[dir]);
+					assert(dest_isec < num_isecs);
+					unsigned const dest_node(4*dest_isec + (orient ^ 1)); // entered from the opposite side
+					length += isecs[type - TYPE_ISEC2][end_seg.conn_ix[dir]].get_sz_dim(orient >> 1); // cross the dest isec
+					in_edges[dest_node].emplace_back(edges.size(), isec_ix, orient);
+					edges.emplace_back(dest_node, length, chain);
+				} // for orient
+			} // for i
+		} // for n
+		next_turn.resize(4*size_t(num_isecs)*num_isecs);
+		calc_routes(0, num_isecs);
+	}
+	void next_frame(vector<road_seg_t> const &segs) { // must be called before the segment car counts are reset
+		if (!enabled()) return;
+
+		for (edge_t &e : edges) { // update smoothed traffic
+			unsigned count(0);
+			for (unsigned s : e.segs) {count += segs[s].car_count;}
+			e.traffic += ROUTE_TRAFFIC_SMOOTH*(count - e.traffic);
+		}
+		unsigned const num_update((num_isecs + ROUTE_UPDATE_FRAMES - 1)/ROUTE_UPDATE_FRAMES);
+		calc_routes(update_pos, num_update);
+		update_pos = (update_pos + num_update) % num_isecs;
+	}
+	unsigned get_turn_dir(unsigned dest_isec, unsigned isec, unsigned entry_side) const { // returns TURN_UNSPEC if there is no route
+		if (!enabled()) return TURN_UNSPEC;
+		assert(dest_isec < num_isecs && isec < num_isecs && entry_side < 4);
+		return next_turn[4*(size_t(num_isecs)*dest_isec + isec) + entry_side];
+	}
+};
+
+
 class city_road_gen_t : public road_gen_base_t {
 
 	struct bench_t : public sphere_t {
@@ -1115,12 +1271,15 @@ class city_road_gen_t : public road_gen_base_t {
 		set<unsigned> connected_to; // vector?
 		map<uint64_t, unsigned> tile_to_block_map;
 		map<unsigned, road_isec_t const *> cix_to_isec; // maps city_ix to intersection
+		car_router_t car_router;
+		vector<unsigned short> city_next_hop; // next connected city on the shortest path to each dest city
 		vector<vect_cube_t> plot_colliders;
 		plot_xy_t plot_xy;
 		unsigned city_id, cluster_id, plot_id_offset;
 		//string city_name; // future work
 		float tot_road_len;
 		mutable unsigned num_cars; // Note: not counting parked cars; mutable so that car_manager can update this
+		float smoothed_density = 0.0; // traffic density averaged over recent frames, since num_cars is reset each frame
 
 		// use only for the global road network
 		struct city_id_pair_t {
@@ -1183,6 +1342,9 @@ class city_road_gen_t : public road_gen_base_t {
 		set<unsigned> const &get_connected() const {return connected_to;}
 		bool is_connected_to(unsigned id) const {return (connected_to.find(id) != connected_to.end());}
 		float get_traffic_density() const {return ((tot_road_len == 0.0) ? 0.0 : num_cars/tot_road_len);} // cars per unit road
+		float get_smoothed_traffic_density() const {return smoothed_density;}
+		void set_city_next_hops(vector<unsigned short> const &next_hop) {city_next_hop = next_hop;}
+		unsigned get_next_city_hop(unsigned dest_city) const {return ((dest_city < city_next_hop.size()) ? city_next_hop[dest_city] : dest_city);}
 		void register_car() const {++num_cars;} // Note: must be const; num_cars is mutable
 
 		void clear() {
@@ -1199,6 +1361,9 @@ class city_road_gen_t : public road_gen_base_t {
 			city_obj_placer.clear();
 			tile_blocks.clear();
 			plot_colliders.clear();
+			car_router.clear();
+			city_next_hop.clear();
+			smoothed_density = 0.0;
 		}
 		bool gen_road_grid(float road_width, float road_spacing) {
 			if (city_params.road_width > 0.5*city_params.road_spacing) {
@@ -1506,6 +1671,7 @@ class city_road_gen_t : public road_gen_base_t {
 				} // for i
 			} // for n
 			for (auto r = roads.begin(); r != roads.end(); ++r) {tot_road_len += r->get_length();} // calculate tot_road_len
+			if (!is_global_rn && city_params.enable_car_path_finding) {car_router.build(isecs, segs);}
 		}
 		bool check_valid_conn_intersection(cube_t const &c, bool dim, bool dir, bool is_4_way) const {
 			return (is_4_way ? (find_3way_int_at(c, dim, dir) >= 0) : (find_conn_int_seg(c, dim, dir) >= 0));
@@ -2247,11 +2413,16 @@ class city_road_gen_t : public road_gen_base_t {
 					orients[TURN_LEFT ] = stoplight_ns::conn_left [orient_in];
 					orients[TURN_RIGHT] = stoplight_ns::conn_right[orient_in];
 
-					// TODO: use dest_seg.car_count to estimate traffic and route around
-					if (car.dest_valid && car.cur_city != CONN_CITY_IX) { // Note: don't need to update dest logic on connector roads since there are no choices to make
+					unsigned const route_turn_dir((car.dest_valid && car.cur_city != CONN_CITY_IX) ? car_rn.get_route_turn_dir(car, orient_in, road_networks, global_rn) : (unsigned)TURN_UNSPEC);
+
+					if (route_turn_dir != TURN_UNSPEC && isec.is_orient_currently_valid(orients[route_turn_dir], route_turn_dir)) { // use precomputed traffic-aware route
+						car.turn_dir = route_turn_dir;
+					}
+					else if (car.dest_valid && car.cur_city != CONN_CITY_IX) { // Note: don't need to update dest logic on connector roads since there are no choices to make
 						point const dest_pos(car_rn.get_car_dest_isec_center(car, road_networks, global_rn));
 						vector3d const dest_dir(dest_pos - car.get_center());
 						bool const pri_dim(fabs(dest_dir.x) < fabs(dest_dir.y)), pri_dir(dest_dir[pri_dim] > 0), sec_dir(dest_dir[!pri_dim] > 0);
+						unsigned const next_city(car_rn.get_next_city_hop(car.dest_city));
 						unsigned best_score(0);
 
 						for (unsigned tdir = 0; tdir < 3; ++tdir) { // choose best scoring of all valid turn dirs from {none/straight, left, right}
@@ -2259,7 +2430,7 @@ class city_road_gen_t : public road_gen_base_t {
 							if (!isec.is_orient_currently_valid(orient, tdir)) continue; // can't turn in this dir
 
 							if (isec.conn_to_city >= 0 && isec.conn_ix[orient] < 0) { // city connector isec
-								if (isec.conn_to_city != car.dest_city) continue; // leads to incorrect city, skip
+								if ((unsigned)isec.conn_to_city != next_city) continue; // leads to incorrect city, skip
 								car.turn_dir = tdir; // this is our destination - done
 								best_score = 1; // set to avoid assertion failure below
 								break;
@@ -2305,11 +2476,32 @@ class city_road_gen_t : public road_gen_base_t {
 			assert(car. cur_city == city_id);
 			assert(car.dest_city == dest_rn.city_id);
 			assert(dest_rn.city_id != city_id); // not ourself
-			// Note: here we don't attempt to find shortcuts through other cities as this would be quite complex
-			auto it(cix_to_isec.find(car.dest_city));
+			auto it(cix_to_isec.find(get_next_city_hop(car.dest_city))); // may go through other cities
 			if (it != cix_to_isec.end()) {return it->second;} // found
 			return nullptr; // not found, caller can error check
 		}
+		unsigned get_isec_ix(road_isec_t const *const isec) const { // inverse of get_isec_by_ix()
+			unsigned ix(0);
+			for (unsigned n = 0; n < 3; ++n) {
+				if (!isecs[n].empty() && isec >= &isecs[n].front() && isec <= &isecs[n].back()) {return (ix + (isec - &isecs[n].front()));}
+				ix += isecs[n].size();
+			}
+			assert(0); // not found
+			return 0;
+		}
+		unsigned get_route_turn_dir(car_t &car, unsigned entry_side, vector<road_network_t> const &road_networks, road_network_t const &global_rn) const {
+			if (!car_router.enabled()) return TURN_UNSPEC;
+			unsigned dest_isec(car.dest_isec);
+
+			if (car.dest_city != city_id) { // route to the connector road isec
+				road_isec_t const *const isec(find_isec_to_dest_city(car, road_networks[car.dest_city], global_rn));
+				if (isec == nullptr) return TURN_UNSPEC;
+				dest_isec = get_isec_ix(isec);
+			}
+			unsigned const cur_isec(get_isec_ix(&get_car_isec(car)));
+			if (cur_isec == dest_isec) return TURN_UNSPEC; // at the destination; connector road turns are handled by the caller
+			return car_router.get_turn_dir(dest_isec, cur_isec, entry_side);
+		}
 	public:
 		bool choose_new_car_dest(car_t &car, rand_gen_t &rgen) const {
 			unsigned const num_tot(isecs[0].size() + isecs[1].size() + isecs[2].size());
@@ -2333,8 +2525,10 @@ class city_road_gen_t : public road_gen_base_t {
 			for (unsigned n = 1; n < 3; ++n) { // {2-way, 3-way, 4-way} - Note: 2-way can be skipped
 				for (auto i = isecs[n].begin(); i != isecs[n].end(); ++i) {i->next_frame();} // update stoplight state
 			}
+			car_router.next_frame(segs); // before clearing segment car counts
 			for (auto i = segs.begin(); i != segs.end(); ++i) {i->next_frame();}
 			//cout << TXT(city_id) << TXT(tot_road_len) << TXT(num_cars) << TXT(get_traffic_density()) << endl;
+			smoothed_density += ROUTE_TRAFFIC_SMOOTH*(get_traffic_density() - smoothed_density); // before clearing num_cars
 			num_cars = 0;
 		}
 		static road_network_t const &get_car_rn(car_base_t const &car, vector<road_network_t> const &road_networks, road_network_t const &global_rn) {
@@ -2403,6 +2597,7 @@ class city_road_gen_t : public road_gen_base_t {
 	road_network_t global_rn; // connects cities together; no plots
 	road_draw_state_t dstate;
 	rand_gen_t rgen;
+	unsigned route_frame_ix = 0; // for periodic update_city_routes() calls
 
 	static float rgen_uniform(float val1, float val2, rand_gen_t &rgen) {return (val1 + (val2 - val1)*rgen.rand_float());}
 
@@ -2652,6 +2847,38 @@ public:
 		unsigned global_plot_id(0);
 		global_rn.calc_ix_values(road_networks, global_rn, global_plot_id);
 		for (auto i = road_networks.begin(); i != road_networks.end(); ++i) {i->calc_ix_values(road_networks, global_rn, global_plot_id);}
+		if (city_params.enable_car_path_finding) {update_city_routes();}
+	}
+	void update_city_routes() { // all-pairs shortest paths between cities along connector roads, weighted by city traffic density
+		unsigned const num(road_networks.size());
+		if (num < 3) return; // no choices to make
+		float const car_cost(ROUTE_CAR_COST*city_params.get_nom_car_size().x);
+		vector<float> dist(num*num, FLT_MAX);
+		vector<unsigned short> next(num*num);
+
+		for (unsigned i = 0; i < num; ++i) {
+			for (unsigned j = 0; j < num; ++j) {next[i*num + j] = j;} // default is direct, if there's no path
+			dist[i*num + i] = 0.0;
+
+			for (unsigned j : road_networks[i].get_connected()) {
+				assert(j < num);
+				road_network_t const &dest(road_networks[j]);
+				float const len(p2p_dist(road_networks[i].get_bcube().get_cube_center(), dest.get_bcube().get_cube_center()));
+				dist[i*num + j] = len*(1.0 + car_cost*dest.get_smoothed_traffic_density()); // fraction of road occupied by cars
+			}
+		}
+		for (unsigned k = 0; k < num; ++k) { // Floyd-Warshall
+			for (unsigned i = 0; i < num; ++i) {
+				float const dik(dist[i*num + k]);
+				if (dik == FLT_MAX) continue;
+
+				for (unsigned j = 0; j < num; ++j) {
+					float const d(dik + dist[k*num + j]);
+					if (d < dist[i*num + j]) {dist[i*num + j] = d; next[i*num + j] = next[i*num + k];}
+				}
+			}
+		}
+		for (unsigned i = 0; i < num; ++i) {road_networks[i].set_city_next_hops(vector<unsigned short>(next.begin() + i*num, next.begin() + (i+1)*num));}
 	}
 	void gen_parking_lots_and_place_objects(vector<car_t> &cars, bool have_cars) {
 		for (auto i = road_networks.begin(); i != road_networks.end(); ++i) {i->gen_parking_lots_and_place_objects(cars, have_cars);}
@@ -2725,6 +2952,7 @@ public:
 		//for (auto r = road_networks.begin(); r != road_networks.end(); ++r) {cout << r->get_traffic_density() << " ";} cout << endl;
 		for (auto r = road_networks.begin(); r != road_networks.end(); ++r) {r->next_frame();}
 		global_rn.next_frame(); // not needed since there are no 3/4-way intersections/stoplights?
+		if (city_params.enable_car_path_finding && (++route_frame_ix % ROUTE_UPDATE_FRAMES) == 0) {update_city_routes();} // reweight by recent traffic
 	}
 	void register_car_at_city(unsigned city_id) const {get_city(city_id).register_car();} // Note: must be const
 	
@@ -2782,7 +3010,7 @@ public:
 	
 	void update_car(car_t &car, rand_gen_t &rgen) const {
 		if (car.cur_city == NO_CITY_IX) return; // not in a city (in a garage), nothing to update
-		//update_car_seg_stats(car); // not needed - stats not yet used
+		if (city_params.enable_car_path_finding) {update_car_seg_stats(car);} // used for traffic-aware routing
 		get_car_rn(car).update_car(car, rgen, road_networks, global_rn);
 		if (city_params.enable_car_path_finding) {update_car_dest(car);}
 	}
@@ -5,6 +5,18 @@
 #include "3DWorld.h"
 #include "cobj_bsp_tree.h"
 
+// SIMD ray packet slab tests; uses the same instruction set detection as the terrain noise code
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define RAY_PACKET_SIMD_WIDTH 8
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RAY_PACKET_SIMD_WIDTH 4
+#else
+#define RAY_PACKET_SIMD_WIDTH 1
+#endif
+static_assert((RAY_PACKET_SIZE % RAY_PACKET_SIMD_WIDTH) == 0 && RAY_PACKET_SIZE <= 32, "RAY_PACKET_SIZE must be a multiple of the SIMD width and fit in a mask");
+
 
 unsigned const MAX_LEAF_SIZE = 2;
 float const POLY_TOLER       = 1.0E-6;
@@ -144,6 +156,67 @@ bool cobj_tree_base::node_ix_mgr::check_node(unsigned &nix) const {
 	return 1;
 }
 
+cobj_tree_base::ray_packet_t::ray_packet_t(point const *const p1_, point const *const p2_, unsigned ray_mask) {
+
+	for (unsigned i = 0; i < RAY_PACKET_SIZE; ++i) {
+		if (!(ray_mask & (1U << i))) { // unused lane: the [0, -1] interval never intersects anything
+			UNROLL_3X(p1[i_][i] = dinv[i_][i] = 0.0;)
+			tmax[i] = -1.0;
+			continue;
+		}
+		vector3d d(p2_[i] - p1_[i]);
+		d.invert(); // same zero handling as node_ix_mgr
+		UNROLL_3X(p1[i_][i] = p1_[i][i_]; dinv[i_][i] = d[i_];)
+		tmax[i] = 1.0;
+	}
+}
+
+// performance critical; conservative (inclusive) version of get_line_clip() for each ray in the packet, in the original [0, tmax] range of each ray
+unsigned cobj_tree_base::ray_packet_t::get_node_mask(float const d[3][2], unsigned ray_mask) const {
+
+	unsigned mask(0);
+#if RAY_PACKET_SIMD_WIDTH == 8
+	for (unsigned n = 0; n < RAY_PACKET_SIZE; n += 8) {
+		if (((ray_mask >> n) & 0xFF) == 0) continue;
+		__m256 tn(_mm256_setzero_ps()), tf(_mm256_loadu_ps(tmax + n));
+
+		for (unsigned e = 0; e < 3; ++e) {
+			__m256 const p(_mm256_loadu_ps(p1[e] + n)), di(_mm256_loadu_ps(dinv[e] + n));
+			__m256 const t1(_mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(d[e][0]), p), di)), t2(_mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(d[e][1]), p), di));
+			tn = _mm256_max_ps(tn, _mm256_min_ps(t1, t2));
+			tf = _mm256_min_ps(tf, _mm256_max_ps(t1, t2));
+		}
+		mask |= unsigned(_mm256_movemask_ps(_mm256_cmp_ps(tn, tf, _CMP_LE_OQ))) << n;
+	}
+#elif RAY_PACKET_SIMD_WIDTH == 4
+	for (unsigned n = 0; n < RAY_PACKET_SIZE; n += 4) {
+		if (((ray_mask >> n) & 0xF) == 0) continue;
+		__m128 tn(_mm_setzero_ps()), tf(_mm_loadu_ps(tmax + n));
+
+		for (unsigned e = 0; e < 3; ++e) {
+			__m128 const p(_mm_loadu_ps(p1[e] + n)), di(_mm_loadu_ps(dinv[e] + n));
+			__m128 const t1(_mm_mul_ps(_mm_sub_ps(_mm_set1_ps(d[e][0]), p), di)), t2(_mm_mul_ps(_mm_sub_ps(_mm_set1_ps(d[e][1]), p), di));
+			tn = _mm_max_ps(tn, _mm_min_ps(t1, t2));
+			tf = _mm_min_ps(tf, _mm_max_ps(t1, t2));
+		}
+		mask |= unsigned(_mm_movemask_ps(_mm_cmple_ps(tn, tf))) << n;
+	}
+#else
+	for (unsigned n = 0; n < RAY_PACKET_SIZE; ++n) {
+		if (!(ray_mask & (1U << n))) continue;
+		float tn(0.0), tf(tmax[n]);
+
+		for (unsigned e = 0; e < 3; ++e) {
+			float const t1((d[e][0] - p1[e][n])*dinv[e][n]), t2((d[e][1] - p1[e][n])*dinv[e][n]);
+			tn = max(tn, min(t1, t2));
+			tf = min(tf, max(t1, t2));
+		}
+		if (tn <= tf) {mask |= (1U << n);}
+	}
+#endif
+	return (mask & ray_mask);
+}
+
 
 // *** cobj_tree_simple_type_t ***
 
@@ -245,6 +318,7 @@ template<typename T> void cobj_tree_simple_type_t<T>::build_tree_top(bool verbos
 struct colored_cube_t;
 template class cobj_tree_simple_type_t<sphere_with_id_t>;
 template class cobj_tree_simple_type_t<colored_cube_t>;
+template class cobj_tree_simple_type_t<cube_with_ix_t>;
 
 
 // *** cobj_tree_tquads_t ***
@@ -317,6 +391,44 @@ bool cobj_tree_tquads_t::check_coll_line(point const &p1, point const &p2, point
 	return ret;
 }
 
+// batched version of check_coll_line() for up to RAY_PACKET_SIZE coherent rays; returns the mask of rays that hit; cpos, cnorm, and color are per-ray arrays
+unsigned cobj_tree_tquads_t::check_coll_line_packet(point const *const p1, point const *const p2, unsigned ray_mask, point *cpos, vector3d *cnorm, colorRGBA *color, bool exact) const {
+
+	if (nodes.empty() || ray_mask == 0) return 0;
+	unsigned hit_mask(0), active_mask(ray_mask); // rays are removed from active_mask once they're done
+	float t(0.0);
+	ray_packet_t packet(p1, p2, ray_mask);
+	unsigned const num_nodes((unsigned)nodes.size());
+
+	for (unsigned nix = 0; nix < num_nodes && active_mask;) {
+		tree_node const &n(nodes[nix]);
+		unsigned const node_mask(packet.get_node_mask(n.d, active_mask));
+
+		if (node_mask == 0) {
+			assert(n.next_node_id > nix);
+			nix = n.next_node_id; // failed the bbox test for all rays
+			continue;
+		}
+		++nix;
+
+		for (unsigned i = n.start; i < n.end; ++i) { // check leaves against each ray that intersects the node
+			coll_tquad const &tq(objects[i]);
+
+			for (unsigned r = 0; r < RAY_PACKET_SIZE; ++r) {
+				unsigned const bit(1U << r);
+				if (!(node_mask & active_mask & bit)) continue;
+				if (!tq.line_int_exact(p1[r], p2[r], t, cnorm[r], 0.0, packet.tmax[r])) continue;
+				if (color) {color[r] = tq.color.get_c4();}
+				cpos[r]   = p1[r] + (p2[r] - p1[r])*t;
+				hit_mask |= bit;
+				if (!exact) {active_mask &= ~bit; continue;} // first hit only
+				packet.tmax[r] = t;
+			}
+		}
+	}
+	return hit_mask;
+}
+
 
 // *** cobj_tree_sphere_t ***
 
@@ -396,6 +508,15 @@ void cobj_bvh_tree::clear() {
 
 	cobj_tree_base::clear();
 	cixs.resize(0);
+	leaves.clear();
+}
+
+
+void cobj_bvh_tree::build_leaves() { // must be called after cixs is reordered by the tree build
+
+	leaves.clear();
+	leaves.reserve(cixs.size());
+	for (auto i = cixs.begin(); i != cixs.end(); ++i) {leaves.emplace_back((*cobjs)[*i], *i);}
 }
 
 
@@ -432,6 +553,31 @@ void cobj_bvh_tree::build_tree_from_cixs(bool do_mt_build) {
 		nodes.resize(ptd.get_next_node_ix());
 	}
 	nodes[root].next_node_id = (unsigned)nodes.size();
+	build_leaves();
+}
+
+
+// shared leaf test for check_coll_line() and check_coll_line_packet(); tmax is relative to the original (unclipped) p1 and p2
+inline bool cobj_bvh_tree::check_leaf_line(unsigned i, point const &p1, point const &p2, float &t, vector3d &cnorm, float tmax, float max_alpha,
+	int ignore_cobj, int test_alpha, bool skip_non_drawn, bool skip_init_colls, bool skip_movable) const
+{
+	// Note: we test cobj against the original (unclipped) p1 and p2 so that t is correct
+	leaf_t const &leaf(leaves[i]);
+	if ((int)leaf.cix == ignore_cobj) return 0;
+
+	if (!leaf.may_move && leaf.type != COLL_POLYGON) { // early reject using the same bbox test as line_int_exact(); polygons may be thin and are skipped
+		float clip_tmin(0.0), clip_tmax(1.0);
+		if (!get_line_clip(p1, p2, leaf.d, clip_tmin, clip_tmax) || clip_tmin > tmax || clip_tmax < 0.0) return 0;
+	}
+	coll_obj const &c((*cobjs)[leaf.cix]);
+	if (!obj_ok(c))                  return 0;
+	if (skip_non_drawn  && !c.cp.might_be_drawn())                    return 0;
+	if (skip_movable    && c.is_movable())                            return 0;
+	if (test_alpha == 1 && c.is_semi_trans())                         return 0; // semi-transparent, can see through
+	if (test_alpha == 2 && c.cp.color.alpha <= max_alpha)             return 0; // lower alpha than an earlier object
+	if (test_alpha == 3 && c.cp.color.alpha < MIN_SHADOW_ALPHA)       return 0; // less than min alpha
+	if (skip_init_colls && c.contains_pt(p1) && c.contains_point(p1)) return 0;
+	return c.line_int_exact(p1, p2, t, cnorm, 0.0, tmax);
 }
 
 
@@ -441,7 +587,7 @@ bool cobj_bvh_tree::check_coll_line(point const &p1, point const &p2, point &cpo
 {
 	if (nodes.empty()) return 0;
 	bool ret(0);
-	float t(0.0), tmin(0.0), tmax(1.0), max_alpha(0.0);
+	float t(0.0), tmax(1.0), max_alpha(0.0);
 	node_ix_mgr nixm(nodes, p1, p2);
 	unsigned const num_nodes((unsigned)nodes.size());
 
@@ -450,23 +596,13 @@ bool cobj_bvh_tree::check_coll_line(point const &p1, point const &p2, point &cpo
 		if (!nixm.check_node(nix)) continue; // Note: modifies nix
 
 		for (unsigned i = n.start; i < n.end; ++i) { // check leaves
-			// Note: we test cobj against the original (unclipped) p1 and p2 so that t is correct
 			// Note: we probably don't need to return cnorm and cpos in inexact mode, but it shouldn't be too expensive to do so
-			if ((int)cixs[i] == ignore_cobj) continue;
-			coll_obj const &c(get_cobj(i));
-			if (!obj_ok(c))                  continue;
-			if (skip_non_drawn  && !c.cp.might_be_drawn())                    continue;
-			if (skip_movable    && c.is_movable())                            continue;
-			if (test_alpha == 1 && c.is_semi_trans())                         continue; // semi-transparent, can see through
-			if (test_alpha == 2 && c.cp.color.alpha <= max_alpha)             continue; // lower alpha than an earlier object
-			if (test_alpha == 3 && c.cp.color.alpha < MIN_SHADOW_ALPHA)       continue; // less than min alpha
-			if (skip_init_colls && c.contains_pt(p1) && c.contains_point(p1)) continue;
-			if (!c.line_int_exact(p1, p2, t, cnorm, tmin, tmax))              continue;
-			cindex = cixs[i];
+			if (!check_leaf_line(i, p1, p2, t, cnorm, tmax, max_alpha, ignore_cobj, test_alpha, skip_non_drawn, skip_init_colls, skip_movable)) continue;
+			cindex = leaves[i].cix;
 			cpos   = p1 + (p2 - p1)*t;
 			//if (c.type == COLL_POLYGON && dot_product((p2 - p1), c.norm) < 0.0) {} // back-facing polygon test
 			if (!exact && test_alpha != 2) return 1; // return first hit
-			max_alpha = c.cp.color.alpha; // we need all intersections to find the max alpha
+			max_alpha = (*cobjs)[cindex].cp.color.alpha; // we need all intersections to find the max alpha
 			nixm.dinv = vector3d(cpos - p1);
 			nixm.dinv.invert();
 			tmax = t;
@@ -476,6 +612,46 @@ bool cobj_bvh_tree::check_coll_line(point const &p1, point const &p2, point &cpo
 	return ret;
 }
 
+// batched version of check_coll_line() for up to RAY_PACKET_SIZE coherent rays, which returns the same per-ray results;
+// nodes are visited if any active ray intersects them, and leaves are tested against each of those rays in the same order as the single ray query;
+// returns the mask of rays that hit; cpos, cnorm, and cindex are per-ray arrays, where cindex is only written for rays that hit
+unsigned cobj_bvh_tree::check_coll_line_packet(point const *const p1, point const *const p2, unsigned ray_mask, point *cpos, vector3d *cnorm, int *cindex,
+	int ignore_cobj, bool exact, int test_alpha, bool skip_non_drawn, unsigned skip_init_colls_mask, bool skip_movable) const
+{
+	if (nodes.empty() || ray_mask == 0) return 0;
+	unsigned hit_mask(0), active_mask(ray_mask); // rays are removed from active_mask once they're done
+	float t(0.0), max_alpha[RAY_PACKET_SIZE] = {0.0};
+	ray_packet_t packet(p1, p2, ray_mask);
+	unsigned const num_nodes((unsigned)nodes.size());
+
+	for (unsigned nix = 0; nix < num_nodes && active_mask;) {
+		tree_node const &n(nodes[nix]);
+		unsigned const node_mask(packet.get_node_mask(n.d, active_mask));
+
+		if (node_mask == 0) {
+			assert(n.next_node_id > nix);
+			nix = n.next_node_id; // failed the bbox test for all rays
+			continue;
+		}
+		++nix;
+
+		for (unsigned i = n.start; i < n.end; ++i) { // check leaves against each ray that intersects the node
+			for (unsigned r = 0; r < RAY_PACKET_SIZE; ++r) {
+				unsigned const bit(1U << r);
+				if (!(node_mask & active_mask & bit)) continue;
+				if (!check_leaf_line(i, p1[r], p2[r], t, cnorm[r], packet.tmax[r], max_alpha[r], ignore_cobj, test_alpha, skip_non_drawn, ((skip_init_colls_mask & bit) != 0), skip_movable)) continue;
+				cindex[r] = leaves[i].cix;
+				cpos[r]   = p1[r] + (p2[r] - p1[r])*t;
+				hit_mask |= bit;
+				if (!exact && test_alpha != 2) {active_mask &= ~bit; continue;} // first hit only
+				max_alpha[r]   = (*cobjs)[cindex[r]].cp.color.alpha;
+				packet.tmax[r] = t;
+			}
+		}
+	}
+	return hit_mask;
+}
+
 
 bool cobj_bvh_tree::check_point_contained(point const &p, int &cindex) const {
 
@@ -490,6 +666,7 @@ bool cobj_bvh_tree::check_point_contained(point const &p, int &cindex) const {
 			continue;
 		}
 		for (unsigned i = n.start; i < n.end; ++i) { // check leaves
+			if (!get_leaf_bcube(i).contains_pt(p)) continue;
 			coll_obj const &c(get_cobj(i));
 			if (c.contains_point(p) && obj_ok(c)) {cindex = cixs[i]; return 1;}
 		}
@@ -514,10 +691,11 @@ void cobj_bvh_tree::get_intersecting_cobjs(cube_t const &cube, vector<unsigned>
 			continue;
 		}
 		for (unsigned i = n.start; i < n.end; ++i) { // check leaves
-			if ((int)cixs[i] == ignore_cobj) continue;
+			if ((int)leaves[i].cix == ignore_cobj) continue;
+			if (!cube.intersects(get_leaf_bcube(i), toler)) continue;
 			coll_obj const &c(get_cobj(i));
 			if (check_ccounter && c.counter == cobj_counter) continue;
-			if (!cube.intersects(c, toler) || !obj_ok(c))    continue;
+			if (!obj_ok(c)) continue;
 			if (id_for_cobj_int >= 0 && coll_objects[id_for_cobj_int].intersects_cobj(c, toler) != 1) continue;
 			cobjs.push_back(cixs[i]);
 		}
@@ -564,19 +742,20 @@ void cobj_bvh_tree::get_coll_line_cobjs(point const &pos1, point const &pos2, in
 			
 		for (unsigned i = n.start; i < n.end; ++i) { // check leaves
 			if ((int)cixs[i] == ignore_cobj) continue;
-			coll_obj const &c(get_cobj(i));
-			if (!obj_ok(c)) continue;
 			
-			if (occluders_only) {
-				if (!c.is_big_occluder()) continue;
-				
+			if (occluders_only) { // test bbox first, since it's in the leaves array
+				cube_t const &leaf_bcube(get_leaf_bcube(i));
+
 				if (do_expand) {
-					cube_t bcube(c);
+					cube_t bcube(leaf_bcube);
 					bcube.expand_by(GET_OCC_EXPAND);
 					if (!nixm.get_line_clip_func(nixm.p1, nixm.dinv, bcube.d)) continue;
 				}
-				else if (!nixm.get_line_clip_func(nixm.p1, nixm.dinv, c.d)) continue;
+				else if (!nixm.get_line_clip_func(nixm.p1, nixm.dinv, leaf_bcube.d)) continue;
 			}
+			coll_obj const &c(get_cobj(i));
+			if (!obj_ok(c)) continue;
+			if (occluders_only && !c.is_big_occluder()) continue;
 			if (cqc && !cqc->register_cobj(c)) return; // done
 			if (cobjs) {cobjs->push_back(cixs[i]);}
 		}
@@ -603,7 +782,7 @@ void cobj_bvh_tree::get_coll_sphere_cobjs(point const &center, float radius, int
 		++nix;
 		
 		for (unsigned i = n.start; i < n.end; ++i) { // check leaves
-			if ((int)cixs[i] != ignore_cobj && get_cobj(i).intersects(bcube)) vcd.check_cobj(cixs[i]);
+			if ((int)cixs[i] != ignore_cobj && get_leaf_bcube(i).intersects(bcube)) vcd.check_cobj(cixs[i]);
 		}
 	}
 }
@@ -805,6 +984,26 @@ bool check_coll_line_exact_tree(point const &p1, point const &p2, point &cpos, v
 	return ret;
 }
 
+// batched version of check_coll_line_exact_tree() for static cobjs and up to RAY_PACKET_SIZE coherent rays; returns the mask of rays that hit;
+// the static moving cobj tree and voxels are small or have their own acceleration structure, so they're still tested per-ray
+unsigned check_coll_line_exact_tree_packet(point const *const p1, point const *const p2, unsigned ray_mask, point *cpos, vector3d *cnorm, int *cindex,
+	int ignore_cobj, int test_alpha, bool include_voxels, unsigned skip_init_colls_mask, bool no_stat_moving)
+{
+	for (unsigned r = 0; r < RAY_PACKET_SIZE; ++r) {cindex[r] = -1;}
+	unsigned hit_mask(get_tree(0).check_coll_line_packet(p1, p2, ray_mask, cpos, cnorm, cindex, ignore_cobj, 1, test_alpha, 0, skip_init_colls_mask, 0));
+
+	for (unsigned r = 0; r < RAY_PACKET_SIZE; ++r) {
+		unsigned const bit(1U << r);
+		if (!(ray_mask & bit)) continue;
+		bool const skip_init_colls((skip_init_colls_mask & bit) != 0);
+		bool ret((hit_mask & bit) != 0);
+		if (!no_stat_moving) {ret |= cobj_tree_static_moving.check_coll_line(p1[r], (ret ? cpos[r] : p2[r]), cpos[r], cnorm[r], cindex[r], ignore_cobj, 1, test_alpha, 0, skip_init_colls, 0);}
+		if (include_voxels ) {ret |= check_voxel_coll_line(p1[r], (ret ? cpos[r] : p2[r]), cpos[r], cnorm[r], cindex[r], ignore_cobj, 1);}
+		if (ret) {hit_mask |= bit;}
+	}
+	return hit_mask;
+}
+
 // can use with snow shadows, grass shadows, tree leaf shadows
 bool check_coll_line_tree(point const &p1, point const &p2, int &cindex, int ignore_cobj, bool dynamic,
 	int test_alpha, bool skip_non_drawn, bool include_voxels, bool skip_init_colls, bool skip_movable)
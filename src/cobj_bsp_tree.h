@@ -6,6 +6,8 @@
 
 #include "physics_objects.h"
 
+unsigned const RAY_PACKET_SIZE = 8; // max rays per packet query; must be a multiple of the SIMD width and <= 32 (one bit per ray in a mask)
+
 
 class cobj_tree_base {
 
@@ -40,6 +42,14 @@ protected:
 		bool (* get_line_clip_func) (point const &p1, vector3d const &dinv, float const d[3][2]); // function pointer
 	};
 
+	// SoA form of a packet of coherent rays for batched traversal; rays are identified by their bit in ray_mask
+	struct ray_packet_t {
+		float p1[3][RAY_PACKET_SIZE], dinv[3][RAY_PACKET_SIZE], tmax[RAY_PACKET_SIZE];
+
+		ray_packet_t(point const *const p1_, point const *const p2_, unsigned ray_mask);
+		unsigned get_node_mask(float const d[3][2], unsigned ray_mask) const; // returns the subset of ray_mask that may intersect the cube
+	};
+
 public:
 	cobj_tree_base() : max_depth(0), max_leaf_count(0), num_leaf_nodes(0) {}
 	bool is_empty() const {return nodes.empty();}
@@ -84,6 +94,7 @@ public:
 	bool check_coll_line(point const &p1, point const &p2, point &cpos, vector3d &cnorm, colorRGBA &color, bool exact) const {
 		return check_coll_line(p1, p2, cpos, cnorm, &color, NULL, -1, exact);
 	}
+	unsigned check_coll_line_packet(point const *const p1, point const *const p2, unsigned ray_mask, point *cpos, vector3d *cnorm, colorRGBA *color, bool exact) const;
 };
 
 
@@ -107,8 +118,17 @@ public:
 
 class cobj_bvh_tree : public cobj_tree_base {
 
+	// cache-dense copy of the per-cobj data needed for leaf bbox tests, in the same order as cixs, so that queries don't touch the (much larger)
+	// coll_obj until its bbox passes; valid until the tree is rebuilt, except for cobjs that can move, which are tested directly
+	struct leaf_t : public cube_t { // size = 32
+		unsigned cix;
+		char type;
+		bool may_move;
+		leaf_t(coll_obj const &c, unsigned cix_) : cube_t(c), cix(cix_), type(c.type), may_move(c.may_be_dynamic()) {}
+	};
 	coll_obj_group const *cobjs;
 	vector<unsigned> cixs;
+	vector<leaf_t> leaves;
 	bool is_static, is_dynamic, occluders_only, cubes_only, inc_voxel_cobjs;
 
 	struct per_thread_data {
@@ -125,10 +145,14 @@ class cobj_bvh_tree : public cobj_tree_base {
 
 	void add_cobj(unsigned ix) {if (obj_ok((*cobjs)[ix])) {cixs.push_back(ix);}}
 	coll_obj const &get_cobj(unsigned ix) const {return (*cobjs)[cixs[ix]];}
+	cube_t const &get_leaf_bcube(unsigned ix) const {leaf_t const &leaf(leaves[ix]); return (leaf.may_move ? (cube_t const &)(*cobjs)[leaf.cix] : leaf);}
 	bool create_cixs();
+	void build_leaves();
 	void calc_node_bbox(tree_node &n) const;
 	void build_tree_top_level_omp();
 	void build_tree(unsigned nix, unsigned skip_dims, unsigned depth, per_thread_data &ptd);
+	bool check_leaf_line(unsigned i, point const &p1, point const &p2, float &t, vector3d &cnorm, float tmax, float max_alpha, int ignore_cobj,
+		int test_alpha, bool skip_non_drawn, bool skip_init_colls, bool skip_movable) const;
 
 	bool obj_ok(coll_obj const &c) const {
 		return (((is_static && c.status == COLL_STATIC) || (is_dynamic && c.status == COLL_DYNAMIC) || (!is_static && !is_dynamic)) &&
@@ -147,6 +171,8 @@ public:
 	void build_tree_from_cixs(bool do_mt_build);
 	bool check_coll_line(point const &p1, point const &p2, point &cpos, vector3d &cnorm, int &cindex, int ignore_cobj,
 		bool exact, int test_alpha, bool skip_non_drawn, bool skip_init_colls, bool skip_movable) const;
+	unsigned check_coll_line_packet(point const *const p1, point const *const p2, unsigned ray_mask, point *cpos, vector3d *cnorm, int *cindex, int ignore_cobj,
+		bool exact, int test_alpha, bool skip_non_drawn, unsigned skip_init_colls_mask, bool skip_movable) const;
 	bool check_point_contained(point const &p, int &cindex) const;
 	void get_intersecting_cobjs(cube_t const &cube, vector<unsigned> &cobjs, int ignore_cobj, float toler, bool check_ccounter, int id_for_cobj_int) const;
 	bool is_cobj_contained(point const &viewer, point const *const pts, unsigned npts, int ignore_cobj, int &cobj) const;
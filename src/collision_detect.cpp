@@ -1457,7 +1457,7 @@ void vert_coll_detector::check_cobj_intersect(int index, bool enable_cfs, bool p
 				assert(TIMESTEP > 0.0);
 				float friction_adj(friction);
 				if (norm.z > 0.25 && (cobj.is_wet() || cobj.is_snow_cov())) {friction_adj *= 0.25;} // slippery when wet, icy, or snow covered
-				if (friction_adj > 0.0) {obj.velocity *= (1.0 - min(1.0f, (tstep/TIMESTEP)*friction_adj));} // apply kinetic friction
+				if (friction_adj > 0.0) {obj.velocity *= (1.0 - min(1.0f, step.get_tstep_scale()*friction_adj));} // apply kinetic friction
 				//for (unsigned i = 0; i < 3; ++i) {obj.velocity[i] *= (1.0 - fabs(norm[i]));} // norm must be normalized
 				orthogonalize_dir(obj.velocity, norm, obj.velocity, 0); // rolling friction model
 			}
@@ -1467,18 +1467,24 @@ void vert_coll_detector::check_cobj_intersect(int index, bool enable_cfs, bool p
 		}
 		else {
 			already_bounced = 1;
-			if (otype.flags & OBJ_IS_CYLIN) {obj.init_dir.x += PI*signed_rand_float();}
+			if (otype.flags & OBJ_IS_CYLIN) {obj.init_dir.x += PI*phys_signed_rand_float();}
 			
 			if (cobj.status == COLL_STATIC) { // only static collisions to avoid camera/smiley bounce sounds
+				point const p(obj.pos);
+
 				if (type == BALL) {
 					float const vmag(obj.velocity.mag());
-					if (vmag > 1.0) {gen_sound(SOUND_BOING, obj.pos, min(1.0, 0.1*vmag));}
+					if (vmag > 1.0) {run_or_defer_phys([p, vmag]() {gen_sound(SOUND_BOING, p, min(1.0, 0.1*vmag));});}
 				}
 				else if (type == SAWBLADE) {
-					gen_sound(SOUND_RICOCHET, obj.pos, 1.0, 0.5);
-					if (cobj.cp.elastic >= 0.5) {gen_particles(obj.pos, (1 + (rand()&3)), 0.5, 1);} // create spark particles
+					bool const sparks(cobj.cp.elastic >= 0.5);
+
+					run_or_defer_phys([p, sparks]() {
+						gen_sound(SOUND_RICOCHET, p, 1.0, 0.5);
+						if (sparks) {gen_particles(p, (1 + (rand()&3)), 0.5, 1);} // create spark particles
+					});
 				}
-				else if (type == SHELLC && obj.direction == 0) {gen_sound(SOUND_SHELLC, obj.pos, 0.1, 1.0);} // M16
+				else if (type == SHELLC && obj.direction == 0) {run_or_defer_phys([p]() {gen_sound(SOUND_SHELLC, p, 0.1, 1.0);});} // M16
 			}
 		}
 	}
@@ -1505,9 +1511,14 @@ void vert_coll_detector::check_cobj_intersect(int index, bool enable_cfs, bool p
 	if (do_coll_funcs && enable_cfs && cobj.cp.coll_func != NULL && type != TELEPORTER) { // call collision function
 		float energy_mult(1.0);
 		if (type == PLASMA) {energy_mult *= obj.init_dir.x*obj.init_dir.x;} // size squared
-		float const energy(get_coll_energy(v_old, obj.velocity, otype.mass));
-			
-		if (!cobj.cp.coll_func(cobj.cp.cf_index, obj_index, v_old, obj.pos, energy_mult*energy, type)) { // invalid collision - reset local collision
+		float const energy(energy_mult*get_coll_energy(v_old, obj.velocity, otype.mass));
+		collision_func const coll_func(cobj.cp.coll_func);
+		int const cf_index(cobj.cp.cf_index), oix(obj_index), otype_ix(type);
+		point const cpos(obj.pos);
+		// when deferred, the collision is assumed to be valid; objects that can make invalid collisions aren't advanced in parallel
+		bool const deferred(defer_phys_side_effect([=]() {coll_func(cf_index, oix, v_old, cpos, energy, otype_ix);}));
+
+		if (!deferred && !coll_func(cf_index, obj_index, v_old, obj.pos, energy, type)) { // invalid collision - reset local collision
 			lcoll = 0;
 			obj   = temp;
 			return;
@@ -1516,12 +1527,16 @@ void vert_coll_detector::check_cobj_intersect(int index, bool enable_cfs, bool p
 	if (!(otype.flags & OBJ_IS_DROP) && type != LEAF && type != CHARRED && type != SHRAPNEL &&
 		type != BEAM && type != LASER && type != FIRE && type != SMOKE && type != PARTICLE && type != WAYPOINT)
 	{
-		coll_objects[index].register_coll(TICKS_PER_SECOND, IMPACT);
+		run_or_defer_phys([index]() {coll_objects[index].register_coll(TICKS_PER_SECOND, IMPACT);});
 	}
 	obj.verify_data();
 		
 	if (!obj.disabled() && (otype.flags & EXPL_ON_COLL)) {
-		gen_explosion_decal((decal_pos - norm*o_radius), o_radius, norm, cobj, (cdir >> 1), ((type == FREEZE_BOMB) ? ICE_C : BLACK));
+		point const dpos(decal_pos - norm*o_radius);
+		float const r(o_radius);
+		unsigned const dim(cdir >> 1);
+		colorRGBA const color((type == FREEZE_BOMB) ? ICE_C : BLACK);
+		run_or_defer_phys([=]() {gen_explosion_decal(dpos, r, norm, coll_objects[index], dim, color);});
 		obj.disable();
 	}
 	if (!obj.disabled()) {
@@ -1530,25 +1545,26 @@ void vert_coll_detector::check_cobj_intersect(int index, bool enable_cfs, bool p
 		colorRGBA color;
 		tex_range_t tex_range;
 
-		if (type == BLOOD && (fabs(obj.velocity.z) > 1.0 || v0.z > 1.0) && !(obj.flags & STATIC_COBJ_COLL) && (rand()&1) == 0) { // only when on a not-bottom surface
+		if (type == BLOOD && (fabs(obj.velocity.z) > 1.0 || v0.z > 1.0) && !(obj.flags & STATIC_COBJ_COLL) && (phys_rand()&1) == 0) { // only when on a not-bottom surface
 			blood_tid = BLUR_CENT_TEX; // blood droplet splat
 			color     = BLOOD_C;
 			sz_scale  = 2.0;
 		}
 		else if (type == CHUNK && !(obj.flags & (TYPE_FLAG | FROZEN_FLAG)) && (fabs(obj.velocity.z) > 1.0 || fabs(v0.z) > 1.0)) {
 			blood_tid = BLOOD_SPLAT_TEX; // bloody chunk splat
-			tex_range = tex_range_t::from_atlas((rand()&1), (rand()&1), 2, 2); // 2x2 texture atlas
+			tex_range = tex_range_t::from_atlas((phys_rand()&1), (phys_rand()&1), 2, 2); // 2x2 texture atlas
 			color     = WHITE; // color is in the texture
 			sz_scale  = 4.0;
 		}
 		if (blood_tid >= 0 && !(obj.flags & OBJ_COLLIDED)) { // only on first collision
-			float const sz(sz_scale*o_radius*rand_uniform(0.6, 1.4));
+			float const sz(sz_scale*o_radius*phys_rand_uniform(0.6, 1.4));
 			
 			if (decal_contained_in_cobj(cobj, decal_pos, norm, sz, (cdir >> 1))) {
-				gen_decal((decal_pos - norm*o_radius), sz, norm, blood_tid, index, color, 0, (blood_tid == BLOOD_SPLAT_TEX), 60*TICKS_PER_SECOND, 1.0, tex_range);
+				point const dpos(decal_pos - norm*o_radius);
+				run_or_defer_phys([=]() {gen_decal(dpos, sz, norm, blood_tid, index, color, 0, (blood_tid == BLOOD_SPLAT_TEX), 60*TICKS_PER_SECOND, 1.0, tex_range);});
 			}
 		}
-		if (!(obj.flags & FROZEN_FLAG)) {deform_obj(obj, norm, v0);} // skip deformation of frozen chunks
+		if (!(obj.flags & FROZEN_FLAG)) {deform_obj(obj, norm, v0, step.tstep);} // skip deformation of frozen chunks
 	}
 	if (cnorm != NULL) *cnorm = norm;
 	obj.flags |= OBJ_COLLIDED;
@@ -1571,7 +1587,7 @@ void vert_coll_detector::init_reset_pos() {
 
 int vert_coll_detector::check_coll() {
 
-	pold -= obj.velocity*tstep;
+	pold -= obj.velocity*step.tstep;
 	assert(!is_nan(pold));
 	assert(type >= 0 && type < NUM_TOT_OBJS);
 	o_radius = obj.get_true_radius();
@@ -1594,10 +1610,12 @@ int vert_coll_detector::check_coll() {
 
 // 0 = no vert coll, 1 = X coll, 2 = Y coll, 3 = X + Y coll
 int dwobject::check_vert_collision(int obj_index, int do_coll_funcs, int iter, vector3d *cnorm,
-	vector3d const &mdir, bool skip_dynamic, bool only_drawn, int only_cobj, bool skip_movable)
+	vector3d const &mdir, bool skip_dynamic, bool only_drawn, int only_cobj, bool skip_movable, phys_step_t const *const step)
 {
+	phys_step_t const cur_step(step ? *step : get_global_phys_step());
+
 	if (world_mode == WMODE_INF_TERRAIN) {
-		point const p_last(pos - velocity*tstep);
+		point const p_last(pos - velocity*cur_step.tstep);
 		float const o_radius(get_true_radius());
 		vector3d cnorm(plus_z);
 		bool const check_interior(PLAYER_CAN_ENTER_BUILDINGS && type == CAMERA);
@@ -1610,16 +1628,19 @@ int dwobject::check_vert_collision(int obj_index, int do_coll_funcs, int iter, v
 			if (friction < STICK_THRESHOLD) {
 				if (otype.elasticity == 0.0 || (flags & IS_CUBE_FLAG) || !object_bounce(3, cnorm, 0.8, 0.0)) { // elasticity is hard-coded to 0.8 here
 					if (type != DYNAM_PART && velocity != zero_vector) {
-						if (friction > 0.0) {velocity *= (1.0 - min(1.0f, (tstep/TIMESTEP)*friction));} // apply kinetic friction
+						if (friction > 0.0) {velocity *= (1.0 - min(1.0f, cur_step.get_tstep_scale()*friction));} // apply kinetic friction
 						orthogonalize_dir(velocity, cnorm, velocity, 0); // rolling friction model
 					}
 				}
 				else { // play bounce sounds
+					point const p(pos);
+					float const vmag(velocity.mag());
+
 					if (type == BALL) {
-						if (velocity.mag() > 1.0) {gen_sound(SOUND_BOING, pos, min(1.0, 0.1*velocity.mag()));}
+						if (vmag > 1.0) {run_or_defer_phys([p, vmag]() {gen_sound(SOUND_BOING, p, min(1.0, 0.1*vmag));});}
 					}
-					else if (type == SAWBLADE) {gen_sound(SOUND_RICOCHET, pos, 1.0, 0.5);}
-					else if (type == SHELLC && direction == 0) {gen_sound(SOUND_SHELLC, pos, 0.1, 1.0);} // M16
+					else if (type == SAWBLADE) {run_or_defer_phys([p]() {gen_sound(SOUND_RICOCHET, p, 1.0, 0.5);});}
+					else if (type == SHELLC && direction == 0) {run_or_defer_phys([p]() {gen_sound(SOUND_SHELLC, p, 0.1, 1.0);});} // M16
 				}
 			}
 			else { // sticks
@@ -1633,7 +1654,7 @@ int dwobject::check_vert_collision(int obj_index, int do_coll_funcs, int iter, v
 		return 0; // no vert coll
 	}
 	if (world_mode != WMODE_GROUND) return 0;
-	vert_coll_detector vcd(*this, obj_index, do_coll_funcs, iter, cnorm, mdir, skip_dynamic, only_drawn, only_cobj, skip_movable);
+	vert_coll_detector vcd(*this, obj_index, do_coll_funcs, iter, cnorm, cur_step, mdir, skip_dynamic, only_drawn, only_cobj, skip_movable);
 	return vcd.check_coll();
 }
 
@@ -5,12 +5,41 @@
 #include "3DWorld.h"
 #include "mesh.h"
 #include <cfloat> // for FLT_EPSILON
+#include <unordered_map>
 
 
 extern float erode_amount, water_plane_z;
 
+unsigned const EROSION_BATCH_SIZE = 1024; // droplets per batch; must not depend on the thread count, or results won't be repeatable
+
+
+// height changes made by the current droplet of one thread; reads see the shared heightmap from the start of the batch plus these changes;
+// stored sparsely since a droplet only touches cells near its path, so memory doesn't scale with heightmap size times thread count
+struct erosion_thread_state_t {
+	std::unordered_map<unsigned, unsigned> ix_map; // heightmap index => index into deltas
+	vector<pair<unsigned, float> > deltas; // {heightmap index, delta}, in the order the cells were first modified
+
+	float get(unsigned ix) const {
+		if (ix_map.empty()) return 0.0; // common case at the start of a droplet
+		auto it(ix_map.find(ix));
+		return ((it == ix_map.end()) ? 0.0 : deltas[it->second].second);
+	}
+	void add(unsigned ix, float d) {
+		auto ret(ix_map.emplace(ix, deltas.size()));
+		if (ret.second) {deltas.emplace_back(ix, 0.0);} // first change to this cell
+		deltas[ret.first->second].second += d;
+	}
+	void flush(vector<pair<unsigned, float> > &out) { // moves this droplet's changes to out, which must be empty
+		assert(out.empty());
+		out.swap(deltas); // reuses the capacity of out for the next droplet
+		ix_map.clear();
+	}
+};
+
 
 // see http://ranmantaru.com/blog/2011/10/08/water-erosion-on-heightmap-terrain/
+// Droplets are simulated in parallel in fixed size batches. Each droplet sees the heightmap as of the start of its batch plus its own changes,
+// and the changes are applied in droplet order at the end of the batch, so the result is the same for any number of threads.
 void apply_erosion(float *heightmap, int xsize, int ysize, float min_zval, unsigned num_iters) {
 
 	if (num_iters == 0 || erode_amount <= 0.0) return; // erosion disabled
@@ -24,8 +53,9 @@ void apply_erosion(float *heightmap, int xsize, int ysize, float min_zval, unsig
 	float const Kq=10, Kw=0.001f, Kr=0.9f, Kd=0.02f, Ki=0.1f, minSlope=0.05f, g=20, Kg=g*2;
 	int const PAD(4), NX(xsize+2*PAD), NY(ysize+2*PAD);
 	unsigned const MAX_PATH_LEN(4*NX*NY);
-	vector<vector2d> erosion(NX*NY, vector2d(0.0, 0.0));
 	vector<float> mh_padded(NX*NY);
+	vector<erosion_thread_state_t> thread_state(omp_get_max_threads_3dw());
+	vector<vector<pair<unsigned, float> > > droplet_deltas(min(num_iters, EROSION_BATCH_SIZE));
 
 	// pad mesh by 1 unit on each side to create a buffer of trash around the edges that can be discarded
 	for (int y = 0; y < NY; ++y) {
@@ -37,13 +67,12 @@ void apply_erosion(float *heightmap, int xsize, int ysize, float min_zval, unsig
 	}
 
 #define HMAP_INDEX(x, y) (NX*max(min(y, NY-1), 0) + max(min(x, NX-1), 0))
-#define HMAP(x, y) mh_padded[HMAP_INDEX(x, y)]
+#define HMAP_IX(ix) (mh_padded[ix] + ts.get(ix))
+#define HMAP(x, y) HMAP_IX(HMAP_INDEX(x, y))
 
 #define DEPOSIT_AT(X, Z, W) { \
 	float const delta = ds*erode_amount*(W); \
-	unsigned const ix(HMAP_INDEX((X), (Z))); \
-	erosion[ix].y += delta; \
-	if (!(X < 0 || Z < 0 || X >= NX || Z >= NY)) {mh_padded[ix] += delta;} \
+	if (!(X < 0 || Z < 0 || X >= NX || Z >= NY)) {ts.add(HMAP_INDEX((X), (Z)), delta);} \
 }
 
 #define DEPOSIT(H) \
@@ -53,106 +82,109 @@ void apply_erosion(float *heightmap, int xsize, int ysize, float min_zval, unsig
 	DEPOSIT_AT(xi+1, zi+1,    xf *   zf ) \
 	(H)+=ds;
 
-#define ERODE(X, Z, W) { \
-	float const delta=ds*erode_amount*(W); \
-	unsigned const ix(HMAP_INDEX((X), (Z))); \
-	mh_padded[ix]-=delta; \
-	vector2d &e=erosion[ix]; \
-	float r=e.x, d=e.y; \
-	if (delta<=d) {d-=delta;} else {r+=delta-d; d=0;} \
-	e.x=r; e.y=d; \
-}
+#define ERODE(X, Z, W) {ts.add(HMAP_INDEX((X), (Z)), -ds*erode_amount*(W));}
+
+	for (unsigned batch_start = 0; batch_start < num_iters; batch_start += EROSION_BATCH_SIZE) {
+		unsigned const batch_end(min(num_iters, batch_start+EROSION_BATCH_SIZE));
 
 #pragma omp parallel for schedule(dynamic,1)
-	for (int iter=0; iter < (int)num_iters; ++iter) {
-		rand_gen_t rgen;
-		rgen.set_state(iter+11, 79*iter+121);
-		int xi = PAD + (rgen.rand()%xsize);
-		int zi = PAD + (rgen.rand()%ysize);
-		float xp=xi, zp=zi, xf=0, zf=0, s=0, v=0, w=1, dx=0, dz=0;
-		float h=HMAP(xi, zi), h00=h, h10=HMAP(xi+1, zi), h01=HMAP(xi, zi+1), h11=HMAP(xi+1, zi+1);
-
-		unsigned numMoves=0;
-		for (; numMoves<MAX_PATH_LEN; ++numMoves) {
-			// calc gradient
-			float gx=h00+h01-h10-h11, gz=h00+h10-h01-h11;
-			// calc next pos
-			dx=(dx-gx)*Ki+gx;
-			dz=(dz-gz)*Ki+gz;
-
-			float dl=sqrtf(dx*dx+dz*dz);
-			if (dl<=FLT_EPSILON) { // pick random dir
-				float a=rgen.rand_float()*TWO_PI;
-				dx=cosf(a); dz=sinf(a);
-			}
-			else {
-				dx/=dl; dz/=dl;
-			}
-			float nxp=xp+dx, nzp=zp+dz;
-			// sample next height
-			int nxi=floor(nxp), nzi=floor(nzp);
-			float nxf=nxp-nxi, nzf=nzp-nzi;
-			float nh00=HMAP(nxi, nzi), nh10=HMAP(nxi+1, nzi), nh01=HMAP(nxi, nzi+1), nh11=HMAP(nxi+1, nzi+1);
-			float nh=(nh00*(1-nxf)+nh10*nxf)*(1-nzf)+(nh01*(1-nxf)+nh11*nxf)*nzf;
-			// adjust by HALF_DXY = average mesh texel size - this is river depth
-			if (max(max(nh00, nh10), max(nh01, nh11)) < water_plane_z - HALF_DXY) break; // reached ocean water, stop and ignore sediment
-
-			// if higher than current, try to deposit sediment up to neighbour height
-			bool const outside(xi < 0 || zi < 0 || xi >= NX || zi >= NY);
-			if (nh>=h || outside) {
-				float ds=(nh-h)+0.001f;
-
-				if (ds>=s || outside) {
-					ds=s;
-					DEPOSIT(h) // deposit all sediment
-					s=0;
-					break; // stop
+		for (int iter=batch_start; iter < (int)batch_end; ++iter) {
+			erosion_thread_state_t &ts(thread_state[omp_get_thread_num_3dw()]);
+			rand_gen_t rgen;
+			rgen.set_state(iter+11, 79*iter+121);
+			int xi = PAD + (rgen.rand()%xsize);
+			int zi = PAD + (rgen.rand()%ysize);
+			float xp=xi, zp=zi, xf=0, zf=0, s=0, v=0, w=1, dx=0, dz=0;
+			float h=HMAP(xi, zi), h00=h, h10=HMAP(xi+1, zi), h01=HMAP(xi, zi+1), h11=HMAP(xi+1, zi+1);
+
+			unsigned numMoves=0;
+			for (; numMoves<MAX_PATH_LEN; ++numMoves) {
+				// calc gradient
+				float gx=h00+h01-h10-h11, gz=h00+h10-h01-h11;
+				// calc next pos
+				dx=(dx-gx)*Ki+gx;
+				dz=(dz-gz)*Ki+gz;
+
+				float dl=sqrtf(dx*dx+dz*dz);
+				if (dl<=FLT_EPSILON) { // pick random dir
+					float a=rgen.rand_float()*TWO_PI;
+					dx=cosf(a); dz=sinf(a);
 				}
-				DEPOSIT(h)
-				s-=ds;
-				v=0;
-			}
-			// compute transport capacity
-			float dh=h-nh;
-			float slope=dh;
-			//float slope=dh/sqrtf(dh*dh+1);
-			float q=max(slope, minSlope)*v*w*Kq;
-
-			// deposit/erode (don't erode more than dh)
-			float ds=s-q;
-			if (ds>=0) { // deposit
-				ds*=Kd;
-				//ds=minval(ds, 1.0f);
-				DEPOSIT(dh)
-				s-=ds;
-			}
-			else { // erode
-				ds*=-Kr;
-				ds=min(ds, dh*0.99f);
-				ds*=((get_bare_ls_tid(nh) == ROCK_TEX) ? 0.5 : 2.0); // rock erodes slower than dirt/sand
-
-				for (int z=zi-1; z<=zi+2; ++z) {
-					float zo=z-zp, zo2=zo*zo;
-
-					for (int x=xi-1; x<=xi+2; ++x) {
-						float xo=x-xp;
-						float w=1-(xo*xo+zo2)*0.25f;
-						if (w<=0) continue;
-						w*=0.1591549430918953f;
-						ERODE(x, z, w)
+				else {
+					dx/=dl; dz/=dl;
+				}
+				float nxp=xp+dx, nzp=zp+dz;
+				// sample next height
+				int nxi=floor(nxp), nzi=floor(nzp);
+				float nxf=nxp-nxi, nzf=nzp-nzi;
+				float nh00=HMAP(nxi, nzi), nh10=HMAP(nxi+1, nzi), nh01=HMAP(nxi, nzi+1), nh11=HMAP(nxi+1, nzi+1);
+				float nh=(nh00*(1-nxf)+nh10*nxf)*(1-nzf)+(nh01*(1-nxf)+nh11*nxf)*nzf;
+				// adjust by HALF_DXY = average mesh texel size - this is river depth
+				if (max(max(nh00, nh10), max(nh01, nh11)) < water_plane_z - HALF_DXY) break; // reached ocean water, stop and ignore sediment
+
+				// if higher than current, try to deposit sediment up to neighbour height
+				bool const outside(xi < 0 || zi < 0 || xi >= NX || zi >= NY);
+				if (nh>=h || outside) {
+					float ds=(nh-h)+0.001f;
+
+					if (ds>=s || outside) {
+						ds=s;
+						DEPOSIT(h) // deposit all sediment
+						s=0;
+						break; // stop
 					}
+					DEPOSIT(h)
+					s-=ds;
+					v=0;
+				}
+				// compute transport capacity
+				float dh=h-nh;
+				float slope=dh;
+				//float slope=dh/sqrtf(dh*dh+1);
+				float q=max(slope, minSlope)*v*w*Kq;
+
+				// deposit/erode (don't erode more than dh)
+				float ds=s-q;
+				if (ds>=0) { // deposit
+					ds*=Kd;
+					//ds=minval(ds, 1.0f);
+					DEPOSIT(dh)
+					s-=ds;
 				}
-				dh-=ds;
-				s+=ds;
-			}
-			// move to the neighbor
-			v=sqrtf(v*v+Kg*dh);
-			w*=1-Kw;
-			xp=nxp; zp=nzp; xi=nxi; zi=nzi; xf=nxf; zf=nzf;
-			h=nh; h00=nh00; h10=nh10; h01=nh01; h11=nh11;
-		} // for numMoves
-		if (numMoves>=MAX_PATH_LEN) {cout << "droplet path is too long: " << iter << endl;}
-	} // for iter
+				else { // erode
+					ds*=-Kr;
+					ds=min(ds, dh*0.99f);
+					ds*=((get_bare_ls_tid(nh) == ROCK_TEX) ? 0.5 : 2.0); // rock erodes slower than dirt/sand
+
+					for (int z=zi-1; z<=zi+2; ++z) {
+						float zo=z-zp, zo2=zo*zo;
+
+						for (int x=xi-1; x<=xi+2; ++x) {
+							float xo=x-xp;
+							float w=1-(xo*xo+zo2)*0.25f;
+							if (w<=0) continue;
+							w*=0.1591549430918953f;
+							ERODE(x, z, w)
+						}
+					}
+					dh-=ds;
+					s+=ds;
+				}
+				// move to the neighbor
+				v=sqrtf(v*v+Kg*dh);
+				w*=1-Kw;
+				xp=nxp; zp=nzp; xi=nxi; zi=nzi; xf=nxf; zf=nzf;
+				h=nh; h00=nh00; h10=nh10; h01=nh01; h11=nh11;
+			} // for numMoves
+			if (numMoves>=MAX_PATH_LEN) {cout << "droplet path is too long: " << iter << endl;}
+			ts.flush(droplet_deltas[iter - batch_start]);
+		} // for iter
+
+		for (unsigned i = 0; i < batch_end - batch_start; ++i) { // apply changes in droplet order
+			for (auto const &d : droplet_deltas[i]) {mh_padded[d.first] += d.second;}
+			droplet_deltas[i].clear();
+		}
+	} // for batch_start
 
 	// remove padding and clamp to min_zval
 	for (int y = 0; y < ysize; ++y) {
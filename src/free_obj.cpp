@@ -69,6 +69,7 @@ void free_obj::reset() {
 	ambient_scale = DEF_AMBIENT_SCALE;
 	draw_rscale = 1.0;
 	target_obj  = NULL;
+	snap_target_obj = NULL;
 	parent      = NULL;
 	pos         = reset_pos;
 	velocity    = zero_vector;
@@ -164,11 +165,20 @@ void free_obj::arb_rotate_about(float rangle, vector3d const &raxis) {
 }
 
 
+void free_obj::rotate_dir_upv(float pitch, float yaw, vector3d &dir_, vector3d &upv_) {
+
+	vector3d const vy(cross_product(dir_, upv_));
+	rotate_vector3d(upv_, yaw, dir_); // x-rotation
+	rotate_vector3d_x2(vy, pitch, upv_, dir_); // y-rotation, rotate up vector
+	upv_.normalize();
+	dir_.normalize();
+}
+
+
 void free_obj::do_rotate(float pitch, float yaw) { // upv rotates as you move the mouse in xy circles
 
-	vector3d const vy(cross_product(dir, upv));
-	rotate_vector3d(upv, yaw, dir); // x-rotation
-	arb_rotate_about(pitch, vy); // y-rotation, rotate up vector
+	rotate_dir_upv(pitch, yaw, dir, upv);
+	invalidate_rotv();
 }
 
 
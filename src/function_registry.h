@@ -11,6 +11,8 @@ struct xform_matrix;
 struct cube_with_zval_t;
 
 int omp_get_thread_num_3dw();
+int omp_get_max_threads_3dw();
+void omp_set_num_threads_3dw(int num);
 
 // function prototypes - main (3DWorld.cpp, etc.)
 bool get_gl_error(unsigned loc_id=0);
@@ -262,6 +264,8 @@ float get_tiled_terrain_height_tex(float xval, float yval, bool nearest_texel=0)
 vector3d get_tiled_terrain_height_tex_norm(int x, int y);
 bool write_default_hmap_modmap();
 float update_tiled_terrain(float &min_camera_dist);
+void gen_tiled_terrain_buildings_and_cities();
+unsigned gen_tiled_terrain_tiles_cpu_only(int tile_radius);
 void pre_draw_tiled_terrain(bool reflection_pass);
 void render_tt_models(bool reflection_pass, bool transparent_pass);
 void draw_tiled_terrain(bool reflection_pass);
@@ -328,6 +332,7 @@ float eval_mesh_sin_terms(float xv, float yv);
 float get_exact_zval(float xval, float yval);
 void reset_offsets();
 float get_median_height(float distribution_pos);
+uint64_t get_mesh_gen_params_hash();
 float get_water_z_height();
 float get_cur_temperature();
 void update_mesh(float dms, bool do_regen_trees);
@@ -450,6 +455,8 @@ void build_static_moving_cobj_tree();
 void build_cobj_tree(bool dynamic=0, bool verbose=1);
 bool check_coll_line_exact_tree(point const &p1, point const &p2, point &cpos, vector3d &cnorm, int &cindex, int ignore_cobj,
 	bool dynamic=0, int test_alpha=0, bool skip_non_drawn=0, bool include_voxels=1, bool skip_init_colls=0, bool skip_movable=0, bool no_stat_moving=0);
+unsigned check_coll_line_exact_tree_packet(point const *const p1, point const *const p2, unsigned ray_mask, point *cpos, vector3d *cnorm, int *cindex,
+	int ignore_cobj, int test_alpha, bool include_voxels, unsigned skip_init_colls_mask, bool no_stat_moving);
 bool check_coll_line_tree(point const &p1, point const &p2, int &cindex, int ignore_cobj, bool dynamic=0, int test_alpha=0,
 	bool skip_non_drawn=0, bool include_voxels=1, bool skip_init_colls=0, bool skip_movable=0);
 bool cobj_contained_tree(point const &viewer, point const *const pts, unsigned npts, int ignore_cobj, int &cobj);
@@ -591,6 +598,7 @@ void update_water_zval(int x, int y, float old_mh);
 
 // function prototypes - textures
 void load_texture_names();
+void load_texture_images();
 void load_textures();
 unsigned get_loaded_textures_cpu_mem();
 unsigned get_loaded_textures_gpu_mem();
@@ -949,7 +957,7 @@ void fgPerspective(float fov_y, float aspect, float near_clip, float far_clip);
 void fgOrtho(float left, float right, float bottom, float top, float zNear, float zFar);
 void fgLookAt(float eyex, float eyey, float eyez, float centerx, float centery, float centerz, float upx, float upy, float upz);
 void fgMultMatrix(xform_matrix const &m);
-void deform_obj(dwobject &obj, vector3d const &norm, vector3d const &v0);
+void deform_obj(dwobject &obj, vector3d const &norm, vector3d const &v0, float obj_tstep);
 void update_deformation(dwobject &obj);
 
 // function prototypes - draw_text
@@ -11,6 +11,7 @@
 #include "draw_utils.h" // for point_sprite_drawer_sized
 #include "subdiv.h" // for sd_sphere_d
 #include "tree_3dw.h" // for tree_placer_t
+#include "cobj_bsp_tree.h" // for cobj_tree_simple_type_t
 
 using std::string;
 
@@ -19,6 +20,7 @@ bool const ADD_ROOM_SHADOWS      = 1;
 bool const ADD_ROOM_LIGHTS       = 1;
 bool const DRAW_INTERIOR_DOORS   = 1;
 float const WIND_LIGHT_ON_RAND   = 0.08;
+unsigned const GRID_BVH_MIN_BCUBES = 16; // grid elements with at least this many buildings get a BVH for queries
 
 bool camera_in_building(0), interior_shadow_maps(0);
 building_params_t global_building_params;
@@ -1474,6 +1476,43 @@ struct building_lights_manager_t : public city_lights_manager_t {
 building_lights_manager_t building_lights_manager;
 
 
+// BVH over the building bcubes of one grid element, used when there are too many buildings for a linear scan to be fast;
+// the leaves index into the grid element's bc_ixs, which are reordered to match the tree, so the bcubes aren't duplicated
+class building_grid_bvh_t : public cobj_tree_simple_type_t<cube_with_ix_t> {
+	virtual void calc_node_bbox(tree_node &n) const {
+		assert(n.start < n.end);
+		for (unsigned i = n.start; i < n.end; ++i) {n.assign_or_union_with_cube(objects[i]);}
+	}
+public:
+	void build(vector<cube_with_ix_t> &bc_ixs) {
+		clear();
+		objects.swap(bc_ixs); // the tree owns the bcubes while building
+		build_tree_top(0);
+		objects.swap(bc_ixs); // return them in tree order
+	}
+	// node_test is applied to tree nodes; leaf_func is called on the bcubes of nodes that pass, and returns 1 to end the query early
+	template<typename NT, typename LF> bool query(vector<cube_with_ix_t> const &bc_ixs, NT const &node_test, LF const &leaf_func) const {
+		unsigned const num_nodes((unsigned)nodes.size());
+
+		for (unsigned nix = 0; nix < num_nodes;) {
+			tree_node const &n(nodes[nix]);
+
+			if (!node_test(n)) {
+				assert(n.next_node_id > nix);
+				nix = n.next_node_id; // skip this subtree
+				continue;
+			}
+			for (unsigned i = n.start; i < n.end; ++i) { // check leaves
+				assert(i < bc_ixs.size());
+				if (leaf_func(bc_ixs[i])) return 1;
+			}
+			++nix;
+		}
+		return 0;
+	}
+};
+
+
 class building_creator_t {
 
 	unsigned grid_sz, gpu_mem_usage;
@@ -1491,6 +1530,7 @@ class building_creator_t {
 	struct grid_elem_t {
 		vector<cube_with_ix_t> bc_ixs;
 		cube_t bcube;
+		building_grid_bvh_t bvh; // only built for large elements, after all buildings have been added
 		bool has_room_geom;
 		grid_elem_t() : has_room_geom(0) {}
 
@@ -1498,6 +1538,19 @@ class building_creator_t {
 			if (bc_ixs.empty()) {bcube = c;} else {bcube.union_with_cube(c);}
 			bc_ixs.emplace_back(c, ix);
 		}
+		void build_bvh() {
+			bvh.clear();
+			if (bc_ixs.size() >= GRID_BVH_MIN_BCUBES) {bvh.build(bc_ixs);}
+		}
+		// calls leaf_func on each building bcube, skipping BVH subtrees that fail node_test if there is a BVH; returns 1 if leaf_func ended the query
+		template<typename NT, typename LF> bool query(NT const &node_test, LF const &leaf_func) const {
+			if (!bvh.is_empty()) {return bvh.query(bc_ixs, node_test, leaf_func);}
+
+			for (auto b = bc_ixs.begin(); b != bc_ixs.end(); ++b) {
+				if (leaf_func(*b)) return 1;
+			}
+			return 0;
+		}
 	};
 	vector<grid_elem_t> grid, grid_by_tile;
 
@@ -1838,7 +1891,9 @@ public:
 		} // if flatten_mesh
 		{ // open a scope
 			timer_t timer2("Gen Building Geometry", !is_tile);
-#pragma omp parallel for schedule(static,1) if (!is_tile)
+			// each building has its own RNG seeded from its index, so the results don't depend on the number of threads or scheduling;
+			// building sizes vary widely, so use dynamic scheduling to balance the load
+#pragma omp parallel for schedule(dynamic,1) if (!is_tile)
 			for (int i = 0; i < (int)buildings.size(); ++i) {buildings[i].gen_geometry(i, 1337*i+rseed);}
 		} // close the scope
 		if (0 && non_city_only) { // perform room graph analysis
@@ -1872,10 +1927,16 @@ public:
 			cout << TXT(s.nbuildings) << TXT(s.nparts) << TXT(s.ndetails) << TXT(s.ntquads) << TXT(s.ndoors) << TXT(s.ninterior)
 				 << TXT(s.nrooms) << TXT(s.nceils) << TXT(s.nfloors) << TXT(s.nwalls) << TXT(s.nrgeom) << TXT(s.nobjs) << TXT(s.nverts) << endl;
 		}
+		build_grid_bvhs();
 		build_grid_by_tile(is_tile);
 		create_vbos(is_tile);
 	} // end gen()
 
+	void build_grid_bvhs() {
+#pragma omp parallel for schedule(dynamic,1)
+		for (int i = 0; i < (int)grid.size(); ++i) {grid[i].build_bvh();}
+	}
+
 	struct pt_by_xval {
 		bool operator()(point const &a, point const &b) const {return (a.x < b.x);}
 	};
@@ -1942,9 +2003,12 @@ public:
 			unsigned const bix(locs[i].bix);
 			assert(bix < peds_by_bix.size());
 			if (peds_by_bix[bix] < 0) {peds_by_bix[bix] = i;} // record first ped index for each building
+			buildings[bix].get_nav_graph(); // build nav graph here so that later path queries are read-only and can be run in parallel
 		}
 		return 1;
 	}
+	bool choose_person_dest(unsigned bix, point const &pos, float radius, rand_gen_t &rgen, point &dest) const {return get_building(bix).choose_dest_for_person(pos, radius, rgen, dest);}
+	bool find_person_route(unsigned bix, point const &from, point const &to, vector<point> &path) const {return get_building(bix).find_route_to_point(from, to, path);}
 	int get_ped_ix_for_bix(unsigned bix) const {return ((bix < peds_by_bix.size()) ? peds_by_bix[bix] : -1);}
 
 	static void multi_draw_shadow(vector3d const &xlate, vector<building_creator_t *> const &bcs) {
@@ -2536,12 +2600,11 @@ public:
 			if (ge.bc_ixs.empty()) return 0; // skip empty grid
 			if (!(xy_only ? ge.bcube.contains_pt_xy(p1x) : ge.bcube.contains_pt(p1x))) return 0; // no intersection - skip this grid
 			vector<point> points; // reused across calls
+			auto contains_pt([&](cube_t const &c) {return (xy_only ? c.contains_pt_xy(p1x) : c.contains_pt(p1x));});
 
-			for (auto b = ge.bc_ixs.begin(); b != ge.bc_ixs.end(); ++b) {
-				if (!(xy_only ? b->contains_pt_xy(p1x) : b->contains_pt(p1x))) continue;
-				if (get_building(b->ix).check_sphere_coll(pos, p_last, ped_bcubes, xlate, 0.0, xy_only, points, cnorm, check_interior)) return 1;
-			}
-			return 0; // no coll
+			return ge.query(contains_pt, [&](cube_with_ix_t const &b) {
+				return (contains_pt(b) && get_building(b.ix).check_sphere_coll(pos, p_last, ped_bcubes, xlate, 0.0, xy_only, points, cnorm, check_interior));
+			});
 		}
 		cube_t bcube; bcube.set_from_sphere((pos - xlate), radius);
 		unsigned ixr[2][2];
@@ -2557,16 +2620,17 @@ public:
 					sphere_cube_intersect(pos, (radius + dist), (ge.bcube + xlate)))) continue; // Note: makes little difference
 
 				// Note: assumes buildings are separated so that only one sphere collision can occur
-				for (auto b = ge.bc_ixs.begin(); b != ge.bc_ixs.end(); ++b) {
-					if (!b->intersects_xy(bcube)) continue;
+				bool const had_coll(ge.query([&](cube_t const &c) {return c.intersects_xy(bcube);}, [&](cube_with_ix_t const &b) {
+					if (!b.intersects_xy(bcube)) return 0;
 
 					if (check_interior) {
 						ped_bcubes.clear();
-						int const ped_ix(get_ped_ix_for_bix(b->ix));
-						if (ped_ix >= 0) {get_ped_bcubes_for_building(ped_ix, b->ix, ped_bcubes);}
+						int const ped_ix(get_ped_ix_for_bix(b.ix));
+						if (ped_ix >= 0) {get_ped_bcubes_for_building(ped_ix, b.ix, ped_bcubes);}
 					}
-					if (get_building(b->ix).check_sphere_coll(pos, p_last, ped_bcubes, xlate, radius, xy_only, points, cnorm, check_interior)) return 1;
-				}
+					return (int)get_building(b.ix).check_sphere_coll(pos, p_last, ped_bcubes, xlate, radius, xy_only, points, cnorm, check_interior);
+				}));
+				if (had_coll) return 1;
 			} // for x
 		} // for y
 		return 0;
@@ -2585,12 +2649,16 @@ public:
 			if (ge.bc_ixs.empty()) return 0; // skip empty grid
 			if (!ge.bcube.contains_pt_xy(p1x)) return 0; // no intersection - skip this grid
 
-			for (auto b = ge.bc_ixs.begin(); b != ge.bc_ixs.end(); ++b) {
-				if (!b->contains_pt_xy(p1x)) continue;
-				unsigned const ret(get_building(b->ix).check_line_coll(p1, p2, xlate, t, points, 0, ret_any_pt, no_coll_pt));
-				if (ret) {hit_bix = b->ix; return ret;} // can only intersect one building
-			} // for b
-			return 0; // no coll
+			unsigned ret(0);
+			auto contains_pt([&](cube_t const &c) {return c.contains_pt_xy(p1x);});
+
+			ge.query(contains_pt, [&](cube_with_ix_t const &b) {
+				if (!contains_pt(b)) return 0;
+				ret = get_building(b.ix).check_line_coll(p1, p2, xlate, t, points, 0, ret_any_pt, no_coll_pt);
+				if (ret) {hit_bix = b.ix;}
+				return (int)(ret != 0); // can only intersect one building
+			});
+			return ret;
 		}
 		cube_t bcube(p1x, p2-xlate);
 		unsigned ixr[2][2];
@@ -2606,17 +2674,20 @@ public:
 				if (ge.bc_ixs.empty()) continue; // skip empty grid
 				if (!check_line_clip(p1x, (end_pos - xlate), ge.bcube.d)) continue; // no intersection - skip this grid
 
-				for (auto b = ge.bc_ixs.begin(); b != ge.bc_ixs.end(); ++b) { // Note: okay to check the same building more than once
-					if (!b->intersects(bcube)) continue;
+				bool const done(ge.query([&](cube_t const &c) {return check_line_clip(p1x, (end_pos - xlate), c.d);}, [&](cube_with_ix_t const &b) {
+					// Note: okay to check the same building more than once
+					if (!b.intersects(bcube)) return 0;
 					float t_new(t);
-					unsigned const ret(get_building(b->ix).check_line_coll(p1, p2, xlate, t_new, points, 0, ret_any_pt, no_coll_pt));
+					unsigned const ret(get_building(b.ix).check_line_coll(p1, p2, xlate, t_new, points, 0, ret_any_pt, no_coll_pt));
 
 					if (ret && t_new <= t) { // closer hit pos, update state
-						t = t_new; hit_bix = b->ix; coll = ret;
+						t = t_new; hit_bix = b.ix; coll = ret;
 						end_pos = p1 + t*(p2 - p1);
-						if (ret_any_pt) return coll;
+						if (ret_any_pt) return 1;
 					}
-				} // for b
+					return 0;
+				}));
+				if (done) return coll;
 			} // for x
 		} // for y
 		return coll; // 0=none, 1=side, 2=roof, 3=details
@@ -2635,12 +2706,12 @@ public:
 		unsigned const gix(get_grid_ix(pos));
 		grid_elem_t const &ge(grid[gix]);
 		if (ge.bc_ixs.empty() || !ge.bcube.contains_pt(pos)) return -1; // skip empty or non-containing grid
-		static vector<point> points; // reused across calls
-
-		for (auto b = ge.bc_ixs.begin(); b != ge.bc_ixs.end(); ++b) {
-			if (b->contains_pt(pos)) {return b->ix;} // found
-		}
-		return -1;
+		int ret(-1);
+		ge.query([&](cube_t const &c) {return c.contains_pt(pos);}, [&](cube_with_ix_t const &b) {
+			if (b.contains_pt(pos)) {ret = b.ix; return 1;} // found
+			return 0;
+		});
+		return ret;
 	}
 
 	bool check_ped_coll(point const &pos, float radius, unsigned plot_id, unsigned &building_id) const { // Note: not thread safe due to static points
@@ -2679,12 +2750,13 @@ public:
 				grid_elem_t const &ge(get_grid_elem(x, y));
 				if (ge.bc_ixs.empty() || !xy_range.intersects_xy(ge.bcube)) continue;
 
-				for (auto b = ge.bc_ixs.begin(); b != ge.bc_ixs.end(); ++b) {
-					if (!xy_range.intersects_xy(*b)) continue;
+				ge.query([&](cube_t const &c) {return xy_range.intersects_xy(c);}, [&](cube_with_ix_t const &b) {
+					if (!xy_range.intersects_xy(b)) return 0;
 					cube_t shared(xy_range);
-					shared.intersect_with_cube(*b);
-					if (get_grid_ix(shared.get_llc()) == y*grid_sz + x) {bcubes.push_back(*b);} // add only if in home grid (to avoid duplicates)
-				}
+					shared.intersect_with_cube(b);
+					if (get_grid_ix(shared.get_llc()) == y*grid_sz + x) {bcubes.push_back(b);} // add only if in home grid (to avoid duplicates)
+					return 0;
+				});
 			} // for x
 		} // for y
 	}
@@ -2697,9 +2769,10 @@ public:
 			point const pos(g->bcube.get_cube_center() + state.xlate);
 			if (!pdu.sphere_and_cube_visible_test(pos, g->bcube.get_bsphere_radius(), (g->bcube + state.xlate))) continue; // VFC
 			
-			for (auto b = g->bc_ixs.begin(); b != g->bc_ixs.end(); ++b) {
-				if (pdu.cube_visible(*b + state.xlate)) {state.building_ids.push_back(b->ix);}
-			}
+			g->query([&](cube_t const &c) {return pdu.cube_visible(c + state.xlate);}, [&](cube_with_ix_t const &b) {
+				if (pdu.cube_visible(b + state.xlate)) {state.building_ids.push_back(b.ix);}
+				return 0;
+			});
 		}
 	}
 	bool check_pts_occluded(point const *const pts, unsigned npts, building_occlusion_state_t &state) const {
@@ -2878,6 +2951,8 @@ int get_building_bcube_contains_pos(point const &pos) {return building_creator_c
 bool check_buildings_ped_coll(point const &pos, float radius, unsigned plot_id, unsigned &building_id) {return building_creator_city.check_ped_coll(pos, radius, plot_id, building_id);}
 bool select_building_in_plot(unsigned plot_id, unsigned rand_val, unsigned &building_id) {return building_creator_city.select_building_in_plot(plot_id, rand_val, building_id);}
 bool place_building_people(vect_building_place_t &locs, float radius, unsigned num) {return building_creator.place_people(locs, radius, num);} // secondary buildings only for now
+bool choose_building_person_dest(unsigned bix, point const &pos, float radius, rand_gen_t &rgen, point &dest) {return building_creator.choose_person_dest(bix, pos, radius, rgen, dest);}
+bool find_building_person_route(unsigned bix, point const &from, point const &to, vector<point> &path) {return building_creator.find_person_route(bix, from, to, path);}
 
 void get_all_garages(vect_cube_t &garages) {
 	building_creator.get_all_garages(garages);
@@ -0,0 +1,162 @@
+// 3D World - Headless benchmark driver: runs the CPU side of scene generation and simulation without a GL context
+
+#include "3DWorld.h"
+#include "mesh.h"
+#include "tree_3dw.h"
+#include "u_event.h"
+#include <chrono>
+#include <fstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace std;
+
+unsigned const BENCH_TT_TILE_RADIUS = 4; // tiled terrain mode: generates a (2R+1)x(2R+1) block of tiles around the origin
+
+extern int world_mode, frame_counter, iticks, srand_param, num_trees, universe_only;
+extern float fticks, tstep, TIMESTEP;
+extern tree_cont_t t_trees;
+
+int load_top_level_config(const char *def_file, bool is_scene_config);
+void init_lights();
+void reset_planet_defaults();
+void create_sin_table();
+
+
+size_t get_peak_rss_kb() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return 0;
+	return pmc.PeakWorkingSetSize/1024;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+	return usage.ru_maxrss/1024; // bytes
+#else
+	return usage.ru_maxrss; // KB
+#endif
+#endif
+}
+
+
+class headless_bench_t {
+
+	typedef chrono::high_resolution_clock clock_type;
+
+	struct phase_t {
+		string name;
+		double time_ms;
+		size_t peak_rss_kb;
+		phase_t(string const &name_, double time_ms_, size_t peak_rss_kb_) : name(name_), time_ms(time_ms_), peak_rss_kb(peak_rss_kb_) {}
+	};
+	string scene_config;
+	vector<phase_t> phases;
+	vector<double> tick_times;
+	clock_type::time_point start_time;
+
+	static double get_elapsed_ms(clock_type::time_point const &t0) {return chrono::duration<double, milli>(clock_type::now() - t0).count();}
+
+	template<typename F> void run_phase(char const *const name, F const &func) {
+		cout << "Headless bench: " << name << endl;
+		clock_type::time_point const t0(clock_type::now());
+		func();
+		phases.emplace_back(name, get_elapsed_ms(t0), get_peak_rss_kb());
+	}
+	static string json_escape(string const &str) {
+		string ret;
+		for (char c : str) {
+			if (c == '"' || c == '\\') {ret.push_back('\\');}
+			ret.push_back(c);
+		}
+		return ret;
+	}
+public:
+	headless_bench_t(char const *const scene_config_) : scene_config(scene_config_), start_time(clock_type::now()) {}
+
+	bool run(unsigned num_ticks) {
+		bool config_ok(0);
+
+		int rs(1);
+		if (srand_param != 0 && srand_param != 1) {rs = srand_param;} // Note: srand_param == 1 (time-based seed) is ignored so that results are repeatable
+		add_uevent_srand(rs);
+
+		run_phase("load_config", [&]() {
+			create_sin_table();
+			set_scene_constants();
+			load_texture_names(); // needs to be before config file load
+			config_ok = (load_top_level_config(scene_config.c_str(), 1) != 0);
+			gen_gauss_rand_arr(); // after reading seed from config file
+		});
+		if (!config_ok) {cerr << "Error: Failed to load scene config " << scene_config << endl; return 0;}
+		if (universe_only || world_mode == WMODE_UNIVERSE) {cerr << "Error: Universe mode is not supported by the headless benchmark" << endl; return 0;}
+		run_phase("load_texture_images", []() {load_texture_images();});
+
+		run_phase("init", []() {
+			reset_planet_defaults(); // set atmosphere and vegetation
+			init_objects();
+			alloc_matrices();
+			t_trees.resize(num_trees);
+			init_models();
+			init_terrain_mesh();
+			init_lights();
+		});
+		run_phase("gen_scene", []() {gen_scene(1, (world_mode == WMODE_GROUND), 0, 0, 0);}); // includes gen_buildings() and add_all_coll_objects() in ground mode
+		run_phase("create_object_groups", []() {create_object_groups(); init_game_state();});
+
+		if (world_mode == WMODE_INF_TERRAIN) {
+			run_phase("gen_buildings_and_cities", []() {gen_tiled_terrain_buildings_and_cities();}); // gen_buildings() + city roads, cars, and pedestrians
+			run_phase("create_tile_zvals",        []() {gen_tiled_terrain_tiles_cpu_only(BENCH_TT_TILE_RADIUS);});
+		}
+		run_phase("sim_ticks", [&]() {
+			tick_times.reserve(num_ticks);
+
+			for (unsigned i = 0; i < num_ticks; ++i) {
+				clock_type::time_point const t0(clock_type::now());
+				fticks = 1.0; // fixed timestep for repeatable results
+				iticks = 1;
+				tstep  = TIMESTEP*fticks;
+				++frame_counter;
+				if (world_mode == WMODE_GROUND) {process_groups();}
+				next_city_frame(0);
+				tick_times.push_back(get_elapsed_ms(t0));
+			}
+		});
+		return 1;
+	}
+
+	void write_json(ostream &out) const {
+		double total_ms(0.0), tick_max_ms(0.0);
+		for (auto const &t : tick_times) {total_ms += t; tick_max_ms = max(tick_max_ms, t);}
+		double const tick_avg_ms(tick_times.empty() ? 0.0 : total_ms/tick_times.size());
+		out << "{\n  \"scene_config\": \"" << json_escape(scene_config) << "\",\n  \"world_mode\": " << world_mode << ",\n  \"phases\": [\n";
+
+		for (auto i = phases.begin(); i != phases.end(); ++i) {
+			out << "    {\"name\": \"" << i->name << "\", \"time_ms\": " << i->time_ms << ", \"peak_rss_kb\": " << i->peak_rss_kb << "}"
+				<< (((i+1) == phases.end()) ? "\n" : ",\n");
+		}
+		out << "  ],\n  \"ticks\": {\"count\": " << tick_times.size() << ", \"avg_ms\": " << tick_avg_ms << ", \"max_ms\": " << tick_max_ms << "},\n";
+		out << "  \"total_time_ms\": " << get_elapsed_ms(start_time) << ",\n  \"peak_rss_kb\": " << get_peak_rss_kb() << "\n}" << endl;
+	}
+};
+
+
+// command line: --headless-bench <scene_config> [<num_ticks>] [<json_out_file>]
+int run_headless_bench(char const *const scene_config, unsigned num_ticks, char const *const json_fn) {
+
+	assert(scene_config != nullptr);
+	headless_bench_t bench(scene_config);
+	if (!bench.run(num_ticks)) return 1;
+	bench.write_json(cout);
+	if (json_fn == nullptr) return 0;
+	ofstream out(json_fn);
+	if (!out.good()) {cerr << "Error: Failed to open " << json_fn << " for write" << endl; return 1;}
+	bench.write_json(out);
+	return 0;
+}
+
@@ -4,6 +4,7 @@
 
 #include "heightmap.h"
 #include "function_registry.h"
+#include "mesh.h"
 #include "inlines.h"
 #include "file_utils.h"
 #include "sinf.h"
@@ -71,6 +72,25 @@ unsigned heightmap_t::get_pixel_value(unsigned x, unsigned y) const {
 }
 
 
+// hash of the current pixel values, which includes any mod map, brush, and flatten edits; hashed a word at a time since the heightmap can be large
+uint64_t heightmap_t::get_data_hash() const {
+
+	uint64_t hash(FNV_HASH_INIT);
+	if (!is_allocated()) return hash;
+	int const vals[4] = {width, height, ncolors, (int)hmap_filter_width};
+	hash_add_val(hash, vals);
+	size_t const nbytes(num_bytes()), nwords(nbytes/sizeof(uint64_t));
+
+	for (size_t i = 0; i < nwords; ++i) {
+		uint64_t word;
+		memcpy(&word, (data + i*sizeof(uint64_t)), sizeof(uint64_t)); // may be unaligned
+		hash = (hash ^ word)*1099511628211ULL;
+	}
+	hash_add_bytes(hash, (data + nwords*sizeof(uint64_t)), (nbytes - nwords*sizeof(uint64_t))); // remaining bytes
+	return hash;
+}
+
+
 float heightmap_t::get_heightmap_value(unsigned x, unsigned y) const { // returns values from 0 to 256
 
 	unsigned const ix(get_pixel_ix(x, y));
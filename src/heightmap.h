@@ -30,6 +30,7 @@ public:
 	float get_heightmap_value(unsigned x, unsigned y) const;
 	void modify_heightmap_value(unsigned x, unsigned y, int val, bool val_is_delta);
 	void postprocess_height();
+	uint64_t get_data_hash() const;
 };
 
 
@@ -135,6 +136,7 @@ public:
 	void apply_cur_mod_map();
 	void apply_cur_brushes();
 	bool enabled() const {return hmap.is_allocated();}
+	uint64_t get_data_hash() const {return hmap.get_data_hash();}
 	~terrain_hmap_manager_t() {hmap.free_data();}
 };
 
@@ -69,6 +69,8 @@ public:
 	lmcell const *get_column(int x, int y) const {return vlmap[y][x];} // Note: no bounds checking
 	lmcell *get_column(int x, int y) {return vlmap[y][x];} // Note: no bounds checking
 	lmcell &get_lmcell(int x, int y, int z) {return get_column(x, y)[z];} // Note: no bounds checking
+	unsigned get_cell_index(lmcell const *lmc) const {assert(lmc >= vldata_alloc.data() && lmc < vldata_alloc.data() + vldata_alloc.size()); return unsigned(lmc - vldata_alloc.data());}
+	lmcell &get_cell_by_index(unsigned ix) {assert(ix < vldata_alloc.size()); return vldata_alloc[ix];}
 	lmcell *get_lmcell_round_down(point const &p);
 	lmcell *get_lmcell(point const &p);
 	void reset_all(lmcell const &init_lmcell=lmcell());
@@ -27,7 +27,7 @@ extern obj_group obj_groups[];
 extern coll_obj_group coll_objects;
 
 
-bool setup_height_gen(mesh_xy_grid_cache_t &height_gen, float x0, float y0, float dx, float dy, unsigned nx, unsigned ny, bool cache_values, bool no_wait=0);
+bool setup_height_gen(mesh_xy_grid_cache_t &height_gen, float x0, float y0, float dx, float dy, unsigned nx, unsigned ny, bool cache_values, bool no_wait=0, bool sparse_reads=0);
 bool using_hmap_with_detail();
 void set_temp_clear_color(colorRGBA const &clear_color);
 float get_heightmap_scale();
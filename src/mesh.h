@@ -43,7 +43,7 @@ public:
 	mesh_xy_grid_cache_t() : cur_nx(0), cur_ny(0), yterms_start(0), tid(0), mx0(0.0), my0(0.0), mdx(0.0), mdy(0.0), sine_offset(0.0),
 		gen_mode(MGEN_SINE), gen_shape(0), do_glaciate(0), cshader(nullptr) {}
 	~mesh_xy_grid_cache_t() {clear_context();}
-	bool build_arrays(float x0, float y0, float dx, float dy, unsigned nx, unsigned ny, bool cache_values=0, bool force_sine_mode=0, bool no_wait=0);
+	bool build_arrays(float x0, float y0, float dx, float dy, unsigned nx, unsigned ny, bool cache_values=0, bool force_sine_mode=0, bool no_wait=0, bool sparse_reads=0);
 	void enable_glaciate();
 	float eval_index(unsigned x, unsigned y, int min_start_sin=0, bool use_cache=1) const;
 	void clear_context();
@@ -101,6 +101,17 @@ struct hmap_params_t {
 };
 
 
+// 64-bit FNV-1a hash, for keying cached generated data on the parameters it was generated from
+uint64_t const FNV_HASH_INIT = 14695981039346656037ULL;
+
+inline void hash_add_bytes(uint64_t &hash, void const *data, size_t len) {
+	unsigned char const *const bytes((unsigned char const *)data);
+	for (size_t i = 0; i < len; ++i) {hash = (hash ^ bytes[i])*1099511628211ULL;}
+}
+template<typename T> void hash_add_val(uint64_t &hash, T const &val) {hash_add_bytes(hash, &val, sizeof(T));}
+inline void hash_add_str(uint64_t &hash, char const *const str) {if (str) {hash_add_bytes(hash, str, strlen(str));} hash_add_val(hash, '\0');}
+
+
 // should be const, but depend on mesh size
 extern int MESH_X_SIZE, MESH_Y_SIZE, MESH_Z_SIZE, MAX_XY_SIZE, XY_MULT_SIZE, XY_SUM_SIZE, I_TIMESCALE;
 extern int MESH_SIZE[];
@@ -40,6 +40,7 @@ float mesh_scale(1.0), tree_scale(1.0), mesh_scale_z(1.0), mesh_scale_z_inv(1.0)
 float mesh_height_scale(1.0), zmax_est2(1.0), zmax_est2_inv(1.0);
 vector<float> sin_table;
 float sinTable[F_TABLE_SIZE][5];
+bool mesh_gen_cpu_only(0); // evaluate the GPU noise modes on the CPU; for use without a GL context
 
 int const mesh_tids_dirt[NTEX_DIRT] = {SAND_TEX, DIRT_TEX, GROUND_TEX, ROCK_TEX, SNOW_TEX};
 float const mesh_rh_dirt[NTEX_DIRT] = {0.40, 0.44, 0.60, 0.75, 1.0};
@@ -584,8 +585,10 @@ void gen_rx_ry(float &rx, float &ry) {
 }
 
 
+void get_noise_zval_batch(float const *const xvals, float const *const yvals, float *const zvals, unsigned n, int mode, int shape);
+
 bool mesh_xy_grid_cache_t::build_arrays(float x0, float y0, float dx, float dy,
-	unsigned nx, unsigned ny, bool cache_values, bool force_sine_mode, bool no_wait)
+	unsigned nx, unsigned ny, bool cache_values, bool force_sine_mode, bool no_wait, bool sparse_reads)
 {
 	assert(nx > 0 && ny > 0);
 	assert(start_eval_sin <= F_TABLE_SIZE);
@@ -595,13 +598,24 @@ bool mesh_xy_grid_cache_t::build_arrays(float x0, float y0, float dx, float dy,
 	do_glaciate = 0; // must set enable_glaciate() after this call if needed
 	cached_vals.clear();
 
-	if (gen_mode >= MGEN_SIMPLEX_GPU) { // GPU simplex noise - always cache values
+	if (gen_mode >= MGEN_SIMPLEX_GPU && !mesh_gen_cpu_only) { // GPU simplex noise - always cache values
 		bool const is_running(cshader && cshader->get_is_running());
 		if (!is_running) {run_gpu_simplex();} // launch the job
 		if (no_wait && !is_running) return 0; // just started, results not yet available
 		cache_gpu_simplex_vals();
 		return 1; // results are available
 	}
+	if (gen_mode != MGEN_SINE && (cache_values || !sparse_reads)) { // CPU noise (including domain warp) - much faster to compute a row at a time in batches
+		cached_vals.resize(cur_nx*cur_ny);
+
+#pragma omp parallel for schedule(static,1)
+		for (int y = 0; y < (int)cur_ny; ++y) {
+			vector<float> xvals(cur_nx), yvals(cur_nx, (y*mdy + my0)*DY_VAL_INV);
+			for (unsigned x = 0; x < cur_nx; ++x) {xvals[x] = (x*mdx + mx0)*DX_VAL_INV;}
+			get_noise_zval_batch(xvals.data(), yvals.data(), &cached_vals[y*cur_nx], cur_nx, gen_mode, gen_shape);
+		}
+		return 1; // results are available
+	}
 	yterms_start = nx*F_TABLE_SIZE;
 	xyterms.resize((nx + ny)*F_TABLE_SIZE, 0.0);
 	float const msx(mesh_scale*DX_VAL_INV), msy(mesh_scale*DY_VAL_INV), ms2(0.5*mesh_scale);
@@ -635,6 +649,25 @@ bool mesh_xy_grid_cache_t::build_arrays(float x0, float y0, float dx, float dy,
 	return 1; // results are available
 }
 
+// hash of everything that affects the procedurally generated height values
+uint64_t get_mesh_gen_params_hash() {
+
+	uint64_t hash(FNV_HASH_INIT);
+	hash_add_val(hash, mesh_gen_mode);
+	hash_add_val(hash, mesh_gen_shape);
+	hash_add_val(hash, start_eval_sin);
+	hash_add_val(hash, GLACIATE);
+	hash_add_val(hash, hmap_params);
+	float const fvals[] = {mesh_scale, mesh_scale_z, mesh_height_scale, glaciate_exp, zmax_est, zmax_est2, custom_glaciate_exp, MESH_HEIGHT, XY_SCENE_SIZE};
+	hash_add_val(hash, fvals);
+	float rxy[2];
+	gen_rx_ry(rxy[0], rxy[1]); // noise random offsets
+	hash_add_val(hash, rxy);
+	hash_add_bytes(hash, sinTable, sizeof(sinTable)); // includes the random seed
+	return hash;
+}
+
+
 void mesh_xy_grid_cache_t::enable_glaciate() {
 
 	do_glaciate = 1;
@@ -750,12 +783,163 @@ float get_noise_zval(float xval, float yval, int mode, int shape) {
 }
 
 
+// batched versions of the above, for evaluating many points per call
+
+unsigned const NOISE_BATCH_SIZE = 64; // points processed together per octave; small enough for the temporaries to stay in L1 cache
+
+inline float noise_floor(float x) {int const i((int)x); return float(i - int(x < float(i)));} // valid for |x| < 2^31
+inline float noise_abs  (float x) {return fabsf(x);}
+inline float noise_max0 (float x) {return max(x, 0.0f);}
+inline float noise_lt   (float a, float b) {return ((a < b) ? 1.0f : 0.0f);}
+
+// SIMD float type with the operators needed by simplex_noise_2d(); results are bitwise identical to the scalar float versions above
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define NOISE_SIMD_WIDTH 8
+struct simd_float_t {
+	__m256 v;
+	simd_float_t(__m256 v_) : v(v_) {}
+	simd_float_t(float f) : v(_mm256_set1_ps(f)) {}
+	static simd_float_t load(float const *const p) {return _mm256_loadu_ps(p);}
+	void store(float *const p) const {_mm256_storeu_ps(p, v);}
+	friend simd_float_t operator+(simd_float_t const &a, simd_float_t const &b) {return _mm256_add_ps(a.v, b.v);}
+	friend simd_float_t operator-(simd_float_t const &a, simd_float_t const &b) {return _mm256_sub_ps(a.v, b.v);}
+	friend simd_float_t operator*(simd_float_t const &a, simd_float_t const &b) {return _mm256_mul_ps(a.v, b.v);}
+	friend simd_float_t operator/(simd_float_t const &a, simd_float_t const &b) {return _mm256_div_ps(a.v, b.v);}
+	friend simd_float_t noise_abs (simd_float_t const &a) {return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v);}
+	friend simd_float_t noise_max0(simd_float_t const &a) {return _mm256_max_ps(a.v, _mm256_setzero_ps());}
+	friend simd_float_t noise_lt  (simd_float_t const &a, simd_float_t const &b) {return _mm256_and_ps(_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ), _mm256_set1_ps(1.0f));}
+	friend simd_float_t noise_floor(simd_float_t const &a) {simd_float_t const f(_mm256_cvtepi32_ps(_mm256_cvttps_epi32(a.v))); return (f - noise_lt(a, f));}
+};
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define NOISE_SIMD_WIDTH 4
+struct simd_float_t {
+	__m128 v;
+	simd_float_t(__m128 v_) : v(v_) {}
+	simd_float_t(float f) : v(_mm_set1_ps(f)) {}
+	static simd_float_t load(float const *const p) {return _mm_loadu_ps(p);}
+	void store(float *const p) const {_mm_storeu_ps(p, v);}
+	friend simd_float_t operator+(simd_float_t const &a, simd_float_t const &b) {return _mm_add_ps(a.v, b.v);}
+	friend simd_float_t operator-(simd_float_t const &a, simd_float_t const &b) {return _mm_sub_ps(a.v, b.v);}
+	friend simd_float_t operator*(simd_float_t const &a, simd_float_t const &b) {return _mm_mul_ps(a.v, b.v);}
+	friend simd_float_t operator/(simd_float_t const &a, simd_float_t const &b) {return _mm_div_ps(a.v, b.v);}
+	friend simd_float_t noise_abs (simd_float_t const &a) {return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v);}
+	friend simd_float_t noise_max0(simd_float_t const &a) {return _mm_max_ps(a.v, _mm_setzero_ps());}
+	friend simd_float_t noise_lt  (simd_float_t const &a, simd_float_t const &b) {return _mm_and_ps(_mm_cmplt_ps(a.v, b.v), _mm_set1_ps(1.0f));}
+	friend simd_float_t noise_floor(simd_float_t const &a) {simd_float_t const f(_mm_cvtepi32_ps(_mm_cvttps_epi32(a.v))); return (f - noise_lt(a, f));}
+};
+#endif // else scalar only
+
+template<typename F> F noise_permute(F const &x) { // mod289((x*34 + 1)*x)
+	F const a((x*34.0f + 1.0f)*x);
+	return (a - noise_floor(a*(1.0f/289.0f))*289.0f);
+}
+template<typename F> F simplex_corner_contrib(F const &p, F const &x, F const &y) {
+	F m(noise_max0(0.5f - (x*x + y*y)));
+	m = m*m; m = m*m;
+	// gradients: 41 points uniformly over a line, mapped onto a diamond
+	F const pc(p*0.024390243902439f), gx(2.0f*(pc - noise_floor(pc)) - 1.0f), h(noise_abs(gx) - 0.5f), a0(gx - noise_floor(gx + 0.5f));
+	m = m*(1.79284291400159f - 0.85373472095314f*(a0*a0 + h*h)); // normalize gradients implicitly by scaling m
+	return m*(a0*x + h*y);
+}
+// same result as glm::simplex(vec2(x, y)) for |x|,|y| < 2^31, with the same operation order; F is float or simd_float_t
+template<typename F> F simplex_noise_2d(F const &x, F const &y) {
+
+	float const C0(0.211324865405187f), C1(0.366025403784439f), C2(-0.577350269189626f);
+	F const s(x*C1 + y*C1);
+	// first corner
+	F ix(noise_floor(x + s)), iy(noise_floor(y + s));
+	F const t(ix*C0 + iy*C0), x0x(x - ix + t), x0y(y - iy + t);
+	// other corners
+	F const i1x(noise_lt(x0y, x0x)), i1y(1.0f - i1x);
+	// permutations
+	ix = ix - 289.0f*noise_floor(ix/289.0f); // avoid truncation effects in permutation
+	iy = iy - 289.0f*noise_floor(iy/289.0f);
+	F const p0(noise_permute((noise_permute(iy) + ix)));
+	F const p1(noise_permute((noise_permute(iy + i1y) + ix) + i1x));
+	F const p2(noise_permute((noise_permute(iy + 1.0f) + ix) + 1.0f));
+	F const v0(simplex_corner_contrib(p0, x0x, x0y));
+	F const v1(simplex_corner_contrib(p1, (x0x + C0 - i1x), (x0y + C0 - i1y)));
+	F const v2(simplex_corner_contrib(p2, (x0x + C2), (x0y + C2)));
+	return 130.0f*((v0 + v1) + v2);
+}
+
+void simplex_noise_2d_batch(float const *const xs, float const *const ys, float *const out, unsigned n) {
+	unsigned k(0);
+#ifdef NOISE_SIMD_WIDTH
+	for (; k + NOISE_SIMD_WIDTH <= n; k += NOISE_SIMD_WIDTH) {simplex_noise_2d(simd_float_t::load(xs+k), simd_float_t::load(ys+k)).store(out+k);}
+#endif
+	for (; k < n; ++k) {out[k] = simplex_noise_2d(xs[k], ys[k]);} // scalar remainder
+}
+
+// same as gen_noise() for n <= NOISE_BATCH_SIZE points
+void gen_noise_batch(float const *const xv, float const *const yv, float *const zvals, unsigned n, int mode, int shape) {
+
+	assert(n <= NOISE_BATCH_SIZE);
+	float px[NOISE_BATCH_SIZE], py[NOISE_BATCH_SIZE], noise[NOISE_BATCH_SIZE];
+	float mag(1.0), freq(1.0), rx, ry;
+	unsigned const end_octave(NUM_FREQ_COMP - start_eval_sin/N_RAND_SIN2);
+	float const lacunarity(1.92), gain(0.5);
+	bool const is_simplex(mode == MGEN_SIMPLEX || mode == MGEN_SIMPLEX_GPU || mode == MGEN_DWARP_GPU);
+	gen_rx_ry(rx, ry);
+	for (unsigned k = 0; k < n; ++k) {zvals[k] = 0.0;}
+
+	for (unsigned i = 0; i < end_octave; ++i) {
+		for (unsigned k = 0; k < n; ++k) {px[k] = freq*xv[k] + rx; py[k] = freq*yv[k] + ry;}
+		
+		if (is_simplex) {simplex_noise_2d_batch(px, py, noise, n);}
+		else {for (unsigned k = 0; k < n; ++k) {noise[k] = glm::perlin(glm::vec2(px[k], py[k]));}} // perlin is rarely used, so it's not vectorized
+		
+		switch (shape) {
+		case 0: break; // linear - do nothing
+		case 1: for (unsigned k = 0; k < n; ++k) {noise[k] = fabs(noise[k]) - 0.40;} break; // billowy
+		case 2: for (unsigned k = 0; k < n; ++k) {noise[k] = 0.45 - fabs(noise[k]);} break; // ridged
+		}
+		for (unsigned k = 0; k < n; ++k) {zvals[k] += mag*noise[k];}
+		mag  *= gain;
+		freq *= lacunarity;
+		rx   *= 1.5;
+		ry   *= 1.5;
+	}
+}
+
+// same as get_noise_zval() for n points
+void get_noise_zval_batch(float const *const xvals, float const *const yvals, float *const zvals, unsigned n, int mode, int shape) {
+
+	assert(mode != MGEN_SINE); // mode 0 not supported by this function
+	float const xy_scale(MESH_SCALE_FACTOR*mesh_scale), hmap_scale(get_hmap_scale(mode));
+	float xv[NOISE_BATCH_SIZE], yv[NOISE_BATCH_SIZE];
+
+	for (unsigned b = 0; b < n; b += NOISE_BATCH_SIZE) {
+		unsigned const num(min(NOISE_BATCH_SIZE, n-b));
+		float *const z(zvals + b);
+		for (unsigned k = 0; k < num; ++k) {xv[k] = xy_scale*xvals[b+k]; yv[k] = xy_scale*yvals[b+k];}
+
+		if (mode == MGEN_DWARP_GPU) { // domain warping
+			float const scale(0.2);
+			float dx1[NOISE_BATCH_SIZE], dy1[NOISE_BATCH_SIZE], dx2[NOISE_BATCH_SIZE], dy2[NOISE_BATCH_SIZE], px[NOISE_BATCH_SIZE], py[NOISE_BATCH_SIZE];
+			gen_noise_batch(xv, yv, dx1, num, mode, shape);
+			for (unsigned k = 0; k < num; ++k) {px[k] = xv[k]+5.2; py[k] = yv[k]+1.3;}
+			gen_noise_batch(px, py, dy1, num, mode, shape);
+			for (unsigned k = 0; k < num; ++k) {px[k] = (xv[k] + scale*dx1[k] + 1.7); py[k] = (yv[k] + scale*dy1[k] + 9.2);}
+			gen_noise_batch(px, py, dx2, num, mode, shape);
+			for (unsigned k = 0; k < num; ++k) {px[k] = (xv[k] + scale*dx1[k] + 8.3); py[k] = (yv[k] + scale*dy1[k] + 2.8);}
+			gen_noise_batch(px, py, dy2, num, mode, shape);
+			for (unsigned k = 0; k < num; ++k) {xv[k] += scale*dx2[k]; yv[k] += scale*dy2[k];}
+		}
+		gen_noise_batch(xv, yv, z, num, mode, shape);
+		for (unsigned k = 0; k < num; ++k) {postproc_noise_zval(z[k]); z[k] *= hmap_scale;}
+	}
+}
+
+
 float mesh_xy_grid_cache_t::eval_index(unsigned x, unsigned y, int min_start_sin, bool use_cache) const {
 
 	assert(x < cur_nx && y < cur_ny);
 	float zval(0.0);
 
-	if ((use_cache || gen_mode >= MGEN_SIMPLEX_GPU) && !cached_vals.empty()) {
+	if ((use_cache || gen_mode != MGEN_SINE) && !cached_vals.empty()) { // noise modes cache unless sparse_reads was set
 		zval += cached_vals[y*cur_nx + x];
 	}
 	else if (gen_mode != MGEN_SINE) { // perlin/simplex
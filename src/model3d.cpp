@@ -14,10 +14,22 @@
 #include <queue>
 #include "meshoptimizer.h"
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 bool const ENABLE_BUMP_MAPS  = 1;
 bool const ENABLE_SPEC_MAPS  = 1;
 bool const ENABLE_INTER_REFLECTIONS = 1;
-unsigned const MAGIC_NUMBER  = 42987143; // arbitrary file signature
+unsigned const MAGIC_NUMBER  = 42987143; // arbitrary file signature (original unversioned format)
+unsigned const MAGIC_NUMBER_V2 = 42987144; // versioned format with page aligned arrays that can be read from a memory mapped file
+unsigned const MODEL3D_FILE_VERSION = 2;
+unsigned const MODEL3D_PAGE_SIZE    = 4096; // alignment of vertex and index arrays in the file
 unsigned const BLOCK_SIZE    = 32768; // in vertex indices
 
 bool model_calc_tan_vect(1); // slower and more memory but sometimes better quality/smoother transitions
@@ -151,22 +163,144 @@ void write_uint(ostream &out, unsigned val) {
 	out.write((const char *)&val, sizeof(unsigned));
 }
 
-unsigned read_uint(istream &in) {
-	unsigned val;
-	in.read((char *)&val, sizeof(unsigned));
-	return val;
+void write_align_to_page(ostream &out) {
+	size_t const rem(size_t(out.tellp()) % MODEL3D_PAGE_SIZE);
+	if (rem == 0) return;
+	static char const zeros[MODEL3D_PAGE_SIZE] = {0};
+	out.write(zeros, (MODEL3D_PAGE_SIZE - rem));
 }
 
-template<typename V> void write_vector(ostream &out, V const &v) {
+// is_array=1 is used for vertex and index data, which is page aligned so that it can be copied directly out of the file mapping
+template<typename V> void write_vector(ostream &out, V const &v, bool is_array=0) {
 	write_uint(out, (unsigned)v.size());
-	out.write((const char *)&v.front(), (std::streamsize)v.size()*sizeof(typename V::value_type));
+	if (is_array) {write_align_to_page(out);}
+	if (!v.empty()) {out.write((const char *)&v.front(), (std::streamsize)v.size()*sizeof(typename V::value_type));}
 }
 
-template<typename V> void read_vector(istream &in, V &v) {
-	v.clear();
-	v.resize(read_uint(in));
-	in.read((char *)&v.front(), (std::streamsize)v.size()*sizeof(typename V::value_type));
-}
+
+class mapped_file_t { // read-only memory mapped file
+
+	unsigned char const *data;
+	size_t sz;
+#ifdef _WIN32
+	HANDLE fh, mh;
+#endif
+public:
+#ifdef _WIN32
+	mapped_file_t() : data(nullptr), sz(0), fh(INVALID_HANDLE_VALUE), mh(NULL) {}
+#else
+	mapped_file_t() : data(nullptr), sz(0) {}
+#endif
+	~mapped_file_t() {close();}
+	unsigned char const *get_data() const {return data;}
+	size_t size() const {return sz;}
+
+	bool open(string const &fn) {
+		close();
+#ifdef _WIN32
+		fh = CreateFileA(fn.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (fh == INVALID_HANDLE_VALUE) return 0;
+		LARGE_INTEGER fsz;
+		if (!GetFileSizeEx(fh, &fsz) || fsz.QuadPart == 0) {close(); return 0;}
+		sz = size_t(fsz.QuadPart);
+		mh = CreateFileMappingA(fh, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mh == NULL) {close(); return 0;}
+		data = (unsigned char const *)MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0);
+		if (data == nullptr) {close(); return 0;}
+#else
+		int const fd(::open(fn.c_str(), O_RDONLY));
+		if (fd < 0) return 0;
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size == 0) {::close(fd); return 0;}
+		void *const ptr(mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0));
+		::close(fd); // the mapping remains valid after the file is closed
+		if (ptr == MAP_FAILED) return 0;
+		data = (unsigned char const *)ptr;
+		sz   = size_t(st.st_size);
+		madvise(ptr, sz, MADV_SEQUENTIAL);
+#endif
+		return 1;
+	}
+	void close() {
+#ifdef _WIN32
+		if (data != nullptr) {UnmapViewOfFile(data);}
+		if (mh != NULL) {CloseHandle(mh); mh = NULL;}
+		if (fh != INVALID_HANDLE_VALUE) {CloseHandle(fh); fh = INVALID_HANDLE_VALUE;}
+#else
+		if (data != nullptr) {munmap((void *)data, sz);}
+#endif
+		data = nullptr;
+		sz   = 0;
+	}
+	// hint that this range has been consumed and won't be read again, so that the file pages don't stay resident alongside the copied data
+	void release_range(size_t start, size_t num_bytes) const {
+#ifndef _WIN32
+		size_t const page_sz(sysconf(_SC_PAGESIZE)), p1(((start + page_sz - 1)/page_sz)*page_sz), p2(((start + num_bytes)/page_sz)*page_sz); // whole pages only
+		if (p1 < p2) {madvise((void *)(data + p1), (p2 - p1), MADV_DONTNEED);}
+#endif
+	}
+};
+
+
+// reads model3d data from either a memory mapped file (preferred) or a stream, in either the original or the versioned/page aligned format
+class model3d_reader_t {
+
+	istream *in;
+	mapped_file_t const *mfile;
+	size_t pos; // mapped file only
+	unsigned page_size; // 0 = original unaligned format
+	bool error;
+
+public:
+	model3d_reader_t(istream &in_) : in(&in_), mfile(nullptr), pos(0), page_size(0), error(0) {}
+	model3d_reader_t(mapped_file_t const &mfile_, size_t pos_=0, unsigned page_size_=0) : in(nullptr), mfile(&mfile_), pos(pos_), page_size(page_size_), error(0) {}
+	void set_page_size(unsigned page_size_) {page_size = page_size_;}
+	unsigned get_page_size() const {return page_size;}
+	bool is_mapped() const {return (mfile != nullptr);}
+	bool good() const {return (!error && (in == nullptr || in->good()));}
+	size_t get_pos() const {return (in ? size_t(in->tellg()) : pos);}
+
+	void seek(size_t new_pos) {
+		if (in) {in->seekg(new_pos); return;}
+		if (new_pos > mfile->size()) {error = 1; return;}
+		pos = new_pos;
+	}
+	void read(void *ptr, size_t num_bytes) {
+		if (in) {in->read((char *)ptr, num_bytes); return;}
+		if (error || pos + num_bytes > mfile->size()) {error = 1; memset(ptr, 0, num_bytes); return;} // truncated file
+		memcpy(ptr, (mfile->get_data() + pos), num_bytes);
+		pos += num_bytes;
+	}
+	unsigned read_uint() {
+		unsigned val(0);
+		read(&val, sizeof(unsigned));
+		return val;
+	}
+	void align_to_page() {
+		if (page_size == 0) return;
+		size_t const cur_pos(get_pos()), rem(cur_pos % page_size);
+		if (rem != 0) {seek(cur_pos + page_size - rem);}
+	}
+	template<typename V> void read_vector(V &v, bool is_array=0) {
+		typedef typename V::value_type T;
+		v.clear();
+		size_t const num(read_uint());
+		if (is_array) {align_to_page();}
+		if (num == 0 || !good()) return;
+		size_t const num_bytes(num*sizeof(T));
+
+		if (in || page_size == 0) { // stream, or unaligned data (can't cast the mapped pointer to T)
+			v.resize(num);
+			read(&v.front(), num_bytes);
+			return;
+		}
+		if (pos + num_bytes > mfile->size()) {error = 1; return;} // truncated file
+		T const *const src((T const *)(mfile->get_data() + pos));
+		v.assign(src, src+num); // single copy directly from the file pages
+		if (is_array) {mfile->release_range(pos, num_bytes);}
+		pos += num_bytes;
+	}
+};
 
 
 // ************ vntc_vect_t/indexed_vntc_vect_t ************
@@ -541,16 +675,16 @@ template<> void indexed_vntc_vect_t<vert_norm_tc_tan>::calc_tangents(unsigned np
 
 
 template<typename T> void vntc_vect_t<T>::write(ostream &out) const {
-	write_vector(out, *this);
+	write_vector(out, *this, 1); // is_array=1
 }
 
-template<typename T> void vntc_vect_t<T>::read(istream &in) {
+template<typename T> void vntc_vect_t<T>::read(model3d_reader_t &in) {
 
 	// Note: it would be nice to write/read without the tangent vectors and recalculate them later,
 	// but knowing which materials require tangents requires loading the material file first, but that requires the model,
 	// so we would have to read the model3d material headers, then read the material file, then read the polygon data into the correct geometry type,
 	// which would also require writing out the model3d file in two passes and smaller blocks of data at a time
-	read_vector(in, *this);
+	in.read_vector(*this, 1); // is_array=1
 	has_tangents = (sizeof(T) == sizeof(vert_norm_tc_tan)); // HACK to get the type
 	calc_bounding_volumes();
 }
@@ -647,16 +781,12 @@ template<typename T> unsigned indexed_vntc_vect_t<T>::add_vertex(T const &v, ver
 
 	T v2(v);
 	if (vmap.get_average_normals()) {v2.n = zero_vector;}
-	auto it(vmap.find(v2));
-	unsigned ix;
+	unsigned const ix(vmap.find_or_insert(v2, (unsigned)size()));
 
-	if (it == vmap.end()) { // not found
-		ix = (unsigned)size();
+	if (ix == size()) { // not found, was added
 		this->push_back(v);
-		vmap[v2] = ix;
 	}
 	else { // found
-		ix = it->second;
 		assert(ix < size());
 
 		if (vmap.get_average_normals()) {
@@ -767,12 +897,12 @@ template<typename T> void indexed_vntc_vect_t<T>::invert_tcy() {
 
 template<typename T> void indexed_vntc_vect_t<T>::write(ostream &out) const {
 	vntc_vect_t<T>::write(out);
-	write_vector(out, indices);
+	write_vector(out, indices, 1); // is_array=1
 }
 
-template<typename T> void indexed_vntc_vect_t<T>::read(istream &in) {
+template<typename T> void indexed_vntc_vect_t<T>::read(model3d_reader_t &in) {
 	vntc_vect_t<T>::read(in);
-	read_vector(in, indices);
+	in.read_vector(indices, 1); // is_array=1
 }
 
 
@@ -907,15 +1037,15 @@ template<typename T> bool vntc_vect_block_t<T>::write(ostream &out) const {
 
 	write_uint(out, (unsigned)this->size());
 	for (auto i = begin(); i != end(); ++i) {i->write(out);}
-	return 1;
+	return out.good();
 }
 
-template<typename T> bool vntc_vect_block_t<T>::read(istream &in) {
+template<typename T> bool vntc_vect_block_t<T>::read(model3d_reader_t &in) {
 
 	this->clear();
-	this->resize(read_uint(in));
+	this->resize(in.read_uint());
 	for (auto i = begin(); i != end(); ++i) {i->read(in);}
-	return 1;
+	return in.good();
 }
 
 
@@ -1207,16 +1337,28 @@ bool material_t::write(ostream &out) const {
 	out.write((char const *)this, sizeof(material_params_t));
 	write_vector(out, name);
 	write_vector(out, filename);
-	return (geom.write(out) && geom_tan.write(out));
+	// write the size of the geometry section so that readers can locate each material's geometry without parsing the previous ones
+	streampos const size_pos(out.tellp());
+	uint64_t geom_size(0);
+	out.write((char const *)&geom_size, sizeof(uint64_t)); // placeholder
+	if (!geom.write(out) || !geom_tan.write(out)) return 0;
+	streampos const end_pos(out.tellp());
+	geom_size = uint64_t(end_pos - size_pos) - sizeof(uint64_t);
+	out.seekp(size_pos);
+	out.write((char const *)&geom_size, sizeof(uint64_t));
+	out.seekp(end_pos);
+	return out.good();
 }
 
 
-bool material_t::read(istream &in) {
+bool material_t::read_header(model3d_reader_t &in, uint64_t &geom_size) { // geom_size is only valid for the versioned format
 
 	in.read((char *)this, sizeof(material_params_t));
-	read_vector(in, name);
-	read_vector(in, filename);
-	return (geom.read(in) && geom_tan.read(in));
+	in.read_vector(name);
+	in.read_vector(filename);
+	geom_size = 0;
+	if (in.get_page_size() > 0) {in.read(&geom_size, sizeof(uint64_t));}
+	return in.good();
 }
 
 
@@ -1236,6 +1378,11 @@ unsigned model3d::add_triangles(vector<triangle> const &triangles, colorRGBA con
 	vntc_map_t  vmap    [2] = {vntc_map_t (1), vntc_map_t (1)};
 	vntct_map_t vmap_tan[2] = {vntct_map_t(1), vntct_map_t(1)};
 	unsigned tot_added(0);
+
+	for (unsigned d = 0; d < 2; ++d) {
+		vmap    [d].set_expected_size(3*triangles.size());
+		vmap_tan[d].set_expected_size(3*triangles.size());
+	}
 	polygon_t poly(color);
 
 	for (vector<triangle>::const_iterator i = triangles.begin(); i != triangles.end(); ++i) {
@@ -2085,6 +2232,46 @@ bool model3d::check_coll_line(point const &p1, point const &p2, point &cpos, vec
 	return coll;
 }
 
+unsigned get_line_clip_mask(point const *const p1, point const *const p2, unsigned ray_mask, cube_t const &c) {
+	for (unsigned r = 0; r < RAY_PACKET_SIZE; ++r) {
+		if ((ray_mask & (1U << r)) && !check_line_clip(p1[r], p2[r], c.d)) {ray_mask &= ~(1U << r);}
+	}
+	return ray_mask;
+}
+
+// batched version of check_coll_line() with build_bvh_if_needed=0 for up to RAY_PACKET_SIZE coherent rays; returns the mask of rays that hit
+unsigned model3d::check_coll_line_packet(point const *const p1, point const *const p2, unsigned ray_mask, point *cpos, vector3d *cnorm, colorRGBA *color, bool exact) {
+
+	if (coll_tree.is_empty()) return 0;
+	if (transforms.empty()) {return coll_tree.check_coll_line_packet(p1, p2, get_line_clip_mask(p1, p2, ray_mask, bcube), cpos, cnorm, color, exact);}
+	if (bcube_all_xf != all_zeros_cube) {ray_mask = get_line_clip_mask(p1, p2, ray_mask, bcube_all_xf);} // use bcube of transformed bcubes
+	unsigned hit_mask(0);
+	point cur[RAY_PACKET_SIZE], p1x[RAY_PACKET_SIZE], p2x[RAY_PACKET_SIZE];
+	for (unsigned r = 0; r < RAY_PACKET_SIZE; ++r) {if (ray_mask & (1U << r)) {cur[r] = p2[r];}}
+
+	for (auto xf = transforms.begin(); xf != transforms.end() && ray_mask; ++xf) { // an affine transform keeps the packet coherent
+		unsigned const xf_mask(get_line_clip_mask(p1, p2, ray_mask, xf->get_xformed_bcube(bcube)));
+		if (xf_mask == 0) continue;
+
+		for (unsigned r = 0; r < RAY_PACKET_SIZE; ++r) {
+			if (!(xf_mask & (1U << r))) continue;
+			p1x[r] = p1[r]; p2x[r] = cur[r];
+			xf->inv_xform_pos(p1x[r]);
+			xf->inv_xform_pos(p2x[r]);
+		}
+		unsigned const xf_hits(coll_tree.check_coll_line_packet(p1x, p2x, get_line_clip_mask(p1x, p2x, xf_mask, bcube), cpos, cnorm, color, exact));
+
+		for (unsigned r = 0; r < RAY_PACKET_SIZE; ++r) {
+			if (!(xf_hits & (1U << r))) continue;
+			xf->xform_pos(cpos[r]);
+			xf->xform_pos_rm(cnorm[r]);
+			cur[r] = cpos[r]; // closer intersection point - shorten the segment
+		}
+		hit_mask |= xf_hits;
+	}
+	return hit_mask;
+}
+
 
 void model3d::get_all_mat_lib_fns(set<string> &mat_lib_fns) const {
 	for (deque<material_t>::const_iterator m = materials.begin(); m != materials.end(); ++m) {mat_lib_fns.insert(m->filename);}
@@ -2127,7 +2314,9 @@ bool model3d::write_to_disk(string const &fn) const { // Note: transforms not wr
 		return 0;
 	}
 	cout << "Writing model3d file " << fn << endl;
-	write_uint(out, MAGIC_NUMBER);
+	write_uint(out, MAGIC_NUMBER_V2);
+	write_uint(out, MODEL3D_FILE_VERSION);
+	write_uint(out, MODEL3D_PAGE_SIZE);
 	out.write((char const *)&bcube, sizeof(cube_t));
 	if (!unbound_geom.write(out)) return 0;
 	write_uint(out, (unsigned)materials.size());
@@ -2144,34 +2333,77 @@ bool model3d::write_to_disk(string const &fn) const { // Note: transforms not wr
 
 bool model3d::read_from_disk(string const &fn) { // Note: transforms not read
 
-	ifstream in(fn, ios::in | ios::binary);
+	// memory map the file if possible, which avoids the stream buffer copy and lets the OS drop file pages as they're consumed
+	mapped_file_t mfile;
+	ifstream in;
+	std::unique_ptr<model3d_reader_t> reader;
+
+	if (mfile.open(fn)) {reader.reset(new model3d_reader_t(mfile));}
+	else {
+		in.open(fn, ios::in | ios::binary);
 	
-	if (!in.good()) {
-		cerr << "Error opening model3d file for read: " << fn << endl;
-		return 0;
+		if (!in.good()) {
+			cerr << "Error opening model3d file for read: " << fn << endl;
+			return 0;
+		}
+		reader.reset(new model3d_reader_t(in));
 	}
+	model3d_reader_t &r(*reader);
 	clear(); // ???
-	unsigned const magic_number_comp(read_uint(in));
+	unsigned const magic_number_comp(r.read_uint());
 
-	if (magic_number_comp != MAGIC_NUMBER) {
+	if (magic_number_comp == MAGIC_NUMBER_V2) {
+		unsigned const version(r.read_uint()), page_size(r.read_uint());
+
+		if (version != MODEL3D_FILE_VERSION || page_size == 0) {
+			cerr << "Error reading model3d file " << fn << ": Unsupported file version " << version << " with page size " << page_size << "." << endl;
+			return 0;
+		}
+		r.set_page_size(page_size);
+	}
+	else if (magic_number_comp != MAGIC_NUMBER) {
 		cerr << "Error reading model3d file " << fn << ": Invalid file format (magic number check failed)." << endl;
 		return 0;
 	}
 	cout << "Reading model3d file " << fn << endl;
 	from_model3d_file = 1;
-	in.read((char *)&bcube, sizeof(cube_t));
-	if (!unbound_geom.read(in)) return 0;
-	materials.resize(read_uint(in));
+	r.read(&bcube, sizeof(cube_t));
+	if (!unbound_geom.read(r)) return 0;
+	materials.resize(r.read_uint());
+	vector<size_t> geom_pos(materials.size(), 0);
+	bool const parallel_read(r.is_mapped() && r.get_page_size() > 0); // material geometry offsets are known, so it can be read in parallel
 	
 	for (deque<material_t>::iterator m = materials.begin(); m != materials.end(); ++m) {
-		if (!m->read(in)) {
+		uint64_t geom_size(0);
+		bool const ret(m->read_header(r, geom_size) && (parallel_read || m->read_geom(r)));
+
+		if (!ret) {
 			cerr << "Error reading material" << endl;
 			return 0;
 		}
+		if (parallel_read) { // skip over this material's geometry for now
+			geom_pos[m - materials.begin()] = r.get_pos();
+			r.seek(r.get_pos() + geom_size);
+		}
 		mat_map[m->name] = (m - materials.begin());
 	}
+	if (parallel_read) {
+		unsigned num_errors(0);
+
+#pragma omp parallel for schedule(dynamic,1)
+		for (int i = 0; i < (int)materials.size(); ++i) {
+			model3d_reader_t mr(mfile, geom_pos[i], r.get_page_size());
+			if (materials[i].read_geom(mr)) continue;
+#pragma omp atomic
+			++num_errors;
+		}
+		if (num_errors > 0) {
+			cerr << "Error reading material geometry for " << num_errors << " materials" << endl;
+			return 0;
+		}
+	}
 	//simplify_indices(0.1); // TESTING
-	return in.good();
+	return r.good();
 }
 
 
@@ -2370,6 +2602,23 @@ bool model3ds::check_coll_line(point const &p1, point const &p2, point &cpos, ve
 	return ret;
 }
 
+unsigned model3ds::check_coll_line_packet(point const *const p1, point const *const p2, unsigned ray_mask, point *cpos, vector3d *cnorm, colorRGBA *color, bool exact) {
+
+	unsigned hit_mask(0);
+	point end_pos[RAY_PACKET_SIZE];
+	for (unsigned r = 0; r < RAY_PACKET_SIZE; ++r) {if (ray_mask & (1U << r)) {end_pos[r] = p2[r];}}
+
+	for (iterator m = begin(); m != end(); ++m) {
+		unsigned const hits(m->check_coll_line_packet(p1, end_pos, ray_mask, cpos, cnorm, color, exact));
+
+		for (unsigned r = 0; r < RAY_PACKET_SIZE; ++r) {
+			if (hits & (1U << r)) {end_pos[r] = cpos[r];} // advance so that we get the closest intersection point to p1
+		}
+		hit_mask |= hits;
+	}
+	return hit_mask;
+}
+
 
 void model3ds::write_to_cobj_file(ostream &out) const {
 	for (const_iterator m = begin(); m != end(); ++m) {m->write_to_cobj_file(out);}
@@ -20,6 +20,8 @@ unsigned const MAX_VMAP_SIZE     = (1 << 18); // 256K
 unsigned const BUILTIN_TID_START = (1 << 16); // 65K
 float const POLY_COPLANAR_THRESH = 0.98;
 
+class model3d_reader_t; // forward declaration
+
 
 struct geom_xform_t { // should be packed, can read/write as POD
 
@@ -183,21 +185,94 @@ template<typename T> struct hash_by_bytes { // should work with all packed verte
 	//uint32_t operator()(T const &v) const {return jenkins_one_at_a_time_hash((const uint32_t*)&v, sizeof(T)>>2);} // faster but lower quality hash
 };
 
-//template<typename T> class vertex_map_t : public unordered_map<T, unsigned, hash_by_bytes<T>> {
-template<typename T> class vertex_map_t : public map<T, unsigned> {
+template<typename T> struct hash_by_words { // for packed vertex types made of floats; much faster than hash_by_bytes
+	uint32_t operator()(T const &v) const {
+		static_assert((sizeof(T) & 3) == 0, "hash_by_words requires a type size that's a multiple of 4 bytes");
+		uint64_t h(0x9E3779B97F4A7C15ULL);
 
+		for (unsigned i = 0; i < sizeof(T); i += 4) {
+			uint32_t w;
+			memcpy(&w, ((const uint8_t*)&v + i), 4);
+			if (w == 0x80000000) {w = 0;} // -0.0 == 0.0, so they must hash the same
+			h = (h ^ w)*0xFF51AFD7ED558CCDULL;
+		}
+		h ^= (h >> 29); h *= 0xC4CEB9FE1A85EC53ULL; h ^= (h >> 32); // mix the high bits into the low bits used for the table index
+		return uint32_t(h);
+	}
+};
+
+// maps vertices to their index for vertex uniquing; uses open addressing with linear probing, which avoids the per-node allocations of a map;
+// clear() is O(1) (invalidates entries by incrementing a generation counter), since the map is cleared on every material change
+template<typename T> class vertex_map_t {
+
+	struct entry_t {
+		T v;
+		unsigned ix, hash, gen; // entry is valid if gen == cur_gen
+		entry_t() : ix(0), hash(0), gen(0) {}
+	};
+	vector<entry_t> table; // size is 0 or a power of 2
+	unsigned num_entries, cur_gen, expected_size;
 	int last_mat_id;
 	unsigned last_obj_id;
 	bool average_normals;
 
+	void rehash(size_t new_size) {
+		assert(new_size > 0 && (new_size & (new_size-1)) == 0); // must be a power of 2
+		vector<entry_t> old_table(new_size);
+		old_table.swap(table);
+		size_t const mask(table.size() - 1);
+
+		for (entry_t const &e : old_table) {
+			if (e.gen != cur_gen) continue; // unused or cleared
+			size_t i(e.hash & mask);
+			while (table[i].gen == cur_gen) {i = ((i+1) & mask);}
+			table[i] = e;
+		}
+	}
 public:
-	vertex_map_t(bool average_normals_=0) : last_mat_id(-1), last_obj_id(0), average_normals(average_normals_) {}
+	vertex_map_t(bool average_normals_=0) : num_entries(0), cur_gen(1), expected_size(0), last_mat_id(-1), last_obj_id(0), average_normals(average_normals_) {}
 	bool get_average_normals() const {return average_normals;}
-	
+	size_t size() const {return num_entries;}
+	bool empty() const {return (num_entries == 0);}
+	// the table is allocated for this many vertices on first use rather than here, since callers often create maps that are never used
+	void set_expected_size(size_t num_verts) {expected_size = (unsigned)min(num_verts, (size_t)MAX_VMAP_SIZE);}
+
+	void clear() {
+		num_entries = 0;
+		if (++cur_gen != 0) return;
+		for (entry_t &e : table) {e.gen = 0;} // generation counter wrapped, reset all entries
+		cur_gen = 1;
+	}
+	// returns the index of v if it's in the map, otherwise adds v with index ix and returns ix
+	unsigned find_or_insert(T const &v, unsigned ix) {
+		if (2*(num_entries + 1) > table.size()) { // keep load factor <= 0.5
+			size_t new_size(max(table.size(), (size_t)16));
+			while (new_size < 2*max((size_t)num_entries + 1, (size_t)expected_size)) {new_size *= 2;}
+			rehash(new_size);
+		}
+		unsigned const hash(hash_by_words<T>()(v));
+		size_t const mask(table.size() - 1);
+
+		for (size_t i = (hash & mask); ; i = ((i+1) & mask)) {
+			entry_t &e(table[i]);
+
+			if (e.gen != cur_gen) { // empty slot, insert here
+				e.v    = v;
+				e.ix   = ix;
+				e.hash = hash;
+				e.gen  = cur_gen;
+				++num_entries;
+				return ix;
+			}
+			if (e.hash == hash && e.v == v) return e.ix; // found
+		}
+		assert(0); // never gets here
+		return ix;
+	}
 	void check_for_clear(int mat_id) {
-		if (mat_id != last_mat_id || this->size() >= MAX_VMAP_SIZE) {
+		if (mat_id != last_mat_id || size() >= MAX_VMAP_SIZE) {
 			last_mat_id = mat_id;
-			this->clear();
+			clear();
 		}
 	}
 };
@@ -249,7 +324,7 @@ public:
 	void optimize(unsigned npts) {remove_excess_cap();}
 	void remove_excess_cap() {if (20*vector<T>::size() < 19*vector<T>::capacity()) {vector<T>::shrink_to_fit();}}
 	void write(ostream &out) const;
-	void read(istream &in);
+	void read(model3d_reader_t &in);
 };
 
 
@@ -314,7 +389,7 @@ public:
 	unsigned get_gpu_mem() const {return (vntc_vect_t<T>::get_gpu_mem() + (this->ivbo_valid() ? indices.size()*sizeof(unsigned) : 0));}
 	void invert_tcy();
 	void write(ostream &out) const;
-	void read(istream &in);
+	void read(model3d_reader_t &in);
 	bool indexing_enabled() const {return !indices.empty();}
 	void mark_need_normalize() {need_normalize = 1;}
 };
@@ -339,7 +414,7 @@ template<typename T> struct vntc_vect_block_t : public deque<indexed_vntc_vect_t
 	void invert_tcy();
 	void simplify_indices(float reduce_target);
 	bool write(ostream &out) const;
-	bool read(istream &in);
+	bool read(model3d_reader_t &in);
 };
 
 
@@ -365,7 +440,7 @@ template<typename T> struct geometry_t {
 	void calc_area(float &area, unsigned &ntris);
 	void simplify_indices(float reduce_target);
 	bool write(ostream &out) const {return (triangles.write(out) && quads.write(out));}
-	bool read(istream &in)         {return (triangles.read (in ) && quads.read (in ));}
+	bool read(model3d_reader_t &in){return (triangles.read (in ) && quads.read (in ));}
 };
 
 
@@ -444,7 +519,8 @@ struct material_t : public material_params_t {
 	colorRGBA get_ad_color() const;
 	colorRGBA get_avg_color(texture_manager const &tmgr, int default_tid=-1) const;
 	bool write(ostream &out) const;
-	bool read(istream &in);
+	bool read_header(model3d_reader_t &in, uint64_t &geom_size);
+	bool read_geom(model3d_reader_t &in) {return (geom.read(in) && geom_tan.read(in));}
 };
 
 
@@ -569,6 +645,7 @@ public:
 	void build_cobj_tree(bool verbose);
 	bool check_coll_line_cur_xf(point const &p1, point const &p2, point &cpos, vector3d &cnorm, colorRGBA &color, bool exact);
 	bool check_coll_line(point const &p1, point const &p2, point &cpos, vector3d &cnorm, colorRGBA &color, bool exact, bool build_bvh_if_needed=0);
+	unsigned check_coll_line_packet(point const *const p1, point const *const p2, unsigned ray_mask, point *cpos, vector3d *cnorm, colorRGBA *color, bool exact);
 	bool get_needs_alpha_test() const {return needs_alpha_test;}
 	bool get_needs_bump_maps () const {return needs_bump_maps;}
 	bool uses_spec_map()        const {return has_spec_maps;}
@@ -603,6 +680,7 @@ struct model3ds : public deque<model3d> {
 	unsigned get_gpu_mem() const;
 	void build_cobj_trees(bool verbose);
 	bool check_coll_line(point const &p1, point const &p2, point &cpos, vector3d &cnorm, colorRGBA &color, bool exact, bool build_bvh_if_needed=0);
+	unsigned check_coll_line_packet(point const *const p1, point const *const p2, unsigned ray_mask, point *cpos, vector3d *cnorm, colorRGBA *color, bool exact);
 	void write_to_cobj_file(std::ostream &out) const;
 };
 
@@ -9,6 +9,7 @@
 #include <stdint.h>
 #include <algorithm> // for transform()
 #include <cctype> // for tolower()
+#include <climits> // for INT_MIN
 #include "fast_atof.h"
 
 
@@ -16,6 +17,10 @@ extern bool use_obj_file_bump_grayscale;
 extern float model_auto_tc_scale, model_mat_lod_thresh;
 extern model3ds all_models;
 
+size_t const OBJ_PARALLEL_READ_MIN_SIZE = (16 << 20); // 16MB; smaller files are read serially
+size_t const OBJ_PARALLEL_CHUNK_SIZE    = (4  << 20); // 4MB; target size of each line-aligned chunk
+int    const OBJ_IX_NONE = INT_MIN; // face index not specified in the file
+
 // hack to avoid slow multithreaded locking in getc()/ungetc() in MSVC++
 #ifndef _getc_nolock
 #define _getc_nolock   getc
@@ -228,6 +233,160 @@ public:
 // ************************************************
 
 
+// A line-aligned section of an object file that can be parsed independently of the others.
+// Face indices are stored raw and resolved in the serial merge, since relative (negative) indices depend on the v/vt/vn counts of earlier chunks.
+struct obj_file_chunk_t {
+
+	enum {EV_USEMTL=0, EV_MTLLIB, EV_OBJECT, EV_GROUP, EV_SMOOTH, EV_UNDEF};
+
+	struct event_t { // non-geometry statements, replayed in file order between faces during the merge
+		unsigned type, face_ix, line, ival;
+		string str;
+		event_t(unsigned type_, unsigned face_ix_, unsigned line_, unsigned ival_=0) : type(type_), face_ix(face_ix_), line(line_), ival(ival_) {}
+	};
+	struct face_t {
+		unsigned ix_start, npts, line, nv, ntc, nn; // {nv, ntc, nn} are the number of {v, vt, vn} seen earlier in this chunk
+		face_t(unsigned ix_start_, unsigned line_, unsigned nv_, unsigned ntc_, unsigned nn_) : ix_start(ix_start_), npts(0), line(line_), nv(nv_), ntc(ntc_), nn(nn_) {}
+	};
+	char const *start, *end;
+	unsigned num_lines, error_line;
+	string error;
+	vector<point> v;
+	vector<colorRGB> colors; // empty if no vertex in this chunk has a color, otherwise the same size as v
+	vector<point2d<float> > tc;
+	vector<vector3d> n;
+	vector<face_t> faces;
+	vector<int> face_ixs; // {vix, tix, nix} for each face vertex
+	vector<event_t> events;
+
+	obj_file_chunk_t(char const *start_=nullptr, char const *end_=nullptr) : start(start_), end(end_), num_lines(0), error_line(0) {}
+
+private:
+	static bool is_line_space(char c) {return (c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f');}
+	static bool is_digit(char c) {return (c >= '0' && c <= '9');}
+	static void skip_space(char const *&p, char const *le) {while (p < le && is_line_space(*p)) {++p;}}
+
+	static bool parse_float(char const *&p, char const *le, float &val) { // same rules as object_file_reader::read_float()
+		skip_space(p, le);
+		if (p == le || (!is_digit(*p) && *p != '.' && *p != '-')) return 0; // not a fp number
+		Assimp::fast_atoreal_move(p, val); // the file buffer is null terminated, so this can't run off the end
+		while (p < le && !is_line_space(*p)) {++p;} // skip any trailing characters, as read_float() does
+		return 1;
+	}
+	static unsigned parse_floats(char const *&p, char const *le, float *vals, unsigned max_num) { // returns the number of values read
+		for (unsigned i = 0; i < max_num; ++i) {
+			if (!parse_float(p, le, vals[i])) return i;
+		}
+		return max_num;
+	}
+	static bool parse_int(char const *&p, char const *le, int &val) {
+		skip_space(p, le);
+		char const *q(p);
+		bool const is_neg(q < le && *q == '-');
+		if (is_neg) {++q;}
+		if (q == le || !is_digit(*q)) return 0;
+		int v(0);
+		for (; q < le && is_digit(*q); ++q) {v = 10*v + int(*q - '0');}
+		val = (is_neg ? -v : v);
+		p   = q;
+		return 1;
+	}
+	static void parse_str(char const *p, char const *le, string &str) { // remainder of the line, without leading and trailing whitespace
+		skip_space(p, le);
+		while (le > p && is_line_space(*(le-1))) {--le;}
+		str.assign(p, le);
+	}
+	bool set_error(string const &msg, unsigned line) {error = msg; error_line = line; return 0;}
+
+public:
+	bool parse(geom_xform_t const &xf, int recalc_normals) {
+		string keyword;
+
+		for (char const *ls = start; ls < end; ++num_lines) {
+			char const *le((char const *)memchr(ls, '\n', (end - ls)));
+			if (le == nullptr) {le = end;}
+			char const *p(ls);
+			ls = le + 1; // start of next line
+			skip_space(p, le);
+			if (p == le || *p == '#') continue; // empty line or comment
+			char const *const ks(p);
+			while (p < le && !is_line_space(*p)) {++p;}
+			size_t const klen(p - ks);
+			auto is_kw([&](char const *const kw) {return (klen == strlen(kw) && memcmp(ks, kw, klen) == 0);});
+
+			if (is_kw("f")) { // face
+				faces.emplace_back((unsigned)face_ixs.size(), num_lines, (unsigned)v.size(), (unsigned)tc.size(), (unsigned)n.size());
+				int vix(0);
+
+				while (parse_int(p, le, vix)) { // read vertex index
+					int tix(OBJ_IX_NONE), nix(OBJ_IX_NONE);
+
+					if (p < le && *p == '/') {
+						++p;
+						parse_int(p, le, tix); // text coord index, ok to fail
+						if (p < le && *p == '/') {++p; parse_int(p, le, nix);} // normal index, ok to fail
+					}
+					face_ixs.push_back(vix);
+					face_ixs.push_back(tix);
+					face_ixs.push_back(nix);
+					++faces.back().npts;
+				}
+			}
+			else if (is_kw("v")) { // vertex
+				float vals[7] = {0};
+				unsigned const num(parse_floats(p, le, vals, 7));
+				if (num < 3) {return set_error("vertex", num_lines);}
+				if (num != 3 && num != 6) {return set_error("vertex color", num_lines);}
+				v.emplace_back(vals[0], vals[1], vals[2]);
+				xf.xform_pos(v.back());
+				if (num == 6 && colors.empty()) {colors.resize(v.size()-1, WHITE);} // pad colors up to this point with white
+				if (!colors.empty()) {colors.push_back((num == 6) ? colorRGB(vals[3], vals[4], vals[5]) : colorRGB(WHITE));}
+			}
+			else if (is_kw("vt")) { // tex coord
+				float vals[3] = {0};
+				if (parse_floats(p, le, vals, 3) < 2) {return set_error("texture coord", num_lines);}
+				tc.emplace_back(vals[0], vals[1]); // discard z
+			}
+			else if (is_kw("vn")) { // normal
+				float vals[3] = {0};
+				if (parse_floats(p, le, vals, 3) < 3) {return set_error("normal", num_lines);}
+				
+				if (!recalc_normals) {
+					vector3d normal(vals[0], vals[1], vals[2]);
+					xf.xform_pos_rm(normal);
+					n.push_back(normal);
+				}
+			}
+			else if (is_kw("l")) {} // line - ignore
+			else if (is_kw("s")) { // smoothing/shading (off/on or 0/1)
+				int sg(0);
+				string str;
+
+				if (!parse_int(p, le, sg) || sg < 0) {
+					parse_str(p, le, str);
+					if (str != "off") {return set_error("smoothing group", num_lines);}
+					sg = 0;
+				}
+				events.emplace_back(EV_SMOOTH, (unsigned)faces.size(), num_lines, sg);
+			}
+			else {
+				unsigned type(EV_UNDEF);
+				if      (is_kw("o"))      {type = EV_OBJECT;}
+				else if (is_kw("g"))      {type = EV_GROUP;}
+				else if (is_kw("usemtl")) {type = EV_USEMTL;}
+				else if (is_kw("mtllib")) {type = EV_MTLLIB;}
+				events.emplace_back(type, (unsigned)faces.size(), num_lines);
+				if (type == EV_UNDEF) {events.back().str.assign(ks, klen);} else {parse_str(p, le, events.back().str);}
+			}
+		} // for ls
+		return 1;
+	}
+};
+
+
+// ************************************************
+
+
 string model_from_file_t::open_include_file(string const &fn, string const &type, ifstream &in_inc) const {
 	assert(!fn.empty());
 	// try absolute path
@@ -281,7 +440,7 @@ bool endswith(string const &value, string const &ending) {
 
 class object_file_reader_model : public object_file_reader, public model_from_file_t {
 
-	bool had_empty_mat_error;
+	bool had_empty_mat_error, had_npts_error;
 
 	bool read_map_name(ifstream &in, string &name, float *scale=nullptr) {
 		if (!(in >> name)) {return 0;} // no name read (EOF?)
@@ -317,7 +476,7 @@ class object_file_reader_model : public object_file_reader, public model_from_fi
 	}
 
 public:
-	object_file_reader_model(string const &fn, model3d &model_) : object_file_reader(fn), model_from_file_t(fn, model_), had_empty_mat_error(0) {}
+	object_file_reader_model(string const &fn, model3d &model_) : object_file_reader(fn), model_from_file_t(fn, model_), had_empty_mat_error(0), had_npts_error(0) {}
 
 	bool load_mat_lib(string const &fn) { // Note: could cache filename, but seems to never be included more than once
 		ifstream mat_in;
@@ -529,13 +688,329 @@ public:
 		return 1;
 	}
 
+	poly_data_block &start_face(deque<poly_data_block> &pblocks, int cur_mat_id, unsigned obj_group_id, unsigned smoothing_group, unsigned &prev_smoothing_group) {
+		unsigned const block_size = (1 << 18); // 256K
+		model.mark_mat_as_used(cur_mat_id);
+
+		if (pblocks.empty() || pblocks.back().pts.size() >= block_size || smoothing_group != prev_smoothing_group) { // create a new block
+			if (!pblocks.empty()) {
+				remove_excess_cap(pblocks.back().polys);
+				remove_excess_cap(pblocks.back().pts);
+			}
+			pblocks.push_back(poly_data_block());
+			prev_smoothing_group = smoothing_group;
+		}
+		poly_data_block &pb(pblocks.back());
+		pb.polys.push_back(poly_header_t(cur_mat_id, obj_group_id));
+		return pb;
+	}
+
+	// computes the normal of the last face in pb, whose points start at pix, and accumulates it into the vertex normals if recalc_normals is set;
+	// returns false and removes the face if it's degenerate
+	bool finish_face(poly_data_block &pb, unsigned pix, vector<point> const &v, vector<counted_normal> &vn, int recalc_normals, bool is_textured, unsigned approx_line) {
+		unsigned const npts(pb.polys.back().npts);
+
+		if (npts < 3) {
+			if (!had_npts_error) {cerr << "Error near line " << approx_line << ": face has only " << npts << " vertices." << endl; had_npts_error = 1;}
+			pb.pts.resize(pix);
+			pb.polys.pop_back(); // remove pts and polygon
+			return 0; // skip it
+		}
+		vector3d &normal(pb.polys.back().n);
+				
+		for (unsigned i = pix; i < pix+npts-2; ++i) { // find a nonzero normal
+			normal = cross_product((v[pb.pts[i+1].vix] - v[pb.pts[i].vix]), (v[pb.pts[i+2].vix] - v[pb.pts[i].vix])); // backwards?
+			// if we disable this normalize() we will weight normal contributions by polygon area,
+			// but we have to change the code below and it causes problems with vertex uniquing
+			normal.normalize();
+			if (normal != zero_vector) break; // got a good normal
+		}
+		if (recalc_normals) {
+			bool const face_weight_avg(recalc_normals == 2 && (npts == 3 || npts == 4)); // only works for quads and triangles
+			float face_area(0.0);
+
+			if (face_weight_avg) {
+				point face_pts[4];
+				for (unsigned i = 0; i < npts; ++i) {face_pts[i] = v[pb.pts[i+pix].vix];}
+				face_area = polygon_area(face_pts, npts);
+			}
+			for (unsigned i = pix; i < pix+npts; ++i) {
+				unsigned const vix(pb.pts[i].vix);
+				assert((unsigned)vix < vn.size());
+				bool const using_texgen(is_textured && model_auto_tc_scale > 0.0 && pb.pts[i].tix == 0);
+
+				if (vn[vix].is_valid() && (using_texgen || dot_product(normal, vn[vix].get_norm()) < 0.25)) { // normals in disagreement (or using texgen)
+					vn[vix] = zero_vector; // zero it out so that it becomes invalid later
+				}
+				else if (face_weight_avg) {vn[vix].add_normal(face_area*normal);} // face weighted average
+				else {vn[vix].add_normal(normal);} // unweighted average of normals
+			}
+		}
+		return 1;
+	}
+
+	bool set_material(string const &material_name, int &cur_mat_id, bool &is_textured, unsigned approx_line) {
+		if (material_name.empty()) {
+			if (!had_empty_mat_error) {cerr << "Error reading material from object file " << filename << " near line " << approx_line << endl;}
+			had_empty_mat_error = 1;
+			return 0;
+		}
+		cur_mat_id = model.find_material(material_name);
+				
+		if (cur_mat_id >= 0) { // material was valid
+			int const tid(model.get_material(cur_mat_id).d_tid);
+			is_textured = (tid >= 0 && model.tmgr.get_tex_avg_color(tid) != WHITE); // no texture, or all white texture
+		}
+		return 1;
+	}
+
+	bool add_mat_lib(string const &mat_lib, set<string> &loaded_mat_libs, unsigned approx_line) {
+		if (mat_lib.empty()) {
+			cerr << "Error reading material library from object file " << filename << " near line " << approx_line << endl;
+			return 0;
+		}
+		if (!try_load_mat_lib(mat_lib, loaded_mat_libs, approx_line)) {
+			//return 0; // nonfatal
+		}
+		return 1;
+	}
+
+	// converts the parsed polygon blocks into model geometry; timer1 is the start time of the file read
+	void build_model(vector<point> &v, vector<vector3d> &n, vector<counted_normal> &vn, vector<point2d<float> > &tc, vector<colorRGB> &colors,
+		deque<poly_data_block> &pblocks, int recalc_normals, bool verbose, unsigned num_objects, unsigned num_groups, int const timer1)
+	{
+		remove_excess_cap(v);
+		remove_excess_cap(n);
+		remove_excess_cap(tc);
+		remove_excess_cap(vn);
+		remove_excess_cap(colors);
+		PRINT_TIME("Object File Load");
+		model.load_all_used_tids(); // need to load the textures here to get the colors
+		PRINT_TIME("Model Texture Load");
+		size_t const num_blocks(pblocks.size());
+		unsigned num_faces(0);
+		model3d::proc_model_normals(vn, recalc_normals); // if recalc_normals
+		vntc_map_t vmap[2]; // {triangles, quads}
+		vntct_map_t vmap_tan[2]; // {triangles, quads}
+
+		for (unsigned d = 0; d < 2; ++d) { // size for the number of unique vertices, which is at most the number of verts in the file
+			vmap    [d].set_expected_size(v.size());
+			vmap_tan[d].set_expected_size(v.size());
+		}
+		while (!pblocks.empty()) {
+			poly_data_block const &pd(pblocks.back());
+			unsigned pix(0);
+			polygon_t poly;
+
+			for (unsigned d = 0; d < 2; ++d) { // reuse the tables across blocks, but don't share vertices
+				vmap    [d].clear();
+				vmap_tan[d].clear();
+			}
+
+			for (vector<poly_header_t>::const_iterator j = pd.polys.begin(); j != pd.polys.end(); ++j) {
+				poly.resize(j->npts);
+				
+				for (unsigned p = 0; p < j->npts; ++p) {
+					vntc_ix_t const &V(pd.pts[pix+p]);
+					vector3d normal;
+
+					if (recalc_normals) {
+						assert(V.vix < vn.size());
+						normal = ((j->n != zero_vector && !vn[V.vix].is_valid()) ? j->n : vn[V.vix]);
+					}
+					else {
+						assert(V.nix < n.size());
+						normal = n[V.nix];
+						if (normal == zero_vector) normal = j->n;
+					}
+					assert(V.vix < v.size() && V.tix < tc.size());
+					point2d<float> tcoord;
+
+					if (V.tix == 0 && model_auto_tc_scale > 0.0) { // generate tc since it wasn't read from the file
+						unsigned const dim(get_max_dim(normal)), dimx((dim == 0) ? 1 : 0), dimy((dim == 2) ? 1 : 2); // looks better for brick textures on walls
+						tcoord.x = model_auto_tc_scale*v[V.vix][dimx];
+						tcoord.y = model_auto_tc_scale*v[V.vix][dimy];
+					}
+					else {tcoord = tc[V.tix];}
+					poly[p] = vert_norm_tc(v[V.vix], normal, tcoord.x, tcoord.y);
+					if (!colors.empty()) {assert(V.vix < colors.size()); poly.color += colors[V.vix];}
+				} // for p
+				if (!colors.empty()) {poly.color = poly.color/j->npts; poly.color.A = 1.0;} // FIXME: uses average vertex color for each face/polygon
+				num_faces += model.add_polygon(poly, vmap, vmap_tan, j->mat_id, j->obj_id);
+				pix += j->npts;
+			} // for j
+			pblocks.pop_back();
+		}
+		model.finalize(); // optimize vertices, remove excess capacity, compute bounding cube, subdivide, generate LOD blocks
+		PRINT_TIME("Model3d Build");
+		
+		if (verbose) {
+			size_t const nn(recalc_normals ? vn.size() : n.size());
+			cout << "verts: " << v.size() << ", normals: " << nn << ", tcs: " << tc.size() << ", colors: " << colors.size() << ", faces: " << num_faces
+				 << ", objects: " << num_objects << ", groups: " << num_groups << ", blocks: " << num_blocks << endl;
+			model.show_stats();
+		}
+	}
+
+	// Large files are read into memory, split into line-aligned chunks that are parsed in parallel, then merged serially in file order.
+	// Faces, materials, groups, and smoothing groups are replayed in the same order as the serial reader, so the resulting model is identical.
+	bool read_parallel(vector<char> &file_data, geom_xform_t const &xf, int recalc_normals, bool verbose, int const timer1) {
+		assert(!file_data.empty() && file_data.back() == '\0'); // must be null terminated
+		char const *const data(file_data.data());
+		size_t const data_sz(file_data.size() - 1);
+		unsigned const num_chunks(max(1U, (unsigned)min((data_sz + OBJ_PARALLEL_CHUNK_SIZE - 1)/OBJ_PARALLEL_CHUNK_SIZE, size_t(16*omp_get_max_threads_3dw()))));
+		vector<obj_file_chunk_t> chunks;
+		chunks.reserve(num_chunks);
+		char const *cstart(data);
+
+		for (unsigned i = 0; i < num_chunks; ++i) { // split at the first newline after each even division
+			char const *cend(data + ((i+1 == num_chunks) ? data_sz : (data_sz*(i+1))/num_chunks));
+			if (cend < cstart) {cend = cstart;}
+			char const *const nl((char const *)memchr(cend, '\n', (data + data_sz - cend)));
+			cend = ((nl == nullptr) ? (data + data_sz) : (nl + 1));
+			chunks.emplace_back(cstart, cend);
+			cstart = cend;
+		}
+#pragma omp parallel for schedule(dynamic, 1)
+		for (int i = 0; i < (int)chunks.size(); ++i) {chunks[i].parse(xf, recalc_normals);}
+		PRINT_TIME("Object File Parse");
+		// merge geometry; this has to be done before the faces are resolved, since face normals are computed from vertices
+		vector<point> v; // vertices
+		vector<vector3d> n; // normals
+		vector<counted_normal> vn; // vertex normals
+		vector<point2d<float> > tc; // texture coords
+		vector<colorRGB> colors; // vertex colors
+		vector<unsigned> v_off(chunks.size()), tc_off(chunks.size()), n_off(chunks.size()), line_off(chunks.size());
+		size_t nv(0), ntc(1), nn(1); // account for tc[0] and n[0]
+		unsigned nlines(0);
+		bool has_colors(0);
+
+		for (unsigned i = 0; i < chunks.size(); ++i) {
+			obj_file_chunk_t const &c(chunks[i]);
+			v_off[i] = (unsigned)nv; tc_off[i] = (unsigned)ntc; n_off[i] = (unsigned)nn; line_off[i] = nlines;
+			nv  += c.v.size();
+			ntc += c.tc.size();
+			nn  += c.n.size();
+			nlines += c.num_lines;
+			has_colors |= !c.colors.empty();
+		}
+		v.reserve(nv);
+		tc.reserve(ntc);
+		n.reserve(nn);
+		tc.push_back(point2d<float>(0.0, 0.0)); // default tex coords
+		n.push_back(zero_vector); // default normal
+		if (has_colors) {colors.resize(nv, WHITE);} // vertices without colors are padded with white
+		if (recalc_normals) {vn.resize(nv);}
+
+		for (unsigned i = 0; i < chunks.size(); ++i) {
+			obj_file_chunk_t const &c(chunks[i]);
+			v .insert(v .end(), c.v .begin(), c.v .end());
+			tc.insert(tc.end(), c.tc.begin(), c.tc.end());
+			n .insert(n .end(), c.n .begin(), c.n .end());
+			if (!c.colors.empty()) {std::copy(c.colors.begin(), c.colors.end(), colors.begin()+v_off[i]);}
+		}
+		// replay faces and events in file order
+		int cur_mat_id(-1);
+		unsigned smoothing_group(0), prev_smoothing_group(0), num_objects(0), num_groups(0), obj_group_id(0);
+		deque<poly_data_block> pblocks;
+		set<string> loaded_mat_libs;
+		bool is_textured(0);
+
+		for (unsigned i = 0; i < chunks.size(); ++i) {
+			obj_file_chunk_t &c(chunks[i]);
+			auto eit(c.events.begin());
+
+			for (unsigned f = 0; f <= c.faces.size(); ++f) {
+				for (; eit != c.events.end() && eit->face_ix <= f; ++eit) { // events before this face
+					unsigned const approx_line(line_off[i] + eit->line + 1);
+
+					switch (eit->type) {
+					case obj_file_chunk_t::EV_USEMTL:
+						if (!set_material(eit->str, cur_mat_id, is_textured, approx_line)) return 0;
+						break;
+					case obj_file_chunk_t::EV_MTLLIB:
+						if (!add_mat_lib(eit->str, loaded_mat_libs, approx_line)) return 0;
+						break;
+					case obj_file_chunk_t::EV_OBJECT: ++num_objects; ++obj_group_id; break;
+					case obj_file_chunk_t::EV_GROUP:  ++num_groups;  ++obj_group_id; break;
+					case obj_file_chunk_t::EV_SMOOTH: smoothing_group = eit->ival;   break;
+					case obj_file_chunk_t::EV_UNDEF:
+						cerr << "Error: Undefined entry '" << eit->str << "' in object file " << filename << " near line " << approx_line << endl;
+						break;
+					default: assert(0);
+					}
+				} // for eit
+				if (f == c.faces.size()) break;
+				obj_file_chunk_t::face_t const &face(c.faces[f]);
+				poly_data_block &pb(start_face(pblocks, cur_mat_id, obj_group_id, smoothing_group, prev_smoothing_group));
+				unsigned const pix((unsigned)pb.pts.size());
+
+				for (unsigned p = 0; p < face.npts; ++p) {
+					int const *const ixs(&c.face_ixs[3*(face.ix_start + p)]);
+					int vix(ixs[0]), tix(ixs[1]), nix(ixs[2]);
+					normalize_index(vix, (v_off[i] + face.nv));
+					vntc_ix_t vntc_ix(vix, 0, 0);
+
+					if (tix != OBJ_IX_NONE) {
+						normalize_index(tix, (tc_off[i] + face.ntc - 1)); // account for tc[0]
+						vntc_ix.tix = tix+1; // account for tc[0]
+					}
+					if (nix != OBJ_IX_NONE && !recalc_normals) {
+						normalize_index(nix, (n_off[i] + face.nn - 1)); // account for n[0]
+						vntc_ix.nix = nix+1; // account for n[0]
+					} // else the normal will be recalculated later
+					pb.pts.push_back(vntc_ix);
+					++pb.polys.back().npts;
+				}
+				finish_face(pb, pix, v, vn, recalc_normals, is_textured, (line_off[i] + face.line + 1));
+			} // for f
+			if (!c.error.empty()) {
+				cerr << "Error reading " << c.error << " from object file " << filename << " near line " << (line_off[i] + c.error_line + 1) << endl;
+				return 0;
+			}
+			c = obj_file_chunk_t(); // free memory
+		} // for i
+		build_model(v, n, vn, tc, colors, pblocks, recalc_normals, verbose, num_objects, num_groups, timer1);
+		return 1;
+	}
+
+	bool read_file_data(vector<char> &file_data) {
+		assert(fp != nullptr);
+		size_t const read_sz(1 << 24); // 16MB
+
+		while (1) {
+			size_t const start(file_data.size());
+			file_data.resize(start + read_sz);
+			size_t const num_read(fread(file_data.data() + start, 1, read_sz, fp));
+			file_data.resize(start + num_read);
+			if (num_read < read_sz) break; // EOF or error
+		}
+		if (ferror(fp)) {cerr << "Error reading object file " << filename << endl; return 0;}
+		file_data.push_back('\0'); // null terminate
+		return 1;
+	}
+
+	bool use_parallel_read() {
+		assert(fp != nullptr);
+		if (omp_get_max_threads_3dw() <= 1 || fseek(fp, 0, SEEK_END) != 0) return 0;
+		long const file_sz(ftell(fp)); // may fail for files > 2GB on some platforms, in which case we use the serial reader
+		rewind(fp);
+		return (file_sz > 0 && (size_t)file_sz >= OBJ_PARALLEL_READ_MIN_SIZE);
+	}
+
 	bool read(geom_xform_t const &xf, int recalc_normals, bool verbose) {
 		RESET_TIME;
 		if (!open_file()) return 0;
 		cout << "Reading object file " << filename << endl;
-		unsigned const block_size = (1 << 18); // 256K
+
+		if (use_parallel_read()) {
+			vector<char> file_data;
+			if (!read_file_data(file_data)) return 0;
+			close_file();
+			return read_parallel(file_data, xf, recalc_normals, verbose, timer1);
+		}
 		int cur_mat_id(-1);
-		unsigned smoothing_group(0), prev_smoothing_group(0), num_faces(0), num_objects(0), num_groups(0), obj_group_id(0);
+		unsigned smoothing_group(0), prev_smoothing_group(0), num_objects(0), num_groups(0), obj_group_id(0);
 		vector<point> v; // vertices
 		vector<vector3d> n; // normals
 		// weighted_normal can also be used, but doesn't work well; see face_weight_avg mode selected by recalc_normals==2
@@ -549,7 +1024,7 @@ public:
 		tc.push_back(point2d<float>(0.0, 0.0)); // default tex coords
 		n.push_back(zero_vector); // default normal
 		unsigned approx_line(0);
-		bool is_textured(0), had_npts_error(0);
+		bool is_textured(0);
 
 		while (read_string(s, MAX_CHARS)) {
 			++approx_line;
@@ -562,20 +1037,9 @@ public:
 				read_to_newline(fp); // ignore
 			}
 			else if (strcmp(s, "f") == 0) { // face
-				model.mark_mat_as_used(cur_mat_id);
-
-				if (pblocks.empty() || pblocks.back().pts.size() >= block_size || smoothing_group != prev_smoothing_group) { // create a new block
-					if (!pblocks.empty()) {
-						remove_excess_cap(pblocks.back().polys);
-						remove_excess_cap(pblocks.back().pts);
-					}
-					pblocks.push_back(poly_data_block());
-					prev_smoothing_group = smoothing_group;
-				}
-				poly_data_block &pb(pblocks.back());
-				pb.polys.push_back(poly_header_t(cur_mat_id, obj_group_id));
+				poly_data_block &pb(start_face(pblocks, cur_mat_id, obj_group_id, smoothing_group, prev_smoothing_group));
 				unsigned &npts(pb.polys.back().npts);
-				unsigned const pix((unsigned)pb.pts.size()), pts_start(pb.pts.size());
+				unsigned const pix((unsigned)pb.pts.size());
 				int vix(0), tix(0), nix(0);
 
 				while (read_int(vix)) { // read vertex index
@@ -602,42 +1066,7 @@ public:
 					pb.pts.push_back(vntc_ix);
 					++npts;
 				} // end while vertex
-				if (npts < 3) {
-					if (!had_npts_error) {cerr << "Error near line " << approx_line << ": face has only " << npts << " vertices." << endl; had_npts_error = 1;}
-					pb.pts.resize(pts_start);
-					pb.polys.pop_back(); // remove pts and polygon
-					continue; // skip it
-				}
-				vector3d &normal(pb.polys.back().n);
-				
-				for (unsigned i = pix; i < pix+npts-2; ++i) { // find a nonzero normal
-					normal = cross_product((v[pb.pts[i+1].vix] - v[pb.pts[i].vix]), (v[pb.pts[i+2].vix] - v[pb.pts[i].vix])); // backwards?
-					// if we disable this normalize() we will weight normal contributions by polygon area,
-					// but we have to change the code below and it causes problems with vertex uniquing
-					normal.normalize();
-					if (normal != zero_vector) break; // got a good normal
-				}
-				if (recalc_normals) {
-					bool const face_weight_avg(recalc_normals == 2 && (npts == 3 || npts == 4)); // only works for quads and triangles
-					float face_area(0.0);
-
-					if (face_weight_avg) {
-						point face_pts[4];
-						for (unsigned i = 0; i < npts; ++i) {face_pts[i] = v[pb.pts[i+pix].vix];}
-						face_area = polygon_area(face_pts, npts);
-					}
-					for (unsigned i = pix; i < pix+npts; ++i) {
-						unsigned const vix(pb.pts[i].vix);
-						assert((unsigned)vix < vn.size());
-						bool const using_texgen(is_textured && model_auto_tc_scale > 0.0 && pb.pts[i].tix == 0);
-
-						if (vn[vix].is_valid() && (using_texgen || dot_product(normal, vn[vix].get_norm()) < 0.25)) { // normals in disagreement (or using texgen)
-							vn[vix] = zero_vector; // zero it out so that it becomes invalid later
-						}
-						else if (face_weight_avg) {vn[vix].add_normal(face_area*normal);} // face weighted average
-						else {vn[vix].add_normal(normal);} // unweighted average of normals
-					}
-				}
+				finish_face(pb, pix, v, vn, recalc_normals, is_textured, approx_line);
 			}
 			else if (strcmp(s, "v") == 0) { // vertex
 				v.push_back(point());
@@ -702,29 +1131,11 @@ public:
 			}
 			else if (strcmp(s, "usemtl") == 0) { // use material
 				read_str_to_newline(fp, material_name);
-
-				if (material_name.empty()) {
-					if (!had_empty_mat_error) {cerr << "Error reading material from object file " << filename << " near line " << approx_line << endl;}
-					had_empty_mat_error = 1;
-					return 0;
-				}
-				cur_mat_id = model.find_material(material_name);
-				
-				if (cur_mat_id >= 0) { // material was valid
-					int const tid(model.get_material(cur_mat_id).d_tid);
-					is_textured = (tid >= 0 && model.tmgr.get_tex_avg_color(tid) != WHITE); // no texture, or all white texture
-				}
+				if (!set_material(material_name, cur_mat_id, is_textured, approx_line)) return 0;
 			}
 			else if (strcmp(s, "mtllib") == 0) { // material library
 				read_str_to_newline(fp, mat_lib);
-
-				if (mat_lib.empty()) {
-					cerr << "Error reading material library from object file " << filename << " near line " << approx_line << endl;
-					return 0;
-				}
-				if (!try_load_mat_lib(mat_lib, loaded_mat_libs, approx_line)) {
-					//return 0; // nonfatal
-				}
+				if (!add_mat_lib(mat_lib, loaded_mat_libs, approx_line)) return 0;
 			}
 			else {
 				cerr << "Error: Undefined entry '" << s << "' in object file " << filename << " near line " << approx_line << endl;
@@ -732,67 +1143,7 @@ public:
 				//return 0;
 			}
 		} // while
-		remove_excess_cap(v);
-		remove_excess_cap(n);
-		remove_excess_cap(tc);
-		remove_excess_cap(vn);
-		remove_excess_cap(colors);
-		PRINT_TIME("Object File Load");
-		model.load_all_used_tids(); // need to load the textures here to get the colors
-		PRINT_TIME("Model Texture Load");
-		size_t const num_blocks(pblocks.size());
-		model3d::proc_model_normals(vn, recalc_normals); // if recalc_normals
-
-		while (!pblocks.empty()) {
-			poly_data_block const &pd(pblocks.back());
-			unsigned pix(0);
-			polygon_t poly;
-			vntc_map_t vmap[2]; // {triangles, quads}
-			vntct_map_t vmap_tan[2]; // {triangles, quads}
-
-			for (vector<poly_header_t>::const_iterator j = pd.polys.begin(); j != pd.polys.end(); ++j) {
-				poly.resize(j->npts);
-				
-				for (unsigned p = 0; p < j->npts; ++p) {
-					vntc_ix_t const &V(pd.pts[pix+p]);
-					vector3d normal;
-
-					if (recalc_normals) {
-						assert(V.vix < vn.size());
-						normal = ((j->n != zero_vector && !vn[V.vix].is_valid()) ? j->n : vn[V.vix]);
-					}
-					else {
-						assert(V.nix < n.size());
-						normal = n[V.nix];
-						if (normal == zero_vector) normal = j->n;
-					}
-					assert(V.vix < v.size() && V.tix < tc.size());
-					point2d<float> tcoord;
-
-					if (V.tix == 0 && model_auto_tc_scale > 0.0) { // generate tc since it wasn't read from the file
-						unsigned const dim(get_max_dim(normal)), dimx((dim == 0) ? 1 : 0), dimy((dim == 2) ? 1 : 2); // looks better for brick textures on walls
-						tcoord.x = model_auto_tc_scale*v[V.vix][dimx];
-						tcoord.y = model_auto_tc_scale*v[V.vix][dimy];
-					}
-					else {tcoord = tc[V.tix];}
-					poly[p] = vert_norm_tc(v[V.vix], normal, tcoord.x, tcoord.y);
-					if (!colors.empty()) {assert(V.vix < colors.size()); poly.color += colors[V.vix];}
-				} // for p
-				if (!colors.empty()) {poly.color = poly.color/j->npts; poly.color.A = 1.0;} // FIXME: uses average vertex color for each face/polygon
-				num_faces += model.add_polygon(poly, vmap, vmap_tan, j->mat_id, j->obj_id);
-				pix += j->npts;
-			} // for j
-			pblocks.pop_back();
-		}
-		model.finalize(); // optimize vertices, remove excess capacity, compute bounding cube, subdivide, generate LOD blocks
-		PRINT_TIME("Model3d Build");
-		
-		if (verbose) {
-			size_t const nn(recalc_normals ? vn.size() : n.size());
-			cout << "verts: " << v.size() << ", normals: " << nn << ", tcs: " << tc.size() << ", colors: " << colors.size() << ", faces: " << num_faces
-				 << ", objects: " << num_objects << ", groups: " << num_groups << ", blocks: " << num_blocks << endl;
-			model.show_stats();
-		}
+		build_model(v, n, vn, tc, colors, pblocks, recalc_normals, verbose, num_objects, num_groups, timer1);
 		return 1;
 	}
 };
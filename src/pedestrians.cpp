@@ -9,6 +9,7 @@ float const PED_HEIGHT_SCALE = 2.5; // ratio of collision radius to model height
 float const CROSS_SPEED_MULT = 1.8; // extra speed multiplier when crossing the road
 float const CROSS_WAIT_TIME  = 60.0; // in seconds
 bool const FORCE_USE_CROSSWALKS = 0; // more realistic and safe, but causes problems with pedestian collisions
+unsigned const PED_PARALLEL_UPDATE_MIN = 4096; // min number of city peds to use the parallel update
 
 extern bool tt_fire_button_down;
 extern int display_mode, game_mode, animate2, frame_counter;
@@ -124,15 +125,19 @@ void register_ped_coll(pedestrian_t &p1, pedestrian_t &p2, unsigned pid1, unsign
 	p2.collided = p2.ped_coll = 1; p2.colliding_ped = pid1;
 }
 
-bool pedestrian_t::check_ped_ped_coll_range(vector<pedestrian_t> &peds, unsigned pid, unsigned ped_start, unsigned target_plot, float prox_radius, vector3d &force) {
+// T is either pedestrian_t or ped_manager_t::ped_snapshot_t; returns 1 and sets coll_ix on collision
+template<typename T> bool pedestrian_t::check_ped_ped_coll_range(vector<T> const &others, unsigned pid, unsigned ped_start, unsigned ped_end, unsigned target_plot,
+	float prox_radius, vector3d &force, unsigned &coll_ix) const
+{
 	float const prox_radius_sq(prox_radius*prox_radius);
+	assert(ped_end <= others.size());
 
-	for (auto i = peds.begin()+ped_start; i != peds.end(); ++i) { // check every ped until we exit target_plot
+	for (auto i = others.begin()+ped_start; i != others.begin()+ped_end; ++i) { // check every ped until we exit target_plot
 		if (i->plot != target_plot) break; // moved to a new plot, no collision, done; since plots are globally unique across cities, we don't need to check cities
 		float const dist_sq(p2p_dist_xy_sq(pos, i->pos));
 		if (dist_sq > prox_radius_sq) continue; // proximity test
 		float const r_sum(0.6f*(radius + i->radius)); // using a smaller radius to allow peds to get close to each other
-		if (dist_sq < r_sum*r_sum) {register_ped_coll(*this, *i, pid, (i - peds.begin())); return 1;} // collision
+		if (dist_sq < r_sum*r_sum) {coll_ix = (i - others.begin()); return 1;} // collision
 		if (speed < TOLERANCE) continue;
 		vector3d const delta_v(vel - i->vel), delta_p((pos.x - i->pos.x), (pos.y - i->pos.y), 0.0);
 		float const dp(-dot_product_xy(delta_v, delta_p));
@@ -149,30 +154,32 @@ bool pedestrian_t::check_ped_ped_coll_range(vector<pedestrian_t> &peds, unsigned
 	return 0;
 }
 
-bool pedestrian_t::check_ped_ped_coll(ped_manager_t const &ped_mgr, vector<pedestrian_t> &peds, unsigned pid, float delta_dir) {
+// ped_end is the end of the range of peds that can be modified by this call, which is the end of this ped's plot when updating in parallel
+bool pedestrian_t::check_ped_ped_coll(ped_manager_t &ped_mgr, vector<pedestrian_t> &peds, unsigned pid, unsigned ped_end, float delta_dir) {
 	if (in_building) return 0; // no ped-ped collisions in buildings (yet)
 	assert(pid < peds.size());
 	float const timestep(2.0*TICKS_PER_SECOND), lookahead_dist(timestep*speed); // how far we can travel in 2s
 	float const prox_radius(1.2*radius + lookahead_dist); // assume other ped has a similar radius
 	vector3d force(zero_vector);
-	if (check_ped_ped_coll_range(peds, pid, pid+1, plot, prox_radius, force)) return 1;
+	unsigned coll_ix(0);
+	if (check_ped_ped_coll_range(peds, pid, pid+1, ped_end, plot, prox_radius, force, coll_ix)) {register_ped_coll(*this, peds[coll_ix], pid, coll_ix); return 1;}
 
 	if (in_the_road && next_plot != plot) {
 		// need to check for coll between two peds crossing the street from different sides, since they won't be in the same plot while in the street
 		unsigned const ped_ix(ped_mgr.get_first_ped_at_plot(next_plot));
 		assert(ped_ix <= peds.size()); // could be at the end
-		if (check_ped_ped_coll_range(peds, pid, ped_ix, next_plot, prox_radius, force)) return 1;
+		if (ped_mgr.check_ped_coll_in_other_plot(*this, pid, ped_ix, next_plot, prox_radius, force)) return 1;
 	}
 	if (force != zero_vector) {set_velocity((0.1*delta_dir)*force + ((1.0 - delta_dir)/speed)*vel);} // apply ped repulsive force
 	return 0;
 }
 
-bool pedestrian_t::check_ped_ped_coll_stopped(vector<pedestrian_t> &peds, unsigned pid) {
+bool pedestrian_t::check_ped_ped_coll_stopped(vector<pedestrian_t> &peds, unsigned pid, unsigned ped_end) {
 	if (in_building) return 0; // no ped-ped collisions in buildings (yet)
-	assert(pid < peds.size());
+	assert(pid < peds.size() && ped_end <= peds.size());
 
 	// Note: shouldn't have to check peds in the next plot, assuming that if we're stopped, they likely are as well, and won't be walking toward us
-	for (auto i = peds.begin()+pid+1; i != peds.end(); ++i) { // check every ped until we exit target_plot
+	for (auto i = peds.begin()+pid+1; i != peds.begin()+ped_end; ++i) { // check every ped until we exit target_plot
 		if (i->plot != plot) break; // moved to a new plot, no collision, done; since plots are globally unique across cities, we don't need to check cities
 		if (!dist_xy_less_than(pos, i->pos, 0.6f*(radius + i->radius))) continue; // no collision
 		i->collided = i->ped_coll = 1; i->colliding_ped = pid;
@@ -478,14 +485,15 @@ void pedestrian_t::move(ped_manager_t const &ped_mgr, cube_t const &plot_bcube,
 	anim_time += timestep*speed;
 }
 
-void pedestrian_t::next_frame(ped_manager_t &ped_mgr, vector<pedestrian_t> &peds, unsigned pid, rand_gen_t &rgen, float delta_dir) {
+void pedestrian_t::next_frame(ped_manager_t &ped_mgr, vector<pedestrian_t> &peds, unsigned pid, unsigned ped_end, rand_gen_t &rgen, float delta_dir) {
 	if (destroyed)    return; // destroyed
 	if (speed == 0.0) return; // not moving, no update needed
 	//assert(!is_nan(pos));
 	if (in_building)  return; // TODO: add any building update/movement logic here
 
 	// navigation with destination
-	if (at_dest) {
+	if (at_dest) { // Note: handled serially before the parallel update since this uses the ped manager's rgen
+		assert(!ped_mgr.is_parallel_update());
 		register_at_dest();
 		ped_mgr.choose_new_ped_plot_pos(*this);
 	}
@@ -502,7 +510,7 @@ void pedestrian_t::next_frame(ped_manager_t &ped_mgr, vector<pedestrian_t> &peds
 			go(); // back up or turn so that we don't walk forward into the street? move() should attempt to rotate in place
 		}
 		else {
-			check_ped_ped_coll_stopped(peds, pid); // still need to check for other peds colliding with us; this doesn't always work
+			check_ped_ped_coll_stopped(peds, pid, ped_end); // still need to check for other peds colliding with us; this doesn't always work
 			collided = ped_coll = 0;
 			return;
 		}
@@ -515,7 +523,7 @@ void pedestrian_t::next_frame(ped_manager_t &ped_mgr, vector<pedestrian_t> &peds
 	else if (!check_inside_plot(ped_mgr, prev_pos, plot_bcube, next_plot_bcube)) {collided = outside_plot = 1;} // outside the plot, treat as a collision with the plot bounds
 	else if (!is_valid_pos(colliders, at_dest, &ped_mgr)) {collided = 1;} // collided with a static collider
 	else if (check_road_coll(ped_mgr, plot_bcube, next_plot_bcube)) {collided = 1;} // collided with something in the road (stoplight, streetlight, etc.)
-	else if (check_ped_ped_coll(ped_mgr, peds, pid, delta_dir)) {collided = 1;} // collided with another pedestrian
+	else if (check_ped_ped_coll(ped_mgr, peds, pid, ped_end, delta_dir)) {collided = 1;} // collided with another pedestrian
 	else { // no collisions
 		//cout << TXT(pid) << TXT(plot) << TXT(dest_plot) << TXT(next_plot) << TXT(at_dest) << TXT(delta_dir) << TXT((unsigned)stuck_count) << TXT(collided) << endl;
 		vector3d dest_pos(get_dest_pos(plot_bcube, next_plot_bcube, ped_mgr));
@@ -530,12 +538,13 @@ void pedestrian_t::next_frame(ped_manager_t &ped_mgr, vector<pedestrian_t> &peds
 			}
 			// run only every several frames to reduce runtime; also run when at dest and when close to the current target pos or at the destination
 			if (at_dest || update_path) {
-				get_avoid_cubes(ped_mgr, colliders, dest_pos, ped_mgr.path_finder.get_avoid_vector());
+				path_finder_t &path_finder(ped_mgr.get_path_finder());
+				get_avoid_cubes(ped_mgr, colliders, dest_pos, path_finder.get_avoid_vector());
 				target_pos = all_zeros;
 				cube_t union_plot_bcube(plot_bcube);
 				union_plot_bcube.union_with_cube(next_plot_bcube); // this is the area the ped is constrained to (both plots + road in between)
 				// run path finding between pos and dest_pos using avoid cubes
-				if (ped_mgr.path_finder.run(pos, dest_pos, union_plot_bcube, 0.1*radius, dest_pos)) {target_pos = dest_pos;}
+				if (path_finder.run(pos, dest_pos, union_plot_bcube, 0.1*radius, dest_pos)) {target_pos = dest_pos;}
 			}
 			else if (target_valid()) {dest_pos = target_pos;} // use previous frame's dest if valid
 			vector3d dest_dir((dest_pos.x - pos.x), (dest_pos.y - pos.y), 0.0); // zval=0, not normalized
@@ -566,7 +575,7 @@ void pedestrian_t::next_frame(ped_manager_t &ped_mgr, vector<pedestrian_t> &peds
 		}
 		if (ped_coll) {
 			assert(colliding_ped < peds.size());
-			vector3d const coll_dir(peds[colliding_ped].pos - pos);
+			vector3d const coll_dir(ped_mgr.get_colliding_ped_pos(peds, colliding_ped) - pos);
 			new_dir = cross_product(vel, plus_z);
 			if (dot_product_xy(new_dir, coll_dir) > 0.0) {new_dir = -new_dir;} // orient away from the other ped
 		}
@@ -653,11 +662,14 @@ void ped_manager_t::init(unsigned num_city, unsigned num_building) {
 		float const angle(rgen.rand_uniform(0.0, TWO_PI));
 		ped.pos   = i->p + vector3d(0.0, 0.0, ped.radius);
 		ped.dir   = vector3d(sinf(angle), cos(angle), 0.0);
-		ped.speed = 0.0; // not moving
+		ped.speed = 0.0; // set when a destination is chosen
 		ped.ssn   = (unsigned short)(peds.size() + peds_b.size()); // may wrap
-		ped.dest_bldg = i->bix; // store building index in dest_bldg field
+		ped.dest_bldg   = i->bix; // store building index in dest_bldg field
+		ped.in_building = 1;
 		peds_b.push_back(ped);
 	} // for i
+	peds_b_paths.clear();
+	peds_b_paths.resize(peds_b.size());
 	cout << "City Pedestrians: " << peds.size() << ", Building Residents: " << peds_b.size() << endl; // testing
 	sort_by_city_and_plot();
 }
@@ -784,6 +796,7 @@ void ped_manager_t::remove_destroyed_peds() {
 }
 
 void ped_manager_t::register_ped_new_plot(pedestrian_t const &ped) {
+	if (in_parallel_update) return; // plot changes are found by comparing to the snapshot after the update
 	if (!need_to_sort_city.empty()) {need_to_sort_city[ped.city] = 1;}
 	need_to_sort_peds = 1;
 }
@@ -793,28 +806,159 @@ void ped_manager_t::move_ped_to_next_plot(pedestrian_t &ped) {
 	register_ped_new_plot(ped);
 }
 
+path_finder_t &ped_manager_t::get_path_finder() {
+	unsigned const thread_ix(in_parallel_update ? omp_get_thread_num_3dw() : 0);
+	assert(thread_ix < path_finders.size());
+	return path_finders[thread_ix];
+}
+point const &ped_manager_t::get_colliding_ped_pos(vector<pedestrian_t> const &peds, unsigned ix) const {
+	if (in_parallel_update) {assert(ix < peds_snapshot.size()); return peds_snapshot[ix].pos;} // may be in a plot owned by another thread
+	assert(ix < peds.size());
+	return peds[ix].pos;
+}
+// checks for collisions with peds in another plot; when updating in parallel, these peds are read from the snapshot and collisions are applied after the update
+bool ped_manager_t::check_ped_coll_in_other_plot(pedestrian_t &ped, unsigned pid, unsigned ped_start, unsigned target_plot, float prox_radius, vector3d &force) {
+	unsigned coll_ix(0);
+
+	if (!in_parallel_update) {
+		if (!ped.check_ped_ped_coll_range(peds, pid, ped_start, peds.size(), target_plot, prox_radius, force, coll_ix)) return 0;
+		register_ped_coll(ped, peds[coll_ix], pid, coll_ix);
+		return 1;
+	}
+	if (!ped.check_ped_ped_coll_range(peds_snapshot, pid, ped_start, peds_snapshot.size(), target_plot, prox_radius, force, coll_ix)) return 0;
+	ped.collided = ped.ped_coll = 1; ped.colliding_ped = coll_ix;
+	unsigned const thread_ix(omp_get_thread_num_3dw());
+	assert(thread_ix < deferred_ped_colls.size());
+	deferred_ped_colls[thread_ix].emplace_back(coll_ix, pid);
+	return 1;
+}
+
+bool ped_manager_t::can_update_peds_in_parallel() const {
+#ifdef _OPENMP
+	if (peds.size() < PED_PARALLEL_UPDATE_MIN) return 0; // not enough peds to be worth the overhead
+	if (need_to_sort_peds || by_plot.empty() || by_plot.back() != peds.size()) return 0; // by_plot is out of date
+	return (omp_get_max_threads_3dw() > 1);
+#else
+	return 0;
+#endif
+}
+
+// called serially before the parallel update since this modifies our rgen; may respawn peds in other plots, so by_plot must be re-sorted after
+void ped_manager_t::choose_dests_for_peds_at_dest() {
+	for (auto i = peds.begin(); i != peds.end(); ++i) {
+		if (i->destroyed || i->speed == 0.0 || i->in_building || !i->at_dest) continue;
+		i->register_at_dest();
+		choose_new_ped_plot_pos(*i);
+	}
+}
+
+// Each plot is updated by a single thread, so peds in the same plot are updated in order with the same neighbor interactions as the serial update.
+// Peds near the road may also collide with peds in the next plot, which could be owned by another thread; these are read from a snapshot of
+// positions taken at the start of the frame, and the collision is applied to the other ped after all plots are updated.
+// Each plot uses its own rand_gen_t seeded from the plot and frame, so results don't depend on the number of threads.
+void ped_manager_t::update_peds_parallel(float delta_dir) {
+	//timer_t timer("Ped Update Parallel");
+	unsigned const num_threads(omp_get_max_threads_3dw()), num_plots(by_plot.size() - 1);
+	if (path_finders.size() < num_threads) {path_finders.resize(num_threads);}
+	deferred_ped_colls.resize(num_threads);
+	peds_snapshot.clear();
+	peds_snapshot.reserve(peds.size());
+	for (auto i = peds.begin(); i != peds.end(); ++i) {peds_snapshot.emplace_back(*i);}
+	in_parallel_update = 1;
+#pragma omp parallel for schedule(dynamic, 4) num_threads(num_threads)
+	for (int plot = 0; plot < (int)num_plots; ++plot) {
+		unsigned const ped_start(by_plot[plot]), ped_end(by_plot[plot+1]);
+		if (ped_start == ped_end) continue; // no peds in this plot
+		rand_gen_t plot_rgen;
+		plot_rgen.set_state(plot+1, frame_counter);
+		for (unsigned i = ped_start; i < ped_end; ++i) {peds[i].next_frame(*this, peds, i, ped_end, plot_rgen, delta_dir);}
+	}
+	in_parallel_update = 0;
+
+	for (unsigned i = 0; i < peds.size(); ++i) {
+		if (peds[i].plot != peds_snapshot[i].plot) {register_ped_new_plot(peds[i]);}
+	}
+	// merge the per-thread collisions and apply them in a fixed order, since each thread's records depend on the dynamic schedule
+	vector<pair<unsigned, unsigned>> &colls(deferred_ped_colls.front());
+	for (auto t = deferred_ped_colls.begin()+1; t != deferred_ped_colls.end(); ++t) {colls.insert(colls.end(), t->begin(), t->end()); t->clear();}
+	sort(colls.begin(), colls.end()); // by ped, then colliding ped
+
+	for (auto c = colls.begin(); c != colls.end(); ++c) {
+		assert(c->first < peds.size());
+		pedestrian_t &ped(peds[c->first]);
+		ped.collided = ped.ped_coll = 1; ped.colliding_ped = c->second; // handled in this ped's next update
+	}
+	colls.clear();
+}
+
+// moves a person inside a building along its path of room centers, doors, and stairs, choosing a new destination after waiting at the current one
+void ped_manager_t::move_building_ped(pedestrian_t &ped, building_ped_path_t &bpath, rand_gen_t &rgen) const {
+	if (bpath.wait_secs > 0.0) {bpath.wait_secs -= fticks/TICKS_PER_SECOND; return;} // waiting at dest
+
+	if (bpath.at_dest()) { // choose a new destination
+		point const floor_pos(ped.pos - vector3d(0.0, 0.0, ped.radius)); // building placement and path points are at floor level
+		point dest;
+		bpath.path.clear();
+		bpath.next_pt = 0;
+		ped.speed     = 0.0;
+
+		if (!choose_building_person_dest(ped.dest_bldg, floor_pos, ped.radius, rgen, dest) || !find_building_person_route(ped.dest_bldg, floor_pos, dest, bpath.path) || bpath.path.empty()) {
+			bpath.wait_secs = rgen.rand_uniform(1.0, 2.0); // no valid dest or path; try again later
+			return;
+		}
+		ped.speed = city_params.ped_speed*rgen.rand_uniform(0.5, 1.0);
+	}
+	if (ped.speed == 0.0) return; // ped_speed is zero
+	point const target(bpath.path[bpath.next_pt] + vector3d(0.0, 0.0, ped.radius)); // path points are at floor level, and change z along stairs
+	vector3d const delta(target - ped.pos);
+	float const dist(delta.mag()), step(ped.speed*fticks);
+
+	float const dist_xy(delta.xy_mag());
+	if (dist_xy > TOLERANCE) {ped.dir = vector3d(delta.x/dist_xy, delta.y/dist_xy, 0.0);} // face horizontally, including on stairs
+	
+	if (step >= dist) { // reached this path point
+		ped.pos = target;
+		++bpath.next_pt;
+		if (bpath.at_dest()) {bpath.wait_secs = rgen.rand_uniform(2.0, 10.0);} // reached the final dest; stay here for a while
+	}
+	else {ped.pos += delta*(step/dist);}
+	ped.anim_time += step;
+}
+
 void ped_manager_t::next_frame() {
-	if (!animate2 || peds.empty()) return; // nothing to do (only applies to moving peds)
+	if (!animate2) return; // nothing to do (only applies to moving peds)
 	//timer_t timer("Ped Update"); // ~3.9ms for 10K peds
 
-	// Note: should make sure this is after sorting cars, so that road_ix values are actually in order; however, that makes things slower, and is unlikely to make a difference
+	if (!peds.empty()) {
+		// Note: should make sure this is after sorting cars, so that road_ix values are actually in order; however, that makes things slower, and is unlikely to make a difference
 #pragma omp critical(modify_car_data)
-	{car_manager.extract_car_data(cars_by_city);}
+		{car_manager.extract_car_data(cars_by_city);}
 
-	if (ped_destroyed) {remove_destroyed_peds();} // at least one ped was destroyed in the previous frame - remove it/them
-	float const delta_dir(1.2*(1.0 - pow(0.7f, fticks))); // controls pedestrian turning rate
-	static bool first_frame(1);
+		if (ped_destroyed) {remove_destroyed_peds();} // at least one ped was destroyed in the previous frame - remove it/them
+		float const delta_dir(1.2*(1.0 - pow(0.7f, fticks))); // controls pedestrian turning rate
+		static bool first_frame(1);
 
-	if (first_frame) { // choose initial ped destinations (must be after building setup, etc.)
-		for (auto i = peds.begin(); i != peds.end(); ++i) {choose_dest_building_or_parked_car(*i);}
-	}
-	for (auto i = peds.begin(); i != peds.end(); ++i) {i->next_frame(*this, peds, (i - peds.begin()), rgen, delta_dir);}
-	if (need_to_sort_peds) {sort_by_city_and_plot();}
+		if (first_frame) { // choose initial ped destinations (must be after building setup, etc.)
+			for (auto i = peds.begin(); i != peds.end(); ++i) {choose_dest_building_or_parked_car(*i);}
+		}
+		bool use_parallel(can_update_peds_in_parallel());
 
-	if (!peds_b.empty()) { // TODO: move people in buildings
-		//for (auto i = peds_b.begin(); i != peds_b.end(); ++i) {i->next_frame(...);}
+		if (use_parallel) {
+			choose_dests_for_peds_at_dest();
+			if (need_to_sort_peds) {sort_by_city_and_plot();} // per-plot ranges must be valid for the parallel update
+			use_parallel = can_update_peds_in_parallel(); // re-validate by_plot; fall back to the serial update if it's still out of date
+		}
+		if (use_parallel) {update_peds_parallel(delta_dir);}
+		else {
+			for (auto i = peds.begin(); i != peds.end(); ++i) {i->next_frame(*this, peds, (i - peds.begin()), peds.size(), rgen, delta_dir);}
+		}
+		if (need_to_sort_peds) {sort_by_city_and_plot();}
+		first_frame = 0;
+	}
+	if (!peds_b.empty()) { // move people in buildings
+		assert(peds_b_paths.size() == peds_b.size());
+		for (unsigned i = 0; i < peds_b.size(); ++i) {move_building_ped(peds_b[i], peds_b_paths[i], rgen);}
 	}
-	first_frame = 0;
 }
 
 pedestrian_t const *ped_manager_t::get_ped_at(point const &p1, point const &p2) const { // Note: p1/p2 in local TT space
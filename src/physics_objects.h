@@ -8,6 +8,7 @@
 
 #include "3DWorld.h"
 #include "collision_detect.h"
+#include <functional>
 
 float const MAX_PART_CLOUD_RAD = 0.25;
 float const DECAL_OFFSET       = 0.001;
@@ -214,6 +215,36 @@ struct decal_obj : public basic_physics_obj { // size = 76
 };
 
 
+struct phys_step_t { // explicit timestep for one object advance substep, rather than scaling the global TIMESTEP and tstep
+	float timestep, tstep; // tstep = timestep*fticks
+	phys_step_t(float timestep_, float tstep_) : timestep(timestep_), tstep(tstep_) {}
+	float get_tstep_scale() const {return tstep/timestep;}
+};
+phys_step_t get_global_phys_step();
+
+
+// side effects on shared state (sounds, decals, splashes, collision callbacks) made while advancing objects in parallel are recorded
+// per thread rather than applied immediately; they're applied serially in object order afterward, which matches the serial order;
+// random numbers come from rgen, which is reseeded for each object, so results don't depend on thread scheduling
+struct phys_cmd_buffer_t {
+	typedef std::function<void()> cmd_t;
+	vector<pair<unsigned, cmd_t>> cmds; // {object index, command}
+	unsigned cur_obj_ix;
+	rand_gen_t rgen;
+
+	phys_cmd_buffer_t() : cur_obj_ix(0) {}
+	static void apply_all(vector<phys_cmd_buffer_t> &bufs);
+};
+void set_thread_phys_cmd_buffer(phys_cmd_buffer_t *buf); // nullptr = apply side effects immediately
+bool defer_phys_side_effect(phys_cmd_buffer_t::cmd_t const &cmd); // returns 0 if this thread has no command buffer
+template<typename F> void run_or_defer_phys(F const &func) {if (!defer_phys_side_effect(func)) {func();}}
+// random numbers for object advance: from the current object's rgen when advancing in parallel, otherwise the global generators
+int phys_rand();
+float phys_rand_uniform(float val1, float val2);
+float phys_signed_rand_float();
+vector3d phys_signed_rand_vector();
+
+
 struct dwobject : public basic_physics_obj { // size = 67(68) (dynamic world object)
 
 	int coll_id;
@@ -231,17 +262,17 @@ struct dwobject : public basic_physics_obj { // size = 67(68) (dynamic world obj
 	float get_true_radius() const;
 	float get_true_density() const;
 	float get_true_mass() const;
-	void advance_object(bool disable_motionless_objects, int iter, int obj_index);
-	int surface_advance();
+	void advance_object(bool disable_motionless_objects, int iter, int obj_index, phys_step_t const &step);
+	int surface_advance(phys_step_t const &step);
 	void set_orient_for_coll(vector3d const *const forced_norm);
-	int check_water_collision(float vz_old);
+	int check_water_collision(float vz_old, phys_step_t const &step);
 	void surf_collide_obj() const;
 	void elastic_collision(point const &obj_pos, float energy, int obj_type);
 	int object_bounce(int coll_type, vector3d &norm, float elasticity2, float z_offset, vector3d const &obj_vel=zero_vector);
-	int object_still_stopped(int obj_index);
+	int object_still_stopped(int obj_index, phys_step_t const &step);
 	void do_coll_damage();
 	int check_vert_collision(int obj_index, int do_coll_funcs, int iter, vector3d *cnorm=NULL,
-		vector3d const &mdir=all_zeros, bool skip_dynamic=0, bool only_drawn=0, int only_cobj=-1, bool skip_movable=0);
+		vector3d const &mdir=all_zeros, bool skip_dynamic=0, bool only_drawn=0, int only_cobj=-1, bool skip_movable=0, phys_step_t const *const step=nullptr);
 	int multistep_coll(point const &last_pos, int obj_index, unsigned nsteps);
 	void update_vel_from_damage(vector3d const &dv);
 	void damage_object(float damage, point const &dpos, point const &shoot_pos, int weapon);
@@ -270,17 +301,18 @@ class vert_coll_detector {
 	vector3d motion_dir, obj_vel;
 	vector3d *cnorm;
 	dwobject temp;
+	phys_step_t step;
 
 	bool safe_norm_div(float rad, float radius, vector3d &norm);
 	void check_cobj_intersect(int index, bool enable_cfs, bool player_step);
 	void init_reset_pos();
 public:
-	vert_coll_detector(dwobject &obj_, int obj_index_, int do_coll_funcs_, int iter_, vector3d *cnorm_,
+	vert_coll_detector(dwobject &obj_, int obj_index_, int do_coll_funcs_, int iter_, vector3d *cnorm_, phys_step_t const &step_,
 		vector3d const &mdir=zero_vector, bool skip_dynamic_=0, bool only_drawn_=0, int only_cobj_=-1, bool skip_movable_=0) :
 	obj(obj_), type(obj.type), iter(iter_), player(type == CAMERA || type == SMILEY || type == WAYPOINT),
 	already_bounced(0), skip_dynamic(skip_dynamic_), only_drawn(only_drawn_), skip_movable(skip_movable_), coll(0), obj_index(obj_index_),
 	do_coll_funcs(do_coll_funcs_), only_cobj(only_cobj_), cdir(0), lcoll(0), z_old(obj.pos.z), o_radius(0.0),
-	z1(0.0), z2(0.0), pos(obj.pos), pold(obj.pos), motion_dir(mdir), obj_vel(obj.velocity), cnorm(cnorm_) {}
+	z1(0.0), z2(0.0), pos(obj.pos), pold(obj.pos), motion_dir(mdir), obj_vel(obj.velocity), cnorm(cnorm_), step(step_) {}
 
 	void check_cobj(int index);
 	int check_coll();
@@ -13,7 +13,10 @@ float const WATER_PART_DIST = 1.0;
 
 extern bool begin_motion;
 extern int animate2, display_mode, camera_coll_id, precip_mode, DISABLE_WATER;
-extern float temperature, fticks, zmin, water_plane_z, brightness, XY_SCENE_SIZE;
+extern float temperature, fticks, tstep, zmin, water_plane_z, brightness, XY_SCENE_SIZE, base_gravity;
+extern obj_type object_types[];
+
+int get_precip_type();
 extern vector3d wind;
 extern int coll_id[];
 extern obj_group obj_groups[];
@@ -274,9 +277,130 @@ public:
 };
 
 
+// Structure-of-arrays simulation of the ground mode precipitation object group (rain, snow, and hail), used in place of per-dwobject physics.
+// Drops only fall under gravity and drift with the wind, so they can be integrated in tight loops over separate arrays that the compiler can vectorize.
+// Collisions use a per-frame heightfield proxy of the mesh, water, and cobj tops rather than cobj queries, and drops that land are respawned
+// at the top of the scene, with their accumulation into water and snow batched by mesh cell. Positions are copied back to the group's
+// dwobjects each frame so that they're drawn and queried as before.
+// Opt-in with soa_precipitation: drops don't rest on cobjs, form puddles, or get pushed by blast waves, and all drops are spawned at once.
+class precip_sim_t {
+
+	enum {SURF_MESH=0, SURF_WATER, SURF_COBJ};
+	vector<float> px, py, pz, vx, vy, vz;
+	vector<float> coll_z; // per mesh cell: top of the highest surface a drop can land on
+	vector<unsigned char> coll_surf; // per mesh cell: SURF_*
+	vector<pair<unsigned, float>> landed; // {mesh cell index, collision energy} for drops that landed this frame
+	rand_gen_t rgen;
+
+	void gen_xy(unsigned i) {
+		px[i] = X_SCENE_SIZE*rgen.signed_rand_float();
+		py[i] = Y_SCENE_SIZE*rgen.signed_rand_float();
+	}
+	void respawn(unsigned i, float zval) {
+		gen_xy(i);
+		pz[i] = zval;
+		vx[i] = vy[i] = vz[i] = 0.0;
+	}
+	float get_spawn_z() {return (CLOUD_CEILING + ztop)*(1.0 + rgen.rand_uniform(-0.1, 0.1));} // same as gen_object_pos()
+
+	void update_coll_proxy() {
+		bool const water_enabled(!DISABLE_WATER && (display_mode & 0x04));
+		coll_z.resize(XY_MULT_SIZE);
+		coll_surf.resize(XY_MULT_SIZE);
+
+		for (int y = 0; y < MESH_Y_SIZE; ++y) {
+			for (int x = 0; x < MESH_X_SIZE; ++x) {
+				unsigned const ix(y*MESH_X_SIZE + x);
+				float z(mesh_height[y][x]);
+				unsigned char surf(SURF_MESH);
+				if (water_enabled && water_matrix[y][x] > z) {z = water_matrix[y][x]; surf = SURF_WATER;}
+				if (v_collision_matrix[y][x].zmax > z)       {z = v_collision_matrix[y][x].zmax; surf = SURF_COBJ;}
+				coll_z[ix] = z;
+				coll_surf[ix] = surf;
+			}
+		}
+	}
+	void resize(unsigned num) {
+		unsigned const prev_num(px.size());
+		if (num == prev_num) return;
+		for (vector<float> *v : {&px, &py, &pz, &vx, &vy, &vz}) {v->resize(num, 0.0);}
+		float const zmax_gen(get_spawn_z());
+		for (unsigned i = prev_num; i < num; ++i) {respawn(i, rgen.rand_uniform(ztop, zmax_gen));} // spread new drops over the height range above the mesh
+	}
+	void accumulate_landed(int type, float radius) {
+		if (landed.empty()) return;
+		sort(landed.begin(), landed.end());
+
+		for (auto i = landed.begin(); i != landed.end();) {
+			auto const start(i);
+			unsigned const cell(i->first);
+			float energy(0.0);
+			for (; i != landed.end() && i->first == cell; ++i) {energy += i->second;}
+			unsigned const count(i - start);
+			int const x(cell % MESH_X_SIZE), y(cell / MESH_X_SIZE);
+			point const pos(get_xval(x), get_yval(y), coll_z[cell]);
+			if (coll_surf[cell] != SURF_COBJ) {accumulate_object(pos, type, count);}
+			if (coll_surf[cell] == SURF_WATER && temperature > W_FREEZE_POINT && energy > 0.0) {add_splash(pos, x, y, energy, radius, 0, zero_vector, 0);} // no sound or droplets
+		}
+		landed.clear();
+	}
+public:
+	void clear() {
+		for (vector<float> *v : {&px, &py, &pz, &vx, &vy, &vz}) {v->clear();}
+		landed.clear();
+	}
+	void update(obj_group &objg) {
+		//timer_t timer("Precip Sim Update");
+		unsigned const num(objg.max_objects());
+		int const type(get_precip_type());
+		obj_type const &otype(object_types[type]);
+		float const radius(otype.radius), vz_max(otype.terminal_vel), dvz(base_gravity*GRAVITY*tstep*otype.gravity);
+		float const wind_rate(min(1.0f, otype.air_factor*fticks)), wx(wind.x), wy(wind.y), ts(tstep);
+		if (!(objg.flags & WAS_ADVANCED)) {clear();} // group was reset
+		resize(num);
+		update_coll_proxy();
+		float *const px_(px.data()), *const py_(py.data()), *const pz_(pz.data()), *const vx_(vx.data()), *const vy_(vy.data()), *const vz_(vz.data());
+
+		for (unsigned i = 0; i < num; ++i) { // integrate; no branches or gathers so that this loop can be vectorized
+			vz_[i]  = max(-vz_max, (vz_[i] - dvz));
+			vx_[i] += wind_rate*(wx - vx_[i]);
+			vy_[i] += wind_rate*(wy - vy_[i]);
+			px_[i] += ts*vx_[i];
+			py_[i] += ts*vy_[i];
+			pz_[i] += ts*vz_[i];
+		}
+		for (unsigned i = 0; i < num; ++i) { // collide with the heightfield proxy
+			int const x(get_xpos(px_[i])), y(get_ypos(py_[i]));
+			if (point_outside_mesh(x, y)) {respawn(i, pz_[i]); continue;} // drifted out of the scene; move back in at the same height
+			unsigned const cell(y*MESH_X_SIZE + x);
+			if ((pz_[i] - radius) > coll_z[cell]) continue; // still falling
+			landed.emplace_back(cell, get_coll_energy(vector3d(vx_[i], vy_[i], vz_[i]), zero_vector, otype.mass));
+			respawn(i, get_spawn_z());
+		}
+		accumulate_landed(type, radius);
+		assert(num <= objg.max_objects());
+
+		for (unsigned i = 0; i < num; ++i) { // copy back for drawing
+			dwobject &obj(objg.get_obj(i));
+			obj.type     = type;
+			obj.status   = 1;
+			obj.flags    = 0;
+			obj.health   = otype.health;
+			obj.pos      = point(px_[i], py_[i], pz_[i]);
+			obj.velocity = vector3d(vx_[i], vy_[i], vz_[i]);
+		}
+		objg.end_id = num;
+	}
+};
+
+
 rain_manager_t rain_manager;
 snow_manager_t snow_manager;
 uw_particle_manager_t uw_part_manager;
+precip_sim_t precip_sim;
+
+
+void update_precip_sim(obj_group &objg) {precip_sim.update(objg);}
 
 
 void draw_local_precipitation(bool no_update) {
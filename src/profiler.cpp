@@ -3,48 +3,227 @@
 // 4/20/13
 
 #include "3DWorld.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <fstream>
+#include <cstring>
 
 using std::string;
+using std::cerr;
 
+unsigned const PROF_MAX_THREADS = 256;  // threads beyond this are not recorded
+unsigned const PROF_RING_SIZE   = 8192; // events per thread; must be a power of 2; oldest events are overwritten
+unsigned const PROF_NAME_LEN    = 48;   // names are copied since callers may pass temporary strings; longer names are truncated
+unsigned const PROF_MAX_RETIRED = 8*PROF_RING_SIZE; // max unread events kept from threads that have exited; oldest threads are dropped first
 
+string timing_profiler_trace_fn; // if nonempty, a Chrome trace-event JSON file is written here on each stats dump (chrome://tracing or ui.perfetto.dev)
+
+
+// Each thread writes events into its own fixed size ring buffer, so there are no locks or shared cache lines on the hot path.
+// The reader (stats/trace export) runs on the main thread and may see a partially written event if a thread wraps its buffer during the read,
+// which is acceptable for profiling; this is normally called between frames when worker threads are idle.
+// When a thread exits, its unread events are moved to a shared list and its buffer slot is reused by the next new thread.
 class timing_profiler {
 
+	struct event_t {
+		char name[PROF_NAME_LEN];
+		uint64_t start_us;
+		uint32_t dur_us, frame;
+		uint16_t depth; // nesting level of timer_t scopes on this thread
+	};
+	struct thread_buffer_t {
+		event_t events[PROF_RING_SIZE];
+		std::atomic<uint64_t> head; // total number of events written by the owning thread
+		uint64_t tail; // first event not yet consumed; only modified under slot_mutex
+		unsigned thread_ix;
+		thread_buffer_t(unsigned thread_ix_) : head(0), tail(0), thread_ix(thread_ix_) {}
+		uint64_t get_first_valid() const {uint64_t const h(head.load(std::memory_order_acquire)); return max(tail, ((h > PROF_RING_SIZE) ? (h - PROF_RING_SIZE) : 0));}
+	};
 	struct entry_t {
 		unsigned count;
-		int time, tmax;
-		entry_t() : count(0), time(0), tmax(0) {}
-		void add(int t) {++count; time += t; tmax = max(tmax, t);}
+		uint64_t time, tmax, frame_max; // in us
+		entry_t() : count(0), time(0), tmax(0), frame_max(0) {}
+		void add(uint64_t t) {++count; time += t; tmax = max(tmax, t);}
 	};
 
-	map<string, entry_t> entries;
+	struct thread_slot_t { // returns the thread's buffer slot when the thread exits
+		timing_profiler *prof;
+		thread_slot_t() : prof(nullptr) {}
+		~thread_slot_t() {if (prof) {prof->release_thread_buffer();}}
+	};
+	typedef pair<unsigned, vector<event_t>> retired_events_t; // {thread_ix, events}
+
+	std::unique_ptr<thread_buffer_t> thread_bufs[PROF_MAX_THREADS];
+	std::atomic<unsigned> num_threads, cur_frame;
+	std::chrono::steady_clock::time_point const epoch;
+	mutable std::mutex slot_mutex; // protects free_slots, retired, and buffer tails
+	vector<unsigned> free_slots;
+	std::deque<retired_events_t> retired; // events from threads that have exited, oldest first
+	unsigned num_retired;
+
+	static thread_local thread_buffer_t *tl_buf;
+	static thread_local unsigned tl_depth;
+	static thread_local thread_slot_t tl_slot;
+
+	thread_buffer_t *get_thread_buffer() {
+		if (tl_buf != nullptr) return tl_buf;
+		unsigned ix(PROF_MAX_THREADS);
+		{
+			std::lock_guard<std::mutex> lock(slot_mutex);
+			if (!free_slots.empty()) {ix = free_slots.back(); free_slots.pop_back();} // reuse the slot of a thread that exited
+		}
+		if (ix == PROF_MAX_THREADS) { // allocate a new slot
+			ix = num_threads.fetch_add(1);
+			if (ix >= PROF_MAX_THREADS) return nullptr; // too many threads, drop events
+			thread_bufs[ix].reset(new thread_buffer_t(ix));
+		}
+		tl_buf = thread_bufs[ix].get();
+		tl_slot.prof = this;
+		return tl_buf;
+	}
+	void release_thread_buffer() { // called on thread exit
+		thread_buffer_t *const buf(tl_buf);
+		if (buf == nullptr) return;
+		tl_buf = nullptr;
+		std::lock_guard<std::mutex> lock(slot_mutex);
+		uint64_t const first(buf->get_first_valid()), last(buf->head.load(std::memory_order_acquire));
+
+		if (last > first) { // move unread events to the retired list
+			retired.emplace_back(buf->thread_ix, vector<event_t>());
+			vector<event_t> &events(retired.back().second);
+			for (uint64_t i = first; i < last; ++i) {events.push_back(buf->events[i & (PROF_RING_SIZE-1)]);}
+			num_retired += events.size();
+
+			while (num_retired > PROF_MAX_RETIRED && retired.size() > 1) {
+				num_retired -= retired.front().second.size();
+				retired.pop_front();
+			}
+		}
+		buf->tail = last;
+		free_slots.push_back(buf->thread_ix);
+	}
+	unsigned get_num_threads() const {return min(num_threads.load(), PROF_MAX_THREADS);}
+
+	void record(const char *str, uint64_t start_us, uint64_t dur_us) {
+		thread_buffer_t *const buf(get_thread_buffer());
+		if (buf == nullptr) return;
+		uint64_t const h(buf->head.load(std::memory_order_relaxed));
+		event_t &e(buf->events[h & (PROF_RING_SIZE-1)]);
+		strncpy(e.name, str, PROF_NAME_LEN-1);
+		e.name[PROF_NAME_LEN-1] = '\0';
+		e.start_us = start_us;
+		e.dur_us   = uint32_t(min(dur_us, uint64_t(0xFFFFFFFF)));
+		e.frame    = cur_frame.load(std::memory_order_relaxed);
+		e.depth    = uint16_t(tl_depth);
+		buf->head.store(h+1, std::memory_order_release);
+	}
+	// builds hierarchical "parent/child" names: events are recorded at scope end, so walking backwards, the most recently seen event at depth d-1 encloses an event at depth d
+	template<typename E, typename F> static void walk_events_with_path(uint64_t first, uint64_t last, E const &get_event, unsigned thread_ix, vector<string> &path, F const &func) {
+		path.clear();
+
+		for (uint64_t i = last; i > first; --i) {
+			event_t const &e(get_event(i-1));
+			if (path.size() <= e.depth) {path.resize(e.depth+1);}
+			path[e.depth] = ((e.depth > 0 && !path[e.depth-1].empty()) ? (path[e.depth-1] + "/") : "") + e.name;
+			func(e, path[e.depth], thread_ix);
+		}
+	}
+	template<typename F> void for_each_event_with_path(F const &func) const {
+		std::lock_guard<std::mutex> lock(slot_mutex); // threads may exit during the read
+		vector<string> path;
 
+		for (retired_events_t const &r : retired) {
+			walk_events_with_path(0, r.second.size(), [&](uint64_t i) -> event_t const & {return r.second[i];}, r.first, path, func);
+		}
+		for (unsigned t = 0; t < get_num_threads(); ++t) {
+			thread_buffer_t const *const buf(thread_bufs[t].get());
+			if (buf == nullptr) continue;
+			walk_events_with_path(buf->get_first_valid(), buf->head.load(std::memory_order_acquire),
+				[&](uint64_t i) -> event_t const & {return buf->events[i & (PROF_RING_SIZE-1)];}, buf->thread_ix, path, func);
+		}
+	}
 public:
 	bool enabled;
 
-	timing_profiler() : enabled(0) {}
-	void clear() {entries.clear();}
+	timing_profiler() : num_threads(0), cur_frame(0), epoch(std::chrono::steady_clock::now()), num_retired(0), enabled(0) {}
 
-	void register_time(const char *str, int delta_time) {
+	uint64_t get_time_us() const {return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch).count();}
+	void next_frame() {++cur_frame;}
+
+	void clear() {
+		std::lock_guard<std::mutex> lock(slot_mutex);
+		retired.clear();
+		num_retired = 0;
+
+		for (unsigned t = 0; t < get_num_threads(); ++t) {
+			if (thread_bufs[t]) {thread_bufs[t]->tail = thread_bufs[t]->head.load(std::memory_order_acquire);}
+		}
+	}
+	uint64_t begin_scope() {++tl_depth; return get_time_us();}
+
+	void end_scope(const char *str, uint64_t start_us, int delta_time) {
+		assert(tl_depth > 0);
+		--tl_depth; // events inside this scope were recorded at depth+1
+		register_time(str, delta_time, start_us);
+	}
+	void register_time(const char *str, int delta_time, uint64_t start_us=0) {
 		if (enabled) {
-			entries[str].add(delta_time);
+			uint64_t const end_us(get_time_us());
+			if (start_us == 0) {start_us = end_us - min(end_us, 1000*uint64_t(max(delta_time, 0)));} // no scope start; estimate from the ms delta
+			record(str, start_us, (end_us - start_us));
 		}
 		else {
 			cout << str << " time = " << delta_time << endl;
 		}
 	}
 	void stats() const {
-		cout << "name count total max average" << endl;
+		map<string, entry_t> entries;
+		map<pair<string, unsigned>, uint64_t> frame_totals;
+		std::set<unsigned> frames;
+
+		for_each_event_with_path([&](event_t const &e, string const &path, unsigned thread_ix) {
+			entries[path].add(e.dur_us);
+			frame_totals[make_pair(path, e.frame)] += e.dur_us;
+			frames.insert(e.frame);
+		});
+		for (auto const &ft : frame_totals) {
+			uint64_t &frame_max(entries[ft.first.first].frame_max);
+			frame_max = max(frame_max, ft.second);
+		}
+		cout << "name count total max average frame_max (times in ms, " << frames.size() << " frames)" << endl;
 		unsigned max_name(0);
 		for (auto i = entries.begin(); i != entries.end(); ++i) {max_name = max(max_name, (unsigned)i->first.size());}
 
-		for (auto i = entries.begin(); i != entries.end(); ++i) {
+		for (auto i = entries.begin(); i != entries.end(); ++i) { // sorted by path, so children follow their parents
 			string const spaces((max_name - i->first.size()), ' ');
-			cout << i->first << spaces << ": " << i->second.count << "\t" << i->second.time << "\t"
-					<< i->second.tmax << "\t" << float(i->second.time)/float(i->second.count) << endl;
+			cout << i->first << spaces << ": " << i->second.count << "\t" << 0.001*i->second.time << "\t" << 0.001*i->second.tmax << "\t"
+				<< 0.001*float(i->second.time)/float(i->second.count) << "\t" << 0.001*i->second.frame_max << endl;
 		}
 	}
+	bool write_trace(string const &fn) const { // Chrome trace-event format
+		std::ofstream out(fn);
+		if (!out.good()) {cerr << "Error: Failed to open timing profiler trace file " << fn << " for write" << endl; return 0;}
+		out << "{\"traceEvents\":[\n";
+		bool first(1);
+
+		for_each_event_with_path([&](event_t const &e, string const &path, unsigned thread_ix) {
+			if (!first) {out << ",\n";}
+			first = 0;
+			out << "{\"name\":\"";
+			for (const char *c = e.name; *c; ++c) {out << (char)((*c == '"' || *c == '\\') ? '_' : *c);}
+			out << "\",\"ph\":\"X\",\"ts\":" << e.start_us << ",\"dur\":" << e.dur_us << ",\"pid\":0,\"tid\":" << thread_ix << ",\"args\":{\"frame\":" << e.frame << "}}";
+		});
+		out << "\n]}" << endl;
+		cout << "Wrote timing profiler trace " << fn << endl;
+		return 1;
+	}
 };
 
+thread_local timing_profiler::thread_buffer_t *timing_profiler::tl_buf = nullptr;
+thread_local unsigned timing_profiler::tl_depth = 0;
+thread_local timing_profiler::thread_slot_t timing_profiler::tl_slot;
+
 timing_profiler global_profiler;
 
 
@@ -56,10 +235,19 @@ void register_timing_value(const char *str, int delta_time) {
 	global_profiler.register_time(str, delta_time);
 }
 
+uint64_t timing_profiler_begin_scope() {return global_profiler.begin_scope();}
+
+void timing_profiler_end_scope(const char *str, uint64_t start_us, int delta_time) {
+	global_profiler.end_scope(str, start_us, delta_time);
+}
+
+void timing_profiler_next_frame() {
+	global_profiler.next_frame();
+}
+
 void timing_profiler_stats() {
 	global_profiler.stats();
+	if (!timing_profiler_trace_fn.empty()) {global_profiler.write_trace(timing_profiler_trace_fn);}
 	global_profiler.clear();
 }
 
-
-
@@ -25,9 +25,11 @@ unsigned NPTS(50000), NRAYS(40000), LOCAL_RAYS(1000000), GLOBAL_RAYS(1000000), D
 std::atomic<unsigned long long> tot_rays(0), num_hits(0), cells_touched(0);
 unsigned const NUM_RAY_SPLITS [NUM_LIGHTING_TYPES] = {1, 1, 1, 1, 1}; // sky, global, local, cobj_accum, dynamic
 unsigned const INIT_RAY_SPLITS[NUM_LIGHTING_TYPES] = {1, 4, 1, 1, 1}; // sky, global, local, cobj_accum, dynamic
+unsigned const LMAP_SHARD_TILE_BITS = 8; // 256 lmap cells per shard tile
+unsigned const LMAP_SHARD_TILE_SIZE = (1 << LMAP_SHARD_TILE_BITS);
 
-extern bool has_snow, combined_gu, global_lighting_update, lighting_update_offline, store_cobj_accum_lighting_as_blocked;
-extern int read_light_files[], write_light_files[], display_mode, DISABLE_WATER;
+extern bool has_snow, combined_gu, global_lighting_update, lighting_update_offline, store_cobj_accum_lighting_as_blocked, sharded_lighting_accum;
+extern int read_light_files[], write_light_files[], display_mode, world_mode, DISABLE_WATER;
 extern float water_plane_z, temperature, snow_depth, ray_step_size_mult, first_ray_weight[];
 extern char *lighting_file[];
 extern point sun_pos, moon_pos;
@@ -214,6 +216,90 @@ light_volume_local &get_local_light_volume(int ltype) {
 }
 
 
+// Per-thread sparse lightmap accumulation buffer: lmap cells are grouped into fixed size tiles by cell index (which keeps each z column together),
+// and a tile's storage is allocated the first time one of its cells is written. Each thread adds into its own shard without locking,
+// and the shards are added into the lmap in thread order once the job completes, so results don't depend on thread timing.
+class lmap_accum_shard_t {
+
+	lmap_manager_t *lmgr;
+	int ltype;
+	vector<unsigned> tile_slots; // slot+1 for each tile, 0 = unallocated
+	vector<unsigned> tiles; // tile index of each slot
+	vector<float> data; // {R, G, B, weight} per cell
+
+public:
+	lmap_accum_shard_t() : lmgr(nullptr), ltype(0) {}
+	bool is_active() const {return (lmgr != nullptr);}
+	lmap_manager_t const *get_lmgr() const {return lmgr;}
+
+	void init(lmap_manager_t *lmgr_, int ltype_) {
+		assert(lmgr_ != nullptr && lmgr_->is_allocated());
+		if (lmgr == lmgr_ && ltype == ltype_) return; // already setup, continue accumulating
+		assert(!is_active()); // can only accumulate into one lmap per job
+		lmgr  = lmgr_;
+		ltype = ltype_;
+		tile_slots.assign((lmgr->size() + LMAP_SHARD_TILE_SIZE - 1)/LMAP_SHARD_TILE_SIZE, 0);
+	}
+	float *get_cell_data(lmcell const *lmc) {
+		unsigned const cix(lmgr->get_cell_index(lmc)), tile(cix >> LMAP_SHARD_TILE_BITS);
+		assert(tile < tile_slots.size());
+		unsigned &slot(tile_slots[tile]);
+
+		if (slot == 0) { // allocate a new tile
+			tiles.push_back(tile);
+			slot = tiles.size();
+			data.resize(4*LMAP_SHARD_TILE_SIZE*tiles.size(), 0.0);
+		}
+		return &data[4*(((slot - 1) << LMAP_SHARD_TILE_BITS) + (cix & (LMAP_SHARD_TILE_SIZE-1)))];
+	}
+	void merge_into_lmap() {
+		if (!is_active()) return;
+		unsigned const num_cells(lmgr->size());
+
+		for (unsigned s = 0; s < tiles.size(); ++s) {
+			unsigned const start(tiles[s] << LMAP_SHARD_TILE_BITS), end(min(num_cells, start + LMAP_SHARD_TILE_SIZE));
+			float const *src(&data[4*(s << LMAP_SHARD_TILE_BITS)]);
+
+			for (unsigned cix = start; cix < end; ++cix, src += 4) {
+				float *color(lmgr->get_cell_by_index(cix).get_offset(ltype));
+				ADD_LIGHT_CONTRIB(src, color);
+				if (ltype != LIGHTING_LOCAL) {color[3] += src[3];}
+			}
+		}
+		if (!tiles.empty()) {lmgr->was_updated = 1;}
+	}
+	void clear() {
+		lmgr = nullptr;
+		tile_slots.clear();
+		tiles.clear();
+		data.clear();
+	}
+};
+
+struct rt_thread_accum_t { // thread-private lighting results and stats, reduced after the job completes
+	lmap_accum_shard_t shard;
+	unsigned long long num_rays, num_hits, cells_touched;
+	rt_thread_accum_t() : num_rays(0), num_hits(0), cells_touched(0) {}
+
+	void reduce() {
+		shard.merge_into_lmap();
+		shard.clear();
+		tot_rays += num_rays; ::num_hits += num_hits; ::cells_touched += cells_touched;
+		num_rays = num_hits = cells_touched = 0;
+	}
+};
+
+thread_local rt_thread_accum_t *cur_thread_accum = nullptr; // set while running a sharded job on this thread
+
+void register_light_ray() {
+	if (cur_thread_accum) {++cur_thread_accum->num_rays;} else {++tot_rays;}
+}
+void register_light_ray_hit(unsigned ncells) {
+	if (cur_thread_accum) {++cur_thread_accum->num_hits; cur_thread_accum->cells_touched += ncells;}
+	else {++num_hits; cells_touched += ncells;}
+}
+
+
 unsigned add_path_to_lmcs(lmap_manager_t *lmgr, cube_t *bcube, point p1, point const &p2, float weight, colorRGBA const &color, int ltype, bool first_pt) {
 
 	bool const dynamic(is_ltype_dynamic(ltype));
@@ -237,12 +323,14 @@ unsigned add_path_to_lmcs(lmap_manager_t *lmgr, cube_t *bcube, point p1, point c
 	}
 	else { // use the lmgr
 		assert(lmgr != nullptr && lmgr->is_allocated());
+		lmap_accum_shard_t *const shard((cur_thread_accum && cur_thread_accum->shard.is_active()) ? &cur_thread_accum->shard : nullptr);
+		assert(!shard || shard->get_lmgr() == lmgr);
 
 		for (unsigned s = 0; s < nsteps; ++s) {
 			lmcell *lmc(lmgr->get_lmcell_round_down(p1));
 		
-			if (lmc != NULL) { // could use a mutex here, but it seems too slow
-				float *color(lmc->get_offset(ltype));
+			if (lmc != NULL) { // unsynchronized if not sharded - could use a mutex here, but it seems too slow
+				float *color(shard ? shard->get_cell_data(lmc) : lmc->get_offset(ltype));
 				ADD_LIGHT_CONTRIB(cw, color);
 				if (ltype != LIGHTING_LOCAL) {color[3] += weight;}
 			}
@@ -252,37 +340,60 @@ unsigned add_path_to_lmcs(lmap_manager_t *lmgr, cube_t *bcube, point p1, point c
 			bcube->assign_or_union_with_pt(p1);
 			bcube->union_with_pt(p2);
 		}
-		lmgr->was_updated = 1;
+		if (!shard) {lmgr->was_updated = 1;} // else set when the shard is merged
 	}
 	return nsteps;
 }
 
 
+bool clip_light_ray_to_scene(point &p1, point &p2) {
+	if (!do_line_clip_scene(p1, p2, min(zbottom, czmin), max(ztop, czmax))) return 0;
+	return !((display_mode & 0x01) && is_under_mesh(p1));
+}
+
+struct light_ray_hit_t { // first cobj and model intersection of a ray that was clipped to the scene, computed by a packet query
+	point p1, p2, cpos;
+	vector3d cnorm;
+	colorRGBA model_color;
+	int cindex;
+	bool coll, model_coll;
+	light_ray_hit_t() : cindex(-1), coll(0), model_coll(0) {}
+};
+
+
 void cast_light_ray(lmap_manager_t *lmgr, point p1, point p2, float weight, float weight0, colorRGBA color, float line_length,
-	int ignore_cobj, int ltype, unsigned depth, rand_gen_t &rgen, cobj_ray_accum_map_t *accum_map, cube_t *bcube=nullptr)
+	int ignore_cobj, int ltype, unsigned depth, rand_gen_t &rgen, cobj_ray_accum_map_t *accum_map, cube_t *bcube=nullptr, light_ray_hit_t const *hit=nullptr)
 {
 	if (depth > MAX_RAY_BOUNCES) return;
 	if (ltype == LIGHTING_DYNAMIC && depth > 4) return; // use a sensible default since this is running during rendering
 	//assert(!is_nan(p1) && !is_nan(p2));
-	++tot_rays;
-
-	// find intersection point with scene cobjs
-	point orig_p1(p1);
-	if (!do_line_clip_scene(p1, p2, min(zbottom, czmin), max(ztop, czmax))) return;
-	if ((display_mode & 0x01) && is_under_mesh(p1)) return;
+	register_light_ray();
 	int cindex(-1), xpos(0), ypos(0);
 	point cpos(p2);
 	vector3d cnorm;
+	colorRGBA model_color;
 	float t(0.0), zval(0.0);
-	bool snow_coll(0), ice_coll(0), water_coll(0), mesh_coll(0);
-	vector3d const dir((p2 - p1).get_norm());
-	bool coll(check_coll_line_exact(p1, p2, cpos, cnorm, cindex, 0.0, ignore_cobj, 1, 0, 1, 1, (p1 == orig_p1), no_stat_moving)); // fast=1, exclude voxels, maybe skip init colls
-	assert(coll ? (cindex >= 0 && cindex < (int)coll_objects.size()) : (cindex == -1));
+	bool coll(0), model_coll(0), snow_coll(0), ice_coll(0), water_coll(0), mesh_coll(0);
 
-	// find the intersection point with the model3ds
-	colorRGBA model_color;
-	bool const model_coll(all_models.check_coll_line(p1, cpos, cpos, cnorm, model_color, 1));
-	coll |= model_coll;
+	if (hit) { // already clipped and intersected with cobjs and models
+		p1 = hit->p1; p2 = hit->p2; cpos = hit->cpos; cnorm = hit->cnorm; cindex = hit->cindex;
+		model_color = hit->model_color;
+		coll        = hit->coll;
+		model_coll  = hit->model_coll;
+	}
+	else {
+		// find intersection point with scene cobjs
+		point orig_p1(p1);
+		if (!clip_light_ray_to_scene(p1, p2)) return;
+		cpos = p2;
+		coll = check_coll_line_exact(p1, p2, cpos, cnorm, cindex, 0.0, ignore_cobj, 1, 0, 1, 1, (p1 == orig_p1), no_stat_moving); // fast=1, exclude voxels, maybe skip init colls
+		assert(coll ? (cindex >= 0 && cindex < (int)coll_objects.size()) : (cindex == -1));
+
+		// find the intersection point with the model3ds
+		model_coll = all_models.check_coll_line(p1, cpos, cpos, cnorm, model_color, 1);
+		coll |= model_coll;
+	}
+	vector3d const dir((p2 - p1).get_norm());
 
 	// find intersection point with mesh (approximate)
 	// Note: the !coll test is a big optimization but not entirely correct, as we can have a ray that intersects the mesh and then hits a cobj below the mesh;
@@ -336,8 +447,7 @@ void cast_light_ray(lmap_manager_t *lmgr, point p1, point p2, float weight, floa
 	if (!coll) return; // more efficient to do this up here and let a reverse ray from the sky light this path
 
 	// walk from p1 to p2, adding light to all lightmap cells encountered
-	cells_touched += add_path_to_lmcs(lmgr, bcube, p1, p2, weight, color, ltype, (depth == 0));
-	++num_hits;
+	register_light_ray_hit(add_path_to_lmcs(lmgr, bcube, p1, p2, weight, color, ltype, (depth == 0)));
 	//if (!coll)    return;
 	if (p1 == p2) return; // line must have started inside a cobj - this is bad, but what can we do?
 
@@ -442,8 +552,7 @@ void cast_light_ray(lmap_manager_t *lmgr, point p1, point p2, float weight, floa
 							point const p_int(p_end + (p2 - p_end)*t);
 
 							if (!dist_less_than(p2, p_int, get_step_size())) {	
-								cells_touched += add_path_to_lmcs(lmgr, bcube, p2, p_int, weight, color, ltype, (depth == 0));
-								++num_hits;
+								register_light_ray_hit(add_path_to_lmcs(lmgr, bcube, p2, p_int, weight, color, ltype, (depth == 0)));
 							}
 							if (calc_refraction_angle(v_refract, v_refract2, -cnorm2, cobj.cp.refract_ix, 1.0)) {
 								p2    = p_int;
@@ -497,13 +606,14 @@ void cast_light_ray(lmap_manager_t *lmgr, point p1, point p2, float weight, floa
 struct rt_data {
 	unsigned ix, num, job_id, checksum;
 	int rseed, ltype;
-	bool is_thread, verbose, randomized, is_running;
+	bool is_thread, verbose, randomized, is_running, sharded;
 	cube_t update_bcube;
 	lmap_manager_t *lmgr;
 	cobj_ray_accum_map_t accum_map;
+	rt_thread_accum_t accum; // used if sharded
 
-	rt_data(unsigned i=0, unsigned n=0, int s=1, bool t=0, bool v=0, bool r=0, int lt=0, unsigned jid=0)
-		: ix(i), num(n), job_id(jid), checksum(0), rseed(s), ltype(lt), is_thread(t), verbose(v), randomized(r), is_running(0), lmgr(nullptr) {update_bcube.set_to_zeros();}
+	rt_data(unsigned i=0, unsigned n=0, int s=1, bool t=0, bool v=0, bool r=0, int lt=0, unsigned jid=0, bool sh=0)
+		: ix(i), num(n), job_id(jid), checksum(0), rseed(s), ltype(lt), is_thread(t), verbose(v), randomized(r), is_running(0), sharded(sh), lmgr(nullptr) {update_bcube.set_to_zeros();}
 
 	void pre_run(rand_gen_t &rgen) {
 		assert(lmgr);
@@ -511,13 +621,25 @@ struct rt_data {
 		assert(!is_running);
 		is_running = 1;
 		rgen.set_state(rseed, 1);
+
+		if (sharded) {
+			if (!is_ltype_dynamic(ltype)) {accum.shard.init(lmgr, ltype);} // dynamic lighting is added to local light volumes instead
+			cur_thread_accum = &accum;
+		}
 	}
 	void post_run() {
 		assert(is_running); // can this fail due to race conditions? too strong? remove?
+		cur_thread_accum = nullptr;
 		is_running = 0;
 	}
 };
 
+void reduce_thread_accum(vector<rt_data> &data) { // in thread order for deterministic results; threads must have finished
+	for (auto i = data.begin(); i != data.end(); ++i) {
+		if (i->sharded) {i->accum.reduce();}
+	}
+}
+
 
 template<typename T> class thread_manager_t {
 
@@ -582,7 +704,9 @@ void check_for_lighting_finished() { // to be called about once per frame
 
 	if (!thread_manager.is_active()) return; // inactive
 	if (thread_manager.any_threads_running()) return; // still running
-	thread_manager.join_and_clear(); // clear() or join_and_clear()?
+	thread_manager.join();
+	reduce_thread_accum(thread_manager.data);
+	thread_manager.clear();
 	update_lmap_from_temp_copy();
 }
 
@@ -594,6 +718,8 @@ void launch_threaded_job(unsigned num_threads, void (*start_func)(rt_data *), bo
 	assert(num_threads > 0 && num_threads < 100);
 	assert(!keep_beams || num_threads == 1); // could use a mutex instead to make this legal
 	bool const single_thread(num_threads == 1);
+	// shard writes across threads unless the job writes directly into the lmap in the background so that partial results are visible while running
+	bool const sharded(sharded_lighting_accum && !single_thread && (blocking || use_temp_lmap));
 	if (verbose) {cout << "Computing lighting on " << num_threads << " threads." << endl;}
 	thread_manager.create(num_threads);
 	vector<rt_data> &data(thread_manager.data);
@@ -601,7 +727,7 @@ void launch_threaded_job(unsigned num_threads, void (*start_func)(rt_data *), bo
 
 	for (unsigned t = 0; t < data.size(); ++t) {
 		// create a custom lmap_manager_t for each thread then merge them together?
-		data[t] = rt_data(t, num_threads, 234323*(t+1), !single_thread, (verbose && t == 0), randomized, ltype, job_id);
+		data[t] = rt_data(t, num_threads, 234323*(t+1), !single_thread, (verbose && t == 0), randomized, ltype, job_id, sharded);
 		data[t].lmgr = (use_temp_lmap ? &thread_temp_lmap : &lmap_manager);
 	}
 	if (single_thread && blocking) { // threads disabled
@@ -612,6 +738,9 @@ void launch_threaded_job(unsigned num_threads, void (*start_func)(rt_data *), bo
 		if (blocking) {thread_manager.join();}
 	}
 	if (blocking) {
+		reduce_thread_accum(data);
+		if (verbose && sharded) {cout << "total rays: " << tot_rays << ", hits: " << num_hits << ", cells touched: " << cells_touched << endl;} // per-thread stats were printed before the reduction
+
 		if (enable_platform_lights(ltype)) {
 			merged_accum_map.clear();
 			for (auto i = data.begin(); i != data.end(); ++i) {merged_accum_map.merge(i->accum_map);}
@@ -640,12 +769,74 @@ bool cube_light_src_vect::ray_intersects_any(point const &start_pt, point const
 }
 
 
-void trace_one_global_ray(lmap_manager_t *lmgr, point const &pos, point const &pt, colorRGBA const &color, float ray_wt,
-	int ltype, bool is_scene_cube, rand_gen_t &rgen, cobj_ray_accum_map_t *accum_map, float line_length)
-{
+// collects coherent primary rays with the same weight and color so that their first intersections can be found with one packet traversal
+// of the cobj and model BVHs; rays are then cast in the order they were added, so results match casting them one at a time
+class light_ray_packet_t {
+
+	lmap_manager_t *lmgr;
+	float weight, line_length;
+	colorRGBA color;
+	int ltype;
+	rand_gen_t &rgen;
+	cobj_ray_accum_map_t *accum_map;
+	unsigned num;
+	point p1[RAY_PACKET_SIZE], p2[RAY_PACKET_SIZE];
+
+public:
+	light_ray_packet_t(lmap_manager_t *lmgr_, float weight_, colorRGBA const &color_, float line_length_, int ltype_, rand_gen_t &rgen_, cobj_ray_accum_map_t *accum_map_)
+		: lmgr(lmgr_), weight(weight_), line_length(line_length_), color(color_), ltype(ltype_), rgen(rgen_), accum_map(accum_map_), num(0) {}
+	~light_ray_packet_t() {flush();}
+
+	void add_ray(point const &pos, point const &end_pt) {
+		p1[num] = pos; p2[num] = end_pt;
+		if (++num == RAY_PACKET_SIZE) {flush();}
+	}
+	void flush() {
+		if (num == 0) return;
+		point cp1[RAY_PACKET_SIZE], cp2[RAY_PACKET_SIZE], cpos[RAY_PACKET_SIZE];
+		vector3d cnorm[RAY_PACKET_SIZE];
+		int cindex[RAY_PACKET_SIZE];
+		colorRGBA model_color[RAY_PACKET_SIZE];
+		unsigned ray_mask(0), skip_init_colls_mask(0);
+
+		for (unsigned r = 0; r < num; ++r) {
+			cp1[r] = p1[r]; cp2[r] = p2[r];
+			if (!clip_light_ray_to_scene(cp1[r], cp2[r])) continue; // cast_light_ray() will reject this ray again
+			cpos[r]   = cp2[r];
+			ray_mask |= (1U << r);
+			if (cp1[r] == p1[r]) {skip_init_colls_mask |= (1U << r);}
+		}
+		unsigned coll_mask(0), model_mask(0);
+
+		if (ray_mask) {
+			// same as the check_coll_line_exact() call in cast_light_ray(): static cobjs only, no splash or dynamic cobjs
+			if (world_mode == WMODE_GROUND) {coll_mask = check_coll_line_exact_tree_packet(cp1, cp2, ray_mask, cpos, cnorm, cindex, -1, 0, 1, skip_init_colls_mask, no_stat_moving);}
+			model_mask = all_models.check_coll_line_packet(cp1, cpos, ray_mask, cpos, cnorm, model_color, 1);
+		}
+		for (unsigned r = 0; r < num; ++r) {
+			unsigned const bit(1U << r);
+
+			if (!(ray_mask & bit)) {
+				cast_light_ray(lmgr, p1[r], p2[r], weight, weight, color, line_length, -1, ltype, 0, rgen, accum_map);
+				continue;
+			}
+			light_ray_hit_t hit;
+			hit.p1 = cp1[r]; hit.p2 = cp2[r]; hit.cpos = cpos[r]; hit.cnorm = cnorm[r];
+			hit.cindex      = ((coll_mask & bit) ? cindex[r] : -1);
+			hit.model_color = model_color[r];
+			hit.model_coll  = ((model_mask & bit) != 0);
+			hit.coll        = (hit.model_coll || hit.cindex >= 0);
+			cast_light_ray(lmgr, p1[r], p2[r], weight, weight, color, line_length, -1, ltype, 0, rgen, accum_map, nullptr, &hit);
+		}
+		num = 0;
+	}
+};
+
+
+void trace_one_global_ray(light_ray_packet_t &packet, point const &pos, point const &pt, bool is_scene_cube, float line_length) {
 	point const end_pt(pt + (pt - pos).get_norm()*line_length);
 	if (is_scene_cube && global_cube_lights.ray_intersects_any(pt, end_pt)) return; // don't double count
-	cast_light_ray(lmgr, pos, end_pt, ray_wt, ray_wt, color, line_length, -1, ltype, 0, rgen, accum_map);
+	packet.add_ray(pos, end_pt);
 }
 
 
@@ -653,6 +844,7 @@ void trace_ray_block_global_cube(lmap_manager_t *lmgr, cube_t const &bnds, point
 	unsigned nrays, int ltype, unsigned disabled_edges, bool is_scene_cube, bool verbose, bool randomized, rand_gen_t &rgen, cobj_ray_accum_map_t *accum_map)
 {
 	float const line_length(2.0*get_scene_radius());
+	light_ray_packet_t packet(lmgr, ray_wt, color, line_length, ltype, rgen, accum_map);
 	vector3d const ldir((bnds.get_cube_center() - pos).get_norm());
 	float proj_area[3] = {0}, tot_area(0.0);
 
@@ -680,7 +872,7 @@ void trace_ray_block_global_cube(lmap_manager_t *lmgr, cube_t const &bnds, point
 				if (verbose && ((s%1000) == 0)) {increment_printed_number(s/1000);}
 				pt[d0] = rgen.rand_uniform(bnds.d[d0][0], bnds.d[d0][1]);
 				pt[d1] = rgen.rand_uniform(bnds.d[d1][0], bnds.d[d1][1]);
-				trace_one_global_ray(lmgr, pos, pt, color, ray_wt, ltype, is_scene_cube, rgen, accum_map, line_length);
+				trace_one_global_ray(packet, pos, pt, is_scene_cube, line_length);
 			}
 		}
 		else {
@@ -697,10 +889,11 @@ void trace_ray_block_global_cube(lmap_manager_t *lmgr, cube_t const &bnds, point
 					if (kill_raytrace) break;
 					if (verbose && ((num%1000) == 0)) increment_printed_number(num/1000);
 					pt[d1] = bnds.d[d1][0] + (s1 + rgen.rand_uniform(0.0, 1.0))*len1/n1;
-					trace_one_global_ray(lmgr, pos, pt, color, ray_wt, ltype, is_scene_cube, rgen, accum_map, line_length);
+					trace_one_global_ray(packet, pos, pt, is_scene_cube, line_length);
 				}
 			}
 		}
+		packet.flush();
 		if (verbose) {cout << endl;}
 	} // for i
 }
@@ -770,6 +963,7 @@ void trace_ray_block_sky(rt_data *data) {
 		}
 		sort(pts.begin(), pts.end());
 		if (data->verbose) {cout << "Sky light source progress (of " << block_npts << "): 0";}
+		light_ray_packet_t packet(data->lmgr, ray_wt, WHITE, line_length, LIGHTING_SKY, rgen, &data->accum_map);
 
 		for (unsigned p = 0; p < block_npts; ++p) {
 			if (kill_raytrace) break;
@@ -788,9 +982,10 @@ void trace_ray_block_sky(rt_data *data) {
 				if (dot_product(dirs[r], pt) >= 0.0) continue; // can get here when (-Z_SCENE_SIZE, Z_SCENE_SIZE) does not contain (czmin, czmax)
 				point const end_pt(pt + dirs[r]*line_length);
 				if (sky_cube_lights.ray_intersects_any(pt, end_pt)) continue; // don't double count
-				cast_light_ray(data->lmgr, pt, end_pt, ray_wt, ray_wt, WHITE, line_length, -1, LIGHTING_SKY, 0, rgen, &data->accum_map);
+				packet.add_ray(pt, end_pt); // rays are sorted by dir, so consecutive rays from the same point are coherent
 				++start_rays;
 			}
+			packet.flush();
 		}
 		if (data->verbose) {cout << endl;}
 	}
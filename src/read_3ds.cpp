@@ -422,6 +422,11 @@ class file_reader_3ds_model : public file_reader_3ds, public model_from_file_t {
 			vntc_map_t vmap[2]; // average_normals=0
 			vntct_map_t vmap_tan[2]; // average_normals=0
 
+			for (unsigned d = 0; d < 2; ++d) {
+				vmap    [d].set_expected_size(min(3*i->second.size(), verts.size()));
+				vmap_tan[d].set_expected_size(min(3*i->second.size(), verts.size()));
+			}
+
 			for (vector<unsigned short>::const_iterator f = i->second.begin(); f != i->second.end(); ++f) {
 				unsigned short *ixs(faces[*f].ix);
 				point pts[3];
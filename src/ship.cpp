@@ -16,12 +16,15 @@ bool const TIMETEST          = (GLOBAL_TIMETEST || 0);
 bool const ERROR_CHECK       = 0;
 unsigned const NUM_TIMESTEPS = 4;
 unsigned const NUM_EXTRA_DAM = 4;
+unsigned const PAR_SHIP_AI_MIN_SHIPS = 32; // fewer ships than this run their AI serially
 
 
-bool player_autopilot(0), player_auto_stop(0), hold_fighters(0), dock_fighters(0), ship_cube_map_reflection(0);
+bool player_autopilot(0), player_auto_stop(0), hold_fighters(0), dock_fighters(0), ship_cube_map_reflection(0), parallel_ship_ai(0);
+bool ship_ai_snapshot_active(0); // set while ship AI runs in parallel
 int onscreen_display(0);
 unsigned univ_reflection_tid(0);
 unsigned alloced_fobjs[3] = {0}; // testing
+unsigned coll_pairs_tested(0), coll_pairs_hit(0); // collision broadphase stats for the last frame
 float uobj_rmax(0.0), urm_ship(0.0), urm_static(0.0), urm_proj(0.0);
 point player_death_pos(all_zeros), universe_origin(all_zeros);
 vector<free_obj *> uobjs; // ships, projectiles, etc.
@@ -266,6 +269,7 @@ void show_stats() {
 		cout << endl;
 	}
 	print_univ_owner_stats();
+	cout << "Collision pairs tested: " << coll_pairs_tested << ", hit: " << coll_pairs_hit << endl;
 	cout << "Alloced: Ships: " << alloced_fobjs[0] << " - " << alloced_fobjs[1] << " = " <<
 		(alloced_fobjs[0] - alloced_fobjs[1]) << ", Proj+Part: " << alloced_fobjs[2] << " (x100)" << endl;
 }
@@ -491,6 +495,52 @@ void remove_bad_cobjs_and_particles(vector<cached_obj> &objs) {
 }
 
 
+thread_local ship_ai_intents_t *cur_ship_ai_intents(nullptr);
+
+bool recording_ship_ai_intents() {return (cur_ship_ai_intents != nullptr);}
+
+void add_ship_ai_intent(std::function<void()> const &intent) {
+	assert(cur_ship_ai_intents != nullptr);
+	cur_ship_ai_intents->push_back(intent);
+}
+
+
+// two phases: ships decide in parallel using the object lists and targets/cloaking from the start of the frame, and record any turn, thrust,
+// weapons fire, or ship spawn as an intent; then intents are committed serially in object order, along with the AI of projectiles and the player ship
+void ai_action_parallel(unsigned nobjs) {
+
+	static vector<unsigned> ai_ships;
+	static vector<ship_ai_intents_t> intents;
+	ai_ships.clear();
+
+	for (unsigned i = 0; i < nobjs; ++i) {
+		free_obj *const obj(c_uobjs[i].obj);
+		obj->snapshot_ai_state();
+		if ((c_uobjs[i].flags & OBJ_FLAGS_SHIP) && !obj->is_player_ship()) {ai_ships.push_back(i);}
+	}
+	intents.resize(ai_ships.size());
+	ship_ai_snapshot_active = 1;
+	int const num_threads(max(1, omp_get_max_threads_3dw()-1)); // leave one thread for universe drawing, which runs concurrently on the master thread
+
+#pragma omp parallel for schedule(dynamic,4) num_threads(num_threads)
+	for (int i = 0; i < (int)ai_ships.size(); ++i) {
+		cur_ship_ai_intents = &intents[i];
+		c_uobjs[ai_ships[i]].obj->ai_action();
+		cur_ship_ai_intents = nullptr;
+	}
+	ship_ai_snapshot_active = 0;
+
+	for (unsigned i = 0, s = 0; i < nobjs; ++i) { // can create new objects here
+		if (s < ai_ships.size() && ai_ships[s] == i) {
+			for (auto const &intent : intents[s]) {intent();}
+			intents[s].clear();
+			++s;
+		}
+		else if (c_uobjs[i].flags & (OBJ_FLAGS_SHIP | OBJ_FLAGS_PROJ)) {c_uobjs[i].obj->ai_action();}
+	}
+}
+
+
 void apply_univ_physics() {
 
 	if (show_framerate) show_stats();
@@ -557,11 +607,16 @@ void apply_univ_physics() {
 	}
 	//if (TIMETEST) cout << "  nobj: " << nobjs << " ship: " << nsh << " proj: " << npr << " part: " << npa << endl;
 	if (TIMETEST) PRINT_TIME("  Rmax + Ship Vector Creation");
+	build_uobj_query_bvhs();
+	if (TIMETEST) PRINT_TIME("  Query BVH Build");
 
 	if (animate2) {
 		// before or after advance time and collision detection?
-		for (unsigned i = 0; i < nobjs; ++i) { // can create new objects here
-			if (c_uobjs[i].flags & (OBJ_FLAGS_SHIP | OBJ_FLAGS_PROJ)) {c_uobjs[i].obj->ai_action();}
+		if (parallel_ship_ai && all_ships.size() >= PAR_SHIP_AI_MIN_SHIPS) {ai_action_parallel(nobjs);}
+		else {
+			for (unsigned i = 0; i < nobjs; ++i) { // can create new objects here
+				if (c_uobjs[i].flags & (OBJ_FLAGS_SHIP | OBJ_FLAGS_PROJ)) {c_uobjs[i].obj->ai_action();}
+			}
 		}
 		if (player_autopilot) {update_cpos();}
 		if (TIMETEST) PRINT_TIME("  AI Action");
@@ -630,35 +685,97 @@ bool proc_coll(free_obj *o1, free_obj *o2) {
 }
 
 
+unsigned choose_sweep_axis(vector<cached_obj> const &objs) { // the axis with the largest spread of object centers separates the most objects
+
+	double sum[3] = {0.0}, sum_sq[3] = {0.0};
+	unsigned num(0);
+
+	for (auto i = objs.begin(); i != objs.end(); ++i) {
+		if (i->flags & OBJ_FLAGS_BAD_) continue;
+		for (unsigned d = 0; d < 3; ++d) {sum[d] += i->pos[d]; sum_sq[d] += i->pos[d]*i->pos[d];}
+		++num;
+	}
+	if (num == 0) return 0;
+	unsigned axis(0);
+	double max_var(0.0);
+
+	for (unsigned d = 0; d < 3; ++d) {
+		double const mean(sum[d]/num), var(sum_sq[d]/num - mean*mean);
+		if (var > max_var) {max_var = var; axis = d;}
+	}
+	return axis;
+}
+
+
+// returns 0 and leaves the intervals partially sorted if more than max_moves moves are needed
+bool insertion_sort_intervals(vector<interval> &intervals, unsigned max_moves) {
+
+	unsigned num_moves(0);
+
+	for (unsigned i = 1; i < intervals.size(); ++i) {
+		interval const iv(intervals[i]);
+		unsigned j(i);
+		for (; j > 0 && iv < intervals[j-1]; --j) {intervals[j] = intervals[j-1];} // stable, so left edges stay before right edges of the same value
+		intervals[j] = iv;
+		num_moves += (i - j);
+		if (num_moves > max_moves) return 0;
+	}
+	return 1;
+}
+
+
+// sweep and prune along the axis with the largest spread, chosen on the first substep;
+// endpoints are rebuilt when the object set changes (t <= 1), and otherwise updated in place and re-sorted with an insertion sort since objects only move a bit per substep
 void collision_detect_objects(vector<cached_obj> &objs, unsigned t) {
 
 	//RESET_TIME;
 	unsigned const size((unsigned)objs.size());
 	static vector<interval> intervals;
-	intervals.clear();
-	intervals.reserve(2*size);
+	static unsigned axis(0);
+	bool sorted(0);
+
+	if (t == 0) {
+		axis = choose_sweep_axis(objs);
+		coll_pairs_tested = coll_pairs_hit = 0;
+	}
+	if (t <= 1) { // first substep, or first substep after removing bad objects and skipping distant/orbiting objects
+		intervals.clear();
+		intervals.reserve(2*size);
 
-	for (unsigned i = 0; i < size; ++i) {
-		if (objs[i].flags & OBJ_FLAGS_BAD_) continue;
+		for (unsigned i = 0; i < size; ++i) {
+			if (objs[i].flags & OBJ_FLAGS_BAD_) continue;
 
-		if (t > 0 && (objs[i].flags & (OBJ_FLAGS_DIST | OBJ_FLAGS_ORBT))) {
-			if (t == 1) {objs[i].refresh();}
-			continue;
+			if (t > 0 && (objs[i].flags & (OBJ_FLAGS_DIST | OBJ_FLAGS_ORBT))) {
+				if (t == 1) {objs[i].refresh();}
+				continue;
+			}
+			if (t > 0) {objs[i].refresh();} // physics advance was run since last refresh
+			double const radius(objs[i].radius), val(objs[i].pos[axis]);
+			float const left(float(val - radius)), right(float(val + radius));
+			assert(radius > 0.0);
+			if (left == right) continue; // floating point precision limitation or bug?
+			assert(left < right);
+			intervals.push_back(interval(left,  i, 1));
+			intervals.push_back(interval(right, i, 0));
+		}
+		sorted = (axis == 0 && insertion_sort_intervals(intervals, 4*size)); // objs are mostly sorted in x
+	}
+	else { // same objects as the last substep
+		for (unsigned i = 0; i < intervals.size(); ++i) {
+			unsigned const ix(intervals[i].ix & ~LEFT_EDGE_BIT);
+			cached_obj &obj(objs[ix]); // Note: objects destroyed in an earlier substep are updated as well so that their endpoints stay ordered
+			bool const left_edge((intervals[i].ix & LEFT_EDGE_BIT) != 0);
+			if (left_edge) {obj.refresh();} // left edge comes first
+			double const radius(obj.radius), val(obj.pos[axis]);
+			intervals[i].val = float(left_edge ? (val - radius) : (val + radius));
 		}
-		if (t > 0) {objs[i].refresh();} // physics advance was run since last refresh
-		double const radius(objs[i].radius), val(objs[i].pos.x);
-		float const left(float(val - radius)), right(float(val + radius));
-		assert(radius > 0.0);
-		if (left == right) continue; // floating point precision limitation or bug?
-		assert(left < right);
-		intervals.push_back(interval(left,  i, 1));
-		intervals.push_back(interval(right, i, 0));
+		sorted = insertion_sort_intervals(intervals, 4*size);
 	}
-	unsigned const size2((unsigned)intervals.size());
+	if (!sorted) {stable_sort(intervals.begin(), intervals.end());}
+	unsigned const size2((unsigned)intervals.size()), d1((axis+1)%3), d2((axis+2)%3);
 	static vector<unsigned> locs, work;
 	locs.resize(size);
 	work.clear();
-	sort(intervals.begin(), intervals.end());
 
 	for (unsigned i = 0; i < size2; ++i) {
 		unsigned const ix(intervals[i].ix & ~LEFT_EDGE_BIT), ix_flags(objs[ix].flags);
@@ -670,19 +787,22 @@ void collision_detect_objects(vector<cached_obj> &objs, unsigned t) {
 		if (intervals[i].ix & LEFT_EDGE_BIT) { // start a new sphere
 			unsigned const wsize((unsigned)work.size());
 
-			if (wsize > 0) {
+			if (wsize > 0 && !(ix_flags & OBJ_FLAGS_BAD_)) { // object may have been destroyed in an earlier substep
 				point const pos_i(objs[ix].pos);
-				float const c_radius_i(objs[ix].radius), pisd(pos_i.y);
+				float const c_radius_i(objs[ix].radius);
 
 				for (unsigned k = 0; k < wsize; ++k) {
 					cached_obj &obj(objs[work[k]]);
 					if (obj.flags & bad_flags) continue;
 					float const radius(c_radius_i + obj.radius);
-					if (fabs(pisd - obj.pos.y) > radius || !dist_less_than(pos_i, obj.pos, radius)) continue; // no intersection
+					if (fabs(pos_i[d1] - obj.pos[d1]) > radius || fabs(pos_i[d2] - obj.pos[d2]) > radius) continue; // separated along the other axes
+					++coll_pairs_tested;
+					if (!dist_less_than(pos_i, obj.pos, radius)) continue; // no intersection
 
 					if (proc_coll(objs[ix].obj, obj.obj)) {
 						objs[ix].refresh(); // ???
 						obj.refresh(); // ???
+						++coll_pairs_hit;
 					}
 				}
 			}
@@ -141,7 +141,7 @@ class u_ship;
 class ship_weapon;
 
 
-extern bool player_enemy, begin_motion; // required for efficiency
+extern bool player_enemy, begin_motion, ship_ai_snapshot_active; // required for efficiency
 extern u_ship *player_ship_ptr;
 
 
@@ -668,6 +668,7 @@ protected:
 	point reset_pos;
 	vector3d velocity, upv, dir, dvel, rot_axis, gvect;
 	free_obj const *target_obj, *parent;
+	free_obj const *snap_target_obj; // target_obj as seen by other ships while ship AI runs in parallel
 	unsigned exp_lights[NUM_EXP_LIGHTS], num_exp_lights;
 	unsigned alignment;
 	float c_radius;
@@ -693,6 +694,7 @@ public:
 	void fix_upv();
 	void accelerate(float speed, float accel);
 	void decelerate(float speed, float decel);
+	static void rotate_dir_upv(float pitch, float yaw, vector3d &dir_, vector3d &upv_);
 	void do_rotate(float pitch, float yaw);
 	void arb_rotate_about(float rangle, vector3d const &raxis);
 	void tilt(float val);
@@ -757,7 +759,7 @@ public:
 	unsigned        get_time()     const {return time;}
 	unsigned        get_flags()    const {return flags;}
 	int          get_shadow_val()  const {return shadow_val;}
-	free_obj const *get_target()   const {return target_obj;}
+	free_obj const *get_target()   const {return (ship_ai_snapshot_active ? snap_target_obj : target_obj);}
 	free_obj const *get_parent()   const {return parent;}
 	free_obj const *get_root_parent() const;
 	int get_owner() const {return alignment;}
@@ -808,6 +810,7 @@ public:
 	virtual void draw_flares_only() const {assert(0);}
 	virtual void set_temp(float temp, point const &tcenter, free_obj const *source=NULL);
 	virtual void ai_action() {} // default: no AI
+	virtual void snapshot_ai_state() {snap_target_obj = target_obj; calc_rotation_vectors();} // rotation vectors are cached on first use, so fill them here
 	virtual void first_frame_hook() {}
 	virtual void apply_physics();
 	virtual void advance_time(float timestep);
@@ -1185,11 +1188,12 @@ class u_ship : public free_obj, public u_ship_base {
 
 	unsigned ai_type; // us_class of this ship
 	bool lhyper, damaged, target_set, fire_primary, has_obstacle, captured, dest_override, is_flagship;
-	float tow_mass, exp_val, cloaked, roll_val, pitch_r, yaw_r, roll_r, cached_rsv, child_stray_dist;
+	float tow_mass, exp_val, cloaked, snap_cloaked, roll_val, pitch_r, yaw_r, roll_r, cached_rsv, child_stray_dist;
 	unsigned curr_weapon, last_hit, target_mode, eflags, init_align;
 	unsigned retarg_time, exp_time, tup_time, last_targ_t, disable_t, elapsed_on_t; // times
 	point tcent;
 	vector3d hit_dir, obs_orient, target_dir;
+	vector3d ai_dir, ai_upv; // heading after this ship's deferred turn, seen only by its own AI while ship AI runs in parallel
 	string name;
 	mesh2d surface_mesh;
 
@@ -1225,7 +1229,9 @@ public:
 	float get_real_speed_val() const;
 	vector<ship_weapon> const *get_weapons() const {return &weapons;}
 	void thrust(int tdir, float speed, bool hyperspeed);
+	vector3d get_turn_angles(vector3d delta);
 	void turn(vector3d delta);
+	vector3d const &get_ai_dir() const;
 	int get_move_dir();
 	vector3d get_tot_vel_at(point const &cpos) const;
 	bool do_multi_target() const;
@@ -1252,6 +1258,7 @@ public:
 	bool has_slow_fighters() const;
 	void fire_at_target(free_obj const *const targ_obj, float min_dist);
 	virtual void ai_action();
+	void snapshot_ai_state();
 	void fire_point_defenses();
 	bool find_coll_enemy_proj(float dmax, point &p_int) const;
 	virtual bool has_clear_line_of_fire(us_weapon const &weap, vector3d const &fire_dir, float target_dist) const;
@@ -1351,7 +1358,7 @@ public:
 	bool self_shadow()  const {return specs().self_shadow;}
 	bool can_move()     const {return specs().can_move();}
 	bool has_seeking_weapons() const;
-	float visibility()  const {return (1.0 - cloaked);}
+	float visibility()  const {return (1.0 - (ship_ai_snapshot_active ? snap_cloaked : cloaked));}
 	float get_damage_abs()   const {return specs().damage_abs;}
 	bool player_controlled() const;
 	string get_name()   const;
@@ -1388,6 +1395,8 @@ private:
 	vector3d axis;
 	point rel_pos, sobj_pos, sun_pos;
 
+	void try_build_ship();
+
 public:
 	orbiting_ship(unsigned sclass_, unsigned align, bool guardian, s_object const &world_path,
 		vector3d const &axis_, point const &start_pos, float rad, float start_ang, float rate);
@@ -6,9 +6,11 @@
 #include "ship_util.h"
 #include "explosion.h"
 #include "obj_sort.h"
+#include "cobj_bsp_tree.h"
 
 
 bool const EXPLODE_LIGHTING = 1;
+unsigned const UOBJ_BVH_MIN_OBJS = 64; // smaller vectors use the linear search along x
 
 float uobjs_lit_rmax(0.0);
 
@@ -18,6 +20,88 @@ extern vector<cached_obj> ships[], all_ships, stat_objs, coll_proj, decoys, c_uo
 extern vector<us_weapon> us_weapons;
 
 
+// per-frame BVH over one of the cached_obj query vectors; it's read-only after construction, so the parallel ship AI can query it
+class uobj_bvh_t : public cobj_tree_sphere_t {
+
+	vector<cached_obj> const *objs;
+	unsigned num_objs;
+
+public:
+	uobj_bvh_t() : objs(NULL), num_objs(0) {}
+
+	void setup(vector<cached_obj> const &objs_) {
+		clear();
+		objs     = &objs_;
+		num_objs = (unsigned)objs_.size();
+		if (num_objs < UOBJ_BVH_MIN_OBJS) return;
+		objects.resize(num_objs);
+		for (unsigned i = 0; i < num_objs; ++i) {objects[i] = sphere_with_id_t(objs_[i].pos, objs_[i].radius, i);} // id is the index into objs
+		build_tree_top(0);
+	}
+	bool is_valid_for(vector<cached_obj> const *const objs_) const {return (objs_ == objs && !is_empty() && objs_->size() == num_objs);}
+
+	// calls func(ix) on objects in nodes intersecting the sphere until it returns 0; radius may be reduced by func during the query
+	template<typename F> void query_sphere(point const &pos, float const &radius, F const &func) const {
+		unsigned const num_nodes((unsigned)nodes.size());
+
+		for (unsigned nix = 0; nix < num_nodes;) {
+			tree_node const &n(nodes[nix]);
+
+			if (!sphere_cube_intersect(pos, radius, n)) {
+				assert(n.next_node_id > nix);
+				nix = n.next_node_id;
+				continue;
+			}
+			for (unsigned i = n.start; i < n.end; ++i) {
+				if (!func(objects[i].id)) return;
+			}
+			++nix;
+		}
+	}
+	// calls func(ix) on objects in nodes intersecting the line expanded by line_radius until it returns 0
+	template<typename F> void query_line(point const &p1, point const &p2, float line_radius, F const &func) const {
+		unsigned const num_nodes((unsigned)nodes.size());
+
+		for (unsigned nix = 0; nix < num_nodes;) {
+			tree_node const &n(nodes[nix]);
+			cube_t bcube(n);
+			bcube.expand_by(line_radius);
+
+			if (!check_line_clip(p1, p2, bcube.d)) {
+				assert(n.next_node_id > nix);
+				nix = n.next_node_id;
+				continue;
+			}
+			for (unsigned i = n.start; i < n.end; ++i) {
+				if (!func(objects[i].id)) return;
+			}
+			++nix;
+		}
+	}
+};
+
+unsigned const NUM_UOBJ_BVHS = NUM_ALIGNMENT + 4;
+uobj_bvh_t uobj_bvhs[NUM_UOBJ_BVHS]; // all_ships, stat_objs, coll_proj, decoys, ships[] by alignment
+
+
+void build_uobj_query_bvhs() { // must be called after the query vectors are created each frame
+
+	vector<cached_obj> const *objs[NUM_UOBJ_BVHS] = {&all_ships, &stat_objs, &coll_proj, &decoys};
+	for (unsigned i = 0; i < NUM_ALIGNMENT; ++i) {objs[i+4] = &ships[i];}
+#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < (int)NUM_UOBJ_BVHS; ++i) {uobj_bvhs[i].setup(*objs[i]);}
+}
+
+
+uobj_bvh_t const *get_uobj_bvh(vector<cached_obj> const *const objs) { // returns NULL if objs has no BVH
+
+	for (unsigned i = 0; i < NUM_UOBJ_BVHS; ++i) {
+		if (uobj_bvhs[i].is_valid_for(objs)) return &uobj_bvhs[i];
+	}
+	return NULL;
+}
+
+
 // what about objects created this frame that aren't sorted?
 unsigned binary_search_pos(vector<cached_obj> const &objs, point const &pos) { // returns the index before
 
@@ -33,62 +117,77 @@ unsigned binary_search_pos(vector<cached_obj> const &objs, point const &pos) { /
 }
 
 
+bool line_intersect_fo(line_int_data &li_data, cached_obj const &obj, free_obj *&fobj, unsigned bad_flags, vector3d const &v_line) {
+
+	if (obj.flags & bad_flags) return 0; // already destroyed or no collisions
+	assert(obj.obj != NULL);
+	if (obj.obj == li_data.curr || obj.obj == li_data.ignore_obj) return 0; // don't hit yourself or ignore_obj
+	point const &pos(obj.pos);
+	vector<uobject const *> *sobjs(li_data.sobjs);
+	float const line_radius(li_data.line_radius), radius(obj.radius + line_radius), rdist(radius + li_data.length), dist_sq(p2p_dist_sq(li_data.start, pos));
+	if (dist_sq > rdist*rdist || (fobj != NULL && sobjs == NULL && dist_sq >= li_data.dist)) return 0;
+	float t_val; // unused
+
+	// check_parent: 0 = disabled, 1 = projectiles only, 2 = projectiles + fighters
+	if (li_data.check_parent && (li_data.check_parent == 2 || (obj.flags & OBJ_FLAGS_PROJ)) &&
+		obj.obj->get_root_parent() == li_data.curr)
+	{
+		return 0; // don't hit your own shot/fighter
+	}
+	if (!sphere_test_comp(li_data.start, pos, v_line, radius*radius, t_val))                 return 0;
+	if (li_data.visible_only && (obj.flags & OBJ_FLAGS_SHIP) && obj.obj->visibility() < 0.1) return 0; // cache miss, rarely fails
+
+	if (line_radius == 0.0 || !li_data.use_lpos) {
+		if (!obj.obj->line_int_obj(li_data.start, li_data.end)) return 0; // skip this check for thick lines
+	}
+	else { // thick lines, used for shadow calculations
+		vector3d const test_dir((li_data.lpos - pos).get_norm());
+		if (!sphere_test_comp(li_data.lpos, li_data.start, test_dir, radius*radius, t_val)) return 0; // thick lines
+		if (li_data.curr && sobjs != NULL && p2p_dist_sq(pos, li_data.lpos) >= (p2p_dist_sq(li_data.start, li_data.lpos) +
+			max(0.0f, (li_data.curr->get_radius() - obj.obj->get_radius())))) return 0;
+	}
+	fobj         = obj.obj;
+	li_data.dist = dist_sq;
+	if (sobjs != NULL) sobjs->push_back(obj.obj);
+	return 1;
+}
+
+
 void line_intersect_fo_vector(line_int_data &li_data, vector<cached_obj> const &objs, free_obj *&fobj, float urm, bool find_ships) {
 
 	unsigned const nobjs((unsigned)objs.size());
 	if (nobjs == 0) return;
-	float const line_radius(li_data.line_radius);
-	urm += line_radius;
+	unsigned bad_flags(OBJ_FLAGS_BAD_); // Note: Bad (dying) objects can still get in the way
+	if (!li_data.even_ncoll) bad_flags |= OBJ_FLAGS_NCOL;
+	if (!find_ships)         bad_flags |= OBJ_FLAGS_SHIP;
+	vector3d const v_line(li_data.start, li_data.end);
+	uobj_bvh_t const *const bvh(get_uobj_bvh(&objs));
+
+	if (bvh != NULL) {
+		// objects aren't visited in order along the line, so unless all hits are wanted, keep going and let line_intersect_fo() keep the closest one
+		bool const stop_at_first(li_data.first_only && li_data.sobjs != NULL);
+		bvh->query_line(li_data.start, li_data.end, li_data.line_radius,
+			[&](unsigned ix) {return !(line_intersect_fo(li_data, objs[ix], fobj, bad_flags, v_line) && stop_at_first);});
+		return;
+	}
+	urm += li_data.line_radius;
 	bool const sign(li_data.dir.x > 0);
 	int const ie(sign ? nobjs+1 : 0), di(sign ? 1 : -1);
 	point start2(li_data.start);
 	float const st_val(li_data.start.x), dmax(fabs(li_data.end.x - st_val) + 1.2*urm); // 2.0*urm?
 	start2.x -= 1.01*di*urm;
-	unsigned bad_flags(OBJ_FLAGS_BAD_); // Note: Bad (dying) objects can still get in the way
-	if (!li_data.even_ncoll) bad_flags |= OBJ_FLAGS_NCOL;
-	if (!find_ships)         bad_flags |= OBJ_FLAGS_SHIP;
 	unsigned const six(binary_search_pos(objs, start2)); // could store the sort index in the object?
-	vector<uobject const *> *sobjs(li_data.sobjs);
-	vector3d const v_line(li_data.start, li_data.end);
-	float t_val; // unused
 
 	for (int i = six; i+1 != ie; i += di) {
 		cached_obj const &obj(objs[i]);
-		if (obj.flags & bad_flags) continue; // already destroyed or no collisions
-		assert(obj.obj != NULL);
-		if (obj.obj == li_data.curr || obj.obj == li_data.ignore_obj) continue; // don't hit yourself or ignore_obj
-		point const &pos(obj.pos);
+		float const pos_x(obj.pos.x);
 
 		// since we're using start2, not start, have to make sure we're comparing in the correct direction
 		// also, objs created this frame aren't sorted, so can't break on them
-		if (!(obj.flags & OBJ_FLAGS_NEW_) && ((st_val > pos.x) ^ sign)) { // move up?
-			if (fabs(st_val - pos.x) > dmax) break; // critical performance improvement
-		}
-		float const radius(obj.radius + line_radius), rdist(radius + li_data.length), dist_sq(p2p_dist_sq(li_data.start, pos));
-		if (dist_sq > rdist*rdist || (fobj != NULL && sobjs == NULL && dist_sq >= li_data.dist)) continue;
-
-		// check_parent: 0 = disabled, 1 = projectiles only, 2 = projectiles + fighters
-		if (li_data.check_parent && (li_data.check_parent == 2 || (obj.flags & OBJ_FLAGS_PROJ)) &&
-			obj.obj->get_root_parent() == li_data.curr)
-		{
-			continue; // don't hit your own shot/fighter
+		if (!(obj.flags & OBJ_FLAGS_NEW_) && ((st_val > pos_x) ^ sign)) { // move up?
+			if (fabs(st_val - pos_x) > dmax) break; // critical performance improvement
 		}
-		if (!sphere_test_comp(li_data.start, pos, v_line, radius*radius, t_val))                 continue;
-		if (li_data.visible_only && (obj.flags & OBJ_FLAGS_SHIP) && obj.obj->visibility() < 0.1) continue; // cache miss, rarely fails
-
-		if (line_radius == 0.0 || !li_data.use_lpos) {
-			if (!obj.obj->line_int_obj(li_data.start, li_data.end)) continue; // skip this check for thick lines
-		}
-		else { // thick lines, used for shadow calculations
-			vector3d const test_dir((li_data.lpos - pos).get_norm());
-			if (!sphere_test_comp(li_data.lpos, li_data.start, test_dir, radius*radius, t_val)) continue; // thick lines
-			if (li_data.curr && sobjs != NULL && p2p_dist_sq(pos, li_data.lpos) >= (p2p_dist_sq(li_data.start, li_data.lpos) +
-				max(0.0f, (li_data.curr->get_radius() - obj.obj->get_radius())))) continue;
-		}
-		fobj         = obj.obj;
-		li_data.dist = dist_sq;
-		if (sobjs != NULL) sobjs->push_back(obj.obj);
-		if (li_data.first_only) break;
+		if (line_intersect_fo(li_data, obj, fobj, bad_flags, v_line) && li_data.first_only) break;
 	}
 }
 
@@ -348,10 +447,22 @@ inline bool query_func_wrap(all_query_data &qdata, all_query query_func, unsigne
 }
 
 
+// search radius for the BVH, which may shrink as closer objects are found
+inline float const &get_search_radius(query_data     const &qdata) {return qdata.radius;} // the object radius is included in the BVH node bounds
+inline float const &get_search_radius(closeness_data const &qdata) {return qdata.dmin;}
+inline float const &get_search_radius(all_query_data const &qdata) {return qdata.max_search_dist;}
+
+
 template<typename data_t, typename query> void find_close_objects(data_t &qdata, query query_func, unsigned bad_flags=0) {
 
 	assert(qdata.objs != NULL);
 	if (qdata.objs->empty()) return;
+	uobj_bvh_t const *const bvh(get_uobj_bvh(qdata.objs));
+
+	if (bvh != NULL) { // the query_func return value is only used to end the search along x, so it's ignored here
+		bvh->query_sphere(qdata.pos, get_search_radius(qdata), [&](unsigned ix) {query_func_wrap(qdata, query_func, bad_flags, ix); return !qdata.exit_query;});
+		return;
+	}
 	unsigned const start(binary_search_pos(*(qdata.objs), qdata.pos)), nobjs((unsigned)qdata.objs->size());
 	assert(start <= nobjs);
 
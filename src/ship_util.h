@@ -9,6 +9,7 @@
 #include "ship.h"
 #include "obj_sort.h"
 #include "draw_utils.h" // for line_tquad_draw_t
+#include <functional>
 
 unsigned const BLOCK_SIZE = 1000;
 
@@ -262,6 +263,7 @@ us_projectile *create_projectile(unsigned type, free_obj const *const parent, un
 								 vector3d const &vel, vector3d const &dir, vector3d const &upv);
 void apply_explosion(point const &pos, float radius, float damage, unsigned eflags, int wclass, uobject *ptr, free_obj const *parent);
 free_obj const *check_for_incoming_proj(point const &pos, int align, float dist);
+void build_uobj_query_bvhs();
 void shift_univ_objs(point const &pos, bool shift_player_ship);
 void create_univ_cube_map();
 void draw_univ_objects();
@@ -271,6 +273,12 @@ void add_other_ships(int align, unsigned num=0, bool initial=0, bool rand_spawne
 void gen_lightning_from(point const &pos, float radius, float dist, free_obj const *src);
 void add_colored_lights(point const &pos, float radius, colorRGBA const &color, float time, unsigned num, free_obj const *const obj);
 
+// ship AI intents: actions of u_ship::ai_action() that affect other objects, recorded when ships run their AI in parallel and committed serially
+typedef vector<std::function<void()>> ship_ai_intents_t;
+bool recording_ship_ai_intents(); // returns 1 if this thread is running ship AI against the frozen object lists
+void add_ship_ai_intent(std::function<void()> const &intent);
+template<typename F> void run_or_defer_ship_ai(F const &func) {if (recording_ship_ai_intents()) {add_ship_ai_intent(func);} else {func();}}
+
 void add_br_light(unsigned index, point const &pos, float radius, free_obj const *const parent);
 void apply_explosions();
 void check_explosion_refs();
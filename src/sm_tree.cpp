@@ -429,7 +429,7 @@ void small_tree_group::gen_trees(int x1, int y1, int x2, int y2, float const den
 	density_gen.build_arrays(xscale*(x1 + xoff2), yscale*(y1 + yoff2), xscale, yscale, (x2-x1), (y2-y1), 0, 1); // force_sine_mode=1
 	
 	if (approx_zval) {
-		height_gen.build_arrays(DX_VAL*(x1 + xoff2 - (MESH_X_SIZE >> 1) + 0.5f), DY_VAL*(y1 + yoff2 - (MESH_Y_SIZE >> 1) + 0.5f), DX_VAL, DY_VAL, (x2-x1), (y2-y1));
+		height_gen.build_arrays(DX_VAL*(x1 + xoff2 - (MESH_X_SIZE >> 1) + 0.5f), DY_VAL*(y1 + yoff2 - (MESH_Y_SIZE >> 1) + 0.5f), DX_VAL, DY_VAL, (x2-x1), (y2-y1), 0, 0, 0, 1); // sparse_reads=1
 		height_gen.enable_glaciate();
 	}
 	float const dxv(skip_val/(x2 - x1 - 1.0f)), dyv(skip_val/(y2 - y1 - 1.0f));
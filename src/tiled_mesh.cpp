@@ -7,6 +7,13 @@
 #include "shaders.h"
 #include "openal_wrap.h"
 #include "heightmap.h"
+#include "binary_file_io.h"
+#include "file_utils.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
 
 
 bool const DEBUG_TILES        = 0;
@@ -30,12 +37,20 @@ float const SMAP_DEL_THRESH   = 1.3;
 float const SMAP_FADE_THRESH  = 1.5;
 float const OCCLUDER_DIST     = 0.2;
 float const FLOWER_REL_DIST   = 0.9; // flower view distance relative to grass view distance
+float const SYNC_GEN_DIST_TILES = 0.25; // tiles closer than this are generated on the main thread, since they may be needed for camera collision this frame
+float const PREFETCH_FRAMES   = 30.0; // how far ahead of the camera to generate tiles in the background
+int   const TILE_CACHE_CHUNK_SZ = 8; // tiles per cache file in x and y
+unsigned const TILE_CACHE_VERSION = 1; // increment when the cache record format or tile generation algorithm changes
 
 int   const LIGHTNING_LIGHT = 2;
 float const LIGHTNING_FREQ  = 200.0; // in ticks (1/40 s)
 float const LITNING_TIME2   = 40.0;
 float const LITNING_DIST    = 1.2;
 
+unsigned const HORIZON_AZ_BINS   = 64;  // sun azimuth quantization for tile horizon maps; a map is reused while the sun stays within its bin
+unsigned const HORIZON_NUM_STEPS = 24;  // samples along each horizon ray
+float    const HORIZON_STEP_SCALE= 1.2; // ratio of successive horizon ray step lengths; the rays reach about 1.5 tiles
+
 unsigned const NUM_AO_DIRS  = 8; // Note: required to be 8 for adj tile calculation
 unsigned const NUM_AO_STEPS = 8;
 unsigned const AO_RAY_LEN(NUM_AO_STEPS*(NUM_AO_STEPS+1)/2); // 36
@@ -46,12 +61,15 @@ enum {FM_NONE, FM_INC_MESH, FM_DEC_MESH, FM_FLATTEN, FM_REM_TREES, FM_ADD_TREES,
 bool tt_lightning_enabled(0), check_tt_mesh_occlusion(1);
 unsigned inf_terrain_fire_mode(0); // none, increase height, decrease height
 string read_hmap_modmap_fn, write_hmap_modmap_fn("heightmap.mod");
+string tile_cache_dir; // if nonempty, generated tile heights, AO, and normals are cached in this directory and reused across runs
+float tt_shadow_update_ms(4.0); // per-frame time budget for terrain shadow updates as the sun moves; 0 = no limit
+bool tt_horizon_shadows(0); // approximate sun shadows from per-tile horizon maps while the sun is high enough; faster but less accurate than tracing
 hmap_brush_param_t cur_brush_param;
 tile_offset_t model3d_offset;
 
 extern bool inf_terrain_scenery, enable_tiled_mesh_ao, underwater, fog_enabled, volume_lighting, combined_gu, enable_depth_clamp, tt_triplanar_tex, use_grass_tess;
-extern bool use_instanced_pine_trees, enable_tt_model_reflect, water_is_lava, tt_fire_button_down, flashlight_on;
-extern unsigned grass_density, max_unique_trees, shadow_map_sz, num_birds_per_tile, num_fish_per_tile, erosion_iters_tt, num_rnd_grass_blocks;
+extern bool use_instanced_pine_trees, enable_tt_model_reflect, water_is_lava, tt_fire_button_down, flashlight_on, mesh_gen_cpu_only;
+extern unsigned grass_density, max_unique_trees, shadow_map_sz, num_birds_per_tile, num_fish_per_tile, erosion_iters_tt, num_rnd_grass_blocks, num_tile_gen_threads;
 extern int DISABLE_WATER, display_mode, tree_mode, leaf_color_changed, ground_effects_level, animate2, iticks, num_trees, window_width, window_height;
 extern int invert_mh_image, is_cloudy, camera_surf_collide, show_fog, mesh_gen_mode, mesh_gen_shape, cloud_model, precip_mode, auto_time_adv;
 extern float zmax, zmin, water_plane_z, mesh_scale, mesh_scale_z, vegetation, relh_adj_tex, grass_length, grass_width, fticks, cloud_height_offset, clouds_per_tile;
@@ -160,15 +178,24 @@ class tiled_terrain_hmap_manager_t : public terrain_hmap_manager_t {
 
 	tile_t *cur_tile;
 	bool modified[3][3];
+	bool data_hash_valid;
+	uint64_t data_hash;
 
 public:
-	tiled_terrain_hmap_manager_t() : cur_tile(NULL) {clear_modified();}
+	tiled_terrain_hmap_manager_t() : cur_tile(NULL), data_hash_valid(0), data_hash(0) {clear_modified();}
 	void clear_modified() {for (unsigned i = 0; i < 3; ++i) {UNROLL_3X(modified[i][i_] = 0;)}}
+	void invalidate_data_hash() {data_hash_valid = 0;}
+
+	uint64_t get_cached_data_hash() { // hashing the full heightmap is slow, so only redo it after the heightmap has been modified
+		if (!data_hash_valid) {data_hash = get_data_hash(); data_hash_valid = 1;}
+		return data_hash;
+	}
 
 	void apply_brush(tex_mod_map_manager_t::hmap_brush_t brush, tile_t *tile, bool cache) { // Note: brush is copied and may be modified
 		cur_tile = tile;
 		assert(brush.radius <= get_tile_size()); // only allow for a single adjacent tile
 		clear_modified();
+		invalidate_data_hash();
 
 		if (brush.is_flatten_brush()) { // use heightmap value at brush center instead of a delta
 			brush.delta = get_clamped_pixel_value(brush.x, brush.y); // Note: original delta is overwritten/unused in this case
@@ -202,6 +229,7 @@ public:
 		int cx1(x1), cy1(y1), cx2(x2), cy2(y2);
 		if (!clamp_xy(cx1, cy1, 0.0, 0.0, 0) || !clamp_xy(cx2, cy2, 0.0, 0.0, 0)) return; // off the texture, skip
 		assert(cx1 >= 0 && cy1 >= 0 && cx1 <= cx2 && cy1 <= cy2);
+		invalidate_data_hash();
 		tex_mod_map_manager_t::mod_elem_t elem(cx1, cy1, height_val);
 
 		for (elem.y = cy1; elem.y <= cy2; ++elem.y) {
@@ -234,6 +262,7 @@ bool read_default_hmap_modmap() {
 
 	if (read_hmap_modmap_fn.empty()) return 0;
 	if (!terrain_hmap_manager.read_and_apply_mod(read_hmap_modmap_fn)) return 0;
+	terrain_hmap_manager.invalidate_data_hash();
 	cout << "Read heightmap modmap " << read_hmap_modmap_fn << endl;
 	return 1;
 }
@@ -247,6 +276,207 @@ bool write_default_hmap_modmap() {
 }
 
 
+// *** persistent tile cache ***
+
+// stores the generated data of each tile in gzip compressed files of TILE_CACHE_CHUNK_SZ x TILE_CACHE_CHUNK_SZ tiles, named by a hash of all of the generation parameters,
+// so that changing any parameter or editing the heightmap uses a different set of files; new tiles are appended to their chunk file as separate gzip members,
+// and a chunk is read in full the first time one of its tiles is requested; thread safe, since it's used by the tile gen worker threads;
+// file I/O is done without holding the main mutex so that other threads can use chunks that are already loaded
+class tile_cache_t {
+
+	typedef map<tile_xy_pair, vector<unsigned char>> record_map_t;
+
+	struct chunk_t {
+		bool loaded;
+		set<tile_xy_pair> in_file; // all tiles that have been written to the file, or are being written
+		record_map_t records; // tile data that has been read but not yet used
+		chunk_t() : loaded(0) {}
+	};
+	std::mutex mutex, file_mutex; // file_mutex serializes appends to chunk files
+	map<tile_xy_pair, chunk_t> chunks;
+	uint64_t params_hash;
+	int gen_mode; // effective mesh gen mode included in params_hash
+	bool enabled, write_failed;
+
+	static int get_chunk_ix(int v) {return ((v < 0) ? ((v + 1)/TILE_CACHE_CHUNK_SZ - 1) : (v/TILE_CACHE_CHUNK_SZ));} // round toward -inf
+	static tile_xy_pair get_chunk_xy(tile_xy_pair const &txy) {return tile_xy_pair(get_chunk_ix(txy.x), get_chunk_ix(txy.y));}
+
+	static string get_chunk_fn(tile_xy_pair const &cxy, uint64_t hash) {
+		std::ostringstream oss;
+		oss << tile_cache_dir << "/tiles_" << std::hex << hash << std::dec << "_" << cxy.x << "_" << cxy.y << ".gz";
+		return oss.str();
+	}
+	static void read_chunk_file(string const &fn, record_map_t &records) { // file format is a sequence of {x, y, num_bytes, data} records
+		if (!check_file_exists(fn)) return; // not yet created
+		binary_file_reader reader;
+		if (!reader.open(fn)) return;
+		int header[3] = {0};
+		vector<unsigned char> data;
+
+		while (reader.read(header, sizeof(int), 3)) {
+			if (header[2] <= 0) break; // corrupt
+			data.resize(header[2]);
+			if (!reader.read(data.data(), 1, data.size())) {cerr << "Error reading tile cache file " << fn << endl; break;} // truncated, or still being appended to
+			records[tile_xy_pair(header[0], header[1])].swap(data); // if a tile was written twice, use the last one
+		}
+	}
+	// reads the chunk file if needed, with the lock released during the read; returns nullptr if the params changed in the meantime
+	chunk_t *get_loaded_chunk(tile_xy_pair const &cxy, std::unique_lock<std::mutex> &lock, bool force_reload=0) {
+		if (!force_reload) {
+			chunk_t &chunk(chunks[cxy]);
+			if (chunk.loaded) return &chunk;
+		}
+		uint64_t const hash(params_hash);
+		record_map_t records;
+		lock.unlock();
+		read_chunk_file(get_chunk_fn(cxy, hash), records);
+		lock.lock();
+		if (!enabled || params_hash != hash) return nullptr; // data is for a different set of files
+		chunk_t &chunk(chunks[cxy]);
+		if (chunk.loaded && !force_reload) return &chunk; // loaded by another thread
+		chunk.loaded = 1;
+		chunk.records.swap(records);
+		for (auto const &r : chunk.records) {chunk.in_file.insert(r.first);} // keep any tiles that are being written
+		return &chunk;
+	}
+public:
+	tile_cache_t() : params_hash(0), gen_mode(0), enabled(0), write_failed(0) {}
+
+	void set_params(bool enabled_, uint64_t params_hash_, int gen_mode_) { // called on the main thread each frame
+		std::unique_lock<std::mutex> lock(mutex);
+		enabled = (enabled_ && !write_failed);
+		if (params_hash_ != params_hash) {chunks.clear();} // different set of files
+		params_hash = params_hash_;
+		gen_mode    = gen_mode_;
+	}
+	void free_distant_chunks(tile_xy_pair const &camera_txy) { // drop unused tile data for chunks the camera has moved away from, but keep the index
+		std::unique_lock<std::mutex> lock(mutex);
+		tile_xy_pair const ccxy(get_chunk_xy(camera_txy));
+
+		for (auto &c : chunks) {
+			if (c.second.records.empty() || (abs(c.first.x - ccxy.x) <= 1 && abs(c.first.y - ccxy.y) <= 1)) continue;
+			c.second.records.clear();
+			c.second.loaded = 0; // reload if needed again
+		}
+	}
+	// mode is the current effective mesh gen mode; tiles generated with a different mode than the one in the params hash aren't cached
+	bool read_tile(tile_xy_pair const &txy, int mode, vector<unsigned char> &data) {
+		std::unique_lock<std::mutex> lock(mutex);
+		if (!enabled || mode != gen_mode) return 0;
+		tile_xy_pair const cxy(get_chunk_xy(txy));
+		chunk_t *chunk(get_loaded_chunk(cxy, lock));
+		if (chunk == nullptr || chunk->in_file.find(txy) == chunk->in_file.end()) return 0; // not cached
+		auto it(chunk->records.find(txy));
+
+		if (it == chunk->records.end()) { // already used and freed, or still being written; reload the chunk
+			chunk = get_loaded_chunk(cxy, lock, 1);
+			if (chunk == nullptr) return 0;
+			it = chunk->records.find(txy);
+			if (it == chunk->records.end()) return 0;
+		}
+		data.swap(it->second);
+		chunk->records.erase(it); // the tile owns the data now
+		return 1;
+	}
+	void invalidate_tile(tile_xy_pair const &txy) { // for records that failed validation; the next write of this tile replaces the record
+		std::unique_lock<std::mutex> lock(mutex);
+		auto it(chunks.find(get_chunk_xy(txy)));
+		if (it != chunks.end()) {it->second.in_file.erase(txy);}
+	}
+	void write_tile(tile_xy_pair const &txy, int mode, vector<unsigned char> const &data) {
+		std::unique_lock<std::mutex> lock(mutex);
+		if (!enabled || mode != gen_mode) return;
+		tile_xy_pair const cxy(get_chunk_xy(txy));
+		chunk_t *const chunk(get_loaded_chunk(cxy, lock));
+		if (chunk == nullptr) return;
+		if (!chunk->in_file.insert(txy).second) return; // already cached (generated again after being freed)
+		string const fn(get_chunk_fn(cxy, params_hash));
+		lock.unlock();
+		bool open_failed(0), write_ok(0);
+		{
+			std::unique_lock<std::mutex> file_lock(file_mutex);
+			binary_file_writer writer;
+
+			if (!writer.open(fn, 1)) {open_failed = 1;} // append=1
+			else {
+				int const header[3] = {txy.x, txy.y, int(data.size())};
+				write_ok = (writer.write(header, sizeof(int), 3) && writer.write(data.data(), 1, data.size()));
+			}
+		}
+		if (write_ok) return;
+		if (open_failed) {cerr << " Disabling tile cache; does the directory " << tile_cache_dir << " exist?" << endl;}
+		else {cerr << "Error writing tile cache file " << fn << endl;}
+		lock.lock();
+		if (open_failed) {write_failed = 1; enabled = 0;}
+		auto it(chunks.find(cxy));
+		if (it != chunks.end()) {it->second.in_file.erase(txy);}
+	}
+};
+
+tile_cache_t tile_cache;
+
+// GPU noise modes give different results when evaluated on the CPU
+int get_effective_mesh_gen_mode() {return ((mesh_gen_mode >= MGEN_SIMPLEX_GPU && mesh_gen_cpu_only) ? (MGEN_END + mesh_gen_mode) : mesh_gen_mode);}
+
+// everything that affects the cached tile data; the heightmap data hash includes any heightmap edits
+uint64_t get_tile_cache_params_hash() {
+
+	bool const using_hmap(using_tiled_terrain_hmap_tex());
+	uint64_t hash(get_mesh_gen_params_hash());
+	int const ivals[] = {(int)TILE_CACHE_VERSION, (int)get_tile_size(), enable_tiled_mesh_ao, enable_terrain_env, USE_PARAMS_HSCALE, (int)erosion_iters_tt,
+		(int)NUM_AO_STEPS, invert_mh_image, using_hmap, using_hmap_with_detail(), get_effective_mesh_gen_mode()};
+	float const fvals[] = {DX_VAL, DY_VAL, X_SCENE_SIZE, Y_SCENE_SIZE, biome_x_offset, zmin, get_water_z_height(), ocean_wave_height};
+	hash_add_val(hash, ivals);
+	hash_add_val(hash, fvals);
+
+	if (using_hmap) {
+		hash_add_str(hash, mh_filename_tt);
+		hash_add_val(hash, terrain_hmap_manager.get_cached_data_hash());
+	}
+	return hash;
+}
+
+void update_tile_cache_params() {
+	bool const enabled(!tile_cache_dir.empty() && inf_terrain_fire_mode == FM_NONE); // don't cache tiles while the mesh is being edited
+	tile_cache.set_params(enabled, (enabled ? get_tile_cache_params_hash() : 0), get_effective_mesh_gen_mode());
+}
+
+// reads/writes a tile cache record
+class tile_data_writer_t {
+	vector<unsigned char> &data;
+public:
+	tile_data_writer_t(vector<unsigned char> &data_) : data(data_) {}
+	template<typename T> void write(T const &val) {data.insert(data.end(), (unsigned char const *)&val, (unsigned char const *)&val + sizeof(T));}
+
+	template<typename T> void write_vect(vector<T> const &v) {
+		write(unsigned(v.size()));
+		if (!v.empty()) {data.insert(data.end(), (unsigned char const *)v.data(), (unsigned char const *)(v.data() + v.size()));}
+	}
+};
+class tile_data_reader_t {
+	vector<unsigned char> const &data;
+	size_t pos;
+public:
+	tile_data_reader_t(vector<unsigned char> const &data_) : data(data_), pos(0) {}
+	bool at_end() const {return (pos == data.size());}
+
+	template<typename T> bool read(T &val) {
+		if (pos + sizeof(T) > data.size()) return 0;
+		memcpy(&val, (data.data() + pos), sizeof(T));
+		pos += sizeof(T);
+		return 1;
+	}
+	template<typename T> bool read_vect(vector<T> &v) {
+		unsigned sz(0);
+		if (!read(sz) || pos + sz*sizeof(T) > data.size()) return 0;
+		v.resize(sz);
+		if (sz > 0) {memcpy(v.data(), (data.data() + pos), sz*sizeof(T));}
+		pos += sz*sizeof(T);
+		return 1;
+	}
+};
+
+
 // *** tile_t ***
 
 tile_t::tile_t() : x1(0), y1(0), x2(0), y2(0), wx1(0), wy1(0), wx2(0), wy2(0),
@@ -277,6 +507,10 @@ float tile_t::get_draw_priority() const {
 	return (p2p_dist_xy(get_camera_pos(), get_center()) + (is_visible() ? 0.0 : FAR_CLIP)); // prioritize visible tiles
 }
 
+float tile_t::get_gen_priority(point const &pred_camera) const { // like get_draw_priority(), but tiles ahead of a moving camera are also high priority
+	return (min(p2p_dist_xy(get_camera_pos(), get_center()), p2p_dist_xy(pred_camera, get_center())) + (is_visible() ? 0.0 : FAR_CLIP));
+}
+
 
 void tile_t::update_terrain_params() { // setup biomes
 
@@ -371,6 +605,8 @@ void tile_t::clear() {
 	weight_data.clear();
 	zvals.clear();
 	clear_shadows();
+	clear_container(horizon);
+	horizon_az_bin = -1;
 	pine_trees.clear_all();
 	decid_trees.clear();
 	scenery.clear();
@@ -408,12 +644,12 @@ void tile_t::clear_vbo_tid(tile_shadow_map_manager *smap_manager) {
 }
 
 
-bool setup_height_gen(mesh_xy_grid_cache_t &height_gen, float x0, float y0, float dx, float dy, unsigned nx, unsigned ny, bool cache_values, bool no_wait=0) {
+bool setup_height_gen(mesh_xy_grid_cache_t &height_gen, float x0, float y0, float dx, float dy, unsigned nx, unsigned ny, bool cache_values, bool no_wait=0, bool sparse_reads=0) {
 
 	bool const add_detail(using_hmap_with_detail());
 	if (!add_detail && using_tiled_terrain_hmap_tex()) return 1; // nothing to do
 	float const xy_scale(add_detail ? HMAP_DETAIL_SCALE : 1.0);
-	bool const results_avail(height_gen.build_arrays(xy_scale*x0, xy_scale*y0, xy_scale*dx, xy_scale*dy, nx, ny, cache_values, 0, no_wait));
+	bool const results_avail(height_gen.build_arrays(xy_scale*x0, xy_scale*y0, xy_scale*dx, xy_scale*dy, nx, ny, cache_values, 0, no_wait, sparse_reads));
 	height_gen.enable_glaciate();
 	return results_avail;
 }
@@ -422,6 +658,7 @@ bool setup_height_gen(mesh_xy_grid_cache_t &height_gen, float x0, float y0, floa
 bool tile_t::create_zvals(mesh_xy_grid_cache_t &height_gen, bool no_wait) {
 
 	//timer_t timer("Create Zvals");
+	if (read_from_cache()) return 1;
 	if (enable_terrain_env) {update_terrain_params();}
 	zvals.resize(zvsize*zvsize);
 	mzmin =  FAR_DISTANCE;
@@ -496,9 +733,73 @@ bool tile_t::create_zvals(mesh_xy_grid_cache_t &height_gen, bool no_wait) {
 	ptzmax = dtzmax = mzmin; // no trees yet
 	if (!can_have_trees()) {no_trees = 1;} // mark as no_trees so that trees don't pop when water is disabled later
 	if (DEBUG_TILES) {cout << "new tile coords: " << x1 << " " << y1 << " " << x2 << " " << y2 << endl;}
+	write_to_cache();
 	return 1; // results are ready
 }
 
+void tile_t::write_tile_data(vector<unsigned char> &data) const {
+
+	tile_data_writer_t w(data);
+	w.write(zvsize);
+	w.write(mzmin); w.write(mzmax); w.write(mesh_dz); w.write(radius); w.write(min_normal_z);
+	w.write(wx1); w.write(wy1); w.write(wx2); w.write(wy2);
+	w.write(sub_zmin); w.write(sub_zmax);
+	w.write(params);
+	w.write_vect(zvals);
+	w.write_vect(ao_lighting);
+	w.write_vect(normal_data);
+}
+
+bool tile_t::read_tile_data(vector<unsigned char> const &data) {
+
+	tile_data_reader_t r(data);
+	unsigned zvsize_in(0);
+	if (!r.read(zvsize_in) || zvsize_in != zvsize) return 0; // shouldn't happen, since the tile size is part of the params hash
+	bool const success(r.read(mzmin) && r.read(mzmax) && r.read(mesh_dz) && r.read(radius) && r.read(min_normal_z) && r.read(wx1) && r.read(wy1) && r.read(wx2) && r.read(wy2) &&
+		r.read(sub_zmin) && r.read(sub_zmax) && r.read(params) && r.read_vect(zvals) && r.read_vect(ao_lighting) && r.read_vect(normal_data) && r.at_end());
+	return (success && zvals.size() == zvsize*zvsize && mzmin <= mzmax);
+}
+
+bool tile_t::read_from_cache() {
+
+	vector<unsigned char> data;
+	if (!tile_cache.read_tile(get_tile_xy_pair(), get_effective_mesh_gen_mode(), data)) return 0;
+
+	if (!read_tile_data(data)) {
+		cerr << "Error: Invalid tile cache record for tile " << get_tile_xy_pair().x << ", " << get_tile_xy_pair().y << "; regenerating" << endl;
+		tile_cache.invalidate_tile(get_tile_xy_pair()); // overwrite it with the regenerated data
+		wx1 = x2; wy1 = y2; wx2 = x1; wy2 = y1; // reset water bbox
+		mesh_dz = 0.0;
+		clear_container(ao_lighting);
+		clear_container(normal_data);
+		return 0;
+	}
+	ptzmax = dtzmax = mzmin; // no trees yet
+	if (!can_have_trees()) {no_trees = 1;}
+	return 1;
+}
+
+void tile_t::write_to_cache() { // computes everything that's cached now, rather than when the tile is first drawn
+
+	if (tile_cache_dir.empty() || inf_terrain_fire_mode != FM_NONE) return; // cache not enabled
+	if (enable_tiled_mesh_ao && ao_lighting.empty()) {calc_mesh_ao_lighting();}
+	if (normal_data.empty()) {calc_normal_data();}
+	vector<unsigned char> data;
+	write_tile_data(data);
+	tile_cache.write_tile(get_tile_xy_pair(), get_effective_mesh_gen_mode(), data);
+}
+
+// generates the zvals and everything derived from them that doesn't need the GL context or other tiles;
+// may be called from a worker thread, since the tile isn't visible to the main thread until it's inserted; requires CPU height generation
+bool tile_t::create_zvals_background(mesh_xy_grid_cache_t &height_gen) {
+
+	if (mesh_gen_mode >= MGEN_SIMPLEX_GPU) return 0; // mode was changed after this tile was queued
+	create_zvals(height_gen, 0); // may be read from the tile cache, including AO and normals
+	if (enable_tiled_mesh_ao && ao_lighting.empty()) {calc_mesh_ao_lighting();}
+	if (normal_data.empty()) {calc_normal_data();}
+	return 1;
+}
+
 void tile_t::get_z_minmax_for_area(point const &pos, float radius, float &zmin, float &zmax) const {
 
 	float const rx1(pos.x - radius), ry1(pos.y - radius), rx2(pos.x + radius), ry2(pos.y + radius);
@@ -561,7 +862,7 @@ void tile_t::calc_mesh_ao_lighting() {
 	if (use_ao_zvals) {czv.swap(ao_zvals);} // use precomputed values, will clear ao_zvals at the end
 	else {
 		czv.resize(context_sz*context_sz);
-		setup_height_gen(height_gen, get_xval(x1 - AO_RAY_LEN), get_yval(y1 - AO_RAY_LEN), deltax, deltay, context_sz, context_sz, 0); // cache_values=0
+		setup_height_gen(height_gen, get_xval(x1 - AO_RAY_LEN), get_yval(y1 - AO_RAY_LEN), deltax, deltay, context_sz, context_sz, 0, 0, 1); // cache_values=0, sparse_reads=1 (only outside the tile)
 	}
 	float const dz(0.5*HALF_DXY);
 	ao_lighting.resize(stride*stride);
@@ -693,6 +994,138 @@ void tile_t::calc_shadows(bool calc_sun, bool calc_moon, bool no_push) {
 }
 
 
+int get_horizon_az_bin(point const &lpos) {
+	float const az(atan2(lpos.y, lpos.x) + PI); // [0, 2*PI]
+	return min(int(HORIZON_AZ_BINS)-1, int(az*HORIZON_AZ_BINS/TWO_PI));
+}
+unsigned short quantize_horizon_angle(float angle) {return (unsigned short)(65535.0f*CLIP_TO_01(angle/PI_TWO));} // angles below the horizon clamp to 0
+
+unsigned tile_t::get_next_tile_id() {
+	static std::atomic<unsigned> next_id(1); // tiles may be created on background threads
+	return next_id++;
+}
+
+uint64_t tile_t::get_adj_horizon_hash() const {
+
+	uint64_t hash(FNV_HASH_INIT);
+
+	for (int dy = -1; dy <= 1; ++dy) {
+		for (int dx = -1; dx <= 1; ++dx) {
+			tile_t const *const adj((dx == 0 && dy == 0) ? this : get_adj_tile(dx, dy));
+			hash_add_val(hash, ((adj && adj->can_calc_horizon_map() && adj->zvsize == zvsize) ? adj->tile_id : 0U));
+		}
+	}
+	return hash;
+}
+
+bool tile_t::horizon_map_valid(int az_bin) const {
+	return (!horizon.empty() && horizon_az_bin == az_bin && horizon_adj_hash == get_adj_horizon_hash());
+}
+
+void tile_t::get_horizon_adj_tiles(tile_t const *adj[3][3]) const { // {y}x{x}, centered on this tile; null if there's no usable height data
+
+	for (int dy = -1; dy <= 1; ++dy) {
+		for (int dx = -1; dx <= 1; ++dx) {
+			tile_t const *const t((dx == 0 && dy == 0) ? this : get_adj_tile(dx, dy));
+			adj[dy+1][dx+1] = ((t && t->can_calc_horizon_map() && t->zvsize == zvsize) ? t : nullptr);
+		}
+	}
+}
+
+// calls func(z, dist) for each interpolated mesh height sample along a ray from zval (x, y) in direction (dxt, dyt), in texels per unit distance;
+// the ray ends after HORIZON_NUM_STEPS samples or when it leaves the 3x3 tile neighborhood
+template<typename F> void tile_t::march_horizon_ray(tile_t const *const adj[3][3], unsigned x, unsigned y, float dxt, float dyt, F const &func) const {
+
+	int const isz(size);
+	float dist(0.0), step(min(deltax, deltay));
+
+	for (unsigned n = 0; n < HORIZON_NUM_STEPS; ++n, step *= HORIZON_STEP_SCALE) {
+		dist += step;
+		float const fx(x + dist*dxt), fy(y + dist*dyt);
+		int const tx(int(floor(fx/isz))), ty(int(floor(fy/isz)));
+		if (tx < -1 || tx > 1 || ty < -1 || ty > 1) break; // off the 3x3 tile neighborhood
+		tile_t const *const t(adj[ty+1][tx+1]);
+		if (t == nullptr) break; // no height data
+		float const lx(fx - tx*isz), ly(fy - ty*isz); // in [0, size]
+		int const ix(min(int(lx), isz)), iy(min(int(ly), isz)); // zvsize = size+2, so ix+1 and iy+1 are valid
+		float const xf(lx - ix), yf(ly - iy);
+		float const *const zv(&t->zvals[iy*zvsize + ix]);
+		func(((1.0f - yf)*((1.0f - xf)*zv[0] + xf*zv[1]) + yf*((1.0f - xf)*zv[zvsize] + xf*zv[zvsize+1])), dist);
+	}
+}
+
+// computes the max terrain elevation angle toward the center of a sun azimuth bin for each zval by marching rays across this tile and its neighbors;
+// sun shadows can then be updated with one compare per texel as the sun elevation changes; occluders beyond the end of the rays are ignored;
+// only reads adjacent tiles, so multiple tiles can be processed in parallel
+void tile_t::calc_horizon_map(int az_bin) {
+
+	assert(can_calc_horizon_map());
+	tile_t const *adj[3][3];
+	get_horizon_adj_tiles(adj);
+	float const az((az_bin + 0.5f)*TWO_PI/HORIZON_AZ_BINS - PI), dxt(cos(az)/deltax), dyt(sin(az)/deltay); // texels per unit distance toward the sun
+	float const step0(min(deltax, deltay));
+	horizon.resize(zvals.size());
+	horizon_max_dz = 0.0;
+
+	for (unsigned y = 0; y < 3; ++y) {
+		for (unsigned x = 0; x < 3; ++x) {
+			if (adj[y][x]) {horizon_max_dz = max(horizon_max_dz, (adj[y][x]->mzmax - mzmin));}
+		}
+	}
+	// rays from zvals on the sunward edge may stop after one tile
+	horizon_reach = min(size*step0, step0*(pow(HORIZON_STEP_SCALE, float(HORIZON_NUM_STEPS)) - 1.0f)/(HORIZON_STEP_SCALE - 1.0f));
+
+	for (unsigned y = 0; y < zvsize; ++y) {
+		for (unsigned x = 0; x < zvsize; ++x) {
+			float const z0(zvals[y*zvsize + x]);
+			float max_tan(0.0);
+			march_horizon_ray(adj, x, y, dxt, dyt, [&](float z, float dist) {max_tan = max(max_tan, (z - z0)/dist);});
+			horizon[y*zvsize + x] = quantize_horizon_angle(atan(max_tan));
+		} // for x
+	} // for y
+	horizon_az_bin   = az_bin;
+	horizon_adj_hash = get_adj_horizon_hash();
+}
+
+// returns 0 if shadows must be traced: horizon shadows are disabled, there's no valid horizon map for this sun azimuth,
+// or the sun is low enough that terrain beyond the end of the horizon rays may cast shadows onto this tile
+bool tile_t::update_sun_shadows_from_horizon(int az_bin) {
+
+	if (!tt_horizon_shadows || !can_calc_horizon_map() || !horizon_map_valid(az_bin)) return 0;
+	point const lpos(get_light_pos(LIGHT_SUN));
+	bool const all_shadowed(lpos.z < zmin); // same as calc_mesh_shadows()
+	float const sun_xy_dist(lpos.xy_mag()), sun_tan(lpos.z/max(sun_xy_dist, TOLERANCE));
+	if (!all_shadowed && horizon_max_dz > sun_tan*horizon_reach) return 0; // long shadows
+	unsigned short const sun_angle(quantize_horizon_angle(atan2(lpos.z, sun_xy_dist)));
+	vector<unsigned char> &sm(smask[LIGHT_SUN]);
+	sm.resize(zvals.size());
+	for (unsigned i = 0; i < sm.size(); ++i) {sm[i] = ((all_shadowed || sun_angle < horizon[i]) ? MESH_SHADOW : 0);}
+	for (unsigned d = 0; d < 2; ++d) {sh_out[LIGHT_SUN][d].assign(zvsize, MESH_MIN_Z);}
+
+	if (!all_shadowed && sun_xy_dist > 0.0) {
+		// refresh the shadow heights on the edges away from the sun, which are the inputs to adjacent tiles if they're traced;
+		// this is the height of the highest shadow ray from the terrain toward the sun, matching calc_mesh_shadows()
+		tile_t const *adj[3][3];
+		get_horizon_adj_tiles(adj);
+		float const dxt(lpos.x/(sun_xy_dist*deltax)), dyt(lpos.y/(sun_xy_dist*deltay));
+		unsigned const ex((lpos.x > 0.0) ? 0 : zvsize-1), ey((lpos.y > 0.0) ? 0 : zvsize-1);
+
+		for (unsigned d = 0; d < 2; ++d) { // d=0: edge along x at y=ey, d=1: edge along y at x=ex
+			for (unsigned i = 0; i < zvsize; ++i) {
+				unsigned const x(d ? ex : i), y(d ? i : ey);
+				if (!sm[y*zvsize + x]) continue; // not shadowed
+				float shadow_z(MESH_MIN_Z);
+				march_horizon_ray(adj, x, y, dxt, dyt, [&](float z, float dist) {shadow_z = max(shadow_z, (z - dist*sun_tan));});
+				sh_out[LIGHT_SUN][d][i] = shadow_z;
+			}
+		}
+	}
+	sun_shadows_invalid = 1;
+	check_shadow_map_and_normal_texture(1); // upload; no_push=1
+	return 1;
+}
+
+
 void tile_t::push_tree_ao_shadow(int dx, int dy, point const &pos, float tradius) const {
 
 	tile_t *const adj_tile(get_adj_tile_smap(dx, dy));
@@ -818,10 +1251,10 @@ void create_or_update_texture(unsigned &tid, bool tid_is_valid, unsigned stride,
 	}
 }
 
-void tile_t::upload_normal_texture(bool tid_is_valid) {
+void tile_t::calc_normal_data() {
 
-	//timer_t timer("Create Normal Texture");
-	vector<unsigned char> normal_data(4*stride*stride, 0);
+	//timer_t timer("Calc Normal Data");
+	normal_data.resize(4*stride*stride, 0);
 	min_normal_z = 1.0;
 
 	for (unsigned y = 0; y < stride; ++y) {
@@ -832,7 +1265,12 @@ void tile_t::upload_normal_texture(bool tid_is_valid) {
 			UNROLL_3X(normal_data[ix_off+i_] = (unsigned char)(127.0*(norm[i_] + 1.0)););
 		}
 	}
+}
+
+void tile_t::upload_normal_texture(bool tid_is_valid) {
+	if (normal_data.empty()) {calc_normal_data();} // else precomputed by create_zvals_background() or read from the tile cache
 	create_or_update_texture(normal_tid, tid_is_valid, stride, normal_data);
+	clear_container(normal_data); // may be stale if the mesh is edited, and can be recomputed if needed
 }
 
 void tile_t::upload_shadow_map_texture(bool tid_is_valid) {
@@ -2060,16 +2498,143 @@ void lightning_strike_t::end_draw() const {
 }
 
 
+// *** tile_gen_pool_t ***
+
+
+// generates tiles on persistent background threads so that only GL work is left for the main thread; used with CPU height generation only,
+// since GPU height generation needs the GL context; pending jobs are run highest priority (lowest value) first and can be reprioritized each frame
+class tile_draw_t::tile_gen_pool_t {
+
+	typedef pair<float, tile_t *> job_t;
+	std::mutex mutex;
+	std::condition_variable cv;
+	vector<std::thread> threads;
+	vector<job_t> pending; // sorted by decreasing priority value, so the next job is at the back
+	vector<tile_t *> finished, failed; // generated, waiting to be inserted or deleted by the main thread
+	set<tile_xy_pair> queued; // pending + running + finished; only accessed by the main thread, so no locking is needed
+	bool exit_flag;
+
+	void sort_pending() {sort(pending.begin(), pending.end(), [](job_t const &a, job_t const &b) {return (a.first > b.first);});}
+
+	void worker_thread() {
+		omp_set_num_threads_3dw(1); // nested omp loops run serially; the parallelism comes from generating multiple tiles at once
+		mesh_xy_grid_cache_t height_gen; // per-thread
+		std::unique_lock<std::mutex> lock(mutex);
+
+		while (1) {
+			while (!exit_flag && pending.empty()) {cv.wait(lock);}
+			if (exit_flag) break;
+			tile_t *const tile(pending.back().second);
+			pending.pop_back();
+			lock.unlock();
+			bool const success(tile->create_zvals_background(height_gen));
+			lock.lock();
+			(success ? finished : failed).push_back(tile);
+		}
+	}
+public:
+	tile_gen_pool_t() : exit_flag(0) {}
+	~tile_gen_pool_t() {stop();}
+	bool is_running() const {return !threads.empty();}
+	bool contains(tile_xy_pair const &txy) const {return (queued.find(txy) != queued.end());}
+	unsigned size() const {return (unsigned)queued.size();}
+
+	void start(unsigned num_threads) {
+		if (is_running()) return;
+		exit_flag = 0;
+		for (unsigned i = 0; i < num_threads; ++i) {threads.emplace_back(&tile_gen_pool_t::worker_thread, this);}
+	}
+	void stop() { // waits for running jobs to finish, then deletes all queued tiles
+		if (!is_running()) return;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			exit_flag = 1;
+		}
+		cv.notify_all();
+		for (auto &t : threads) {t.join();}
+		threads.clear();
+		for (auto &job : pending) {delete job.second;}
+		for (tile_t *tile : finished) {delete tile;}
+		for (tile_t *tile : failed  ) {delete tile;}
+		pending.clear();
+		finished.clear();
+		failed.clear();
+		queued.clear();
+	}
+	void add_jobs(vector<job_t> const &jobs) {
+		if (jobs.empty()) return;
+		assert(is_running());
+		for (auto const &job : jobs) {queued.insert(job.second->get_tile_xy_pair());}
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			pending.insert(pending.end(), jobs.begin(), jobs.end());
+			sort_pending();
+		}
+		cv.notify_all();
+	}
+	// get_priority(tile) returns the new priority of a pending tile, or a negative value to remove it from the queue and pass it to on_remove(tile)
+	template<typename P, typename R> void update_pending(P const &get_priority, R const &on_remove) {
+		std::unique_lock<std::mutex> lock(mutex);
+		unsigned pos(0);
+
+		for (auto &job : pending) {
+			job.first = get_priority(*job.second);
+			if (job.first < 0.0) {queued.erase(job.second->get_tile_xy_pair()); on_remove(job.second);}
+			else {pending[pos++] = job;}
+		}
+		pending.resize(pos);
+		sort_pending();
+	}
+	void get_finished(vector<tile_t *> &tiles) {
+		vector<tile_t *> to_delete;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			tiles.swap(finished);
+			to_delete.swap(failed);
+		}
+		for (tile_t *tile : tiles) {queued.erase(tile->get_tile_xy_pair());}
+		for (tile_t *tile : to_delete) {queued.erase(tile->get_tile_xy_pair()); delete tile;} // will be recreated if still needed
+	}
+};
+
+
 // *** tile_draw_t ***
 
 
-tile_draw_t::tile_draw_t() : buildings_valid(0), tiles_gen_prev_frame(0), terrain_zmin(0.0), lod_renderer(USE_TREE_BILLBOARDS) {
+tile_draw_t::tile_draw_t() : buildings_valid(0), tiles_gen_prev_frame(0), terrain_zmin(0.0), last_global_camera(all_zeros), camera_vel(zero_vector), lod_renderer(USE_TREE_BILLBOARDS) {
 	assert(MESH_X_SIZE == MESH_Y_SIZE && X_SCENE_SIZE == Y_SCENE_SIZE);
 }
+tile_draw_t::~tile_draw_t() {/*clear();*/}
+
+// generates all tiles within tile_radius of the origin without any GL calls (no VBOs, textures, or compute shaders); used for the headless benchmark
+unsigned tile_draw_t::gen_tiles_cpu_only(int tile_radius) {
+
+	maybe_gen_buildings_and_cities();
+	auto_calc_model_zvals();
+	if (height_gens.empty()) {height_gens.resize(1);}
+	bool const prev_cpu_only(mesh_gen_cpu_only);
+	mesh_gen_cpu_only = 1; // evaluate GPU simplex and domain warp noise with the equivalent CPU code
+	update_tile_cache_params(); // after setting the mode, so that CPU generated tiles use their own cache files
+	unsigned num_gen(0);
+
+	for (int y = -tile_radius; y <= tile_radius; ++y) {
+		for (int x = -tile_radius; x <= tile_radius; ++x) {
+			if (tiles.find(tile_xy_pair(x, y)) != tiles.end()) continue; // already exists
+			tile_t *tile(new tile_t(get_tile_size(), x, y));
+			tile->create_zvals(height_gens[0], 0);
+			insert_tile(tile);
+			++num_gen;
+		}
+	}
+	mesh_gen_cpu_only = prev_cpu_only;
+	update_tile_cache_params();
+	return num_gen;
+}
 
 void tile_draw_t::clear(bool no_regen_buildings) {
 
 	clear_vbos_tids(); // needed to clear vbo, ivbo, and free list
+	if (gen_pool) {gen_pool->stop();} // tiles generated with the old parameters are discarded
 	for (tile_map::iterator i = tiles.begin(); i != tiles.end(); ++i) {i->second->clear();} // may not be necessary
 	to_draw.clear();
 	tiles.clear();
@@ -2086,36 +2651,77 @@ void tile_draw_t::free_compute_shader() {
 	for (auto i = height_gens.begin(); i != height_gens.end(); ++i) {i->clear_context();}
 }
 
-float tile_draw_t::update(float &min_camera_dist) { // view-independent updates; returns terrain zmin
+void tile_draw_t::maybe_gen_buildings_and_cities() {
 
-	//timer_t timer("TT Update");
-	unsigned const max_tile_gen_per_frame = 16; // higher = less overall gen time (more parallel), but longer wait for first render
-	unsigned const max_cpu_tiles          = 3; // 0 = GPU only
-	unsigned const max_defer_tiles        = 8; // 0 = disable
-	if (height_gens.empty()) {height_gens.resize(max(max_defer_tiles, 1U));}
-	if (terrain_hmap_manager.maybe_load(mh_filename_tt, (invert_mh_image != 0))) {read_default_hmap_modmap();}
+	if (terrain_hmap_manager.maybe_load(mh_filename_tt, (invert_mh_image != 0))) {read_default_hmap_modmap();} // cities are generated here
 	
 	if (!buildings_valid) {
 		gen_buildings();
 		gen_city_details(); // after building generation
 		buildings_valid = 1;
 	}
+}
+
+float tile_draw_t::update(float &min_camera_dist) { // view-independent updates; returns terrain zmin
+
+	//timer_t timer("TT Update");
+	unsigned const max_tile_gen_per_frame = 16; // higher = less overall gen time (more parallel), but longer wait for first render
+	unsigned const max_cpu_tiles          = 3; // 0 = GPU only
+	unsigned const max_defer_tiles        = 8; // 0 = disable
+	if (height_gens.empty()) {height_gens.resize(max(max_defer_tiles, 1U));}
+	maybe_gen_buildings_and_cities();
 	auto_calc_model_zvals(); // must be done after heightmap loading but before any tiles are created
+	update_tile_cache_params();
 	to_draw.clear();
 	terrain_zmin = FAR_DISTANCE;
 	grass_tile_manager.update(); // every frame, even if not in tiled terrain mode?
 	assert(MESH_X_SIZE == MESH_Y_SIZE); // limitation, for now
 	point const cpos(get_camera_pos()), camera(cpos - get_tiled_terrain_model_xlate());
+	bool const async_gen(num_tile_gen_threads > 0 && mesh_gen_mode < MGEN_SIMPLEX_GPU && inf_terrain_fire_mode == FM_NONE); // no background gen while editing the mesh
+	point const global_camera(cpos - vector3d(DX_VAL*(xoff - xoff2), DY_VAL*(yoff - yoff2), 0.0)); // doesn't change when the mesh is recentered
+	vector3d const camera_delta(global_camera - last_global_camera);
+	// smooth the camera velocity, and ignore teleports
+	if (camera_delta.mag() < get_scaled_tile_radius()) {camera_vel = 0.9*camera_vel + 0.1*camera_delta;} else {camera_vel = zero_vector;}
+	last_global_camera = global_camera;
+	vector3d pred_delta(camera_vel*PREFETCH_FRAMES);
+	pred_delta.z = 0.0;
+	pred_delta.set_max_mag(CREATE_DIST_TILES*get_scaled_tile_radius()); // limit prefetch to about one extra ring of tiles
+	point const pred_cpos(cpos + pred_delta), pred_camera(camera + pred_delta);
 	int const tile_radius(int(CREATE_DIST_TILES*TILE_RADIUS) + 1);
 	int const toffx(int(0.5*camera.x/X_SCENE_SIZE)), toffy(int(0.5*camera.y/Y_SCENE_SIZE));
-	int const x1(-tile_radius + toffx), y1(-tile_radius + toffy);
-	int const x2( tile_radius + toffx), y2( tile_radius + toffy);
+	int const ptoffx(async_gen ? int(0.5*pred_camera.x/X_SCENE_SIZE) : toffx), ptoffy(async_gen ? int(0.5*pred_camera.y/Y_SCENE_SIZE) : toffy);
+	int const x1(-tile_radius + min(toffx, ptoffx)), y1(-tile_radius + min(toffy, ptoffy));
+	int const x2( tile_radius + max(toffx, ptoffx)), y2( tile_radius + max(toffy, ptoffy));
 	unsigned const init_tiles((unsigned)tiles.size());
 	unsigned num_erased(0);
 	min_camera_dist = FAR_DISTANCE;
+	if (!tile_cache_dir.empty()) {tile_cache.free_distant_chunks(tile_xy_pair(toffx, toffy));}
 	// Note: we may want to calculate distant low-res or larger tiles when the camera is high above the mesh
 
-	if (!to_gen_zvals.empty()) {
+	if (async_gen) {
+		if (!gen_pool) {gen_pool.reset(new tile_gen_pool_t);}
+		gen_pool->start(num_tile_gen_threads);
+		vector<tile_t *> finished;
+		gen_pool->get_finished(finished);
+
+		for (tile_t *tile : finished) {
+			if (tile->get_rel_dist_to_camera() < DELETE_DIST_TILES) {insert_tile(tile);} // ready to draw; textures are created on first use
+			else {delete tile;} // camera moved away while this tile was being generated
+		}
+		// reprioritize pending tiles for the current camera; remove tiles that are no longer needed, and take back tiles needed immediately
+		gen_pool->update_pending([&](tile_t const &tile) {
+				float const dist(tile.get_rel_dist_to_camera());
+				if (dist >= DELETE_DIST_TILES || dist < SYNC_GEN_DIST_TILES) return -1.0f;
+				return tile.get_gen_priority(pred_cpos);
+			},
+			[&](tile_t *tile) {
+				if (tile->get_rel_dist_to_camera() < SYNC_GEN_DIST_TILES) {to_gen_zvals.push_back(make_pair(tile->get_draw_priority(), tile));}
+				else {delete tile;}
+			});
+	}
+	else if (gen_pool) {gen_pool->stop();}
+
+	if (!to_gen_zvals.empty() && (mesh_gen_mode >= MGEN_SIMPLEX_GPU)) {
 		//ostringstream oss; oss << "Gen " << to_gen_zvals.size() << " tiles (wait)"; timer_t timer(oss.str());
 		assert(to_gen_zvals.size() <= height_gens.size());
 
@@ -2133,16 +2739,31 @@ float tile_draw_t::update(float &min_camera_dist) { // view-independent updates;
 			++num_erased;
 		} else {++i;}
 	}
+	set<tile_xy_pair> pending_zvals; // tiles in to_gen_zvals that aren't in tiles yet, including those taken back from gen_pool
+	for (auto const &t : to_gen_zvals) {pending_zvals.insert(t.second->get_tile_xy_pair());}
+
 	for (int y = y1; y <= y2; ++y ) { // create new tiles
 		for (int x = x1; x <= x2; ++x ) {
 			tile_xy_pair const txy(x, y);
 			if (tiles.find(txy) != tiles.end()) continue; // already exists
+			if (async_gen && gen_pool->contains(txy)) continue; // already being generated
+			if (!pending_zvals.empty() && pending_zvals.find(txy) != pending_zvals.end()) continue; // already waiting to be generated
 			tile_t tile(get_tile_size(), x, y);
-			if (tile.get_rel_dist_to_camera() >= CREATE_DIST_TILES) continue; // too far away to create
+			float const rel_dist(tile.get_rel_dist_to_camera());
+
+			if (rel_dist >= CREATE_DIST_TILES) { // too far away to create
+				// prefetch tiles that will be in range when the camera gets to its predicted position
+				if (!async_gen || rel_dist >= DELETE_DIST_TILES || tile.get_rel_dist_to_pt(pred_cpos) >= CREATE_DIST_TILES) continue;
+			}
 			tile_t *new_tile(new tile_t(tile));
-			to_gen_zvals.push_back(make_pair(new_tile->get_draw_priority(), new_tile));
+			if (async_gen && rel_dist >= SYNC_GEN_DIST_TILES) {to_gen_async.push_back(make_pair(new_tile->get_gen_priority(pred_cpos), new_tile));}
+			else {to_gen_zvals.push_back(make_pair(new_tile->get_draw_priority(), new_tile));}
 		}
 	}
+	if (async_gen) {
+		gen_pool->add_jobs(to_gen_async);
+		to_gen_async.clear();
+	}
 	//if (to_gen_zvals.size() < max_cpu_tiles) {to_gen_zvals.clear();} // block until at least max_cpu_tiles tiles to generate (lower average gen time, but causes more slow frames/lag)
 	unsigned const num_to_gen(to_gen_zvals.size());
 	unsigned gen_this_frame(min(num_to_gen, max_tile_gen_per_frame));
@@ -2176,11 +2797,17 @@ float tile_draw_t::update(float &min_camera_dist) { // view-independent updates;
 
 		for (unsigned i = 0; i < num_to_gen; ++i) {
 			tile_t *tile(to_gen_zvals[i].second);
-			if (i >= gen_this_frame) {delete tile; continue;} // delete these tiles - they will be created in a later frame
+
+			if (i >= gen_this_frame) { // generate these tiles in the background, or delete them and create them in a later frame
+				if (async_gen) {to_gen_async.push_back(to_gen_zvals[i]);} else {delete tile;}
+				continue;
+			}
 			tile->create_zvals(height_gens[0], 0); // generate these tiles
 			insert_tile(tile);
 		}
 		to_gen_zvals.clear();
+		if (async_gen) {gen_pool->add_jobs(to_gen_async);}
+		to_gen_async.clear();
 		mesh_gen_mode = prev_mesh_gen_mode;
 	}
 	for (tile_map::iterator i = tiles.begin(); i != tiles.end(); ++i) { // calculate terrain_zmin and updated building tiles
@@ -2210,6 +2837,8 @@ float tile_draw_t::update(float &min_camera_dist) { // view-independent updates;
 				shadow_recomp_queue.emplace_back(-p2p_dist(sun_pos, i->second->get_center()), i->second->get_tile_xy_pair());
 			}
 			sort(shadow_recomp_queue.begin(), shadow_recomp_queue.end()); // sort by decreasing distance to light source
+			num_horizon_maps = num_horizon_updates = num_traced_updates = 0;
+			horizon_map_time_ms = 0.0;
 		}
 		else { // invalidate and recompute all shadows on moon change (infrequent) or user sun pos change
 			for (tile_map::iterator i = tiles.begin(); i != tiles.end(); ++i) {i->second->clear_shadows(sun_change, moon_change);}
@@ -2217,17 +2846,52 @@ float tile_draw_t::update(float &min_camera_dist) { // view-independent updates;
 		last_sun  = sun_pos;
 		last_moon = moon_pos;
 	}
-	unsigned num_shadow_updates = 12; // hard max per frame
-
-	while (!shadow_recomp_queue.empty() && num_shadow_updates > 0) { // perform some queued shadow map updates, starting at light source
-		tile_xy_pair const tp(shadow_recomp_queue.back().second);
-		shadow_recomp_queue.pop_back();
-		tile_map::const_iterator it(tiles.find(tp));
-		if (it == tiles.end()) continue; // tile no longer exists/was deleted
-		// recompute shadows; tiles feeding in (closer to the light) should have already been calculated
-		it->second->clear_shadows(1, 0); // update sun shadows only
-		it->second->check_shadow_map_and_normal_texture(1); // no_push=1
-		--num_shadow_updates;
+	if (!shadow_recomp_queue.empty()) {
+		typedef std::chrono::steady_clock clock_type;
+		clock_type::time_point const start_time(clock_type::now());
+		auto out_of_time([&]() {return (tt_shadow_update_ms > 0.0 && std::chrono::duration<double, std::milli>(clock_type::now() - start_time).count() > tt_shadow_update_ms);});
+		int const az_bin(get_horizon_az_bin(sun_pos));
+
+		if (tt_horizon_shadows) {
+			unsigned const batch_size(2*max(1, omp_get_max_threads_3dw()));
+			vector<tile_t *> to_calc;
+			// compute horizon maps in parallel for the next tiles in the queue; these are reused for all sun positions within this azimuth bin
+			for (auto i = shadow_recomp_queue.rbegin(); i != shadow_recomp_queue.rend() && !out_of_time();) {
+				to_calc.clear();
+
+				for (; i != shadow_recomp_queue.rend() && to_calc.size() < batch_size; ++i) {
+					tile_map::const_iterator it(tiles.find(i->second));
+					if (it == tiles.end()) continue; // tile no longer exists/was deleted
+					tile_t *const tile(it->second.get());
+					if (tile->can_calc_horizon_map() && !tile->horizon_map_valid(az_bin)) {to_calc.push_back(tile);}
+				}
+#pragma omp parallel for schedule(dynamic,1)
+				for (int t = 0; t < (int)to_calc.size(); ++t) {to_calc[t]->calc_horizon_map(az_bin);}
+				num_horizon_maps += to_calc.size();
+			}
+			horizon_map_time_ms += std::chrono::duration<double, std::milli>(clock_type::now() - start_time).count();
+		}
+		unsigned num_shadow_updates = 12; // hard max traced updates per frame
+
+		while (!shadow_recomp_queue.empty() && num_shadow_updates > 0) { // perform some queued shadow map updates, starting at light source
+			tile_xy_pair const tp(shadow_recomp_queue.back().second);
+			shadow_recomp_queue.pop_back();
+			tile_map::const_iterator it(tiles.find(tp));
+			if (it == tiles.end()) continue; // tile no longer exists/was deleted
+
+			if (it->second->update_sun_shadows_from_horizon(az_bin)) {++num_horizon_updates;} // cheap, per-texel compare
+			else { // recompute shadows; tiles feeding in (closer to the light) should have already been calculated
+				it->second->clear_shadows(1, 0); // update sun shadows only
+				it->second->check_shadow_map_and_normal_texture(1); // no_push=1
+				--num_shadow_updates;
+				++num_traced_updates;
+			}
+			if (out_of_time()) break;
+		}
+		if (DEBUG_TILES && shadow_recomp_queue.empty()) {
+			cout << "shadow update: horizon maps: " << num_horizon_maps << " in " << horizon_map_time_ms << "ms, horizon updates: " << num_horizon_updates
+				 << ", traced updates: " << num_traced_updates << endl;
+		}
 	}
 	// Note: we could regen trees and scenery if water was just turned on to remove underwater vegetation
 	//if ((GET_TIME_MS() - timer1) > 100) {PRINT_TIME("Tiled Terrain Update");}
@@ -3330,6 +3994,8 @@ bool tile_smap_data_t::needs_update(point const &lpos) {
 
 tile_t *get_tile_from_xy  (tile_xy_pair const &tp) {return terrain_tile_draw.get_tile_from_xy(tp);}
 float update_tiled_terrain(float &min_camera_dist) {return terrain_tile_draw.update(min_camera_dist);}
+void gen_tiled_terrain_buildings_and_cities() {terrain_tile_draw.maybe_gen_buildings_and_cities();}
+unsigned gen_tiled_terrain_tiles_cpu_only(int tile_radius) {return terrain_tile_draw.gen_tiles_cpu_only(tile_radius);}
 void pre_draw_tiled_terrain(bool reflection_pass) {terrain_tile_draw.pre_draw(reflection_pass);}
 
 
@@ -175,9 +175,14 @@ private:
 	float sub_zmin[4][4] = {0}, sub_zmax[4][4] = {0};
 	vector<float> zvals, ao_zvals;
 	vector<tree_map_val> tree_map;
-	vector<unsigned char> mesh_weight_data, weight_data, ao_lighting;
+	vector<unsigned char> mesh_weight_data, weight_data, ao_lighting, normal_data;
 	vector<unsigned char> smask[NUM_LIGHT_SRC];
 	vector<float> sh_out[NUM_LIGHT_SRC][2];
+	vector<unsigned short> horizon; // per-zval terrain horizon elevation angle toward the sun azimuth bin horizon_az_bin, quantized
+	int horizon_az_bin = -1;
+	uint64_t horizon_adj_hash = 0; // identifies the adjacent tiles that were used to compute horizon
+	float horizon_max_dz = 0.0, horizon_reach = 0.0; // max occluder height above this tile and min horizon ray length, used to detect shadows the rays can't reach
+	unsigned tile_id = get_next_tile_id(); // unique per tile object; used to detect regenerated adjacent tiles
 	vect_smap_t<tile_smap_data_t> smap_data;
 	small_tree_group pine_trees;
 	scenery_group scenery;
@@ -204,6 +209,10 @@ private:
 
 	void update_terrain_params();
 	unsigned get_lod_level(bool reflection_pass) const;
+	static unsigned get_next_tile_id();
+	uint64_t get_adj_horizon_hash() const;
+	void get_horizon_adj_tiles(tile_t const *adj[3][3]) const;
+	template<typename F> void march_horizon_ray(tile_t const *const adj[3][3], unsigned x, unsigned y, float dxt, float dyt, F const &func) const;
 
 public:
 	tile_t();
@@ -284,6 +293,11 @@ public:
 	void clear_vbo_tid(tile_shadow_map_manager *smap_manager);
 	void clear_pine_tree_vbos() {pine_trees.clear_vbos();}
 	bool create_zvals(mesh_xy_grid_cache_t &height_gen, bool no_wait);
+	bool create_zvals_background(mesh_xy_grid_cache_t &height_gen);
+	void write_tile_data(vector<unsigned char> &data) const;
+	bool read_tile_data(vector<unsigned char> const &data);
+	bool read_from_cache();
+	void write_to_cache();
 	void get_z_minmax_for_area(point const &pos, float radius, float &zmin, float &zmax) const;
 	float get_zval_at(float x, float y, bool in_global_space) const;
 
@@ -298,6 +312,10 @@ public:
 	void calc_shadows_for_light(unsigned l);
 	static void proc_tile_queue(tile_t *init_tile, unsigned l);
 	void calc_shadows(bool calc_sun, bool calc_moon, bool no_push=0);
+	bool can_calc_horizon_map() const {return (!is_distant && !zvals.empty());}
+	bool horizon_map_valid(int az_bin) const;
+	void calc_horizon_map(int az_bin);
+	bool update_sun_shadows_from_horizon(int az_bin);
 
 	tile_xy_pair get_tile_xy_pair(int dx=0, int dy=0) const {
 		return tile_xy_pair((x1/(int)size)+dx, (y1/(int)size)+dy);
@@ -316,6 +334,7 @@ public:
 	void apply_ao_shadows_for_trees(tile_t const *const tile, bool no_adj_test);
 	void apply_tree_ao_shadows();
 	void check_shadow_map_and_normal_texture(bool no_push=0);
+	void calc_normal_data();
 	void upload_normal_texture(bool tid_is_valid);
 	void upload_shadow_map_texture(bool tid_is_valid);
 	void setup_shadow_maps(tile_shadow_map_manager &smap_manager, bool cleanup_only);
@@ -330,9 +349,10 @@ public:
 	void create_or_update_weight_tex();
 	void calc_avg_mesh_color();
 
-	float get_rel_dist_to_camera(bool xy_dist=1) const {
-		return max(0.0f, (xy_dist ? p2p_dist_xy(get_camera_pos(), get_center()) : p2p_dist(get_camera_pos(), get_center())) - radius)/get_scaled_tile_radius();
+	float get_rel_dist_to_pt(point const &pos, bool xy_dist=1) const {
+		return max(0.0f, (xy_dist ? p2p_dist_xy(pos, get_center()) : p2p_dist(pos, get_center())) - radius)/get_scaled_tile_radius();
 	}
+	float get_rel_dist_to_camera(bool xy_dist=1) const {return get_rel_dist_to_pt(get_camera_pos(), xy_dist);}
 	float get_bsphere_radius_inc_water() const;
 	bool use_as_occluder() const;
 	bool mesh_sphere_intersect(point const &pos, float rradius) const;
@@ -346,6 +366,7 @@ public:
 		return ((ENABLE_TREE_LOD && !force_high_detail) ? CLIP_TO_01(GEOMORPH_THRESH*(get_tree_dist_scale(has_palm) - 1.0f)) : 0.0);
 	}
 	float get_draw_priority() const;
+	float get_gen_priority(point const &pred_camera) const;
 
 	// *** trees ***
 	template <typename T> void postproc_trees(T const &trees, float &tzmax) { // pine/decidious trees
@@ -414,6 +435,7 @@ class tile_draw_t : public indexed_vbo_manager_t {
 	typedef map<tile_xy_pair, std::unique_ptr<tile_t> > tile_map;
 	typedef set<tile_xy_pair> tile_set_t;
 	typedef vector<pair<float, tile_t *> > draw_vect_t;
+	class tile_gen_pool_t;
 
 	tile_map tiles;
 	bool buildings_valid;
@@ -423,7 +445,10 @@ class tile_draw_t : public indexed_vbo_manager_t {
 	draw_vect_t to_draw;
 	vector<tile_t *> occluded_tiles;
 	vector<tile_t *> to_draw_trunk_pts;
-	vector<pair<float, tile_t *>> to_gen_zvals;
+	vector<pair<float, tile_t *>> to_gen_zvals, to_gen_async;
+	std::unique_ptr<tile_gen_pool_t> gen_pool; // background tile generation
+	point last_global_camera;
+	vector3d camera_vel; // smoothed, per frame, used to prefetch tiles ahead of the camera
 	cloud_draw_list_t to_draw_clouds;
 	vector<mesh_xy_grid_cache_t> height_gens;
 	lightning_strike_t lightning_strike;
@@ -431,6 +456,8 @@ class tile_draw_t : public indexed_vbo_manager_t {
 	crack_ibuf_t crack_ibuf;
 	tile_shadow_map_manager smap_manager;
 	vector<pair<float, tile_xy_pair>> shadow_recomp_queue;
+	unsigned num_horizon_maps = 0, num_horizon_updates = 0, num_traced_updates = 0; // shadow update stats since the last sun change
+	double horizon_map_time_ms = 0.0;
 
 	struct occluder_pts_t {
 		point cube_pts[4];
@@ -442,10 +469,12 @@ class tile_draw_t : public indexed_vbo_manager_t {
 
 public:
 	tile_draw_t();
-	~tile_draw_t() {/*clear();*/}
+	~tile_draw_t();
 	void clear(bool no_regen_buildings);
 	void free_compute_shader();
+	void maybe_gen_buildings_and_cities();
 	float update(float &min_camera_dist);
+	unsigned gen_tiles_cpu_only(int tile_radius);
 private:
 	static void setup_terrain_textures(shader_t &s, unsigned start_tu_id);
 	static void add_texture_colors(shader_t &s, unsigned start_tu_id);
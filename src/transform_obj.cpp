@@ -255,13 +255,13 @@ void apply_obj_mesh_roll(xform_matrix &matrix, point const &pos, point const &lp
 }
 
 
-void deform_obj(dwobject &obj, vector3d const &norm, vector3d const &v0) { // apply collision deformations
+void deform_obj(dwobject &obj, vector3d const &norm, vector3d const &v0, float obj_tstep) { // apply collision deformations
 
 	float const deform(object_types[obj.type].deform);
 	if (deform == 0.0) return;
 	assert(deform > 0.0 && deform < 1.0);
 	vector3d const vd(obj.velocity, v0);
-	float const vthresh(base_gravity*GRAVITY*tstep*object_types[obj.type].gravity), vd_mag(vd.mag());
+	float const vthresh(base_gravity*GRAVITY*obj_tstep*object_types[obj.type].gravity), vd_mag(vd.mag());
 
 	if (vd_mag > max(2.0f*vthresh, 12.0f/fticks) && (fabs(v0.x) + fabs(v0.y)) > 0.01f) { // what about when it hits the ground/mesh?
 		float const deform_mag(SQRT3*deform*min(1.0, 0.05*vd_mag));
@@ -116,6 +116,7 @@ void u_ship::reset() {
 	o_docked     = 0;
 	exp_val      = 0.0;
 	cloaked      = 0.0;
+	snap_cloaked = 0.0;
 	fuel         = 1.0;
 	tow_mass     = 0.0;
 	used_cargo   = 0.0; // ???
@@ -281,6 +282,7 @@ float u_ship::get_real_speed_val() const {
 void u_ship::thrust(int tdir, float speed, bool hyperspeed) {
 
 	if (invalid_or_disabled()) return;
+	if (recording_ship_ai_intents()) {add_ship_ai_intent([=]() {thrust(tdir, speed, hyperspeed);}); return;} // velocity is read by other ships' AI
 	us_class const &sc(specs());
 	if (!specs().has_hyper) hyperspeed = 0;
 
@@ -352,9 +354,8 @@ void u_ship::thrust(int tdir, float speed, bool hyperspeed) {
 }
 
 
-void u_ship::turn(vector3d delta) {
+vector3d u_ship::get_turn_angles(vector3d delta) { // returns {yaw, pitch, unused}
 
-	if (invalid_or_disabled()) return;
 	float mult(1.0);
 
 	if (player_controlled()) {
@@ -364,8 +365,26 @@ void u_ship::turn(vector3d delta) {
 	if (cached_rsv == 0.0) {cached_rsv = get_real_speed_val();}
 	delta *= mult*cached_rsv;
 	delta.set_max_mag(specs().max_turn); // limit turning speed
-	pitch_r = delta.y;
-	yaw_r   = delta.x; // delta.z is unused
+	return delta;
+}
+
+
+vector3d const &u_ship::get_ai_dir() const {return (recording_ship_ai_intents() ? ai_dir : dir);}
+
+
+void u_ship::turn(vector3d delta) {
+
+	if (invalid_or_disabled()) return;
+
+	if (recording_ship_ai_intents()) { // dir is read by other ships' AI, so it's updated when intents are committed
+		add_ship_ai_intent([=]() {turn(delta);});
+		vector3d const angles(get_turn_angles(delta));
+		rotate_dir_upv(angles.y, angles.x, ai_dir, ai_upv); // the rest of our own AI sees the new heading, as in the serial update
+		return;
+	}
+	vector3d const angles(get_turn_angles(delta));
+	pitch_r = angles.y;
+	yaw_r   = angles.x; // delta.z is unused
 	do_rotate(pitch_r, yaw_r);
 }
 
@@ -528,7 +547,8 @@ void u_ship::acquire_target(float min_dist) {
 				retarg_time = RETARG_DELAY;
 				
 				if (target_obj->is_player_ship() && target_obj != parent) {
-					send_warning_message(string("Enemy Ship Detected: ") + get_name());
+					string const msg(string("Enemy Ship Detected: ") + get_name());
+					run_or_defer_ship_ai([msg]() {send_warning_message(msg);});
 				}
 			}
 			if (target_obj != NULL && target_mode == TARGET_LAST) {target_set = 1;}
@@ -745,7 +765,9 @@ void sobj_manager::set_object(uobject const *obj) {
 
 void sobj_manager::choose_dest(point const &p, unsigned align, float tmax) {
 
-	uobject const *dest(choose_dest_world(p, old_uobj_id, align, tmax));
+	uobject const *dest(NULL);
+	#pragma omp critical(choose_dest_world)
+	dest = choose_dest_world(p, old_uobj_id, align, tmax); // uses a shared rand_gen_t
 
 	if (dest != NULL) {
 		set_object(dest);
@@ -779,7 +801,16 @@ bool u_ship::choose_destination() {
 		float const rad(c_radius + dest_mgr.get_radius()), dest_dist(p2p_dist(pos, dest_mgr.get_pos()));
 
 		if (powered_priv() && dest_dist < 1.6f*rad) {
-			claim_world(NULL); // or at least try to
+			if (recording_ship_ai_intents()) { // claim the current destination when intents are committed
+				sobj_manager const dest(dest_mgr);
+				add_ship_ai_intent([this, dest]() {
+					sobj_manager const cur_dest(dest_mgr);
+					dest_mgr = dest;
+					claim_world(NULL);
+					dest_mgr = cur_dest;
+				});
+			}
+			else {claim_world(NULL);} // or at least try to
 			dest_mgr.at_dest();
 		}
 		else {
@@ -877,7 +908,7 @@ free_obj const *u_ship::try_orbital_regen(free_obj const *cur_targ, bool last_od
 				targ_friend = 1;
 
 				if (dist_less_than(pos, dock->get_pos(), 2.3*dock_dist)) {
-					dock->orbital_dock(this);
+					run_or_defer_ship_ai([this, dock]() {dock->orbital_dock(this);});
 					o_dock_close = dist_less_than(pos, dock->get_pos(), 1.7*dock_dist);
 					o_docked     = 1;
 				}
@@ -950,6 +981,16 @@ bool is_valid_fire_dir(vector3d const &target_dir, vector3d const &fire_dir, boo
 	return (fire_dir != zero_vector && (is_close || get_angle(target_dir, fire_dir) < MAX_LEAD_SHOT_DOTP)); // check dir if not close
 }
 
+void u_ship::snapshot_ai_state() {
+
+	free_obj::snapshot_ai_state();
+	snap_cloaked = cloaked;
+	ai_dir       = dir;
+	ai_upv       = upv;
+	specs().get_weap_range(); // cached on first use
+}
+
+
 void u_ship::ai_action() {
 
 	float const old_cloaked(cloaked);
@@ -1181,11 +1222,11 @@ void u_ship::ai_action() {
 
 	// move
 	if (specs().has_fast_speed && target_dist > get_fast_target_dist(cur_targ) &&
-		dot_product(orient, dir) > 0.0 && !has_slow_fighters()) {
+		dot_product(orient, get_ai_dir()) > 0.0 && !has_slow_fighters()) {
 		set_max_sf(FAST_SPEED_FACTOR); // fast speed when far from the target
 	}
 	vector3d const delta_v(velocity - cur_targ->get_velocity());
-	float const d_turn_ang_mv((!targ_friend && weap_turret(get_weapon_id())) ? 0.0 : get_angle(orient, dir));
+	float const d_turn_ang_mv((!targ_friend && weap_turret(get_weapon_id())) ? 0.0 : get_angle(orient, get_ai_dir()));
 	float const dist_per_sec(TICKS_PER_SECOND*fticks*delta_v.mag());
 	bool const pickup_fighter(!has_target && cur_targ != NULL);
 	bool const dock(!parent_is_player && ((is_fighter() && cur_targ == parent) || pickup_fighter));
@@ -1319,10 +1360,11 @@ void u_ship::ai_fire(vector3d const &targ_dir, float target_dist, float min_dist
 	if (target_dist > specs().fire_dist || target_dist < 0.5*min_dist) return; // target not in range
 	assert(nweap > 0);
 	float const dv(p2p_dist(velocity, target_obj->get_velocity()));
-	float const cur_damage(get_damage()), d_angle(get_angle(targ_dir, dir));
+	vector3d const &cur_dir(get_ai_dir()); // includes this frame's turn
+	float const cur_damage(get_damage()), d_angle(get_angle(targ_dir, cur_dir));
 	unsigned const target_crew(target_obj->get_ncrew());
 	unsigned default_next_weap(curr_weapon);
-	static vector<unsigned> good_weapons;
+	static thread_local vector<unsigned> good_weapons;
 	good_weapons.resize(0);
 	
 	// multiple weapons fire in the same frame - player's ship works differently (primary/secondary fire) ?
@@ -1370,7 +1412,7 @@ void u_ship::ai_fire(vector3d const &targ_dir, float target_dist, float min_dist
 	}
 	float const rsum(c_radius + target_obj->get_c_radius()); // can target_obj be NULL?
 	float min_value(-2000.0); // set to 0 or positive to conserve ammo, etc.
-	static vector<pair<float, unsigned> > wchoices;
+	static thread_local vector<pair<float, unsigned> > wchoices;
 	wchoices.resize(0);
 
 	for (unsigned i = 0; i < good_weapons.size(); ++i) { // choose a weapon
@@ -1421,8 +1463,8 @@ void u_ship::ai_fire(vector3d const &targ_dir, float target_dist, float min_dist
 			unsigned const modval(unsigned(mmult*weap.fire_delay/wcount));
 			if (modval > 1 && (rand() % modval) != 0) continue;
 		}
-		if (!s_turret && targ_dir != dir && !has_clear_line_of_fire(weap, targ_dir, target_dist)) continue; // aim and fire weapon - check for line of sight to target
-		vector3d fire_dir(s_turret ? targ_dir : dir);
+		if (!s_turret && targ_dir != cur_dir && !has_clear_line_of_fire(weap, targ_dir, target_dist)) continue; // aim and fire weapon - check for line of sight to target
+		vector3d fire_dir(s_turret ? targ_dir : cur_dir);
 
 		if (PREDICT_TARGETS && s_turret && !weap.is_beam && weap.speed > 0.0) {
 			fire_dir = predict_target_dir(pos, target_obj, weapon_id);
@@ -1463,6 +1505,22 @@ bool u_ship::fire_weapon(vector3d const &fire_dir, float target_dist) {
 	if (!weap.hyper_fire && !check_fire_speed()) return 0;
 	ship_weapon &sw(weapons[curr_weapon]);
 	sw.last_fframe = frame_counter;
+
+	if (recording_ship_ai_intents()) { // fire when intents are committed, with the current weapon and target
+		unsigned const wix(curr_weapon);
+		free_obj const *const tobj(target_obj);
+
+		add_ship_ai_intent([=]() {
+			unsigned const cur_wix(curr_weapon);
+			free_obj const *const cur_tobj(target_obj);
+			curr_weapon = wix;
+			target_obj  = tobj;
+			fire_weapon(fire_dir, target_dist);
+			curr_weapon = cur_wix;
+			target_obj  = cur_tobj;
+		});
+		return 1;
+	}
 	float const wrange(weap.range + c_radius), cscale(sqrt(get_crew_scale())); // firing error is slightly higher with fewer crew
 	float const firing_error(weap.firing_error/max(0.001f, cscale*specs().stability));
 	int const base_intersect_type(get_line_query_obj_types(wrange));
@@ -2227,8 +2285,8 @@ void u_ship::get_fighter_target(u_ship const *ship) { // recursive
 
 	if (target_obj != NULL || ship == NULL || invalid_priv()) return; // base case 1
 	
-	if (ship != this && ship->target_obj != NULL) { // base case 2
-		if (target_valid(ship->target_obj)) target_obj = ship->target_obj;
+	if (ship != this && ship->get_target() != NULL) { // base case 2
+		if (target_valid(ship->get_target())) target_obj = ship->get_target();
 		return;
 	}
 	for (auto i = ship->fighters.begin(); i != ship->fighters.end() && target_obj == NULL; ++i) {
@@ -2965,56 +3023,61 @@ void multipart_ship::check_size_scale() { // could update c_radius here instead
 bool have_excess_credits(unsigned align) {return (team_credits[align] > init_credits[align]);}
 float get_wealthy_value (unsigned align) {return (init_credits[align] ? float(team_credits[align])/float(init_credits[align]) : 0.0);}
 
-void orbiting_ship::ai_action() {
+void orbiting_ship::try_build_ship() {
 
-	assert(alignment < NUM_ALIGNMENT);
-	assert(sclasses.size() == NUM_US_CLASS);
+	unsigned const reserve_credits(sclasses[USC_HW_SPORT].cost + 2*(sclasses[USC_DEFSAT].cost + sclasses[USC_ANTI_MISS].cost));
+	vector<unsigned> const &btypes(build_types[alignment]);
+	bool const excess_credits(have_excess_credits(alignment));
 
-	if (begin_motion && sobj_liveable && specs().orbiting_dock && !invalid_or_disabled() && !is_player_ship() &&
-		init_credits[alignment] > 0 && (time - last_build_time) > unsigned(TICKS_PER_SECOND*max(ship_build_delay, 2.0f*global_regen)))
+	// limit to 1-2x the number of allocated ships
+	if (team_credits[alignment] >= reserve_credits &&
+		((excess_credits && build_any) || ind_ships_used[alignment] < (excess_credits ? 2 : 1)*btypes.size())) // inefficient, but rarely called
 	{
-		unsigned const reserve_credits(sclasses[USC_HW_SPORT].cost + 2*(sclasses[USC_DEFSAT].cost + sclasses[USC_ANTI_MISS].cost));
-		vector<unsigned> const &btypes(build_types[alignment]);
-		bool const excess_credits(have_excess_credits(alignment));
-
-		// limit to 1-2x the number of allocated ships
-		if (team_credits[alignment] >= reserve_credits &&
-			((excess_credits && build_any) || ind_ships_used[alignment] < (excess_credits ? 2 : 1)*btypes.size())) // inefficient, but rarely called
-		{
-			vector<pair<int, unsigned> > scs; // {-cost, type}
+		vector<pair<int, unsigned> > scs; // {-cost, type}
 
-			if (excess_credits) { // second game phase build - have excess credits
-				set<unsigned> unique_sc;
+		if (excess_credits) { // second game phase build - have excess credits
+			set<unsigned> unique_sc;
 
-				if (build_any) {
-					for (unsigned i = 0; i < USC_COLONY; ++i) {unique_sc.insert(i);}
-				}
-				else {
-					copy(btypes.begin(), btypes.end(), inserter(unique_sc, unique_sc.begin()));
-				}
-				for (auto it = unique_sc.begin(); it != unique_sc.end(); ++it) {
-					scs.push_back(make_pair(-int(sclasses[*it].cost), *it));
-				}
-				sort(scs.begin(), scs.end());
+			if (build_any) {
+				for (unsigned i = 0; i < USC_COLONY; ++i) {unique_sc.insert(i);}
 			}
 			else {
-				unsigned const sc(btypes[rand()%btypes.size()]); // choose a random ship type with the same distribution as init
-				scs.push_back(make_pair(-int(sclasses[sc].cost), sc));
+				copy(btypes.begin(), btypes.end(), inserter(unique_sc, unique_sc.begin()));
 			}
-			for (unsigned i = 0; i < scs.size(); ++i) { // try each suggested build sclass until one can be built
-				unsigned const sc(scs[i].second);
-				//cout << get_name() << " " << i << ": trying " << sclasses[sc].name << ", cost = " << -scs[i].first << endl;
-
-				if (sclasses[sc].can_move() && alloc_resources_for(sc, alignment, reserve_credits)) {
-					point const pos2(pos + dir*(c_radius + sclasses[sc].radius*sclasses[sc].cr_scale));
-					u_ship *ship(create_ship(sc, pos2, alignment, AI_ATT_ENEMY, TARGET_CLOSEST, 1));
-					assert(ship != NULL); // set parent?
-					//cout << get_name() << " built " << ship->get_name() << endl;
-					break;
-				}
+			for (auto it = unique_sc.begin(); it != unique_sc.end(); ++it) {
+				scs.push_back(make_pair(-int(sclasses[*it].cost), *it));
+			}
+			sort(scs.begin(), scs.end());
+		}
+		else {
+			unsigned const sc(btypes[rand()%btypes.size()]); // choose a random ship type with the same distribution as init
+			scs.push_back(make_pair(-int(sclasses[sc].cost), sc));
+		}
+		for (unsigned i = 0; i < scs.size(); ++i) { // try each suggested build sclass until one can be built
+			unsigned const sc(scs[i].second);
+			//cout << get_name() << " " << i << ": trying " << sclasses[sc].name << ", cost = " << -scs[i].first << endl;
+
+			if (sclasses[sc].can_move() && alloc_resources_for(sc, alignment, reserve_credits)) {
+				point const pos2(pos + dir*(c_radius + sclasses[sc].radius*sclasses[sc].cr_scale));
+				u_ship *ship(create_ship(sc, pos2, alignment, AI_ATT_ENEMY, TARGET_CLOSEST, 1));
+				assert(ship != NULL); // set parent?
+				//cout << get_name() << " built " << ship->get_name() << endl;
+				break;
 			}
 		}
-		last_build_time = time; // don't queue up builds - if can't build now then too bad, have to wait another iteration
+	}
+	last_build_time = time; // don't queue up builds - if can't build now then too bad, have to wait another iteration
+}
+
+void orbiting_ship::ai_action() {
+
+	assert(alignment < NUM_ALIGNMENT);
+	assert(sclasses.size() == NUM_US_CLASS);
+
+	if (begin_motion && sobj_liveable && specs().orbiting_dock && !invalid_or_disabled() && !is_player_ship() &&
+		init_credits[alignment] > 0 && (time - last_build_time) > unsigned(TICKS_PER_SECOND*max(ship_build_delay, 2.0f*global_regen)))
+	{
+		run_or_defer_ship_ai([this]() {try_build_ship();}); // creates a new ship
 	}
 	u_ship::ai_action();
 }
@@ -133,7 +133,7 @@ struct vert_norm_tc_tan : public vert_norm_tc { // size = 48
 		if (p.t[1] < t[1]) return 0;
 		return (tangent < p.tangent);
 	}
-	//bool operator==(vert_norm_tc_tan const &p) const {}
+	bool operator==(vert_norm_tc_tan const &p) const {return (vert_norm_tc::operator==(p) && tangent == p.tangent);}
 	static void set_vbo_arrays(bool set_state=1, void const *vbo_ptr_offset=NULL);
 	static void set_vbo_arrays_shadow(bool include_tcs);
 	static void unset_attrs();
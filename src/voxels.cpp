@@ -12,6 +12,7 @@
 #include "openal_wrap.h"
 #include "cobj_bsp_tree.h"
 #include <glm/gtc/noise.hpp>
+#include <chrono>
 
 
 bool const DEBUG_BLOCKS    = 0;
@@ -25,12 +26,14 @@ unsigned char const UNDER_MESH_BIT = 0x08;
 
 
 voxel_params_t global_voxel_params;
+int remesh_frame(-1); // frame that remesh_frame_time_ms applies to
+float remesh_frame_time_ms(0.0); // remesh time used by all voxel models this frame, which share global_voxel_params.remesh_time_ms
 voxel_model_ground terrain_voxel_model(GROUND_NUM_LOD);
 voxel_brush_params_t voxel_brush_params;
 bool voxel_ppb_enable_falling(0);
 
 extern bool group_back_face_cull, voxel_shadows_updated;
-extern int dynamic_mesh_scroll, rand_gen_index, scrolling, display_mode, display_framerate, voxel_editing, mesh_gen_mode, mesh_freq_filter;
+extern int dynamic_mesh_scroll, frame_counter, rand_gen_index, scrolling, display_mode, display_framerate, voxel_editing, mesh_gen_mode, mesh_freq_filter;
 extern float FAR_CLIP;
 extern double tfticks;
 extern coll_obj_group coll_objects;
@@ -78,28 +81,21 @@ float noise_texture_manager_t::eval_at(point const &pos) const {
 }
 
 
-template<typename V> void voxel_grid<V>::init_grid(unsigned nx_, unsigned ny_, unsigned nz_, V default_val, unsigned num_blocks) {
+void voxel_grid_base::set_dims(unsigned nx_, unsigned ny_, unsigned nz_, unsigned num_blocks) {
 	nx = nx_; ny = ny_; nz = nz_;
 	xblocks = 1+(nx-1)/num_blocks; // ceil
 	yblocks = 1+(ny-1)/num_blocks; // ceil
-	unsigned const tot_size(nx * ny * nz);
-	assert(tot_size > 0);
-	clear();
-	resize(tot_size, default_val);
+	assert(nx * ny * nz > 0);
 }
 
-template<typename V> void voxel_grid<V>::init(unsigned nx_, unsigned ny_, unsigned nz_, vector3d const &vsz_,
-	point const &center_, V const &default_val, unsigned num_blocks)
-{
-	init_grid(nx_, ny_, nz_, default_val, num_blocks);
+void voxel_grid_base::set_pos(vector3d const &vsz_, point const &center_) {
 	vsz = vsz_;
 	assert(vsz.x > 0.0 && vsz.y > 0.0 && vsz.z > 0.0);
 	center = center_;
 	lo_pos = center - 0.5*vector3d((nx-1)*vsz.x, (ny-1)*vsz.y, (nz-1)*vsz.z);
 }
 
-template<typename V> void voxel_grid<V>::init(unsigned nx_, unsigned ny_, unsigned nz_, cube_t const &bcube, V const &default_val, unsigned num_blocks) {
-	init_grid(nx_, ny_, nz_, default_val, num_blocks);
+void voxel_grid_base::set_pos(cube_t const &bcube) {
 	assert(!bcube.is_zero_area());
 	vector3d const csz(bcube.get_size());
 	center = bcube.get_cube_center();
@@ -107,6 +103,24 @@ template<typename V> void voxel_grid<V>::init(unsigned nx_, unsigned ny_, unsign
 	vsz    = vector3d(csz.x/(nx-1), csz.y/(ny-1), csz.z/(nz-1));
 }
 
+template<typename V> void voxel_grid<V>::init_grid(unsigned nx_, unsigned ny_, unsigned nz_, V default_val, unsigned num_blocks) {
+	set_dims(nx_, ny_, nz_, num_blocks);
+	clear();
+	resize(nx*ny*nz, default_val);
+}
+
+template<typename V> void voxel_grid<V>::init(unsigned nx_, unsigned ny_, unsigned nz_, vector3d const &vsz_,
+	point const &center_, V const &default_val, unsigned num_blocks)
+{
+	init_grid(nx_, ny_, nz_, default_val, num_blocks);
+	set_pos(vsz_, center_);
+}
+
+template<typename V> void voxel_grid<V>::init(unsigned nx_, unsigned ny_, unsigned nz_, cube_t const &bcube, V const &default_val, unsigned num_blocks) {
+	init_grid(nx_, ny_, nz_, default_val, num_blocks);
+	set_pos(bcube);
+}
+
 
 // Note: assumes mesh is centered around 0,0
 template<> void voxel_grid<float>::init_from_heightmap(float **height, unsigned mesh_nx, unsigned mesh_ny,
@@ -171,7 +185,7 @@ template<> void voxel_grid<float>::downsample_2x() { // modify in place, perserv
 template<> void voxel_grid<cube_t>::downsample_2x() {assert(0);} // not supported
 
 
-template<typename V> void voxel_grid<V>::get_bcube_ix_bounds(cube_t const &bcube, int llc[3], int urc[3]) const {
+void voxel_grid_base::get_bcube_ix_bounds(cube_t const &bcube, int llc[3], int urc[3]) const {
 
 	get_xyz(bcube.get_llc(), llc);
 	get_xyz(bcube.get_urc(), urc);
@@ -199,14 +213,30 @@ template<typename T> bool write_pod(T const &v, FILE *fp, char const *const name
 }
 
 
-template<typename V> bool voxel_grid<V>::read(FILE *fp) {
+bool voxel_grid_base::read_header(FILE *fp, unsigned &sz) {
 
 	assert(fp);
-	unsigned sz(0);
 	if (!read_pod(nx, fp, "voxel nx") || !read_pod(nx, fp, "voxel ny") || !read_pod(nx, fp, "voxel nz")) return 0;
 	if (!read_pod(xblocks, fp, "voxel xblocks") || !read_pod(yblocks, fp, "voxel yblocks")) return 0;
 	if (!read_pod(vsz, fp, "voxel vsz") || !read_pod(center, fp, "voxel center") || !read_pod(lo_pos, fp, "voxel lo_pos")) return 0;
-	if (!read_pod(sz, fp, "voxel_grid size")) return 0;
+	return read_pod(sz, fp, "voxel_grid size");
+}
+
+
+bool voxel_grid_base::write_header(FILE *fp, unsigned sz) const {
+
+	assert(fp);
+	if (!write_pod(nx, fp, "voxel nx") || !write_pod(nx, fp, "voxel ny") || !write_pod(nx, fp, "voxel nz")) return 0;
+	if (!write_pod(xblocks, fp, "voxel xblocks") || !write_pod(yblocks, fp, "voxel yblocks")) return 0;
+	if (!write_pod(vsz, fp, "voxel vsz") || !write_pod(center, fp, "voxel center") || !write_pod(lo_pos, fp, "voxel lo_pos")) return 0;
+	return write_pod(sz, fp, "voxel_grid size");
+}
+
+
+template<typename V> bool voxel_grid<V>::read(FILE *fp) {
+
+	unsigned sz(0);
+	if (!read_header(fp, sz)) return 0;
 	
 	if (empty()) {
 		resize(sz);
@@ -225,12 +255,7 @@ template<typename V> bool voxel_grid<V>::read(FILE *fp) {
 
 template<typename V> bool voxel_grid<V>::write(FILE *fp) const {
 
-	assert(fp);
-	unsigned const sz(size());
-	if (!write_pod(nx, fp, "voxel nx") || !write_pod(nx, fp, "voxel ny") || !write_pod(nx, fp, "voxel nz")) return 0;
-	if (!write_pod(xblocks, fp, "voxel xblocks") || !write_pod(yblocks, fp, "voxel yblocks")) return 0;
-	if (!write_pod(vsz, fp, "voxel vsz") || !write_pod(center, fp, "voxel center") || !write_pod(lo_pos, fp, "voxel lo_pos")) return 0;
-	if (!write_pod(sz, fp, "voxel_grid size")) return 0;
+	if (!write_header(fp, size())) return 0;
 	
 	if (fwrite(&front(), sizeof(V), size(), fp) != size()) {
 		cerr << "Error writing voxel_grid data" << endl;
@@ -240,6 +265,121 @@ template<typename V> bool voxel_grid<V>::write(FILE *fp) const {
 }
 
 
+void sparse_byte_voxel_grid::clear() {
+	nx = ny = nz = nbx = nby = nbz = 0;
+	uniform_vals.clear();
+	brick_data.clear();
+}
+
+void sparse_byte_voxel_grid::init(unsigned nx_, unsigned ny_, unsigned nz_, vector3d const &vsz_, point const &center_, unsigned char default_val, unsigned num_blocks) {
+	set_dims(nx_, ny_, nz_, num_blocks);
+	set_pos(vsz_, center_);
+	nbx = (nx + MASK) >> SHIFT; nby = (ny + MASK) >> SHIFT; nbz = (nz + MASK) >> SHIFT;
+	uniform_vals.clear();
+	uniform_vals.resize(nbx*nby*nbz, default_val);
+	brick_data.clear();
+	brick_data.resize(nbx*nby*nbz);
+}
+
+void sparse_byte_voxel_grid::make_dense(unsigned x1, unsigned y1, unsigned x2, unsigned y2) {
+	if (x1 >= x2 || y1 >= y2) return; // empty range
+	assert(x2 <= nx && y2 <= ny);
+
+	for (unsigned by = (y1 >> SHIFT); by <= ((y2-1) >> SHIFT); ++by) {
+		for (unsigned bx = (x1 >> SHIFT); bx <= ((x2-1) >> SHIFT); ++bx) {
+			for (unsigned bz = 0; bz < nbz; ++bz) {
+				unsigned const bix(bz + (bx + by*nbx)*nbz);
+				if (brick_data[bix].empty()) {brick_data[bix].resize(BRICK_VOXELS, uniform_vals[bix]);}
+			}
+		}
+	}
+}
+
+void sparse_byte_voxel_grid::compact_brick(unsigned bx, unsigned by, unsigned bz) {
+
+	unsigned const bix(bz + (bx + by*nbx)*nbz);
+	vector<unsigned char> &data(brick_data[bix]);
+	if (data.empty()) return; // already uniform
+	// only check voxels inside the grid; voxels past the end of partial bricks at the upper edges are never written
+	unsigned const sz(SIZE), xe(min(sz, nx - (bx << SHIFT))), ye(min(sz, ny - (by << SHIFT))), ze(min(sz, nz - (bz << SHIFT)));
+	unsigned char const val(data[0]);
+
+	for (unsigned y = 0; y < ye; ++y) {
+		for (unsigned x = 0; x < xe; ++x) {
+			unsigned char const *const vals(&data[(x + y*SIZE)*SIZE]);
+			for (unsigned z = 0; z < ze; ++z) {if (vals[z] != val) return;} // not uniform
+		}
+	}
+	uniform_vals[bix] = val;
+	vector<unsigned char>().swap(data); // free the memory
+}
+
+void sparse_byte_voxel_grid::compact(unsigned x1, unsigned y1, unsigned x2, unsigned y2) {
+	if (x1 >= x2 || y1 >= y2) return; // empty range
+	assert(x2 <= nx && y2 <= ny);
+
+	for (unsigned by = (y1 >> SHIFT); by <= ((y2-1) >> SHIFT); ++by) {
+		for (unsigned bx = (x1 >> SHIFT); bx <= ((x2-1) >> SHIFT); ++bx) {
+			for (unsigned bz = 0; bz < nbz; ++bz) {compact_brick(bx, by, bz);}
+		}
+	}
+}
+
+void sparse_byte_voxel_grid::get_dense_data(vector<unsigned char> &data) const { // in voxel_grid order, for texture upload
+	data.resize(size());
+	unsigned ix(0);
+
+	for (unsigned y = 0; y < ny; ++y) {
+		for (unsigned x = 0; x < nx; ++x) {
+			for (unsigned z = 0; z < nz; ++z, ++ix) {data[ix] = get(x, y, z);}
+		}
+	}
+}
+
+// same file format as voxel_grid<unsigned char>
+bool sparse_byte_voxel_grid::read(FILE *fp) {
+
+	unsigned sz(0);
+	if (!read_header(fp, sz)) return 0;
+
+	if (sz != size()) { // must be initialized to the correct size first
+		cerr << "Error reading voxel_grid size: expected " << size() << " but got " << sz << endl;
+		return 0;
+	}
+	vector<unsigned char> column(nz);
+
+	for (unsigned y = 0; y < ny; ++y) {
+		for (unsigned x = 0; x < nx; ++x) {
+			if (fread(&column.front(), sizeof(unsigned char), nz, fp) != nz) {
+				cerr << "Error reading voxel_grid data" << endl;
+				return 0;
+			}
+			for (unsigned z = 0; z < nz; ++z) {set(x, y, z, column[z]);}
+		}
+	}
+	compact();
+	return 1;
+}
+
+bool sparse_byte_voxel_grid::write(FILE *fp) const {
+
+	if (!write_header(fp, size())) return 0;
+	vector<unsigned char> column(nz);
+
+	for (unsigned y = 0; y < ny; ++y) {
+		for (unsigned x = 0; x < nx; ++x) {
+			for (unsigned z = 0; z < nz; ++z) {column[z] = get(x, y, z);}
+
+			if (fwrite(&column.front(), sizeof(unsigned char), nz, fp) != nz) {
+				cerr << "Error writing voxel_grid data" << endl;
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
+
+
 bool voxel_model::from_file(string const &fn) {
 
 	FILE *fp(fopen(fn.c_str(), "rb"));
@@ -248,7 +388,13 @@ bool voxel_model::from_file(string const &fn) {
 		cerr << "Error opening voxel file " << fn << " for read" << endl;
 		return 0;
 	}
-	bool const success(read(fp) && outside.read(fp) && ao_lighting.read(fp)); // should ao_lighting be read or recalculated?
+	bool success(read(fp));
+
+	if (success) { // sparse grids are sized before reading
+		outside    .init(nx, ny, nz, vsz, center, 0,   params.num_blocks);
+		ao_lighting.init(nx, ny, nz, vsz, center, 255, params.num_blocks);
+		success = (outside.read(fp) && ao_lighting.read(fp)); // should ao_lighting be read or recalculated?
+	}
 	fclose(fp);
 	return success;
 }
@@ -504,11 +650,10 @@ unsigned voxel_manager::add_triangles_for_voxel(tri_data_t::value_type &tri_vert
 
 	for (unsigned yhi = 0; yhi < 2; ++yhi) {
 		for (unsigned xhi = 0; xhi < 2; ++xhi) {
-			unsigned const ix(get_ix(xv[xhi], yv[yhi], z));
-			if (all_under_mesh) {all_under_mesh = ((outside[ix] & UNDER_MESH_BIT) != 0);}
+			if (all_under_mesh) {all_under_mesh = ((outside.get(xv[xhi], yv[yhi], z) & UNDER_MESH_BIT) != 0);}
 			
 			for (unsigned zhi = 0; zhi < 2; ++zhi) {
-				if (outside[ix + zv[zhi]-z] & 7) {cix |= 1 << ((xhi^yhi) + 2*yhi + 4*zhi);} // outside or on edge
+				if (outside.get(xv[xhi], yv[yhi], zv[zhi]) & 7) {cix |= 1 << ((xhi^yhi) + 2*yhi + 4*zhi);} // outside or on edge
 			}
 		}
 	}
@@ -536,7 +681,7 @@ unsigned voxel_manager::add_triangles_for_voxel(tri_data_t::value_type &tri_vert
 			unsigned const yhi((eix[d] & 2) >> 1), xhi(yhi ^ (eix[d] & 1)), zhi(eix[d] >> 2);
 			unsigned const ix(get_ix(xv[xhi], yv[yhi], zv[zhi]));
 			xhv &= xhi; yhv &= yhi; zhv &= zhi;
-			vals[d] = ((outside[ix] & 7) == ON_EDGE_BIT) ? params.isolevel : operator[](ix);
+			vals[d] = ((outside.get(xv[xhi], yv[yhi], zv[zhi]) & 7) == ON_EDGE_BIT) ? params.isolevel : operator[](ix);
 			pts[d].assign(cube.d[0][xhi], cube.d[1][yhi], cube.d[2][zhi]);
 		}
 		vlist[i] = interpolate_pt(params.isolevel, pts[0], pts[1], vals[0], vals[1]);
@@ -585,16 +730,22 @@ void voxel_manager::determine_voxels_outside() { // determine inside/outside poi
 	assert(vsz.x > 0.0 && vsz.y > 0.0 && vsz.z > 0.0);
 	outside.init(nx, ny, nz, vsz, center, 0, params.num_blocks);
 	bool const sphere_mode(params.atten_sphere_mode());
+	int const brick_sz(outside.get_brick_size()); // each thread writes to its own rows of bricks
 
 #pragma omp parallel for schedule(static)
-	for (int y = 0; y < (int)ny; ++y) {
-		for (unsigned x = 0; x < nx; ++x) {
-			point const pos(get_pt_at(x, y, 0));
-			int const xpos(get_xpos(pos.x)), ypos(get_xpos(pos.y));
-			bool const no_zix(sphere_mode || !use_mesh || point_outside_mesh(xpos, ypos));
-			unsigned const zix(no_zix ? 0 : max(0, int((z_min_matrix[ypos][xpos] - lo_pos.z)/vsz.z)));
-			for (unsigned z = 0; z < nz; ++z) {calc_outside_val(x, y, z, (z < zix));}
+	for (int y1 = 0; y1 < (int)ny; y1 += brick_sz) {
+		unsigned const y2(min(ny, unsigned(y1 + brick_sz)));
+
+		for (unsigned y = y1; y < y2; ++y) {
+			for (unsigned x = 0; x < nx; ++x) {
+				point const pos(get_pt_at(x, y, 0));
+				int const xpos(get_xpos(pos.x)), ypos(get_xpos(pos.y));
+				bool const no_zix(sphere_mode || !use_mesh || point_outside_mesh(xpos, ypos));
+				unsigned const zix(no_zix ? 0 : max(0, int((z_min_matrix[ypos][xpos] - lo_pos.z)/vsz.z)));
+				for (unsigned z = 0; z < nz; ++z) {calc_outside_val(x, y, z, (z < zix));}
+			}
 		}
+		outside.compact(0, y1, nx, y2);
 	}
 }
 
@@ -821,6 +972,7 @@ void voxel_manager::remove_unconnected_outside_range(bool keep_at_edge, unsigned
 			if (had_update && xy_updated) {xy_updated->push_back(y*nx + x);}
 		}
 	}
+	outside.compact(x1, y1, x2, y2);
 }
 
 
@@ -851,6 +1003,7 @@ void voxel_manager::remove_interior_holes() {
 			make_voxel_inside(ix);
 		}
 	}
+	outside.compact();
 }
 
 
@@ -943,10 +1096,10 @@ unsigned voxel_manager::upload_to_3d_texture(int wrap) const { // only works for
 float voxel_model::get_ao_lighting_val(point const &pos) const {
 
 	if (ao_lighting.empty()) return 1.0;
-	unsigned ix(0);
-	if (!ao_lighting.get_ix(pos, ix)) return 1.0; // off the voxel grid
-	assert(ix < ao_lighting.size());
-	return ao_lighting[ix]/255.0;
+	int i[3]; // x,y,z
+	ao_lighting.get_xyz(pos, i);
+	if (!ao_lighting.is_valid_range(i)) return 1.0; // off the voxel grid
+	return ao_lighting.get(i[0], i[1], i[2])/255.0;
 }
 
 
@@ -1000,7 +1153,7 @@ unsigned voxel_model::get_block_ix(unsigned voxel_ix) const {
 }
 
 
-voxel_model::voxel_model(noise_texture_manager_t *ntg, bool use_mesh_, unsigned num_lod_levels) : voxel_manager(use_mesh_), volume_added(0), noise_tex_gen(ntg) {
+voxel_model::voxel_model(noise_texture_manager_t *ntg, bool use_mesh_, unsigned num_lod_levels) : voxel_manager(use_mesh_), volume_added(0), remesh_volume_added(0), noise_tex_gen(ntg) {
 
 	assert(num_lod_levels > 0);
 	tri_data.resize(num_lod_levels);
@@ -1025,9 +1178,10 @@ void voxel_model::clear() {
 	}
 	modified_blocks.clear();
 	next_frame_modified_blocks.clear();
+	remesh_queue.clear();
 	ao_lighting.clear();
 	voxel_manager::clear();
-	volume_added = 0;
+	volume_added = remesh_volume_added = 0;
 }
 
 
@@ -1070,8 +1224,31 @@ bool voxel_model_ground::clear_block(unsigned block_ix) {
 }
 
 
+void voxel_model::calc_remesh_brick_mask(unsigned block_ix, remesh_brick_mask_t &bmask) const {
+
+	unsigned const B(remesh_brick_mask_t::SIZE), S(remesh_brick_mask_t::SHIFT);
+	unsigned const x0((block_ix%params.num_blocks)*xblocks), y0((block_ix/params.num_blocks)*yblocks);
+	// include one extra brick past the end of the block so that cells along the upper block edges can check their neighbor brick
+	unsigned const x_end(min(nx, x0+xblocks+B)), y_end(min(ny, y0+yblocks+B));
+	if (x0 >= x_end || y0 >= y_end) {bmask.init(0, 0, 0); return;} // empty block
+	bmask.init((x_end - x0 + B-1) >> S, (y_end - y0 + B-1) >> S, (nz + B-1) >> S);
+
+	for (unsigned y = y0; y < y_end; ++y) {
+		for (unsigned x = x0; x < x_end; ++x) {
+			unsigned const bx((x - x0) >> S), by((y - y0) >> S);
+
+			for (unsigned bz = 0; bz < bmask.nbz; ++bz) {
+				unsigned char f(0);
+				for (unsigned z = (bz << S); z < min(nz, (bz+1) << S); ++z) {f |= ((outside.get(x, y, z) & 7) ? remesh_brick_mask_t::HAS_OUTSIDE : remesh_brick_mask_t::HAS_INSIDE);} // outside or on edge
+				bmask.get_ref(bx, by, bz) |= f;
+			}
+		}
+	}
+}
+
+
 // returns the number of triangles created
-unsigned voxel_model::create_block(voxel_ix_cache &vix_cache, unsigned block_ix, bool first_create, bool count_only, unsigned lod_level) {
+unsigned voxel_model::create_block(voxel_ix_cache &vix_cache, remesh_brick_mask_t const &bmask, unsigned block_ix, bool first_create, bool count_only, unsigned lod_level) {
 
 	assert(lod_level < tri_data.size());
 	tri_data_t &td(tri_data[lod_level]);
@@ -1080,12 +1257,33 @@ unsigned voxel_model::create_block(voxel_ix_cache &vix_cache, unsigned block_ix,
 	assert(tri_block.empty());
 	vix_cache.init(xblocks+1, yblocks+1, nz, vsz, zero_vector, vert_ix_cache_entry(), 1);
 	unsigned const xbix(block_ix%params.num_blocks), ybix(block_ix/params.num_blocks), step(1 << lod_level);
+	unsigned const x0(xbix*xblocks), y0(ybix*yblocks), B(remesh_brick_mask_t::SIZE);
 	unsigned count(0);
 
-	for (unsigned y = ybix*yblocks; y < (ybix+1)*yblocks; y += step) {
-		for (unsigned x = xbix*xblocks; x < (xbix+1)*xblocks; x += step) {
-			for (unsigned z = 0; z < nz; z += step) {
-				count += add_triangles_for_voxel(tri_block, vix_cache, x, y, z, xbix*xblocks, ybix*yblocks, count_only, lod_level);
+	if (step <= B) { // iterate over bricks, skipping homogeneous ones; brick boundaries are aligned to cell boundaries
+		for (unsigned by = 0; by < bmask.nby && by*B < yblocks; ++by) {
+			for (unsigned bx = 0; bx < bmask.nbx && bx*B < xblocks; ++bx) {
+				for (unsigned bz = 0; bz < bmask.nbz; ++bz) {
+					if (bmask.is_homogeneous(bx, by, bz)) continue; // no triangles
+					unsigned const y_end(y0 + min(yblocks, (by+1)*B)), x_end(x0 + min(xblocks, (bx+1)*B)), z_end(min(nz, (bz+1)*B));
+
+					for (unsigned y = y0 + by*B; y < y_end; y += step) {
+						for (unsigned x = x0 + bx*B; x < x_end; x += step) {
+							for (unsigned z = bz*B; z < z_end; z += step) {
+								count += add_triangles_for_voxel(tri_block, vix_cache, x, y, z, x0, y0, count_only, lod_level);
+							}
+						}
+					}
+				} // for bz
+			} // for bx
+		} // for by
+	}
+	else { // LOD cells are larger than bricks; iterate over all cells
+		for (unsigned y = y0; y < y0+yblocks; y += step) {
+			for (unsigned x = x0; x < x0+xblocks; x += step) {
+				for (unsigned z = 0; z < nz; z += step) {
+					count += add_triangles_for_voxel(tri_block, vix_cache, x, y, z, x0, y0, count_only, lod_level);
+				}
 			}
 		}
 	}
@@ -1110,9 +1308,11 @@ unsigned voxel_model::create_block_all_lods(unsigned block_ix, bool first_create
 	assert(!tri_data.empty());
 	unsigned count(0);
 	voxel_ix_cache vix_cache; // reused across LODs
+	remesh_brick_mask_t bmask; // shared across LODs
+	calc_remesh_brick_mask(block_ix, bmask);
 
 	for (unsigned lod = 0; lod < (count_only ? 1 : tri_data.size()); ++lod) { // in count_only mode we only process the LOD 0
-		unsigned const lod_count(create_block(vix_cache, block_ix, first_create, count_only, lod));
+		unsigned const lod_count(create_block(vix_cache, bmask, block_ix, first_create, count_only, lod));
 		if (lod == 0) {count = lod_count;} // only count LOD 0
 	}
 	return count;
@@ -1182,8 +1382,7 @@ void voxel_model::calc_ao_dirs() {
 				if (x == 0 && y == 0 && z == 0) continue;
 				vector3d const delta(x*vsz.x, y*vsz.y, z*vsz.z);
 				unsigned const nsteps(max(1, int(params.ao_radius/delta.mag())));
-				int const dist(z + (x + y*(int)nx)*(int)nz);
-				ao_dirs.push_back(step_dir_t(x, y, z, nsteps, dist));
+				ao_dirs.push_back(step_dir_t(x, y, z, nsteps));
 			}
 		}
 	}
@@ -1201,6 +1400,7 @@ void voxel_model::calc_ao_lighting_for_block(unsigned block_ix, bool increase_on
 	unsigned const zstep(use_mesh ? max(1U, nz/MESH_SIZE[2]) : 1U);
 	unsigned const x_end(min(nx, (xbix+1)*xblocks)), y_end(min(ny, (ybix+1)*yblocks));
 	unsigned const voxel_sz[3] = {nx, ny, nz};
+	ao_lighting.make_dense(xbix*xblocks, ybix*yblocks, x_end, y_end); // threads may write to the same bricks
 	
 	#pragma omp parallel for schedule(dynamic,1)
 	for (int yi = ybix*yblocks; yi < (int)y_end; yi += ystep) {
@@ -1226,12 +1426,12 @@ void voxel_model::calc_ao_lighting_for_block(unsigned block_ix, bool increase_on
 						unsigned max_steps(i->nsteps);
 						UNROLL_3X(if (i->dir[i_] > 0) cur[i_] += 1;);
 						UNROLL_3X(if (i->dir[i_]) max_steps = min(max_steps, (unsigned)max(0, ((i->dir[i_] < 0) ? (int)cur[i_] : (int)voxel_sz[i_]-(int)cur[i_]-1))););
-						int ix(outside.get_ix(cur[0], cur[1], cur[2]));
 
 						for (unsigned s = 0; s < max_steps; ++s) { // take steps in this direction
-							ix += i->dist_per_step; // increment first to skip the current voxel
+							UNROLL_3X(cur[i_] += i->dir[i_];); // increment first to skip the current voxel
+							unsigned char const ray_outside_val(outside.get(cur[0], cur[1], cur[2]));
 						
-							if (outside[ix] == 0 || (outside[ix] & end_ray_flags)) {
+							if (ray_outside_val == 0 || (ray_outside_val & end_ray_flags)) {
 								cur_val = s*i->nsteps_inv; // Note: ambient obscurance - uses actual distance to occluder
 								break; // voxel known to be inside the volume or under the mesh
 							}
@@ -1253,6 +1453,7 @@ void voxel_model::calc_ao_lighting_for_block(unsigned block_ix, bool increase_on
 			} // for z
 		} // for x
 	} // for y
+	ao_lighting.compact(xbix*xblocks, ybix*yblocks, x_end, y_end);
 }
 
 
@@ -1329,6 +1530,7 @@ bool voxel_model::update_voxel_sphere_region(point const &center, float radius,
 			}
 		}
 	}
+	outside.compact(bounds[0][0], bounds[1][0], bounds[0][1]+1, bounds[1][1]+1);
 	if (!saw_inside || !saw_outside) return 0; // nothing else to do
 	std::copy(blocks_to_update.begin(), blocks_to_update.end(), inserter(modified_blocks, modified_blocks.begin()));
 
@@ -1367,12 +1569,15 @@ unsigned voxel_model::get_texture_at(point const &pos) const {
 }
 
 
+// Note: voxel updates are applied immediately, but the modified blocks are added to remesh_queue and rebuilt in parallel batches until
+// the per-frame time budget is used up, so that large edits such as explosions are spread across several frames; old triangles are kept until then;
+// the budget is shared by all voxel models (terrain and destroyable asteroids), so frame time doesn't grow with the number of models modified
 void voxel_model::proc_pending_updates(bool postproc_brushes_mode) {
 
-	if (modified_blocks.empty()) return;
+	if (modified_blocks.empty() && remesh_queue.empty()) return;
 	//RESET_TIME;
 
-	if (params.remove_unconnected >= 2) {
+	if (!modified_blocks.empty() && params.remove_unconnected >= 2) {
 		if (postproc_brushes_mode) { // iterate until all blocks stop falling
 			std::set<unsigned> orig_modified_blocks(modified_blocks);
 
@@ -1388,9 +1593,39 @@ void voxel_model::proc_pending_updates(bool postproc_brushes_mode) {
 			remove_unconnected_outside_modified_blocks(0);
 		}
 	}
+	remesh_queue.insert(modified_blocks.begin(), modified_blocks.end());
+	remesh_volume_added |= volume_added;
+	modified_blocks = next_frame_modified_blocks;
+	next_frame_modified_blocks.clear();
+	volume_added = 0;
+	typedef std::chrono::steady_clock clock_type;
+	clock_type::time_point const start_time(clock_type::now());
+	float const time_budget_ms(postproc_brushes_mode ? 0.0 : global_voxel_params.remesh_time_ms); // brushes are applied in full
+	unsigned const batch_size(2*max(1, omp_get_max_threads_3dw())); // enough blocks to keep all threads busy with dynamic scheduling
+	vector<unsigned> blocks_to_update;
+	float elapsed_ms(0.0);
+	if (frame_counter != remesh_frame) {remesh_frame = frame_counter; remesh_frame_time_ms = 0.0;} // first model updated this frame
+
+	while (!remesh_queue.empty()) {
+		if (time_budget_ms > 0.0 && (remesh_frame_time_ms + elapsed_ms) >= time_budget_ms) break; // out of time; continue next frame
+		blocks_to_update.clear();
+
+		for (auto i = remesh_queue.begin(); i != remesh_queue.end() && (time_budget_ms <= 0.0 || blocks_to_update.size() < batch_size);) {
+			blocks_to_update.push_back(*i);
+			i = remesh_queue.erase(i);
+		}
+		remesh_blocks(blocks_to_update, !remesh_volume_added); // update can only remove, so lighting can only increase
+		elapsed_ms = std::chrono::duration<float, std::milli>(clock_type::now() - start_time).count();
+	}
+	remesh_frame_time_ms += elapsed_ms;
+	if (remesh_queue.empty()) {remesh_volume_added = 0;}
+}
+
+
+void voxel_model::remesh_blocks(vector<unsigned> const &blocks_to_update, bool increase_only_ao) {
+
 	bool something_removed(0);
-	vector<unsigned> blocks_to_update(modified_blocks.begin(), modified_blocks.end());
-	
+
 	// FIXME: can we only remove/add voxels within the modified region of each block?
 	//        or, create the block first and only remove triangles that don't exist in the new block + add triangles that don't exist in the old block?
 	for (unsigned i = 0; i < blocks_to_update.size(); ++i) {
@@ -1414,14 +1649,11 @@ void voxel_model::proc_pending_updates(bool postproc_brushes_mode) {
 			}
 		}
 		for (unsigned i = 0; i < blocks_to_update.size(); ++i) { // blocks will be sorted by y then x
-			calc_ao_lighting_for_block(blocks_to_update[i], !volume_added); // update can only remove, so lighting can only increase
+			calc_ao_lighting_for_block(blocks_to_update[i], increase_only_ao);
 		}
 		update_blocks_hook(blocks_to_update, tot_num_added);
-		//PRINT_TIME(postproc_brushes_mode ? "  Process Voxel Updates" : "Process Voxel Updates");
+		//PRINT_TIME("Process Voxel Updates");
 	}
-	modified_blocks = next_frame_modified_blocks;
-	next_frame_modified_blocks.clear();
-	volume_added = 0;
 }
 
 
@@ -1673,7 +1905,11 @@ void voxel_model_space::setup_tex_gen_for_rendering(shader_t &s) {
 	voxel_model::setup_tex_gen_for_rendering(s);
 	
 	if (!ao_lighting.empty()) {
-		if (ao_tid == 0) {ao_tid = create_3d_texture(nx, ny, nz, 1, ao_lighting, GL_LINEAR, GL_CLAMP_TO_EDGE);}
+		if (ao_tid == 0) {
+			vector<unsigned char> ao_data;
+			ao_lighting.get_dense_data(ao_data);
+			ao_tid = create_3d_texture(nx, ny, nz, 1, ao_data, GL_LINEAR, GL_CLAMP_TO_EDGE);
+		}
 		set_3d_texture_as_current(ao_tid, 9);
 	}
 	if (shadow_tid == 0) {
@@ -2063,6 +2299,9 @@ bool parse_voxel_option(FILE *fp) {
 	else if (str == "texture_rseed") {
 		if (!read_int(fp, global_voxel_params.texture_rseed)) voxel_file_err("texture_rseed", error);
 	}
+	else if (str == "remesh_time_ms") {
+		if (!read_float(fp, global_voxel_params.remesh_time_ms) || global_voxel_params.remesh_time_ms < 0.0) voxel_file_err("remesh_time_ms", error);
+	}
 	else if (str == "detail_normal_map") {
 		if (!read_bool(fp, global_voxel_params.detail_normal_map)) voxel_file_err("detail_normal_map", error);
 	}
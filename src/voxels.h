@@ -6,6 +6,7 @@
 
 #include "3DWorld.h"
 #include "model3d.h"
+#include <unordered_map>
 
 struct coll_tquad;
 
@@ -18,6 +19,7 @@ struct voxel_params_t {
 	unsigned xsize, ysize, zsize, num_blocks; // num_blocks is in x and y
 	float isolevel, elasticity, mag, freq, atten_thresh, tex_scale, noise_scale, noise_freq, tex_mix_saturate, z_gradient, height_eval_freq, radius_val;
 	float ao_radius, ao_weight_scale, ao_atten_power, spec_mag, spec_exp;
+	float remesh_time_ms; // per-frame time budget for rebuilding modified blocks, shared by all models (from global_voxel_params); 0 = no limit
 	bool make_closed_surface, invert, remove_under_mesh, add_cobjs, normalize_to_1, top_tex_used, detail_normal_map;
 	unsigned remove_unconnected; // 0=never, 1=init only, 2=always, 3=always, including interior holes
 	unsigned atten_at_edges; // 0=no atten, 1=top only, 2=all 5 edges (excludes the bottom), 3=sphere (outer), 4=sphere (inner and outer), 5=sphere (inner and outer, excludes the bottom)
@@ -34,7 +36,7 @@ struct voxel_params_t {
 
 	voxel_params_t() : xsize(0), ysize(0), zsize(0), num_blocks(12), isolevel(0.0), elasticity(0.5), mag(1.0), freq(1.0), atten_thresh(1.0), tex_scale(1.0), noise_scale(0.1),
 		noise_freq(1.0), tex_mix_saturate(5.0), z_gradient(0.0), height_eval_freq(1.0), radius_val(0.5), ao_radius(1.0), ao_weight_scale(2.0), ao_atten_power(1.0),
-		spec_mag(0.0), spec_exp(1.0), make_closed_surface(1), invert(0), remove_under_mesh(0), add_cobjs(1), normalize_to_1(1), top_tex_used(0), detail_normal_map(1),
+		spec_mag(0.0), spec_exp(1.0), remesh_time_ms(8.0), make_closed_surface(1), invert(0), remove_under_mesh(0), add_cobjs(1), normalize_to_1(1), top_tex_used(0), detail_normal_map(1),
 		remove_unconnected(1), atten_at_edges(0), keep_at_scene_edge(0), atten_top_mode(0), enable_falling(1), geom_rseed(123), texture_rseed(321), base_color(WHITE)
 	{
 			tids[0] = tids[1] = tids[2] = 0; colors[0] = colors[1] = WHITE;
@@ -114,29 +116,20 @@ public:
 };
 
 
-// stored internally in yxz order
-template<typename V> class voxel_grid : public vector<V> {
-	void init_grid(unsigned nx_, unsigned ny_, unsigned nz_, V default_val, unsigned num_blocks);
+// grid dimensions and positions shared by dense and sparse voxel grids; stored internally in yxz order
+class voxel_grid_base {
+protected:
+	void set_dims(unsigned nx_, unsigned ny_, unsigned nz_, unsigned num_blocks);
+	void set_pos(vector3d const &vsz_, point const &center_);
+	void set_pos(cube_t const &bcube);
+	bool read_header (FILE *fp, unsigned &sz);
+	bool write_header(FILE *fp, unsigned sz) const;
 public:
 	unsigned nx, ny, nz, xblocks, yblocks;
 	vector3d vsz; // size of a voxel in x,y,z
 	point center, lo_pos;
 
-	using vector<V>::clear;
-	using vector<V>::empty;
-	using vector<V>::size;
-	using vector<V>::at;
-	using vector<V>::operator[];
-	using vector<V>::resize;
-	using vector<V>::begin;
-	using vector<V>::end;
-	using vector<V>::front;
-
-	voxel_grid() : nx(0), ny(0), nz(0), xblocks(0), yblocks(0), vsz(zero_vector) {}
-	void init(unsigned nx_, unsigned ny_, unsigned nz_, vector3d const &vsz_, point const &center_, V const &default_val, unsigned num_blocks=1);
-	void init(unsigned nx_, unsigned ny_, unsigned nz_, cube_t const &bcube, V const &default_val, unsigned num_blocks=1);
-	void init_from_heightmap(float **height, unsigned mesh_nx, unsigned mesh_ny, unsigned zsteps, float mesh_xsize, float mesh_ysize, unsigned num_blocks=1, bool invert=0);
-	void downsample_2x();
+	voxel_grid_base() : nx(0), ny(0), nz(0), xblocks(0), yblocks(0), vsz(zero_vector) {}
 	bool is_valid_range(int i[3]) const {return (i[0] >= 0 && i[1] >= 0 && i[2] >= 0 && i[0] < (int)nx && i[1] < (int)ny && i[2] < (int)nz);}
 	float get_xv(int x) const {return (x*vsz.x + lo_pos.x);}
 	float get_yv(int y) const {return (y*vsz.y + lo_pos.y);}
@@ -158,10 +151,30 @@ public:
 	}
 	void get_bcube_ix_bounds(cube_t const &bcube, int llc[3], int urc[3]) const;
 	point get_pt_at(unsigned x, unsigned y, unsigned z) const  {return (point(x, y, z)*vsz + lo_pos);}
+	cube_t get_raw_bbox() const {return cube_t(lo_pos, center + (center - lo_pos));}
+};
+
+
+template<typename V> class voxel_grid : public voxel_grid_base, public vector<V> {
+	void init_grid(unsigned nx_, unsigned ny_, unsigned nz_, V default_val, unsigned num_blocks);
+public:
+	using vector<V>::clear;
+	using vector<V>::empty;
+	using vector<V>::size;
+	using vector<V>::at;
+	using vector<V>::operator[];
+	using vector<V>::resize;
+	using vector<V>::begin;
+	using vector<V>::end;
+	using vector<V>::front;
+
+	void init(unsigned nx_, unsigned ny_, unsigned nz_, vector3d const &vsz_, point const &center_, V const &default_val, unsigned num_blocks=1);
+	void init(unsigned nx_, unsigned ny_, unsigned nz_, cube_t const &bcube, V const &default_val, unsigned num_blocks=1);
+	void init_from_heightmap(float **height, unsigned mesh_nx, unsigned mesh_ny, unsigned zsteps, float mesh_xsize, float mesh_ysize, unsigned num_blocks=1, bool invert=0);
+	void downsample_2x();
 	V const &get   (unsigned x, unsigned y, unsigned z) const  {return operator[](get_ix(x, y, z));}
 	V &get_ref     (unsigned x, unsigned y, unsigned z)        {return operator[](get_ix(x, y, z));}
 	void set       (unsigned x, unsigned y, unsigned z, V const &val) {operator[](get_ix(x, y, z)) = val;}
-	cube_t get_raw_bbox() const {return cube_t(lo_pos, center + (center - lo_pos));}
 	bool read(FILE *fp);
 	bool write(FILE *fp) const;
 };
@@ -169,12 +182,73 @@ public:
 typedef voxel_grid<float> float_voxel_grid;
 
 
+// per-voxel byte values stored as 8x8x8 bricks, where a brick with the same value for every voxel is stored as only that value;
+// used for flags and lighting that are constant over large regions (all air or all solid); indexed the same as voxel_grid
+class sparse_byte_voxel_grid : public voxel_grid_base {
+	static unsigned const SHIFT = 3, SIZE = (1 << SHIFT), MASK = (SIZE - 1), BRICK_VOXELS = SIZE*SIZE*SIZE;
+	unsigned nbx, nby, nbz; // number of bricks in x,y,z
+	vector<unsigned char> uniform_vals; // value of each brick that has no data
+	vector<vector<unsigned char> > brick_data; // BRICK_VOXELS values per brick in yxz order, or empty if the brick is uniform
+
+	unsigned get_brick_ix(unsigned x, unsigned y, unsigned z) const {return ((z >> SHIFT) + ((x >> SHIFT) + (y >> SHIFT)*nbx)*nbz);}
+	static unsigned get_ix_in_brick(unsigned x, unsigned y, unsigned z) {return ((z & MASK) + ((x & MASK) + (y & MASK)*SIZE)*SIZE);}
+	void get_xyz_from_ix(unsigned ix, unsigned &x, unsigned &y, unsigned &z) const {unsigned const xy(ix/nz); z = ix - xy*nz; y = xy/nx; x = xy - y*nx;}
+	void compact_brick(unsigned bx, unsigned by, unsigned bz);
+
+public:
+	class ref_t { // returned by the non-const operator[] so that writes can expand uniform bricks
+		sparse_byte_voxel_grid &grid;
+		unsigned ix;
+	public:
+		ref_t(sparse_byte_voxel_grid &grid_, unsigned ix_) : grid(grid_), ix(ix_) {}
+		operator unsigned char() const {return grid.get_by_ix(ix);}
+		ref_t &operator= (unsigned char val) {grid.set_by_ix(ix, val); return *this;}
+		ref_t &operator|=(unsigned char val) {return operator=(grid.get_by_ix(ix) | val);}
+		ref_t &operator&=(unsigned char val) {return operator=(grid.get_by_ix(ix) & val);}
+	};
+
+	sparse_byte_voxel_grid() : nbx(0), nby(0), nbz(0) {}
+	bool empty() const {return brick_data.empty();}
+	unsigned size() const {return nx*ny*nz;}
+	void clear();
+	void init(unsigned nx_, unsigned ny_, unsigned nz_, vector3d const &vsz_, point const &center_, unsigned char default_val, unsigned num_blocks=1);
+	static unsigned get_brick_size() {return SIZE;}
+
+	unsigned char get(unsigned x, unsigned y, unsigned z) const {
+		unsigned const bix(get_brick_ix(x, y, z));
+		vector<unsigned char> const &data(brick_data[bix]);
+		return (data.empty() ? uniform_vals[bix] : data[get_ix_in_brick(x, y, z)]);
+	}
+	void set(unsigned x, unsigned y, unsigned z, unsigned char val) { // not thread safe for voxels in the same brick unless make_dense() was called on it
+		unsigned const bix(get_brick_ix(x, y, z));
+		vector<unsigned char> &data(brick_data[bix]);
+
+		if (data.empty()) {
+			if (val == uniform_vals[bix]) return; // no change
+			data.resize(BRICK_VOXELS, uniform_vals[bix]);
+		}
+		data[get_ix_in_brick(x, y, z)] = val;
+	}
+	unsigned char get_by_ix(unsigned ix) const {unsigned x, y, z; get_xyz_from_ix(ix, x, y, z); return get(x, y, z);}
+	void set_by_ix(unsigned ix, unsigned char val) {unsigned x, y, z; get_xyz_from_ix(ix, x, y, z); set(x, y, z, val);}
+	unsigned char operator[](unsigned ix) const {return get_by_ix(ix);}
+	ref_t operator[](unsigned ix) {return ref_t(*this, ix);}
+	// x/y ranges cover all z values; bricks are expanded before writes from multiple threads, and compacted back to uniform values afterward
+	void make_dense(unsigned x1, unsigned y1, unsigned x2, unsigned y2);
+	void compact(unsigned x1, unsigned y1, unsigned x2, unsigned y2);
+	void compact() {compact(0, 0, nx, ny);}
+	void get_dense_data(vector<unsigned char> &data) const;
+	bool read(FILE *fp);
+	bool write(FILE *fp) const;
+};
+
+
 class voxel_manager : public float_voxel_grid {
 
 protected:
 	bool use_mesh;
 	voxel_params_t params;
-	voxel_grid<unsigned char> outside;
+	sparse_byte_voxel_grid outside;
 	vector<unsigned> temp_work; // used in remove_unconnected_outside_range()/flood_fill()
 	typedef vert_norm vertex_type_t;
 	typedef vntc_vect_block_t<vertex_type_t> tri_data_t;
@@ -245,17 +319,18 @@ public:
 class voxel_model : public voxel_manager {
 
 protected:
-	bool volume_added;
+	bool volume_added, remesh_volume_added;
 	vector<tri_data_t> tri_data; // one per LOD level
 	noise_texture_manager_t *noise_tex_gen;
 	std::set<unsigned> modified_blocks, next_frame_modified_blocks;
-	voxel_grid<unsigned char> ao_lighting;
+	std::set<unsigned> remesh_queue; // blocks whose voxels have been updated but whose triangles haven't been rebuilt yet; sorted by y then x
+	sparse_byte_voxel_grid ao_lighting;
 
 	struct step_dir_t {
 		unsigned nsteps;
 		float nsteps_inv;
-		int dir[3], dist_per_step;
-		step_dir_t(int x, int y, int z, unsigned n, int d) : nsteps(n), nsteps_inv(1.0/nsteps), dist_per_step(d) {dir[0] = x; dir[1] = y; dir[2] = z;}
+		int dir[3];
+		step_dir_t(int x, int y, int z, unsigned n) : nsteps(n), nsteps_inv(1.0/nsteps) {dir[0] = x; dir[1] = y; dir[2] = z;}
 	};
 	vector<step_dir_t> ao_dirs;
 	vector<vector<pt_ix_t> > pt_to_ix;
@@ -272,9 +347,28 @@ protected:
 		void finalize();
 	};
 
-	typedef map<point, merge_vn_t> vert_norm_map_t;
+	typedef unordered_map<point, merge_vn_t, hash_by_words<point> > vert_norm_map_t;
 	vector<vert_norm_map_t> boundary_vnmap;
 
+	// remeshing acceleration: a block is split into 8x8x8 bricks, and bricks where every voxel is on the same side of the isosurface
+	// (including the voxels shared with the next brick) can't produce triangles and are skipped by create_block()
+	struct remesh_brick_mask_t {
+		static unsigned const SHIFT = 3, SIZE = (1 << SHIFT);
+		enum {HAS_INSIDE=1, HAS_OUTSIDE=2, MIXED=3}; // bit flags; 0 = no voxels in this brick
+		unsigned nbx, nby, nbz;
+		vector<unsigned char> flags;
+
+		remesh_brick_mask_t() : nbx(0), nby(0), nbz(0) {}
+		void init(unsigned nbx_, unsigned nby_, unsigned nbz_) {nbx = nbx_; nby = nby_; nbz = nbz_; flags.clear(); flags.resize(nbx*nby*nbz, 0);}
+		unsigned char &get_ref(unsigned bx, unsigned by, unsigned bz) {return flags[bz + (bx + by*nbx)*nbz];}
+		unsigned char get(unsigned bx, unsigned by, unsigned bz) const {return ((bx < nbx && by < nby && bz < nbz) ? flags[bz + (bx + by*nbx)*nbz] : 0);}
+		bool is_homogeneous(unsigned bx, unsigned by, unsigned bz) const { // includes the +x/+y/+z neighbors, which contain the upper cell corners
+			unsigned char f(0);
+			for (unsigned n = 0; n < 8; ++n) {f |= get(bx+(n&1), by+((n>>1)&1), bz+(n>>2));}
+			return (f != MIXED);
+		}
+	};
+
 	struct comp_by_dist {
 		point const p;
 		comp_by_dist(point const &p_) : p(p_) {}
@@ -284,8 +378,10 @@ protected:
 	void remove_unconnected_outside_modified_blocks(bool postproc_brushes_mode);
 	unsigned get_block_ix(unsigned voxel_ix) const;
 	virtual bool clear_block(unsigned block_ix);
-	unsigned create_block(voxel_ix_cache &vix_cache, unsigned block_ix, bool first_create, bool count_only, unsigned lod_level);
+	void calc_remesh_brick_mask(unsigned block_ix, remesh_brick_mask_t &bmask) const;
+	unsigned create_block(voxel_ix_cache &vix_cache, remesh_brick_mask_t const &bmask, unsigned block_ix, bool first_create, bool count_only, unsigned lod_level);
 	unsigned create_block_all_lods(unsigned block_ix, bool first_create, bool count_only);
+	void remesh_blocks(vector<unsigned> const &blocks_to_update, bool increase_only_ao);
 	void update_boundary_normals_for_block(unsigned block_ix, bool calc_average);
 	void finalize_boundary_vmap();
 	void calc_ao_dirs();
@@ -319,7 +415,7 @@ public:
 	bool has_filled_at_edges() const;
 	bool from_file(string const &fn);
 	bool to_file(string const &fn) const;
-	bool has_modified_blocks() const {return !modified_blocks.empty();}
+	bool has_modified_blocks() const {return (!modified_blocks.empty() || !remesh_queue.empty());}
 };
 
 